@@ -6,7 +6,14 @@
 
 EN_AUD_AEC_ERR _AUD_AEC_Init(void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
 EN_AUD_AEC_ERR _AUD_AEC_Uninit(void);
-void _AUD_AEC_Run(short *ps16MicBuf, short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
+void _AUD_AEC_Run(const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
 EN_AUD_AEC_ERR _AUD_AEC_SetParam(EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
+void _AUD_AEC_GetBufSize(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn);
+AUD_AEC_HANDLE _AUD_AEC_Create(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
+AUD_AEC_HANDLE _AUD_AEC_CreateEx(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
+void _AUD_AEC_RunEx(AUD_AEC_HANDLE hAec, const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
+EN_AUD_AEC_ERR _AUD_AEC_SetParamEx(AUD_AEC_HANDLE hAec, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
+void _AUD_AEC_Destroy(AUD_AEC_HANDLE hAec);
+AUD_AEC_HANDLE _AUD_AEC_Clone(AUD_AEC_HANDLE hTemplate, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
 
 #endif
@@ -1,6 +1,8 @@
 #ifndef _AUD_AEC_API_H_
 #define _AUD_AEC_API_H_
 
+#include "aud_pool_api.h"
+
 #define AEC_QCONST16(x,bits) ((short)(.5+(x)*(((int)1)<<(bits))))
 
 
@@ -13,6 +15,8 @@ typedef struct _ST_AUD_AEC_INFO
     int u32SamplingRate;    //Sampling rate of processed signal.
     int u32SpkrMixIn;       //Boolean param for mixing stereo speaker to mono or not before AEC. if enable , u32SpkrDualMono must be 0.
     int u32SpkrDualMono;    //Boolean param for dual mono speaker or not. 
+    int u32MaxDelay;        //Longest playback latency in samples the speaker is aligned over before AEC, 0 for none. u32FilterLen then only has to cover the room.
+    int u32ShareTables;     //Boolean, the transform tables, windows and filter banks are shared with every instance of the same sizes in the process (heap, reference counted) instead of taking room in the internal buffer.
 } ST_AUD_AEC_INFO, *PST_AUD_AEC_INFO;
 
 typedef struct _ST_AUD_AEC_RTN
@@ -21,15 +25,21 @@ typedef struct _ST_AUD_AEC_RTN
     int u32EchoBufSize;             //Return Input buffer size
     int u32OutBufSize;              //Return Output buffer size
     int u32InternalBufSize;         //Return AEC internal buffer size
+    int u32EchoStateBufSize;        //Return part of the internal buffer used by the echo canceller state(s)
+    int u32PreProcStateBufSize;     //Return part of the internal buffer used by the preprocess states of all mics
+    int u32StateBufSize;            //Return internal buffer size when the scratch is passed separately to AUD_AEC_CreateEx
+    int u32ScratchBufSize;          //Return per-frame scratch size, one scratch buffer serves every instance run on the same thread
 } ST_AUD_AEC_RTN, *PST_AUD_AEC_RTN;
 
 typedef struct _ST_AUD_AEC_PRELOAD
 {
     int u32PreloadEnable;           //Enable/Disable preload funtion (set by user)
-    int u32ForegroundSize;          //Return foreground filter size          
-    short *ps16Foreground;          //Return foreground filter coef
-    int u32BackgroundSize;          //Return background filter size
-    int *ps32Background;            //Return background filter coef
+    int u32ForegroundSize;          //Unused, superseded by pState
+    short *ps16Foreground;          //Unused, superseded by pState
+    int u32BackgroundSize;          //Unused, superseded by pState
+    int *ps32Background;            //Unused, superseded by pState
+    void *pState;                   //Snapshot of AUD_AEC_SaveState restored by AUD_AEC_Init/AUD_AEC_Create/AUD_AEC_CreateEx when u32PreloadEnable is set
+    int u32StateSize;               //Size of pState in bytes
 } ST_AUD_AEC_PRELOAD, *PST_AUD_AEC_PRELOAD;
 
 
@@ -41,15 +51,20 @@ typedef enum _EN_AUD_AEC_PARAMS
     EN_AUD_AEC_AMP_RATE,                //Enlarge mic/speaker signal.   (default=1)
     EN_AUD_AEC_PREEMPH,                 //Parameter for high pass filter. The bigger of this param, the higher gain of high frequency band. (default=0.9)
     EN_AUD_AEC_LEAK_ESTIMATE,           //Means the proportion of leaked echo. Note that the setting works only when leak estimate is enabled. (default=0.25)
+    EN_AUD_AEC_SPARSE_UPDATE,           //1: partitions holding little echo adapt every few frames, the update cost follows the echo path (default=0)
     EN_AUD_AEC_ECHO_END,                
 
     /*Noise Suppression*/
-    EN_AUD_AEC_BANK_SCALE,              //Band scale method, 1: linear scale  0: bark scale (default=1 (linear))
+    EN_AUD_AEC_BANK_SCALE,              //Gain resolution of the noise/echo suppression, 1: linear scale  0: bark scale, 10-20% cheaper (default=1 (linear))
     EN_AUD_AEC_NOISE_SUPPRESS,          //Noise suppression level (defualt=-15)
     EN_AUD_AEC_DENOISE,                 //Denoise enable
     EN_AUD_AEC_ECHO_SUPPRESS,           //Echo suppression level (defualt=-40)
     EN_AUD_AEC_ECHO_SUPPRESS_ACTIVE,    //Echo suppression level (defualt=-15)
     EN_AUD_AEC_NLP_ENABLE,              //NLP enable (defualt=1)
+    EN_AUD_AEC_FUSED_RESIDUAL,          //1: residual echo from the AEC's own echo spectrum, one FFT less per mic per frame, suppression differs slightly (default=0)
+
+    /*Threading*/
+    EN_AUD_AEC_THREAD_POOL,             //PST_AUD_POOL the microphones of a frame are spread over, NULL to run them on the caller's thread (default=NULL)
     EN_AUD_AEC_PARAMS_TOTAL
 } EN_AUD_AEC_PARAMS;
 
@@ -58,15 +73,41 @@ typedef enum _EN_AUD_AEC_ERR
     EN_AUD_AEC_ENOERR,      //No error.
     EN_AUD_AEC_EINITFAIL,   //AUD_AEC_Init fail.
     EN_AUD_AEC_EINVALCMD,   //AUD_AEC_SetParam fail due to invalid command.
+    EN_AUD_AEC_ESTATE,      //AUD_AEC_SaveState/AUD_AEC_LoadState fail, buffer too small or snapshot of another configuration.
     EN_AUD_AEC_ERR_TOTAL
 } EN_AUD_AEC_ERR;
 
+typedef void *AUD_AEC_HANDLE;           //Opaque AEC instance, returned by AUD_AEC_Create
+
 
 void AUD_AEC_PreInit(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn);
 int AUD_AEC_Init(void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
-void AUD_AEC_Run(short *ps16MicBuf, short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
+/*AUD_AEC_Run/AUD_AEC_RunEx only read the mic and speaker buffers and write ps16OutBuf directly.
+  ps16OutBuf may be ps16MicBuf itself, it must not overlap ps16SpeakerBuf or be offset into ps16MicBuf.*/
+void AUD_AEC_Run(const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
 int AUD_AEC_SetParam(EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
 int AUD_AEC_GetVersion(void);
 int AUD_AEC_Uninit(void);
 
+/*Multi-instance interface, every handle owns its own state inside the caller's internal buffer*/
+void AUD_AEC_GetBufSize(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn);
+AUD_AEC_HANDLE AUD_AEC_Create(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
+/*Same as AUD_AEC_Create with the per-frame scratch taken from pScratchBuf (u32ScratchBufSize of the largest instance).
+  Instances sharing one scratch buffer must never run concurrently.*/
+AUD_AEC_HANDLE AUD_AEC_CreateEx(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
+void AUD_AEC_RunEx(AUD_AEC_HANDLE hAec, const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
+int AUD_AEC_SetParamEx(AUD_AEC_HANDLE hAec, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
+void AUD_AEC_Destroy(AUD_AEC_HANDLE hAec);      //Internal buffer is owned by the caller and is not freed
+/*Fast session start: a new instance of the template's ST_AUD_AEC_INFO, buffers sized as for AUD_AEC_CreateEx, whose
+  transform tables, windows and filter banks are copied from hTemplate instead of computed. It starts unconverged with
+  the parameters set on hTemplate, EN_AUD_AEC_THREAD_POOL excepted. hTemplate may be running on another thread.*/
+AUD_AEC_HANDLE AUD_AEC_Clone(AUD_AEC_HANDLE hTemplate, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
+
+/*Warm start: a snapshot of everything the AEC and noise suppression have learnt (filters, power, leak and noise estimates),
+  so an instance of the same ST_AUD_AEC_INFO and build cancels from its first frame instead of converging again.
+  hAec NULL stands for the AUD_AEC_Init instance. Not to be called while the instance runs.*/
+int AUD_AEC_GetStateSize(AUD_AEC_HANDLE hAec);
+int AUD_AEC_SaveState(AUD_AEC_HANDLE hAec, void *pBuf, int u32BufSize);
+int AUD_AEC_LoadState(AUD_AEC_HANDLE hAec, const void *pBuf, int u32BufSize);
+
 #endif //#ifndef _AUD_AEC_API_H_
@@ -1,16 +1,22 @@
 #ifndef _AUD_AGC_API_H_
 #define _AUD_AGC_API_H_
 
+#include "aud_pool_api.h"
+
 typedef struct _ST_AUD_AGC_INFO {
     int s32FrameSize;     // Number of samples in a frame
     int s32ChannelNum;    // Number of channels
     int s32SamplingRate;  // Sampling rate of processed signal.
+    int s32ShareTables;   // Boolean, the transform tables, windows and filter banks are shared with AEC instances of the same sizes (heap, reference counted) instead of taking room in the internal buffer.
 } ST_AUD_AGC_INFO, *PST_AUD_AGC_INFO;
 
 typedef struct _ST_AUD_AGC_RTN {
     int u32InBufSize;        // Return Input buffer size
     int u32OutBufSize;       // Return Output buffer size
-    int u32InternalBufSize;  // Return NS internal buffer size
+    int u32InternalBufSize;  // Return AGC internal buffer size
+    int u32PreProcStateBufSize;  // Return part of the internal buffer used by one channel's preprocess state
+    int u32StateBufSize;         // Return internal buffer size when the scratch is passed separately to AUD_AGC_InitEx
+    int u32ScratchBufSize;       // Return per-frame scratch size, may be shared with other modules run on the same thread
 } ST_AUD_AGC_RTN, *PST_AUD_AGC_RTN;
 
 typedef enum _EN_AUD_AGC_PARAMS {
@@ -21,6 +27,8 @@ typedef enum _EN_AUD_AGC_PARAMS {
     EN_AUD_AGC_AGC_MAX_GAIN,    //maximal gain in dB (int32), default: 30
     EN_AUD_AGC_NOISE_SUPPRESS,  //Noise suppression level (defualt=-15)
     EN_AUD_AGC_DENOISE,         //denoiser state
+    EN_AUD_AGC_INTERLEAVED,     //Channels of a frame interleaved sample by sample (1) or one frame after the other (0) (default=0)
+    EN_AUD_AGC_THREAD_POOL,     //PST_AUD_POOL the channels of a frame are spread over, NULL to run them on the caller's thread (default=NULL)
     EN_AUD_AGC_PARAMS_TOTAL
 } EN_AUD_AGC_PARAMS;
 
@@ -33,6 +41,7 @@ typedef enum _EN_AUD_AGC_ERR {
 
 void AUD_AGC_PreInit(PST_AUD_AGC_INFO pstNsInfo, PST_AUD_AGC_RTN pstNsRtn);
 int AUD_AGC_Init(void *pInternalBuf, int u32BufSize);
+int AUD_AGC_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
 void AUD_AGC_Run(short *ps16InBuf, short *ps16OutBuf);
 int AUD_AGC_SetParam(EN_AUD_AGC_PARAMS enParamsCMD, void *pParamsValue);
 int AUD_AGC_Uninit(void);
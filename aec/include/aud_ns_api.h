@@ -1,23 +1,32 @@
 #ifndef _AUD_NS_API_H_
 #define _AUD_NS_API_H_
 
+#include "aud_pool_api.h"
+
 #define NS_QCONST16(x, bits) ((short)(.5 + (x) * (((int)1) << (bits))))
 
 typedef struct _ST_AUD_NS_INFO {
     int s32FrameSize;     // Number of samples in a frame
     int s32ChannelNum;    // Number of channels
     int s32SamplingRate;  // Sampling rate of processed signal.
+    int s32ShareTables;   // Boolean, the transform tables, windows and filter banks are shared with AEC instances of the same sizes (heap, reference counted) instead of taking room in the internal buffer.
 } ST_AUD_NS_INFO, *PST_AUD_NS_INFO;
 
 typedef struct _ST_AUD_NS_RTN {
     int u32InBufSize;        // Return Input buffer size
     int u32OutBufSize;       // Return Output buffer size
     int u32InternalBufSize;  // Return NS internal buffer size
+    int u32PreProcStateBufSize;  // Return part of the internal buffer used by one channel's preprocess state
+    int u32StateBufSize;         // Return internal buffer size when the scratch is passed separately to AUD_NS_InitEx
+    int u32ScratchBufSize;       // Return per-frame scratch size, may be shared with other modules run on the same thread
 } ST_AUD_NS_RTN, *PST_AUD_NS_RTN;
 
 typedef enum _EN_AUD_NS_PARAMS {
     EN_AUD_NS_NOISE_SUPPRESS,  // Noise suppression level (defualt=-15)
     EN_AUD_NS_DENOISE,         // denoiser state
+    EN_AUD_NS_BANK_SCALE,      // Gain resolution, 1: linear scale  0: bark scale, 10-20% cheaper, for channels where quality matters less (default=1 (linear))
+    EN_AUD_NS_INTERLEAVED,     // Channels of a frame interleaved sample by sample (1) or one frame after the other (0) (default=0)
+    EN_AUD_NS_THREAD_POOL,     // PST_AUD_POOL the channels of a frame are spread over, NULL to run them on the caller's thread (default=NULL)
     EN_AUD_NS_PARAMS_TOTAL
 } EN_AUD_NS_PARAMS;
 
@@ -30,8 +39,10 @@ typedef enum _EN_AUD_NS_ERR {
 
 void AUD_NS_PreInit(PST_AUD_NS_INFO pstNsInfo, PST_AUD_NS_RTN pstNsRtn);
 int AUD_NS_Init(void *pInternalBuf, int u32BufSize);
+int AUD_NS_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
 int AUD_NS_Uninit(void);
 void AUD_NS_Run(short *ps16InBuf, short *ps16OutBuf);
+void AUD_NS_RunVad(short *ps16InBuf, int *ps32Vad);  // Voice activity of each channel (1: speech, 0: noise) without the denoised output, about half the cost of AUD_NS_Run; may be mixed with AUD_NS_Run frame by frame
 int AUD_NS_SetParam(EN_AUD_NS_PARAMS enParamsCMD, void *pParamsValue);
 // int AUD_NS_GetVersion(void);
 
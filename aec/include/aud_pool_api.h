@@ -0,0 +1,21 @@
+#ifndef _AUD_POOL_API_H_
+#define _AUD_POOL_API_H_
+
+typedef void (*AUD_POOL_TASK)(void *pArg, int s32Index);
+
+/*Thread pool the modules fan their per-channel work out to.
+  pfRun(pCtx, pfTask, pArg, s32Count) runs pfTask(pArg, i) for every i in 0..s32Count-1, in any order and on any
+  thread, and returns only once all of them are done. The calling thread may run some of the tasks itself.
+  Callers can fill in their own pool or take the built-in one from AUD_Pool_Create.*/
+typedef struct _ST_AUD_POOL {
+    void (*pfRun)(void *pCtx, AUD_POOL_TASK pfTask, void *pArg, int s32Count);
+    void *pCtx;
+} ST_AUD_POOL, *PST_AUD_POOL;
+
+/*Built-in pool of s32NumThreads workers on top of the calling thread, NULL on failure.
+  One pool serves any number of instances and threads: pfRun runs one job at a time, a call made while another
+  job is running waits for it to finish first. pfRun must not be called from inside a task of the same pool.*/
+PST_AUD_POOL AUD_Pool_Create(int s32NumThreads);
+void AUD_Pool_Destroy(PST_AUD_POOL pstPool);
+
+#endif  //#ifndef _AUD_POOL_API_H_
@@ -5,8 +5,10 @@
 #include "comdef_nvt.h" 
 
 EN_AUD_NS_ERR _AUD_NS_Init(void *pInternalBuf, int u32BufSize);
+EN_AUD_NS_ERR _AUD_NS_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
 EN_AUD_NS_ERR _AUD_NS_Uninit(void);
 void _AUD_NS_Run(short *ps16InBuf, short *ps16OutBuf);
+void _AUD_NS_RunVad(short *ps16InBuf, int *ps32Vad);
 EN_AUD_NS_ERR _AUD_NS_SetParam(EN_AUD_NS_PARAMS enParamsCMD, void *pParamsValue);
 
 #endif
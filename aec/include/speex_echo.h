@@ -60,6 +60,46 @@ extern "C" {
 /** Get impulse response (int32[]) */
 #define SPEEX_ECHO_GET_IMPULSE_RESPONSE 29
 
+/** Run the per-microphone work of a multi-microphone state on a thread pool (ST_AUD_POOL *, NULL to run it inline) */
+#define SPEEX_ECHO_SET_THREAD_POOL 40
+
+/** Set the mean far-end power per sample (int32, after pre-emphasis) below which a frame counts as silent (default 10).
+ * Once the far end has been silent for the whole tail the filters are bypassed and held until it comes back.
+ * 0 never bypasses. */
+#define SPEEX_ECHO_SET_FAR_END_SILENCE 42
+/** Get the far-end silence level (int32) */
+#define SPEEX_ECHO_GET_FAR_END_SILENCE 43
+
+/** Set sparse updates (int32, 0 or 1, default 0). The partitions whose weights are well below those of the strongest
+ * one only adapt every few frames, in turn and with a larger step, and are filtered with the weights they have. The cost of the update then
+ * follows how much of the tail actually holds echo. */
+#define SPEEX_ECHO_SET_SPARSE_UPDATE 44
+/** Get whether sparse updates are on (int32) */
+#define SPEEX_ECHO_GET_SPARSE_UPDATE 45
+
+/** Set the frames of silence the playback ring of speex_echo_playback/speex_echo_capture starts with (int32, 0 to 14,
+ * default 2). The far end is then kept that many frames ahead of the microphone. Empties the ring, so neither
+ * side may be running. */
+#define SPEEX_ECHO_SET_PLAYBACK_DELAY 46
+/** Get the playback pre-buffer depth in frames (int32) */
+#define SPEEX_ECHO_GET_PLAYBACK_DELAY 47
+
+/* Can't set playback statistics */
+/** Get the statistics of the playback ring (SpeexEchoPlaybackStats), from the capture thread. Starts a new
+ * fill_min/fill_max window. */
+#define SPEEX_ECHO_GET_PLAYBACK_STATS 49
+
+/** Statistics of the ring between speex_echo_playback and speex_echo_capture */
+typedef struct SpeexEchoPlaybackStats_ {
+    spx_int32_t fill;      /**< Far-end frames queued right now */
+    spx_int32_t fill_min;  /**< Fewest frames a capture found since the statistics were last read */
+    spx_int32_t fill_max;  /**< Most frames a capture found since the statistics were last read */
+    spx_int32_t underruns; /**< Captures that found no far end and let the microphone through */
+    spx_int32_t overruns;  /**< Playback frames dropped because the ring was full */
+    spx_int32_t refills;   /**< Playback frames queued twice because the ring ran low */
+    spx_int32_t drift;     /**< Playback frames offered less captures, in ppm of the captures: > 0 for a faster playback clock */
+} SpeexEchoPlaybackStats;
+
 /** Internal echo canceller state. Should never be accessed directly. */
 struct SpeexEchoState_;
 
@@ -70,21 +110,35 @@ struct SpeexEchoState_;
 /** Internal echo canceller state. Should never be accessed directly. */
 typedef struct SpeexEchoState_ SpeexEchoState;
 
+/** Memory arena the states are carved from (see aud_mem.h) */
+struct _ST_AUD_MEM_ARENA;
+
 /** Creates a new echo canceller state
  * @param frame_size Number of samples to process at one time (should correspond to 10-20 ms)
  * @param filter_length Number of samples of echo to cancel (should generally correspond to 100-500 ms)
+ * @param arena Memory arena for the state, NULL for the system heap
  * @return Newly-created echo canceller state
  */
-SpeexEchoState *speex_echo_state_init(int frame_size, int filter_length);
+SpeexEchoState *speex_echo_state_init(int frame_size, int filter_length, struct _ST_AUD_MEM_ARENA *arena);
 
 /** Creates a new multi-channel echo canceller state
  * @param frame_size Number of samples to process at one time (should correspond to 10-20 ms)
  * @param filter_length Number of samples of echo to cancel (should generally correspond to 100-500 ms)
  * @param nb_mic Number of microphone channels
  * @param nb_speakers Number of speaker channels
+ * @param arena Memory arena for the state, NULL for the system heap
+ * @return Newly-created echo canceller state
+ */
+SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_length, int nb_mic, int nb_speakers, struct _ST_AUD_MEM_ARENA *arena);
+
+/** Creates an echo canceller of the same shape and settings as proto, starting from scratch like a new state but
+ * with the transform tables, window and residual gain copied from proto instead of computed. Takes the same
+ * arena space as the init call that made proto. The thread pool of proto is not carried over.
+ * @param proto Echo canceller state to copy, it may be running meanwhile
+ * @param arena Memory arena for the state, NULL for the system heap
  * @return Newly-created echo canceller state
  */
-SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_length, int nb_mic, int nb_speakers);
+SpeexEchoState *speex_echo_state_clone(const SpeexEchoState *proto, struct _ST_AUD_MEM_ARENA *arena);
 
 /** Destroys an echo canceller state
  * @param st Echo canceller state
@@ -101,11 +155,28 @@ void speex_echo_state_destroy(SpeexEchoState *st);
  */
 void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *rec, const spx_int16_t *play, spx_int16_t *out);
 
+/** Same as speex_echo_cancellation with the channels picked out of wider interleaved buffers: sample i of
+ * microphone c is rec[i*rec_stride + c], of speaker c play[i*play_stride + c] and of output c out[i*out_stride + c].
+ * speex_echo_cancellation is the case rec_stride = out_stride = nb_mic, play_stride = nb_speakers.
+ * The buffers are read and written in place. out may be rec itself with the same stride, otherwise they must not overlap.
+ *
+ * @param st Echo canceller state
+ * @param rec Signal from the microphone (near end + far end echo)
+ * @param rec_stride Distance between two samples of the same microphone
+ * @param play Signal played to the speaker (received from far end)
+ * @param play_stride Distance between two samples of the same speaker
+ * @param out Returns near-end signal with echo removed
+ * @param out_stride Distance between two samples of the same output
+ */
+void speex_echo_cancellation_strided(SpeexEchoState *st, const spx_int16_t *rec, int rec_stride, const spx_int16_t *play, int play_stride, spx_int16_t *out, int out_stride);
+
 /** Performs echo cancellation a frame (deprecated) */
 void speex_echo_cancel(SpeexEchoState *st, const spx_int16_t *rec, const spx_int16_t *play, spx_int16_t *out, spx_int32_t *Yout);
 
 /** Perform echo cancellation using internal playback buffer, which is delayed by two frames
  * to account for the delay introduced by most soundcards (but it could be off!)
+ * speex_echo_capture and speex_echo_playback may be called from two different threads, one each: they share a
+ * lock-free ring and never wait for each other (see SPEEX_ECHO_SET_PLAYBACK_DELAY, SPEEX_ECHO_GET_PLAYBACK_STATS).
  * @param st Echo canceller state
  * @param rec Signal from the microphone (near end + far end echo)
  * @param out Returns near-end signal with echo removed
@@ -123,6 +194,40 @@ void speex_echo_playback(SpeexEchoState *st, const spx_int16_t *play);
  */
 void speex_echo_state_reset(SpeexEchoState *st);
 
+/** Size of a snapshot of the converged state of st (speex_echo_state_save)
+ * @param st Echo canceller state
+ * @return Bytes speex_echo_state_save writes
+ */
+int speex_echo_state_snapshot_size(SpeexEchoState *st);
+
+/** Saves what the echo canceller has learnt of the echo path: both filters, the far-end power estimates, the leak
+ * estimate and the statistics that pick the foreground filter. Loading it into a fresh state of the same shape
+ * cancels from the first frame instead of converging again, e.g. across a restart of the same device.
+ * @param st Echo canceller state
+ * @param buf Snapshot (out)
+ * @param size Bytes available at buf
+ * @return Bytes written, -1 if buf is too small
+ */
+int speex_echo_state_save(SpeexEchoState *st, void *buf, int size);
+
+/** Checks that a snapshot taken by speex_echo_state_save would load into st, without touching st
+ * @param st Echo canceller state
+ * @param buf Snapshot
+ * @param size Bytes at buf
+ * @return Bytes speex_echo_state_load would read, -1 if the snapshot does not match st
+ */
+int speex_echo_state_snapshot_check(SpeexEchoState *st, const void *buf, int size);
+
+/** Restores a snapshot taken by speex_echo_state_save. The state is reset first, so the signal memories start from
+ * silence, then the snapshot is copied in; the playback ring of speex_echo_playback is left as it is. Only a snapshot of a state built with the same frame size, filter
+ * length, channels and arithmetic (fixed or float) is accepted.
+ * @param st Echo canceller state
+ * @param buf Snapshot
+ * @param size Bytes at buf
+ * @return Bytes read, -1 if the snapshot does not match st
+ */
+int speex_echo_state_load(SpeexEchoState *st, const void *buf, int size);
+
 /** Used like the ioctl function to control the echo canceller parameters
  *
  * @param st Echo canceller state
@@ -132,6 +237,92 @@ void speex_echo_state_reset(SpeexEchoState *st);
  */
 int speex_echo_ctl(SpeexEchoState *st, int request, void *ptr);
 
+/** Get the delay applied to the far end in samples (int32) */
+#define SPEEX_ECHO_DELAY_GET_DELAY 1
+/** Get the current best estimate of the echo path delay in samples (int32), applied once it is stable */
+#define SPEEX_ECHO_DELAY_GET_ESTIMATE 3
+
+/** Internal state of a far-end delay estimator. Should never be accessed directly. */
+struct SpeexEchoDelay_;
+
+/** @class SpeexEchoDelay
+ * Estimates the playback latency between the far end and its echo in the microphone, in whole frames, and
+ * delays the far end by it. The echo canceller then only needs a tail as long as the room response.
+*/
+typedef struct SpeexEchoDelay_ SpeexEchoDelay;
+
+/** Creates a far-end delay estimator
+ * @param frame_size Number of samples per frame, the same as the echo canceller's
+ * @param sampling_rate Sampling rate
+ * @param max_delay Longest delay to look for, in samples
+ * @param nb_speakers Number of speaker channels, interleaved in the far end
+ * @param arena Memory arena for the estimator, NULL for the system heap
+ * @return Newly-created estimator
+ */
+SpeexEchoDelay *speex_echo_delay_init(int frame_size, int sampling_rate, int max_delay, int nb_speakers, struct _ST_AUD_MEM_ARENA *arena);
+
+/** Creates a far-end delay estimator set up as proto, with its transform tables copied, starting from no estimate
+ * @param proto Estimator to copy
+ * @param arena Memory arena for the estimator, NULL for the system heap
+ * @return Newly-created estimator
+ */
+SpeexEchoDelay *speex_echo_delay_clone(const SpeexEchoDelay *proto, struct _ST_AUD_MEM_ARENA *arena);
+
+/** Destroys a far-end delay estimator
+ * @param dl Estimator
+*/
+void speex_echo_delay_destroy(SpeexEchoDelay *dl);
+
+/** Updates the estimate with one frame and returns the far end delayed by it
+ * @param dl Estimator
+ * @param rec Signal from the microphone, sample i is rec[i*rec_stride]
+ * @param rec_stride Distance between two microphone samples
+ * @param play Signal played to the speakers (interleaved)
+ * @return Far end to cancel rec with, valid until the next call
+ */
+const spx_int16_t *speex_echo_delay_align(SpeexEchoDelay *dl, const spx_int16_t *rec, int rec_stride, const spx_int16_t *play);
+
+/** Size of a snapshot of dl (speex_echo_delay_save)
+ * @param dl Estimator
+ * @return Bytes speex_echo_delay_save writes
+ */
+int speex_echo_delay_snapshot_size(SpeexEchoDelay *dl);
+
+/** Saves the delay estimate: the delay in use, the best candidate and how long it has been the best, the distance of
+ * every candidate and the band means of the binary spectra
+ * @param dl Estimator
+ * @param buf Snapshot (out)
+ * @param size Bytes available at buf
+ * @return Bytes written, -1 if buf is too small
+ */
+int speex_echo_delay_save(SpeexEchoDelay *dl, void *buf, int size);
+
+/** Checks that a snapshot taken by speex_echo_delay_save would load into dl, without touching dl
+ * @param dl Estimator
+ * @param buf Snapshot
+ * @param size Bytes at buf
+ * @return Bytes speex_echo_delay_load would read, -1 if the snapshot does not match dl
+ */
+int speex_echo_delay_snapshot_check(SpeexEchoDelay *dl, const void *buf, int size);
+
+/** Restores a snapshot taken by speex_echo_delay_save from an estimator of the same frame size, sampling rate,
+ * maximum delay, speakers and arithmetic. The far-end history starts from silence, so the delayed far end is silent
+ * until the ring has refilled up to the restored delay.
+ * @param dl Estimator
+ * @param buf Snapshot
+ * @param size Bytes at buf
+ * @return Bytes read, -1 if the snapshot does not match dl
+ */
+int speex_echo_delay_load(SpeexEchoDelay *dl, const void *buf, int size);
+
+/** Used like the ioctl function to query the estimator
+ * @param dl Estimator
+ * @param request ioctl-type request (one of the SPEEX_ECHO_DELAY_* macros)
+ * @param ptr Data exchanged to-from function
+ * @return 0 if no error, -1 if request in unknown
+ */
+int speex_echo_delay_ctl(SpeexEchoDelay *dl, int request, void *ptr);
+
 
 
 struct SpeexDecorrState_;
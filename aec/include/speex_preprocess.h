@@ -55,20 +55,68 @@ struct SpeexPreprocessState_;
 /** State of the preprocessor (one per channel). Should never be accessed directly. */
 typedef struct SpeexPreprocessState_ SpeexPreprocessState;
 
+/** Memory arena the states are carved from (see aud_mem.h) */
+struct _ST_AUD_MEM_ARENA;
+
+/** Thread pool the channels of speex_preprocess_run_mc are spread over (see aud_pool_api.h) */
+struct _ST_AUD_POOL;
+
 
 /** Creates a new preprocessing state. You MUST create one state per channel processed.
  * @param frame_size Number of samples to process at one time (should correspond to 10-20 ms). Must be
  * the same value as that used for the echo canceller for residual echo cancellation to work.
  * @param sampling_rate Sampling rate used for the input.
+ * @param arena Memory arena for the state, NULL for the system heap
  * @return Newly created preprocessor state
 */
-SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sampling_rate);
+SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sampling_rate, struct _ST_AUD_MEM_ARENA *arena);
+
+/** Creates a preprocessing state with the frame size, sampling rate and settings of proto, starting from no
+ * estimate like a new state. The filter bank, windows and transform tables are copied from proto instead of being
+ * worked out again; the echo state is not carried over.
+ * @param proto Preprocessor state to copy, it may be running meanwhile
+ * @param arena Memory arena for the state, NULL for the system heap
+ * @return Newly created preprocessor state
+*/
+SpeexPreprocessState *speex_preprocess_state_clone(const SpeexPreprocessState *proto, struct _ST_AUD_MEM_ARENA *arena);
 
 /** Destroys a preprocessor state
  * @param st Preprocessor state to destroy
 */
 void speex_preprocess_state_destroy(SpeexPreprocessState *st);
 
+/** Size of a snapshot of st (speex_preprocess_state_save)
+ * @param st Preprocessor state
+ * @return Bytes speex_preprocess_state_save writes
+*/
+int speex_preprocess_state_snapshot_size(SpeexPreprocessState *st);
+
+/** Saves the estimates the preprocessor has built up: noise, residual echo and reverberation spectra, the noise
+ * update's minimum tracking, the speech probability and the AGC loudness and gain
+ * @param st Preprocessor state
+ * @param buf Snapshot (out)
+ * @param size Bytes available at buf
+ * @return Bytes written, -1 if buf is too small
+*/
+int speex_preprocess_state_save(SpeexPreprocessState *st, void *buf, int size);
+
+/** Checks that a snapshot taken by speex_preprocess_state_save would load into st, without touching st
+ * @param st Preprocessor state
+ * @param buf Snapshot
+ * @param size Bytes at buf
+ * @return Bytes speex_preprocess_state_load would read, -1 if the snapshot does not match st
+*/
+int speex_preprocess_state_snapshot_check(SpeexPreprocessState *st, const void *buf, int size);
+
+/** Restores a snapshot taken by speex_preprocess_state_save from a state of the same frame size, sampling rate and
+ * arithmetic. The parameters set through speex_preprocess_ctl are not part of it.
+ * @param st Preprocessor state
+ * @param buf Snapshot
+ * @param size Bytes at buf
+ * @return Bytes read, -1 if the snapshot does not match st
+*/
+int speex_preprocess_state_load(SpeexPreprocessState *st, const void *buf, int size);
+
 /** Preprocess a frame
  * @param st Preprocessor state
  * @param x Audio sample vector (in and out). Must be same size as specified in speex_preprocess_state_init().
@@ -76,6 +124,19 @@ void speex_preprocess_state_destroy(SpeexPreprocessState *st);
 */
 int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x);
 
+/** Preprocess a frame of several channels, one state per channel. Sample i of channel c is
+ * x[c*chan_step + i*stride]: chan_step = frame_size, stride = 1 for channels one after the other,
+ * chan_step = 1, stride = nb_chan for interleaved ones. Each channel is run exactly once, on pool when one is given.
+ * Consecutive states attached to the same echo state share one residual echo estimate.
+ * @param st Preprocessor states, one per channel
+ * @param nb_chan Number of channels
+ * @param x Audio samples of all channels (in and out)
+ * @param chan_step Distance from the first sample of a channel to that of the next channel
+ * @param stride Distance between two samples of the same channel
+ * @param pool Thread pool the channels are spread over (see aud_pool_api.h), NULL to run them in turn
+*/
+void speex_preprocess_run_mc(SpeexPreprocessState **st, int nb_chan, spx_int16_t *x, int chan_step, int stride, struct _ST_AUD_POOL *pool);
+
 /** Preprocess a frame (deprecated, use speex_preprocess_run() instead)*/
 int speex_preprocess(SpeexPreprocessState *st, spx_int16_t *x, spx_int32_t *echo);
 
@@ -85,6 +146,26 @@ int speex_preprocess(SpeexPreprocessState *st, spx_int16_t *x, spx_int32_t *echo
 */
 void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16_t *x);
 
+/** Voice activity of a frame without the output: runs the analysis, the noise and echo estimates and the speech
+ * probability at Bark band resolution, but neither the gains per bin nor the synthesis. The speech probability is
+ * then read with SPEEX_PREPROCESS_GET_PROB. Calls may be mixed with speex_preprocess_run() on the same state.
+ * @param st Preprocessor state
+ * @param x Audio sample vector (in only). Must be same size as specified in speex_preprocess_state_init().
+ * @return Bool value for voice activity (1 for speech, 0 for noise/silence), whether or not VAD is turned on
+*/
+int speex_preprocess_vad(SpeexPreprocessState *st, const spx_int16_t *x);
+
+/** speex_preprocess_vad on a frame of several channels, laid out and spread over pool as in speex_preprocess_run_mc()
+ * @param st Preprocessor states, one per channel
+ * @param nb_chan Number of channels
+ * @param x Audio samples of all channels (in only)
+ * @param chan_step Distance from the first sample of a channel to that of the next channel
+ * @param stride Distance between two samples of the same channel
+ * @param vad Voice activity of each channel (out, nb_chan entries)
+ * @param pool Thread pool the channels are spread over (see aud_pool_api.h), NULL to run them in turn
+*/
+void speex_preprocess_vad_mc(SpeexPreprocessState **st, int nb_chan, const spx_int16_t *x, int chan_step, int stride, int *vad, struct _ST_AUD_POOL *pool);
+
 /** Used like the ioctl function to control the preprocessor parameters
  * @param st Preprocessor state
  * @param request ioctl-type request (one of the SPEEX_PREPROCESS_* macros)
@@ -211,6 +292,19 @@ int speex_preprocess_ctl(SpeexPreprocessState *st, int request, void *ptr);
 /** Get preprocessor Automatic Gain Control level (int32) */
 #define SPEEX_PREPROCESS_GET_AGC_TARGET 47
 
+/** Take the residual echo from the spectrum of the echo canceller's own echo estimate instead of transforming
+    its time-domain estimate again (int32, 0 or 1). Saves an FFT per frame, the suppression then differs slightly. */
+#define SPEEX_PREPROCESS_SET_ECHO_FUSED 48
+/** Get whether the residual echo is taken from the echo canceller's spectrum (int32) */
+#define SPEEX_PREPROCESS_GET_ECHO_FUSED 49
+
+/** Compute the gains at linear frequency resolution (int32, 1, the default) or at Bark band resolution only (0).
+    Bark resolution skips the per-bin SNR and gain, 10-20% of the cost of the preprocessor, at some loss of
+    suppression between the harmonics of speech. */
+#define SPEEX_PREPROCESS_SET_LINEAR_GAIN 50
+/** Get whether the gains are computed at linear frequency resolution (int32) */
+#define SPEEX_PREPROCESS_GET_LINEAR_GAIN 51
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,245 @@
+/*
+    Per-frame cost of AEC and NS for a few typical configurations.
+
+    The numbers only mean something relative to another build of the library, e.g.
+        make -C ../source NVT_PRJCFG_CFG=Linux                  all _*_OPT switches of the Makefile
+        make -C ../source NVT_PRJCFG_CFG=Linux OPTFLAG=         generic code paths
+        make -C ../source NVT_PRJCFG_CFG=Linux OPTFLAG="-D_Bark_scale_OPT"
+                                                                one switch on its own
+    then relink and run aec_bench against each. The switches only pick a faster way to do the same
+    arithmetic, so all builds produce the same output.
+
+    Input is aec_mic.pcm / aec_speaker.pcm, looped as needed. Every configuration is timed
+    BENCH_PASSES times over BENCH_SECONDS of audio and the fastest pass is reported.
+
+    The multi-mic/multi-channel configurations copy aec_mic.pcm into every channel, channel c delayed by c
+    samples, so each mic still hears the same echo path as the speaker signal. With
+    threads > 0 the channels of a frame are spread over an AUD_Pool_Create pool of that many workers on top of
+    the calling thread. The fused configurations set EN_AUD_AEC_FUSED_RESIDUAL, the bark ones compute the
+    suppression gains at Bark band resolution only. The vad ones call AUD_NS_RunVad instead of AUD_NS_Run.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aud_aec_api.h"
+#include "aud_ns_api.h"
+
+#define BENCH_SECONDS 20
+#define BENCH_PASSES 5
+
+typedef struct _ST_BENCH_CFG {
+    const char *pName;
+    int s32SamplingRate;
+    int s32FrameSize;
+    int s32FilterLen;     // 0 for noise suppression only
+    int s32DisNoiseSuppr;
+    int s32NumMic;        // Mics or noise suppression channels, 0 for one
+    int s32Threads;       // Pool workers besides the calling thread, 0 for no pool
+    int s32Fused;         // EN_AUD_AEC_FUSED_RESIDUAL
+    int s32BarkGain;      // 1 to set EN_AUD_AEC_BANK_SCALE/EN_AUD_NS_BANK_SCALE to 0 (bark scale gains)
+    int s32VadOnly;       // AUD_NS_RunVad instead of AUD_NS_Run
+} ST_BENCH_CFG;
+
+static const ST_BENCH_CFG _stBenchCfg[] = {
+    {"aec    8k N=256 L=512", 8000, 256, 512, 1},
+    {"aec+ns 8k N=256 L=512", 8000, 256, 512, 0},
+    {"aec+ns 16k N=160 L=1600", 16000, 160, 1600, 0},
+    {"aec+ns 16k N=160 L=1600 fused", 16000, 160, 1600, 0, 0, 0, 1},
+    {"aec    48k N=1024 L=1024", 48000, 1024, 1024, 1},
+    {"aec    48k N=1024 L=4096", 48000, 1024, 4096, 1},
+    {"aec+ns 48k N=1024 L=1024", 48000, 1024, 1024, 0},
+    {"aec+ns 48k N=1024 L=1024 fused", 48000, 1024, 1024, 0, 0, 0, 1},
+    {"aec+ns 48k N=1024 L=1024 bark", 48000, 1024, 1024, 0, 0, 0, 0, 1},
+    {"ns     8k N=256", 8000, 256, 0, 0},
+    {"ns     48k N=1024", 48000, 1024, 0, 0},
+    {"ns     48k N=1024 bark", 48000, 1024, 0, 0, 0, 0, 0, 1},
+    {"ns     48k N=1024 vad", 48000, 1024, 0, 0, 0, 0, 0, 0, 1},
+    {"aec    16k N=160 L=1600 8mic", 16000, 160, 1600, 1, 8, 0},
+    {"aec    16k N=160 L=1600 8mic 3thr", 16000, 160, 1600, 1, 8, 3},
+    {"ns     16k N=160 4ch", 16000, 160, 0, 0, 4, 0},
+    {"ns     16k N=160 4ch 3thr", 16000, 160, 0, 0, 4, 3},
+    {"ns     16k N=160 4ch bark", 16000, 160, 0, 0, 4, 0, 0, 1},
+    {"ns     16k N=160 4ch vad", 16000, 160, 0, 0, 4, 0, 0, 0, 1},
+    {"aec    16k N=160 L=8000", 16000, 160, 8000, 1},
+    {"aec    48k N=480 L=24000", 48000, 480, 24000, 1},
+};
+
+static short *_ps16Mic, *_ps16Speaker;
+static int _s32PcmLen;
+
+/* aec_mic.pcm interleaved into s32NumCh channels, channel c delayed by c samples */
+static short *_spreadMic(int s32NumCh)
+{
+    short *ps16Buf = (short *)malloc((size_t)_s32PcmLen * s32NumCh * sizeof(short));
+    int i, c;
+
+    for (i = 0; i < _s32PcmLen; i++)
+        for (c = 0; c < s32NumCh; c++)
+            ps16Buf[i * s32NumCh + c] = i >= c ? _ps16Mic[i - c] : 0;
+    return ps16Buf;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static short *_loadPcm(const char *pName, int *ps32Len)
+{
+    FILE *fd;
+    long size;
+    short *ps16Buf;
+
+    if ((fd = fopen(pName, "rb")) == NULL) {
+        printf("Open %s failed\n", pName);
+        return NULL;
+    }
+    fseek(fd, 0, SEEK_END);
+    size = ftell(fd);
+    fseek(fd, 0, SEEK_SET);
+    ps16Buf  = (short *)malloc(size);
+    *ps32Len  = (int)(fread(ps16Buf, 1, size, fd) / sizeof(short));
+    fclose(fd);
+    return ps16Buf;
+}
+
+/* Returns the fastest pass in microseconds per frame */
+static double _benchAec(const ST_BENCH_CFG *pstCfg)
+{
+    ST_AUD_AEC_INFO stAecInfo;
+    ST_AUD_AEC_RTN stAecRtn;
+    AUD_AEC_HANDLE hAec;
+    PST_AUD_POOL pstPool = NULL;
+    void *pInternalBuf;
+    int s32NumMic  = pstCfg->s32NumMic ? pstCfg->s32NumMic : 1;
+    short *ps16Mic = s32NumMic > 1 ? _spreadMic(s32NumMic) : _ps16Mic;
+    short *ps16Out = (short *)malloc(s32NumMic * pstCfg->s32FrameSize * sizeof(short));
+    int s32Frames  = BENCH_SECONDS * pstCfg->s32SamplingRate / pstCfg->s32FrameSize;
+    int s32Linear  = 0;
+    int s32Pass, s32Frame, s32Pos;
+    double best = 1e30;
+
+    memset(&stAecInfo, 0, sizeof(stAecInfo));
+    stAecInfo.u32FrameSize    = pstCfg->s32FrameSize;
+    stAecInfo.u32FilterLen    = pstCfg->s32FilterLen;
+    stAecInfo.u32NumMic       = s32NumMic;
+    stAecInfo.u32NumSpeaker   = 1;
+    stAecInfo.u32SamplingRate = pstCfg->s32SamplingRate;
+    AUD_AEC_GetBufSize(&stAecInfo, &stAecRtn);
+    pInternalBuf = malloc(stAecRtn.u32InternalBufSize);
+    if (pstCfg->s32Threads)
+        pstPool = AUD_Pool_Create(pstCfg->s32Threads);
+
+    for (s32Pass = 0; s32Pass < BENCH_PASSES; s32Pass++) {
+        double start;
+        /* Restart from the same state so every pass does the same work */
+        hAec = AUD_AEC_Create(&stAecInfo, pInternalBuf, stAecRtn.u32InternalBufSize, NULL);
+        if (pstPool)
+            AUD_AEC_SetParamEx(hAec, EN_AUD_AEC_THREAD_POOL, pstPool);
+        if (pstCfg->s32Fused)
+            AUD_AEC_SetParamEx(hAec, EN_AUD_AEC_FUSED_RESIDUAL, (void *)&pstCfg->s32Fused);
+        if (pstCfg->s32BarkGain)
+            AUD_AEC_SetParamEx(hAec, EN_AUD_AEC_BANK_SCALE, &s32Linear);
+        start = _now();
+        for (s32Frame = 0, s32Pos = 0; s32Frame < s32Frames; s32Frame++) {
+            if (s32Pos + pstCfg->s32FrameSize > _s32PcmLen)
+                s32Pos = 0;
+            AUD_AEC_RunEx(hAec, ps16Mic + s32Pos * s32NumMic, _ps16Speaker + s32Pos, ps16Out, pstCfg->s32DisNoiseSuppr, NULL);
+            s32Pos += pstCfg->s32FrameSize;
+        }
+        start = (_now() - start) * 1e6 / s32Frames;
+        if (start < best)
+            best = start;
+        AUD_AEC_Destroy(hAec);
+    }
+    AUD_Pool_Destroy(pstPool);
+    if (ps16Mic != _ps16Mic)
+        free(ps16Mic);
+    free(pInternalBuf);
+    free(ps16Out);
+    return best;
+}
+
+static double _benchNs(const ST_BENCH_CFG *pstCfg)
+{
+    ST_AUD_NS_INFO stNsInfo;
+    ST_AUD_NS_RTN stNsRtn;
+    PST_AUD_POOL pstPool = NULL;
+    void *pInternalBuf;
+    int s32NumCh       = pstCfg->s32NumMic ? pstCfg->s32NumMic : 1;
+    short *ps16Mic     = s32NumCh > 1 ? _spreadMic(s32NumCh) : _ps16Mic;
+    int s32Interleaved = 1;
+    int s32Linear      = 0;
+    short *ps16Out     = (short *)malloc(s32NumCh * pstCfg->s32FrameSize * sizeof(short));
+    int *ps32Vad       = (int *)malloc(s32NumCh * sizeof(int));
+    int s32Frames      = BENCH_SECONDS * pstCfg->s32SamplingRate / pstCfg->s32FrameSize;
+    int s32Pass, s32Frame, s32Pos;
+    double best = 1e30;
+
+    stNsInfo.s32FrameSize    = pstCfg->s32FrameSize;
+    stNsInfo.s32ChannelNum   = s32NumCh;
+    stNsInfo.s32SamplingRate = pstCfg->s32SamplingRate;
+    stNsInfo.s32ShareTables  = 0;
+    AUD_NS_PreInit(&stNsInfo, &stNsRtn);
+    if (pstCfg->s32Threads)
+        pstPool = AUD_Pool_Create(pstCfg->s32Threads);
+
+    for (s32Pass = 0; s32Pass < BENCH_PASSES; s32Pass++) {
+        double start;
+        /* AUD_NS_Uninit releases the internal buffer */
+        pInternalBuf = malloc(stNsRtn.u32InternalBufSize);
+        AUD_NS_Init(pInternalBuf, stNsRtn.u32InternalBufSize);
+        AUD_NS_SetParam(EN_AUD_NS_INTERLEAVED, &s32Interleaved);
+        if (pstPool)
+            AUD_NS_SetParam(EN_AUD_NS_THREAD_POOL, pstPool);
+        if (pstCfg->s32BarkGain)
+            AUD_NS_SetParam(EN_AUD_NS_BANK_SCALE, &s32Linear);
+        start = _now();
+        for (s32Frame = 0, s32Pos = 0; s32Frame < s32Frames; s32Frame++) {
+            if (s32Pos + pstCfg->s32FrameSize > _s32PcmLen)
+                s32Pos = 0;
+            if (pstCfg->s32VadOnly)
+                AUD_NS_RunVad(ps16Mic + s32Pos * s32NumCh, ps32Vad);
+            else
+                AUD_NS_Run(ps16Mic + s32Pos * s32NumCh, ps16Out);
+            s32Pos += pstCfg->s32FrameSize;
+        }
+        start = (_now() - start) * 1e6 / s32Frames;
+        if (start < best)
+            best = start;
+        AUD_NS_Uninit();
+    }
+    AUD_Pool_Destroy(pstPool);
+    if (ps16Mic != _ps16Mic)
+        free(ps16Mic);
+    free(ps32Vad);
+    free(ps16Out);
+    return best;
+}
+
+int main(void)
+{
+    int s32SpeakerLen;
+    unsigned int i;
+
+    _ps16Mic     = _loadPcm("aec_mic.pcm", &_s32PcmLen);
+    _ps16Speaker = _loadPcm("aec_speaker.pcm", &s32SpeakerLen);
+    if (!_ps16Mic || !_ps16Speaker)
+        return 1;
+    if (s32SpeakerLen < _s32PcmLen)
+        _s32PcmLen = s32SpeakerLen;
+
+    printf("%-34s %12s %10s\n", "config", "us/frame", "x realtime");
+    for (i = 0; i < sizeof(_stBenchCfg) / sizeof(_stBenchCfg[0]); i++) {
+        const ST_BENCH_CFG *pstCfg = &_stBenchCfg[i];
+        double us                  = pstCfg->s32FilterLen ? _benchAec(pstCfg) : _benchNs(pstCfg);
+        printf("%-34s %12.2f %10.1f\n", pstCfg->pName, us, 1e6 * pstCfg->s32FrameSize / pstCfg->s32SamplingRate / us);
+    }
+
+    free(_ps16Mic);
+    free(_ps16Speaker);
+    return 0;
+}
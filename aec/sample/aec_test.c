@@ -156,6 +156,8 @@ int main_AEC(void)
     stAecInfoPre.u32SamplingRate = SAMPLING_RATE;
     stAecInfoPre.u32SpkrMixIn    = 0;
     stAecInfoPre.u32SpkrDualMono = 0;
+    stAecInfoPre.u32MaxDelay     = 0;
+    stAecInfoPre.u32ShareTables  = 0;
 
     AUD_AEC_PreInit(&stAecInfoPre, &stAecRtn);
     pInternalBuf = malloc(stAecRtn.u32InternalBufSize);
@@ -167,16 +169,12 @@ int main_AEC(void)
             printf("Open %s failed\n", FilterR_bin);
             return 0;
         }
-        fread(&stAecPreload.u32ForegroundSize, sizeof(u32), 1, FilterR_fd);
-        stAecPreload.ps16Foreground = (short *)malloc(stAecPreload.u32ForegroundSize);
-        fread(stAecPreload.ps16Foreground, 1, stAecPreload.u32ForegroundSize, FilterR_fd);
-        fread(&stAecPreload.u32BackgroundSize, sizeof(u32), 1, FilterR_fd);
-        stAecPreload.ps32Background = (int *)malloc(stAecPreload.u32BackgroundSize);
-        fread(stAecPreload.ps32Background, 1, stAecPreload.u32BackgroundSize, FilterR_fd);
+        fread(&stAecPreload.u32StateSize, sizeof(u32), 1, FilterR_fd);
+        stAecPreload.pState = malloc(stAecPreload.u32StateSize);
+        fread(stAecPreload.pState, 1, stAecPreload.u32StateSize, FilterR_fd);
         fclose(FilterR_fd);
         printf("----------Preload----------\n");
-        printf("[Foreground] %p: 0x%x\n", stAecPreload.ps16Foreground, stAecPreload.u32ForegroundSize);
-        printf("[Background] %p: 0x%x\n", stAecPreload.ps32Background, stAecPreload.u32BackgroundSize);
+        printf("[State] %p: 0x%x\n", stAecPreload.pState, stAecPreload.u32StateSize);
     }
     AUD_AEC_Init(pInternalBuf, stAecRtn.u32InternalBufSize, &stAecPreload);
     memset(e_buf, 0, micSize);
@@ -241,10 +239,17 @@ int main_AEC(void)
     printf("decode time = %f seconds\n", total_time);
     total_time = 0;
 #endif
-    fwrite(&stAecPreload.u32ForegroundSize, sizeof(u32), 1, FilterW_fd);
-    fwrite(stAecPreload.ps16Foreground, 1, stAecPreload.u32ForegroundSize, FilterW_fd);
-    fwrite(&stAecPreload.u32BackgroundSize, sizeof(u32), 1, FilterW_fd);
-    fwrite(stAecPreload.ps32Background, 1, stAecPreload.u32BackgroundSize, FilterW_fd);
+    // Converged state, read back as preload_r.bin by a run with u32PreloadEnable set
+    {
+        int s32StateSize = AUD_AEC_GetStateSize(NULL);
+        void *pState     = malloc(s32StateSize);
+        if (AUD_AEC_SaveState(NULL, pState, s32StateSize)) {
+            fwrite(&s32StateSize, sizeof(u32), 1, FilterW_fd);
+            fwrite(pState, 1, s32StateSize, FilterW_fd);
+        }
+        free(pState);
+    }
+    free(stAecPreload.pState);
 
     fclose(e_fd);
     fclose(echo_fd);
@@ -301,6 +306,7 @@ int main_NS(int useDenoise)
     stNsInfoPre.s32FrameSize    = NN;
     stNsInfoPre.s32ChannelNum   = CH;
     stNsInfoPre.s32SamplingRate = SAMPLING_RATE;
+    stNsInfoPre.s32ShareTables  = 0;
     AUD_NS_PreInit(&stNsInfoPre, &stNsRtn);
     pInternalBuf = malloc(stNsRtn.u32InternalBufSize);
 
@@ -413,6 +419,7 @@ int main_AGC(void)
     stAgcInfoPre.s32FrameSize    = NN;
     stAgcInfoPre.s32ChannelNum   = CH;
     stAgcInfoPre.s32SamplingRate = SAMPLING_RATE;
+    stAgcInfoPre.s32ShareTables  = 0;
     AUD_AGC_PreInit(&stAgcInfoPre, &stAgcRtn);
     pInternalBuf = malloc(stAgcRtn.u32InternalBufSize);
 
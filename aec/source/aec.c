@@ -14,6 +14,7 @@
 #endif
 
 #include "aec.h"
+#include "aud_mem.h"
 #include "speex_echo.h"
 #include "speex_preprocess.h"
 //#include "perf.h"
@@ -26,62 +27,305 @@
 /*-----------------------------------------------------------------------------*/
 /* Extern Global Variables                                                     */
 /*-----------------------------------------------------------------------------*/
-extern u32 _Aec_GetInternalBufSize(PST_AUD_AEC_INFO pstAecInfo, u32 u32NumPreProc);
 extern u32 _Aec_SetEchoParams(void *pstEchoState, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
-extern u32 _Aec_SetPreProcParams(void **ppstPreProcState, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
+extern u32 _Aec_SetPreProcParams(void **ppstPreProcState, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue, s32 s32ChannelNum);
 
-extern void AUD_Malloc_Init(void *ptr, u32 u32TotalLen);
-extern int AUD_Malloc_Uninit(void);
-extern void *(*AUD_calloc)(s32 s32num, s32 s32size);
 
 /*-----------------------------------------------------------------------------*/
-/* Local Global Variables                                                      */
+/* Local Type Definitions                                                      */
 /*-----------------------------------------------------------------------------*/
-static void *_pstEchoState;
-static void **_ppstPreProcState;
-static void **_ppstEchoState;
+typedef struct _ST_AUD_AEC_INST {
+    ST_AUD_MEM_ARENA stArena;  // Arena over the caller's internal buffer, the instance itself is its first block
+    ST_AUD_AEC_INFO stAecInfo;
+    void *pstEchoState;
+    void **ppstEchoState;
+    void **ppstPreProcState;
+    s16 *ps16MixBuf;     // Scratch, u32SpkrMixIn mono speaker of a frame, u32FrameSize samples
+    PST_AUD_POOL pstPool;  // EN_AUD_AEC_THREAD_POOL, NULL runs every mic on the caller's thread
+    void *pstDelay;        // u32MaxDelay far-end alignment, NULL if none
+} ST_AUD_AEC_INST, *PST_AUD_AEC_INST;
 
-static ST_AUD_AEC_INFO _stAecInfo;
+/*One frame of the dual mono states, each mic on its own pool task*/
+typedef struct _ST_AUD_AEC_DUAL_MONO_TASK {
+    PST_AUD_AEC_INST pstInst;
+    const short *ps16MicBuf;
+    const short *ps16SpeakerBuf;
+    short *ps16OutBuf;
+} ST_AUD_AEC_DUAL_MONO_TASK, *PST_AUD_AEC_DUAL_MONO_TASK;
 
-static s16 *_ps16AecOutBuf;
-short _g_tmp_buf[2048];
+/*-----------------------------------------------------------------------------*/
+/* Local Global Variables                                                      */
+/*-----------------------------------------------------------------------------*/
+static ST_AUD_AEC_INFO _stAecInfo;
+static AUD_AEC_HANDLE _hAecDefault;
+static void *_pAecDefaultBuf;
 
 /*-------------------------------------------------------------------------------
-** Input        : pstAecInfo
-** Output   : pstAecRtn
+** Input        : pstArena, pstAecInfo
+** Output   : instance carved from pstArena, which then moves inside the instance
 **--------------------------------------------------------------------------------*/
-void AUD_AEC_PreInit(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn)
+static PST_AUD_AEC_INST _AUD_AEC_Alloc(PST_AUD_MEM_ARENA pstArena, PST_AUD_AEC_INFO pstAecInfo)
 {
-    PST_AUD_AEC_INFO pstAecInfoSave = &_stAecInfo;
-    u32 u32BytePerSample            = 2;
+    PST_AUD_AEC_INST pstInst;
 
-    memcpy(pstAecInfoSave, pstAecInfo, sizeof(ST_AUD_AEC_INFO));
+    pstInst = (PST_AUD_AEC_INST)AUD_Arena_Calloc(pstArena, 1, sizeof(ST_AUD_AEC_INST));
+    if (pstInst == NULL)
+        return NULL;
+    memcpy(&pstInst->stArena, pstArena, sizeof(ST_AUD_MEM_ARENA));
+    memcpy(&pstInst->stAecInfo, pstAecInfo, sizeof(ST_AUD_AEC_INFO));
 
-    pstAecRtn->u32MicBufSize      = pstAecInfoSave->u32NumMic * pstAecInfoSave->u32FrameSize * u32BytePerSample;
-    pstAecRtn->u32EchoBufSize     = pstAecInfoSave->u32NumSpeaker * pstAecInfoSave->u32FrameSize * u32BytePerSample;
-    pstAecRtn->u32OutBufSize      = pstAecInfoSave->u32NumMic * pstAecInfoSave->u32FrameSize * u32BytePerSample;
-    pstAecRtn->u32InternalBufSize = _Aec_GetInternalBufSize(pstAecInfoSave, pstAecInfoSave->u32NumMic);
-#ifndef FIXED_POINT
-    pstAecRtn->u32InternalBufSize *= 2;
-#endif
-    if (pstAecInfo->u32SpkrMixIn)
-        pstAecRtn->u32EchoBufSize <<= 1;
+    return pstInst;
 }
 
 /*-------------------------------------------------------------------------------
-** Input        : pInternalBuf, u32BufSize
-** Output   : EN_AUD_AEC_ERR
+** Input        : pstInst, pstProto instance of the same info to copy the tables from, NULL to compute them
+** Output   : pstAecRtn sub-object sizes (optional), EN_AUD_AEC_ERR
 **--------------------------------------------------------------------------------*/
-EN_AUD_AEC_ERR _AUD_AEC_Init(void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload)
+static EN_AUD_AEC_ERR _AUD_AEC_Build(PST_AUD_AEC_INST pstInst, PST_AUD_AEC_RTN pstAecRtn, PST_AUD_AEC_INST pstProto)
 {
-    PST_AUD_AEC_INFO pstAecInfo = &_stAecInfo;
+    PST_AUD_AEC_INFO pstAecInfo = &pstInst->stAecInfo;
+    PST_AUD_MEM_ARENA pstArena  = &pstInst->stArena;
     u32 u32FrameSize            = pstAecInfo->u32FrameSize;
     u32 u32FilterLen            = pstAecInfo->u32FilterLen;
     u32 u32NumMic               = pstAecInfo->u32NumMic;
     u32 u32NumSpeaker           = pstAecInfo->u32NumSpeaker;
     u32 u32SamplingRate         = pstAecInfo->u32SamplingRate;
+    u32 u32EchoSize = 0, u32PreProcSize = 0, u32Mark;
     u32 i;
 
+    pstInst->ppstPreProcState = (void **)AUD_Arena_Calloc(pstArena, u32NumMic, sizeof(void *));
+    pstInst->ppstEchoState    = (void **)AUD_Arena_Calloc(pstArena, u32NumMic, sizeof(void *));
+    if (pstInst->ppstPreProcState == NULL || pstInst->ppstEchoState == NULL)
+        return EN_AUD_AEC_EINITFAIL;
+    if (pstAecInfo->u32SpkrMixIn) {
+        pstInst->ps16MixBuf = (s16 *)AUD_Arena_CallocScratch(pstArena, u32FrameSize, sizeof(s16));
+        if (pstInst->ps16MixBuf == NULL)
+            return EN_AUD_AEC_EINITFAIL;
+    }
+
+    if (pstAecInfo->u32SpkrDualMono) {
+        u32Mark = AUD_Arena_GetUsedSize(pstArena);
+        for (i = 0; i < u32NumMic; i++) {
+            if (pstProto)
+                pstInst->ppstEchoState[i] = speex_echo_state_clone(pstProto->ppstEchoState[i], pstArena);
+            else
+                pstInst->ppstEchoState[i] = speex_echo_state_init(u32FrameSize, u32FilterLen, pstArena);
+            if (pstInst->ppstEchoState[i] == 0)
+                return EN_AUD_AEC_EINITFAIL;
+            speex_echo_ctl(pstInst->ppstEchoState[i], SPEEX_ECHO_SET_SAMPLING_RATE, &u32SamplingRate);
+        }
+        u32EchoSize = AUD_Arena_GetUsedSize(pstArena) - u32Mark;
+
+        u32Mark = AUD_Arena_GetUsedSize(pstArena);
+        for (i = 0; i < u32NumMic; i++) {
+            if (pstProto)
+                pstInst->ppstPreProcState[i] = speex_preprocess_state_clone(pstProto->ppstPreProcState[i], pstArena);
+            else
+                pstInst->ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate, pstArena);
+            if (pstInst->ppstPreProcState[i] == 0)
+                return EN_AUD_AEC_EINITFAIL;
+            speex_preprocess_ctl(pstInst->ppstPreProcState[i], SPEEX_PREPROCESS_SET_ECHO_STATE, pstInst->ppstEchoState[i]);
+        }
+        u32PreProcSize = AUD_Arena_GetUsedSize(pstArena) - u32Mark;
+
+        // Noah@20220118, _ps16AecOutBuf -> _ppstEchoState
+        pstInst->pstEchoState = pstInst->ppstEchoState[0];
+    } else {
+        u32Mark               = AUD_Arena_GetUsedSize(pstArena);
+        if (pstProto)
+            pstInst->pstEchoState = speex_echo_state_clone(pstProto->pstEchoState, pstArena);
+        else
+            pstInst->pstEchoState = speex_echo_state_init_mc(u32FrameSize, u32FilterLen, u32NumMic, u32NumSpeaker, pstArena);
+        pstInst->ppstEchoState[0] = pstInst->pstEchoState;
+        if (pstInst->pstEchoState == 0)
+            return EN_AUD_AEC_EINITFAIL;
+        speex_echo_ctl(pstInst->pstEchoState, SPEEX_ECHO_SET_SAMPLING_RATE, &u32SamplingRate);
+        u32EchoSize = AUD_Arena_GetUsedSize(pstArena) - u32Mark;
+
+        u32Mark = AUD_Arena_GetUsedSize(pstArena);
+        for (i = 0; i < u32NumMic; i++) {
+            if (pstProto)
+                pstInst->ppstPreProcState[i] = speex_preprocess_state_clone(pstProto->ppstPreProcState[i], pstArena);
+            else
+                pstInst->ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate, pstArena);
+            if (pstInst->ppstPreProcState[i] == 0)
+                return EN_AUD_AEC_EINITFAIL;
+            speex_preprocess_ctl(pstInst->ppstPreProcState[i], SPEEX_PREPROCESS_SET_ECHO_STATE, pstInst->pstEchoState);
+        }
+        u32PreProcSize = AUD_Arena_GetUsedSize(pstArena) - u32Mark;
+    }
+
+    if (pstAecInfo->u32MaxDelay > 0) {
+        // Aligns the speaker as the echo states see it, mixed down to mono or not
+        if (pstProto)
+            pstInst->pstDelay = speex_echo_delay_clone((SpeexEchoDelay *)pstProto->pstDelay, pstArena);
+        else
+            pstInst->pstDelay = speex_echo_delay_init(u32FrameSize, u32SamplingRate, pstAecInfo->u32MaxDelay, pstAecInfo->u32SpkrMixIn ? 1 : u32NumSpeaker, pstArena);
+        if (pstInst->pstDelay == NULL)
+            return EN_AUD_AEC_EINITFAIL;
+    }
+
+    if (pstAecRtn) {
+        pstAecRtn->u32EchoStateBufSize    = u32EchoSize;
+        pstAecRtn->u32PreProcStateBufSize = u32PreProcSize;
+    }
+
+    return EN_AUD_AEC_ENOERR;
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : pstAecInfo
+** Output   : pstAecRtn
+**--------------------------------------------------------------------------------*/
+void _AUD_AEC_GetBufSize(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn)
+{
+    ST_AUD_MEM_ARENA stArena, stScratch;
+    PST_AUD_AEC_INST pstInst;
+    u32 u32BytePerSample = 2;
+
+    pstAecRtn->u32MicBufSize  = pstAecInfo->u32NumMic * pstAecInfo->u32FrameSize * u32BytePerSample;
+    pstAecRtn->u32EchoBufSize = pstAecInfo->u32NumSpeaker * pstAecInfo->u32FrameSize * u32BytePerSample;
+    pstAecRtn->u32OutBufSize  = pstAecInfo->u32NumMic * pstAecInfo->u32FrameSize * u32BytePerSample;
+    if (pstAecInfo->u32SpkrMixIn)
+        pstAecRtn->u32EchoBufSize <<= 1;
+
+    // Dry run of the real init code, the arenas tally what the state and scratch buffers must hold
+    pstAecRtn->u32InternalBufSize     = 0;
+    pstAecRtn->u32EchoStateBufSize    = 0;
+    pstAecRtn->u32PreProcStateBufSize = 0;
+    pstAecRtn->u32StateBufSize        = 0;
+    pstAecRtn->u32ScratchBufSize      = 0;
+    AUD_Arena_InitCounter(&stArena);
+    AUD_Arena_InitCounter(&stScratch);
+    stArena.pstScratch     = &stScratch;
+    stArena.u32ShareTables = pstAecInfo->u32ShareTables != 0;
+    pstInst                = _AUD_AEC_Alloc(&stArena, pstAecInfo);
+    if (pstInst == NULL) {
+        AUD_Arena_UninitCounter(&stArena);
+        AUD_Arena_UninitCounter(&stScratch);
+        return;
+    }
+    _AUD_AEC_Build(pstInst, pstAecRtn, NULL);
+    // The arena lives inside the instance, which is one of the blocks about to be freed
+    memcpy(&stArena, &pstInst->stArena, sizeof(ST_AUD_MEM_ARENA));
+    // Drops the references to the shared tables, the blocks themselves go with the counter
+    _AUD_AEC_Destroy((AUD_AEC_HANDLE)pstInst);
+    pstAecRtn->u32StateBufSize   = AUD_Arena_UninitCounter(&stArena);
+    pstAecRtn->u32ScratchBufSize = AUD_Arena_UninitCounter(&stScratch);
+    // Without a shared scratch buffer both parts are carved from the internal buffer, aligned once
+    pstAecRtn->u32InternalBufSize = pstAecRtn->u32StateBufSize + pstAecRtn->u32ScratchBufSize - (AUD_MEM_ALIGN - 1);
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : pstAecInfo
+** Output   : pstAecRtn
+**--------------------------------------------------------------------------------*/
+void AUD_AEC_PreInit(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn)
+{
+    memcpy(&_stAecInfo, pstAecInfo, sizeof(ST_AUD_AEC_INFO));
+    _AUD_AEC_GetBufSize(&_stAecInfo, pstAecRtn);
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, NULL for the AUD_AEC_Init instance
+** Output   : snapshot size in bytes
+** Note     : the echo state(s) come first, then the preprocess state of every mic, then the delay estimator
+**--------------------------------------------------------------------------------*/
+int _AUD_AEC_GetStateSize(AUD_AEC_HANDLE hAec)
+{
+    PST_AUD_AEC_INST pstInst = (PST_AUD_AEC_INST)(hAec ? hAec : _hAecDefault);
+    u32 u32NumMic            = pstInst->stAecInfo.u32NumMic;
+    u32 u32NumEcho           = pstInst->stAecInfo.u32SpkrDualMono ? u32NumMic : 1;
+    int s32Size              = 0;
+    u32 i;
+
+    for (i = 0; i < u32NumEcho; i++)
+        s32Size += speex_echo_state_snapshot_size(pstInst->ppstEchoState[i]);
+    for (i = 0; i < u32NumMic; i++)
+        s32Size += speex_preprocess_state_snapshot_size(pstInst->ppstPreProcState[i]);
+    if (pstInst->pstDelay)
+        s32Size += speex_echo_delay_snapshot_size((SpeexEchoDelay *)pstInst->pstDelay);
+    return s32Size;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, NULL for the AUD_AEC_Init instance, u32BufSize
+** Output   : pBuf snapshot, EN_AUD_AEC_ERR
+**--------------------------------------------------------------------------------*/
+EN_AUD_AEC_ERR _AUD_AEC_SaveState(AUD_AEC_HANDLE hAec, void *pBuf, int u32BufSize)
+{
+    PST_AUD_AEC_INST pstInst = (PST_AUD_AEC_INST)(hAec ? hAec : _hAecDefault);
+    u32 u32NumMic            = pstInst->stAecInfo.u32NumMic;
+    u32 u32NumEcho           = pstInst->stAecInfo.u32SpkrDualMono ? u32NumMic : 1;
+    char *pPos               = (char *)pBuf;
+    int s32Len;
+    u32 i;
+
+    for (i = 0; i < u32NumEcho; i++) {
+        s32Len = speex_echo_state_save(pstInst->ppstEchoState[i], pPos, u32BufSize - (int)(pPos - (char *)pBuf));
+        if (s32Len < 0)
+            return EN_AUD_AEC_ESTATE;
+        pPos += s32Len;
+    }
+    for (i = 0; i < u32NumMic; i++) {
+        s32Len = speex_preprocess_state_save(pstInst->ppstPreProcState[i], pPos, u32BufSize - (int)(pPos - (char *)pBuf));
+        if (s32Len < 0)
+            return EN_AUD_AEC_ESTATE;
+        pPos += s32Len;
+    }
+    if (pstInst->pstDelay && speex_echo_delay_save((SpeexEchoDelay *)pstInst->pstDelay, pPos, u32BufSize - (int)(pPos - (char *)pBuf)) < 0)
+        return EN_AUD_AEC_ESTATE;
+    return EN_AUD_AEC_ENOERR;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, NULL for the AUD_AEC_Init instance, pBuf snapshot of _AUD_AEC_SaveState, u32BufSize
+** Output   : EN_AUD_AEC_ERR
+** Note     : every part is checked before any is copied in, a mismatch leaves the instance untouched
+**--------------------------------------------------------------------------------*/
+EN_AUD_AEC_ERR _AUD_AEC_LoadState(AUD_AEC_HANDLE hAec, const void *pBuf, int u32BufSize)
+{
+    PST_AUD_AEC_INST pstInst = (PST_AUD_AEC_INST)(hAec ? hAec : _hAecDefault);
+    u32 u32NumMic            = pstInst->stAecInfo.u32NumMic;
+    u32 u32NumEcho           = pstInst->stAecInfo.u32SpkrDualMono ? u32NumMic : 1;
+    const char *pPos         = (const char *)pBuf;
+    int s32Len;
+    u32 i;
+
+    for (i = 0; i < u32NumEcho; i++) {
+        s32Len = speex_echo_state_snapshot_check(pstInst->ppstEchoState[i], pPos, u32BufSize - (int)(pPos - (const char *)pBuf));
+        if (s32Len < 0)
+            return EN_AUD_AEC_ESTATE;
+        pPos += s32Len;
+    }
+    for (i = 0; i < u32NumMic; i++) {
+        s32Len = speex_preprocess_state_snapshot_check(pstInst->ppstPreProcState[i], pPos, u32BufSize - (int)(pPos - (const char *)pBuf));
+        if (s32Len < 0)
+            return EN_AUD_AEC_ESTATE;
+        pPos += s32Len;
+    }
+    if (pstInst->pstDelay && speex_echo_delay_snapshot_check((SpeexEchoDelay *)pstInst->pstDelay, pPos, u32BufSize - (int)(pPos - (const char *)pBuf)) < 0)
+        return EN_AUD_AEC_ESTATE;
+
+    pPos = (const char *)pBuf;
+    for (i = 0; i < u32NumEcho; i++)
+        pPos += speex_echo_state_load(pstInst->ppstEchoState[i], pPos, u32BufSize - (int)(pPos - (const char *)pBuf));
+    for (i = 0; i < u32NumMic; i++)
+        pPos += speex_preprocess_state_load(pstInst->ppstPreProcState[i], pPos, u32BufSize - (int)(pPos - (const char *)pBuf));
+    if (pstInst->pstDelay)
+        speex_echo_delay_load((SpeexEchoDelay *)pstInst->pstDelay, pPos, u32BufSize - (int)(pPos - (const char *)pBuf));
+    return EN_AUD_AEC_ENOERR;
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : pstAecInfo, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize, pstProto (see _AUD_AEC_Build)
+** Output   : instance, NULL if fail
+**--------------------------------------------------------------------------------*/
+static PST_AUD_AEC_INST _AUD_AEC_New(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize, PST_AUD_AEC_INST pstProto)
+{
+    PST_AUD_AEC_INST pstInst;
+    ST_AUD_MEM_ARENA stArena, stScratch;
+
 #ifdef _MIPS_
     {
         int temp;
@@ -95,54 +339,97 @@ EN_AUD_AEC_ERR _AUD_AEC_Init(void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRE
 #endif /*_MIPS_*/
 
     if (pInternalBuf == 0)
-        return EN_AUD_AEC_EINITFAIL;
+        return NULL;
 
-    AUD_Malloc_Init(pInternalBuf, u32BufSize);
-    _ppstPreProcState = (void **)AUD_calloc(u32NumMic, sizeof(void *));
-    _ps16AecOutBuf    = (s16 *)AUD_calloc((u32NumMic * u32FrameSize), sizeof(s16));
-    _ppstEchoState    = (void **)AUD_calloc(u32NumMic, sizeof(void *));
+    AUD_Arena_Init(&stArena, pInternalBuf, u32BufSize);
+    stArena.u32ShareTables = pstAecInfo->u32ShareTables != 0;
+    if (pScratchBuf) {
+        // Every instance lays its scratch out from the start of the shared buffer
+        AUD_Arena_Init(&stScratch, pScratchBuf, u32ScratchBufSize);
+        stArena.pstScratch = &stScratch;
+    }
+    pstInst = _AUD_AEC_Alloc(&stArena, pstAecInfo);
+    if (pstInst == NULL)
+        return NULL;
+    if (_AUD_AEC_Build(pstInst, NULL, pstProto) != EN_AUD_AEC_ENOERR)
+        return NULL;
+    pstInst->stArena.pstScratch = NULL;
 
-    if (_stAecInfo.u32SpkrDualMono) {
-        for (i = 0; i < u32NumMic; i++) {
-            _ppstEchoState[i] = speex_echo_state_init(u32FrameSize, u32FilterLen);
-            speex_echo_ctl(_ppstEchoState[i], SPEEX_ECHO_SET_SAMPLING_RATE, &u32SamplingRate);
-        }
+    return pstInst;
+}
 
-        for (i = 0; i < u32NumMic; i++) {
-            _ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate);
-            speex_preprocess_ctl(_ppstPreProcState[i], SPEEX_PREPROCESS_SET_ECHO_STATE, _ppstEchoState[i]);
-        }
+/*-------------------------------------------------------------------------------
+** Input        : pstAecInfo, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
+** Output   : AEC handle, NULL if fail
+** Note     : pScratchBuf may be shared by every instance run on the same thread,
+**            NULL keeps the scratch inside pInternalBuf
+**--------------------------------------------------------------------------------*/
+AUD_AEC_HANDLE _AUD_AEC_CreateEx(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize, PST_AUD_AEC_PRELOAD pstAecPreload)
+{
+    PST_AUD_AEC_INST pstInst = _AUD_AEC_New(pstAecInfo, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize, NULL);
 
-        // Noah@20220118, _ps16AecOutBuf -> _ppstEchoState
-        _pstEchoState = _ppstEchoState[0];
-        if (_ppstEchoState[i - 1] == 0 || _ppstPreProcState[i - 1] == 0) {
-            return EN_AUD_AEC_EINITFAIL;
-        }
-    } else {
-        _pstEchoState = _ppstEchoState[0] = speex_echo_state_init_mc(u32FrameSize, u32FilterLen, u32NumMic, u32NumSpeaker);
-        speex_echo_ctl(_pstEchoState, SPEEX_ECHO_SET_SAMPLING_RATE, &u32SamplingRate);
-        for (i = 0; i < u32NumMic; i++) {
-            _ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate);
-            speex_preprocess_ctl(_ppstPreProcState[i], SPEEX_PREPROCESS_SET_ECHO_STATE, _pstEchoState);
-        }
-        if (_pstEchoState == 0 || _ppstPreProcState[i - 1] == 0)
-            return EN_AUD_AEC_EINITFAIL;
-    }
+    if (pstInst == NULL)
+        return NULL;
+    // A snapshot of another configuration is refused by the states, the instance then starts unconverged
+    if (pstAecPreload && pstAecPreload->u32PreloadEnable && pstAecPreload->pState)
+        _AUD_AEC_LoadState((AUD_AEC_HANDLE)pstInst, pstAecPreload->pState, pstAecPreload->u32StateSize);
 
-    return EN_AUD_AEC_ENOERR;
+    return (AUD_AEC_HANDLE)pstInst;
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : hTemplate, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
+** Output   : AEC handle, NULL if fail
+** Note     : same buffer sizes as hTemplate, whose transform tables, windows and filter banks are copied
+**            instead of computed; it starts unconverged with the parameters set on hTemplate, the pool excepted
+**--------------------------------------------------------------------------------*/
+AUD_AEC_HANDLE _AUD_AEC_Clone(AUD_AEC_HANDLE hTemplate, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize)
+{
+    PST_AUD_AEC_INST pstProto = (PST_AUD_AEC_INST)hTemplate;
+
+    if (pstProto == NULL)
+        return NULL;
+    return (AUD_AEC_HANDLE)_AUD_AEC_New(&pstProto->stAecInfo, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize, pstProto);
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : pstAecInfo, pInternalBuf, u32BufSize
+** Output   : AEC handle, NULL if fail
+**--------------------------------------------------------------------------------*/
+AUD_AEC_HANDLE _AUD_AEC_Create(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload)
+{
+    return _AUD_AEC_CreateEx(pstAecInfo, pInternalBuf, u32BufSize, NULL, 0, pstAecPreload);
 }
+
 /*-------------------------------------------------------------------------------
-** Input    : pu16MicBuf, pu16EchoBuf
+** Input    : pArg (PST_AUD_AEC_DUAL_MONO_TASK), s32Mic
+** Output   : echo cancelled mic s32Mic, interleaved into ps16OutBuf
+**--------------------------------------------------------------------------------*/
+static void _AUD_AEC_DualMonoTask(void *pArg, int s32Mic)
+{
+    PST_AUD_AEC_DUAL_MONO_TASK pstTask = (PST_AUD_AEC_DUAL_MONO_TASK)pArg;
+
+    // Each mono state picks its channel straight out of the interleaved stereo buffers
+    speex_echo_cancellation_strided(pstTask->pstInst->ppstEchoState[s32Mic], pstTask->ps16MicBuf + s32Mic, 2, pstTask->ps16SpeakerBuf + s32Mic, 2,
+                                    pstTask->ps16OutBuf + s32Mic, 2);
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, pu16MicBuf, pu16EchoBuf
 ** Output   : pu16OutBuf
+** Note     : the inputs are only read, the output is written in place and may be ps16MicBuf itself
 **--------------------------------------------------------------------------------*/
-void _AUD_AEC_Run(short *ps16MicBuf, short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload)
+void _AUD_AEC_RunEx(AUD_AEC_HANDLE hAec, const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload)
 {
-    s32 s32NumMic    = _stAecInfo.u32NumMic;
-    s32 s32FrameSize = _stAecInfo.u32FrameSize;
+    PST_AUD_AEC_INST pstInst    = (PST_AUD_AEC_INST)hAec;
+    PST_AUD_AEC_INFO pstAecInfo = &pstInst->stAecInfo;
+    s32 s32NumMic               = pstAecInfo->u32NumMic;
+    s32 s32FrameSize            = pstAecInfo->u32FrameSize;
     s32 i;
 
-    if (_stAecInfo.u32SpkrMixIn) {
-        s16 *s16Src = ps16SpeakerBuf, *s16Des = ps16SpeakerBuf;
+    if (pstAecInfo->u32SpkrMixIn) {
+        const s16 *s16Src = ps16SpeakerBuf;
+        s16 *s16Des       = pstInst->ps16MixBuf;
         for (i = 0; i < (s32FrameSize >> 1); i++) {
             *s16Des = ((*s16Src) >> 1) + ((*(s16Src + 1)) >> 1);
             s16Src += 2;
@@ -151,66 +438,124 @@ void _AUD_AEC_Run(short *ps16MicBuf, short *ps16SpeakerBuf, short *ps16OutBuf, s
             s16Src += 2;
             s16Des++;
         }
+        ps16SpeakerBuf = pstInst->ps16MixBuf;
     }
+    if (pstInst->pstDelay)
+        ps16SpeakerBuf = speex_echo_delay_align((SpeexEchoDelay *)pstInst->pstDelay, ps16MicBuf, s32NumMic, ps16SpeakerBuf);
 
-    if ((_stAecInfo.u32SpkrDualMono) && (_stAecInfo.u32NumSpeaker == 2)) {
-        memcpy(_g_tmp_buf, ps16MicBuf, s32FrameSize * 4);
-        for (i = 0; i < (s32FrameSize); i++) {
-            ps16MicBuf[i]                = _g_tmp_buf[i * 2];
-            ps16MicBuf[s32FrameSize + i] = _g_tmp_buf[i * 2 + 1];
-        }
-        memcpy(_g_tmp_buf, ps16SpeakerBuf, s32FrameSize * 4);
-        for (i = 0; i < (s32FrameSize); i++) {
-            ps16SpeakerBuf[i]                = _g_tmp_buf[i * 2];
-            ps16SpeakerBuf[s32FrameSize + i] = _g_tmp_buf[i * 2 + 1];
-        }
-        for (i = 0; i < 2; i++) {
-            speex_echo_cancellation(_ppstEchoState[i], &ps16MicBuf[i * s32FrameSize], &ps16SpeakerBuf[i * s32FrameSize], &_ps16AecOutBuf[i * s32FrameSize]);
-        }
-        memcpy(_g_tmp_buf, _ps16AecOutBuf, s32FrameSize * 4);
-
-        for (i = 0; i < (s32FrameSize); i++) {
-            _ps16AecOutBuf[2 * i]     = _g_tmp_buf[i];
-            _ps16AecOutBuf[i * 2 + 1] = _g_tmp_buf[s32FrameSize + i];
+    if ((pstAecInfo->u32SpkrDualMono) && (pstAecInfo->u32NumSpeaker == 2)) {
+        ST_AUD_AEC_DUAL_MONO_TASK stTask = {pstInst, ps16MicBuf, ps16SpeakerBuf, ps16OutBuf};
+        if (pstInst->pstPool) {
+            pstInst->pstPool->pfRun(pstInst->pstPool->pCtx, _AUD_AEC_DualMonoTask, &stTask, 2);
+        } else {
+            for (i = 0; i < 2; i++)
+                _AUD_AEC_DualMonoTask(&stTask, i);
         }
-
     } else {
-        speex_echo_cancellation(_pstEchoState, ps16MicBuf, ps16SpeakerBuf, _ps16AecOutBuf);
-    }
-    if (s16DisNoiseSuppr == 0) {
-        for (i = 0; i < s32NumMic; i++)
-            speex_preprocess_run(_ppstPreProcState[i], _ps16AecOutBuf);
+        speex_echo_cancellation(pstInst->pstEchoState, ps16MicBuf, ps16SpeakerBuf, ps16OutBuf);
     }
-
-    memcpy(ps16OutBuf, _ps16AecOutBuf, (s32NumMic * s32FrameSize) << 1);
+    // The echo cancelled mics are interleaved, each preprocess state takes its own
+    if (s16DisNoiseSuppr == 0)
+        speex_preprocess_run_mc((SpeexPreprocessState **)pstInst->ppstPreProcState, s32NumMic, ps16OutBuf, 1, s32NumMic, pstInst->pstPool);
 }
 
 /*-------------------------------------------------------------------------------
-** Input    : enParamsCMD,  u32ParamsValue
+** Input    : hAec, enParamsCMD,  u32ParamsValue
 ** Output   : EN_AUD_AEC_ERR
 **--------------------------------------------------------------------------------*/
-EN_AUD_AEC_ERR _AUD_AEC_SetParam(EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue)
+EN_AUD_AEC_ERR _AUD_AEC_SetParamEx(AUD_AEC_HANDLE hAec, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue)
 {
     u32 ret                     = 0;
-    PST_AUD_AEC_INFO pstAecInfo = &_stAecInfo;
+    PST_AUD_AEC_INST pstInst    = (PST_AUD_AEC_INST)hAec;
+    PST_AUD_AEC_INFO pstAecInfo = &pstInst->stAecInfo;
     u32 u32NumMic               = pstAecInfo->u32NumMic;
     int i;
+    if (enParamsCMD == EN_AUD_AEC_THREAD_POOL) {
+        /* Dual mono spreads its two mono states over the pool itself, the multi-mic state its mics */
+        pstInst->pstPool = (PST_AUD_POOL)pParamsValue;
+        if (!pstAecInfo->u32SpkrDualMono)
+            speex_echo_ctl(pstInst->pstEchoState, SPEEX_ECHO_SET_THREAD_POOL, pParamsValue);
+        return EN_AUD_AEC_ENOERR;
+    }
     if ((s32)enParamsCMD < (s32)EN_AUD_AEC_ECHO_END) {
-        if (_stAecInfo.u32SpkrDualMono) {
+        if (pstAecInfo->u32SpkrDualMono) {
             for (i = 0; i < u32NumMic; i++) {
-                ret = _Aec_SetEchoParams(_ppstEchoState[i], enParamsCMD, pParamsValue);
+                ret = _Aec_SetEchoParams(pstInst->ppstEchoState[i], enParamsCMD, pParamsValue);
             }
         } else {
-            ret = _Aec_SetEchoParams(_pstEchoState, enParamsCMD, pParamsValue);
+            ret = _Aec_SetEchoParams(pstInst->pstEchoState, enParamsCMD, pParamsValue);
         }
     } else
-        ret = _Aec_SetPreProcParams(_ppstPreProcState, enParamsCMD, pParamsValue);
+        ret = _Aec_SetPreProcParams(pstInst->ppstPreProcState, enParamsCMD, pParamsValue, u32NumMic);
 
     if (ret != 0)
         return EN_AUD_AEC_EINVALCMD;
     return EN_AUD_AEC_ENOERR;
 }
 
+/*-------------------------------------------------------------------------------
+** Input    : hAec
+** Output   :
+**--------------------------------------------------------------------------------*/
+void _AUD_AEC_Destroy(AUD_AEC_HANDLE hAec)
+{
+    PST_AUD_AEC_INST pstInst = (PST_AUD_AEC_INST)hAec;
+    u32 u32NumMic;
+    u32 i;
+
+    if (pstInst == NULL)
+        return;
+
+    u32NumMic = pstInst->stAecInfo.u32NumMic;
+    for (i = 0; i < u32NumMic; i++) {
+        if (pstInst->ppstPreProcState[i])
+            speex_preprocess_state_destroy(pstInst->ppstPreProcState[i]);
+    }
+    if (pstInst->stAecInfo.u32SpkrDualMono) {
+        for (i = 0; i < u32NumMic; i++) {
+            if (pstInst->ppstEchoState[i])
+                speex_echo_state_destroy(pstInst->ppstEchoState[i]);
+        }
+    } else if (pstInst->pstEchoState) {
+        speex_echo_state_destroy(pstInst->pstEchoState);
+    }
+    if (pstInst->pstDelay)
+        speex_echo_delay_destroy((SpeexEchoDelay *)pstInst->pstDelay);
+    memset(pstInst, 0, sizeof(ST_AUD_AEC_INST));
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : pInternalBuf, u32BufSize
+** Output   : EN_AUD_AEC_ERR
+**--------------------------------------------------------------------------------*/
+EN_AUD_AEC_ERR _AUD_AEC_Init(void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload)
+{
+    _pAecDefaultBuf = pInternalBuf;
+    _hAecDefault    = _AUD_AEC_Create(&_stAecInfo, pInternalBuf, u32BufSize, pstAecPreload);
+    if (_hAecDefault == NULL)
+        return EN_AUD_AEC_EINITFAIL;
+
+    return EN_AUD_AEC_ENOERR;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : pu16MicBuf, pu16EchoBuf
+** Output   : pu16OutBuf
+**--------------------------------------------------------------------------------*/
+void _AUD_AEC_Run(const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload)
+{
+    _AUD_AEC_RunEx(_hAecDefault, ps16MicBuf, ps16SpeakerBuf, ps16OutBuf, s16DisNoiseSuppr, pstAecPreload);
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : enParamsCMD,  u32ParamsValue
+** Output   : EN_AUD_AEC_ERR
+**--------------------------------------------------------------------------------*/
+EN_AUD_AEC_ERR _AUD_AEC_SetParam(EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue)
+{
+    return _AUD_AEC_SetParamEx(_hAecDefault, enParamsCMD, pParamsValue);
+}
+
 /*-------------------------------------------------------------------------------
 ** Input    :
 ** Output   : version
@@ -226,5 +571,12 @@ int AUD_AEC_GetVersion(void)
 **--------------------------------------------------------------------------------*/
 EN_AUD_AEC_ERR _AUD_AEC_Uninit(void)
 {
-    return AUD_Malloc_Uninit();
+    _AUD_AEC_Destroy(_hAecDefault);
+    _hAecDefault = NULL;
+    if (_pAecDefaultBuf) {
+        free(_pAecDefaultBuf);
+        _pAecDefaultBuf = NULL;
+        return TRUE;
+    }
+    return FALSE;
 }
\ No newline at end of file
@@ -15,24 +15,67 @@
 #endif
 
 #include "agc.h"
+#include "aud_mem.h"
 #include "speex_echo.h"
 #include "speex_preprocess.h"
 
 /*-----------------------------------------------------------------------------*/
 /* Extern Global Variables                                                     */
 /*-----------------------------------------------------------------------------*/
-extern u32 _Agc_GetInternalBufSize(PST_AUD_AGC_INFO pstAgcInfo, u32 u32NumPreProc);
 extern u32 _Agc_SetPreProcParams(void **ppstPreProcState, EN_AUD_AGC_PARAMS enParamsCMD, void *pParamsValue, s32 s32ChannelNum);
 
-extern void AUD_Malloc_Init(void *ptr, u32 u32TotalLen);
-extern int AUD_Malloc_Uninit(void);
-extern void *(*AUD_calloc)(s32 s32num, s32 s32size);
 
 /*-----------------------------------------------------------------------------*/
 /* Local Global Variables                                                      */
 /*-----------------------------------------------------------------------------*/
 static void **_ppstPreProcState;
+static ST_AUD_MEM_ARENA _stAgcArena;
 static ST_AUD_AGC_INFO _stAgcInfo;
+static PST_AUD_POOL _pstAgcPool;  // EN_AUD_AGC_THREAD_POOL
+static s32 _s32AgcInterleaved;  // EN_AUD_AGC_INTERLEAVED
+
+/*-------------------------------------------------------------------------------
+** Input    : pstArena, pstAgcInfo
+** Output   : preprocess state array carved from pstArena, NULL if fail
+**--------------------------------------------------------------------------------*/
+static void **_AUD_AGC_Build(PST_AUD_MEM_ARENA pstArena, PST_AUD_AGC_INFO pstAgcInfo, u32 *pu32StateSize)
+{
+    u32 u32FrameSize    = (u32)pstAgcInfo->s32FrameSize;
+    u32 u32ChannelNum   = (u32)pstAgcInfo->s32ChannelNum;
+    u32 u32SamplingRate = (u32)pstAgcInfo->s32SamplingRate;
+    u32 u32Mark;
+    void **ppstPreProcState;
+    u32 i;
+
+    ppstPreProcState = (void **)AUD_Arena_Calloc(pstArena, u32ChannelNum, sizeof(void *));
+    if (!ppstPreProcState)
+        return NULL;
+
+    for (i = 0; i < u32ChannelNum; i++) {
+        u32Mark             = AUD_Arena_GetUsedSize(pstArena);
+        ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate, pstArena);
+        if (!ppstPreProcState[i])
+            return NULL;
+        if (pu32StateSize)
+            *pu32StateSize = AUD_Arena_GetUsedSize(pstArena) - u32Mark;
+    }
+
+    return ppstPreProcState;
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : ppstPreProcState of _AUD_AGC_Build, s32ChannelNum
+** Note     : the memory stays with the arena, this only drops the references to the shared tables
+**--------------------------------------------------------------------------------*/
+static void _AUD_AGC_Release(void **ppstPreProcState, s32 s32ChannelNum)
+{
+    s32 i;
+
+    for (i = 0; i < s32ChannelNum; i++) {
+        if (ppstPreProcState[i])
+            speex_preprocess_state_destroy((SpeexPreprocessState *)ppstPreProcState[i]);
+    }
+}
 
 /*-------------------------------------------------------------------------------
 ** Input    : pstAgcInfo
@@ -41,29 +84,37 @@ static ST_AUD_AGC_INFO _stAgcInfo;
 void AUD_AGC_PreInit(PST_AUD_AGC_INFO pstAgcInfo, PST_AUD_AGC_RTN pstAgcRtn)
 {
     PST_AUD_AGC_INFO pstAgcInfoSave = &_stAgcInfo;
-    u32 u32BytePerSample            = 2;
+    ST_AUD_MEM_ARENA stArena, stScratch;
+    void **ppstPreProcState;
+    u32 u32StateSize     = 0;
+    u32 u32BytePerSample = 2;
 
     memcpy(pstAgcInfoSave, pstAgcInfo, sizeof(ST_AUD_AGC_INFO));
 
-    pstAgcRtn->u32InBufSize       = pstAgcInfoSave->s32ChannelNum * pstAgcInfoSave->s32FrameSize * u32BytePerSample;
-    pstAgcRtn->u32OutBufSize      = pstAgcRtn->u32InBufSize;
-    pstAgcRtn->u32InternalBufSize = _Agc_GetInternalBufSize(pstAgcInfoSave, pstAgcInfoSave->s32ChannelNum);
-#ifndef FIXED_POINT
-    pstAgcRtn->u32InternalBufSize *= 2;
-#endif
+    pstAgcRtn->u32InBufSize  = pstAgcInfoSave->s32ChannelNum * pstAgcInfoSave->s32FrameSize * u32BytePerSample;
+    pstAgcRtn->u32OutBufSize = pstAgcRtn->u32InBufSize;
+
+    // Dry run of the real init code, the arenas tally what the state and scratch buffers must hold
+    AUD_Arena_InitCounter(&stArena);
+    AUD_Arena_InitCounter(&stScratch);
+    stArena.pstScratch     = &stScratch;
+    stArena.u32ShareTables = pstAgcInfoSave->s32ShareTables != 0;
+    ppstPreProcState       = _AUD_AGC_Build(&stArena, pstAgcInfoSave, &u32StateSize);
+    if (ppstPreProcState)
+        _AUD_AGC_Release(ppstPreProcState, pstAgcInfoSave->s32ChannelNum);
+    pstAgcRtn->u32StateBufSize        = AUD_Arena_UninitCounter(&stArena);
+    pstAgcRtn->u32ScratchBufSize      = AUD_Arena_UninitCounter(&stScratch);
+    pstAgcRtn->u32InternalBufSize     = pstAgcRtn->u32StateBufSize + pstAgcRtn->u32ScratchBufSize - (AUD_MEM_ALIGN - 1);
+    pstAgcRtn->u32PreProcStateBufSize = u32StateSize;
 }
 
 /*-------------------------------------------------------------------------------
-** Input    : pInternalBuf, u32BufSize
+** Input    : pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
 ** Output   : EN_AUD_AGC_ERR
 **--------------------------------------------------------------------------------*/
-EN_AUD_AGC_ERR _AUD_AGC_Init(void *pInternalBuf, int u32BufSize)
+EN_AUD_AGC_ERR _AUD_AGC_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize)
 {
-    PST_AUD_AGC_INFO pstAgcInfo = &_stAgcInfo;
-    u32 u32FrameSize           = (u32)pstAgcInfo->s32FrameSize;
-    u32 u32ChannelNum          = (u32)pstAgcInfo->s32ChannelNum;
-    u32 u32SamplingRate        = (u32)pstAgcInfo->s32SamplingRate;
-    u32 i;
+    ST_AUD_MEM_ARENA stScratch;
 
 #ifdef _MIPS_
     {
@@ -80,32 +131,48 @@ EN_AUD_AGC_ERR _AUD_AGC_Init(void *pInternalBuf, int u32BufSize)
     if (pInternalBuf == 0)
         return EN_AUD_AGC_EINITFAIL;
 
-    AUD_Malloc_Init(pInternalBuf, u32BufSize * 2);
-    _ppstPreProcState = (void **)AUD_calloc(u32ChannelNum, sizeof(void *));
-
-    for (i = 0; i < u32ChannelNum; i++) {
-        _ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate);
-        if (!_ppstPreProcState[i])
-            return EN_AUD_AGC_EINITFAIL;
+    AUD_Arena_Init(&_stAgcArena, pInternalBuf, u32BufSize);
+    _stAgcArena.u32ShareTables = _stAgcInfo.s32ShareTables != 0;
+    if (pScratchBuf) {
+        AUD_Arena_Init(&stScratch, pScratchBuf, u32ScratchBufSize);
+        _stAgcArena.pstScratch = &stScratch;
     }
+    _ppstPreProcState      = _AUD_AGC_Build(&_stAgcArena, &_stAgcInfo, NULL);
+    _stAgcArena.pstScratch = NULL;
+    _pstAgcPool            = NULL;
+    _s32AgcInterleaved     = 0;
+    if (!_ppstPreProcState)
+        return EN_AUD_AGC_EINITFAIL;
 
     return EN_AUD_AGC_ENOERR;
 }
 
+/*-------------------------------------------------------------------------------
+** Input    : pInternalBuf, u32BufSize
+** Output   : EN_AUD_AGC_ERR
+**--------------------------------------------------------------------------------*/
+EN_AUD_AGC_ERR _AUD_AGC_Init(void *pInternalBuf, int u32BufSize)
+{
+    return _AUD_AGC_InitEx(pInternalBuf, u32BufSize, NULL, 0);
+}
+
 /*-------------------------------------------------------------------------------
 ** Input        : ps16InBuf
 ** Output   : pu16OutBuf
 **--------------------------------------------------------------------------------*/
 void _AUD_AGC_Run(short *ps16InBuf, short *ps16OutBuf)
 {
-    s32 s32NumCH = _stAgcInfo.s32ChannelNum;
-    s32 i;
-
-    for (i = 0; i < s32NumCH; i++)
-        speex_preprocess_run(_ppstPreProcState[i], ps16InBuf);
+    s32 s32NumCH     = _stAgcInfo.s32ChannelNum;
+    s32 s32FrameSize = _stAgcInfo.s32FrameSize;
 
+    // Processed in place in the output, the input is left as it was
     if (((uintptr_t)ps16InBuf) != ((uintptr_t)ps16OutBuf))
-        memcpy(ps16OutBuf, ps16InBuf, s32NumCH * _stAgcInfo.s32FrameSize * sizeof(short));
+        memcpy(ps16OutBuf, ps16InBuf, s32NumCH * s32FrameSize * sizeof(short));
+
+    if (_s32AgcInterleaved)
+        speex_preprocess_run_mc((SpeexPreprocessState **)_ppstPreProcState, s32NumCH, ps16OutBuf, 1, s32NumCH, _pstAgcPool);
+    else
+        speex_preprocess_run_mc((SpeexPreprocessState **)_ppstPreProcState, s32NumCH, ps16OutBuf, s32FrameSize, 1, _pstAgcPool);
 }
 
 /*-------------------------------------------------------------------------------
@@ -117,6 +184,14 @@ EN_AUD_AGC_ERR _AUD_AGC_SetParam(EN_AUD_AGC_PARAMS enParamsCMD, void *pParamsVal
     s32 s32NumCH = _stAgcInfo.s32ChannelNum;
     u32 ret;
 
+    if (enParamsCMD == EN_AUD_AGC_THREAD_POOL) {
+        _pstAgcPool = (PST_AUD_POOL)pParamsValue;
+        return EN_AUD_AGC_ENOERR;
+    }
+    if (enParamsCMD == EN_AUD_AGC_INTERLEAVED) {
+        _s32AgcInterleaved = *((s32 *)pParamsValue);
+        return EN_AUD_AGC_ENOERR;
+    }
     ret = _Agc_SetPreProcParams(_ppstPreProcState, enParamsCMD, pParamsValue, s32NumCH);
 
     if (ret != 0)
@@ -130,7 +205,11 @@ EN_AUD_AGC_ERR _AUD_AGC_SetParam(EN_AUD_AGC_PARAMS enParamsCMD, void *pParamsVal
 **--------------------------------------------------------------------------------*/
 EN_AUD_AGC_ERR _AUD_AGC_Uninit(void)
 {
-    return AUD_Malloc_Uninit();
+    if (_ppstPreProcState) {
+        _AUD_AGC_Release(_ppstPreProcState, _stAgcInfo.s32ChannelNum);
+        _ppstPreProcState = NULL;
+    }
+    return AUD_Arena_Uninit(&_stAgcArena);
 }
 
 /*-------------------------------------------------------------------------------
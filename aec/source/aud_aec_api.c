@@ -21,8 +21,18 @@
 
 EN_AUD_AEC_ERR _AUD_AEC_Init(void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
 EN_AUD_AEC_ERR _AUD_AEC_Uninit(void);
-void _AUD_AEC_Run(short *ps16MicBuf, short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
+void _AUD_AEC_Run(const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
 EN_AUD_AEC_ERR _AUD_AEC_SetParam(EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
+void _AUD_AEC_GetBufSize(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn);
+AUD_AEC_HANDLE _AUD_AEC_Create(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
+AUD_AEC_HANDLE _AUD_AEC_CreateEx(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize, PST_AUD_AEC_PRELOAD pstAecPreload);
+void _AUD_AEC_RunEx(AUD_AEC_HANDLE hAec, const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload);
+EN_AUD_AEC_ERR _AUD_AEC_SetParamEx(AUD_AEC_HANDLE hAec, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue);
+void _AUD_AEC_Destroy(AUD_AEC_HANDLE hAec);
+AUD_AEC_HANDLE _AUD_AEC_Clone(AUD_AEC_HANDLE hTemplate, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
+int _AUD_AEC_GetStateSize(AUD_AEC_HANDLE hAec);
+EN_AUD_AEC_ERR _AUD_AEC_SaveState(AUD_AEC_HANDLE hAec, void *pBuf, int u32BufSize);
+EN_AUD_AEC_ERR _AUD_AEC_LoadState(AUD_AEC_HANDLE hAec, const void *pBuf, int u32BufSize);
 
 /*-----------------------------------------------------------------------------*/
 /* Interface Functions                                                         */
@@ -47,7 +57,7 @@ int AUD_AEC_Init(void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecP
 ** Input    : pu16MicBuf, pu16EchoBuf
 ** Output   : pu16OutBuf
 **--------------------------------------------------------------------------------*/
-void AUD_AEC_Run(short *ps16MicBuf, short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload)
+void AUD_AEC_Run(const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload)
 {
     _AUD_AEC_Run(ps16MicBuf, ps16SpeakerBuf, ps16OutBuf, s16DisNoiseSuppr, pstAecPreload);
 }
@@ -72,4 +82,122 @@ int AUD_AEC_SetParam(EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue)
 int AUD_AEC_Uninit(void)
 {
     return _AUD_AEC_Uninit();
-}
\ No newline at end of file
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : pstAecInfo
+** Output   : pstAecRtn
+**--------------------------------------------------------------------------------*/
+void AUD_AEC_GetBufSize(PST_AUD_AEC_INFO pstAecInfo, PST_AUD_AEC_RTN pstAecRtn)
+{
+    _AUD_AEC_GetBufSize(pstAecInfo, pstAecRtn);
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : pstAecInfo, pInternalBuf, u32BufSize
+** Output   : handle, NULL if fail
+**--------------------------------------------------------------------------------*/
+AUD_AEC_HANDLE AUD_AEC_Create(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, PST_AUD_AEC_PRELOAD pstAecPreload)
+{
+    AUD_AEC_HANDLE hAec;
+    hAec = _AUD_AEC_Create(pstAecInfo, pInternalBuf, u32BufSize, pstAecPreload);
+    if (hAec == NULL)
+        printf("AUD_AEC_Create fail...\n");
+    return hAec;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : pstAecInfo, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
+** Output   : handle, NULL if fail
+**--------------------------------------------------------------------------------*/
+AUD_AEC_HANDLE AUD_AEC_CreateEx(PST_AUD_AEC_INFO pstAecInfo, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize, PST_AUD_AEC_PRELOAD pstAecPreload)
+{
+    AUD_AEC_HANDLE hAec;
+    hAec = _AUD_AEC_CreateEx(pstAecInfo, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize, pstAecPreload);
+    if (hAec == NULL)
+        printf("AUD_AEC_CreateEx fail...\n");
+    return hAec;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hTemplate, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
+** Output   : handle, NULL if fail
+**--------------------------------------------------------------------------------*/
+AUD_AEC_HANDLE AUD_AEC_Clone(AUD_AEC_HANDLE hTemplate, void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize)
+{
+    AUD_AEC_HANDLE hAec;
+    hAec = _AUD_AEC_Clone(hTemplate, pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize);
+    if (hAec == NULL)
+        printf("AUD_AEC_Clone fail...\n");
+    return hAec;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, pu16MicBuf, pu16EchoBuf
+** Output   : pu16OutBuf
+**--------------------------------------------------------------------------------*/
+void AUD_AEC_RunEx(AUD_AEC_HANDLE hAec, const short *ps16MicBuf, const short *ps16SpeakerBuf, short *ps16OutBuf, short s16DisNoiseSuppr, PST_AUD_AEC_PRELOAD pstAecPreload)
+{
+    _AUD_AEC_RunEx(hAec, ps16MicBuf, ps16SpeakerBuf, ps16OutBuf, s16DisNoiseSuppr, pstAecPreload);
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, enParamsCMD,  u32ParamsValue
+** Output   : err
+**--------------------------------------------------------------------------------*/
+int AUD_AEC_SetParamEx(AUD_AEC_HANDLE hAec, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue)
+{
+    int err;
+    err = _AUD_AEC_SetParamEx(hAec, enParamsCMD, pParamsValue);
+    if (err != EN_AUD_AEC_ENOERR)
+        return FALSE;
+    else
+        return TRUE;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec
+**--------------------------------------------------------------------------------*/
+void AUD_AEC_Destroy(AUD_AEC_HANDLE hAec)
+{
+    _AUD_AEC_Destroy(hAec);
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec
+** Output   : snapshot size in bytes
+**--------------------------------------------------------------------------------*/
+int AUD_AEC_GetStateSize(AUD_AEC_HANDLE hAec)
+{
+    return _AUD_AEC_GetStateSize(hAec);
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, u32BufSize
+** Output   : pBuf, err
+**--------------------------------------------------------------------------------*/
+int AUD_AEC_SaveState(AUD_AEC_HANDLE hAec, void *pBuf, int u32BufSize)
+{
+    EN_AUD_AEC_ERR err;
+    err = _AUD_AEC_SaveState(hAec, pBuf, u32BufSize);
+    if (err != EN_AUD_AEC_ENOERR) {
+        printf("AUD_AEC_SaveState fail(%d)...\n", err);
+        return FALSE;
+    } else
+        return TRUE;
+}
+
+/*-------------------------------------------------------------------------------
+** Input    : hAec, pBuf, u32BufSize
+** Output   : err
+**--------------------------------------------------------------------------------*/
+int AUD_AEC_LoadState(AUD_AEC_HANDLE hAec, const void *pBuf, int u32BufSize)
+{
+    EN_AUD_AEC_ERR err;
+    err = _AUD_AEC_LoadState(hAec, pBuf, u32BufSize);
+    if (err != EN_AUD_AEC_ENOERR) {
+        printf("AUD_AEC_LoadState fail(%d)...\n", err);
+        return FALSE;
+    } else
+        return TRUE;
+}
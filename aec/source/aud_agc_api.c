@@ -16,6 +16,7 @@
 #define FALSE 0
 
 EN_AUD_AGC_ERR _AUD_AGC_Init(void *pInternalBuf, int u32BufSize);
+EN_AUD_AGC_ERR _AUD_AGC_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
 EN_AUD_AGC_ERR _AUD_AGC_Uninit(void);
 void _AUD_AGC_Run(short *ps16InBuf, short *ps16OutBuf);
 EN_AUD_AGC_ERR _AUD_AGC_SetParam(EN_AUD_AGC_PARAMS enParamsCMD, void *pParamsValue);
@@ -38,6 +39,20 @@ int AUD_AGC_Init(void *pInternalBuf, int u32BufSize)
         return TRUE;
 }
 
+/*-------------------------------------------------------------------------------
+** Input    : pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
+** Output   : err
+**--------------------------------------------------------------------------------*/
+int AUD_AGC_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize)
+{
+    EN_AUD_AGC_ERR err;
+    err = _AUD_AGC_InitEx(pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize);
+    if (err != EN_AUD_AGC_ENOERR)
+        return FALSE;
+    else
+        return TRUE;
+}
+
 /*-------------------------------------------------------------------------------
 ** Input    :
 ** Output   : err
@@ -3,65 +3,71 @@
 #include <string.h>
 #include "aud_mem.h"
 
-void *(*AUD_malloc)(s32 s32size);
-void *(*AUD_calloc)(s32 s32num, s32 s32size);
-void *(*AUD_realloc)(void *ptr, s32 s32size);
-void (*AUD_free)(void *ptr);
-
-typedef enum _EN_AUD_MEMORY_ALLOC_STATUS {
-    EN_AUD_MEMORY_ALLOC_STATUS_NORMAL,
-    EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN,
-    EN_AUD_MEMORY_ALLOC_STATUS_TOTAL
-} EN_AUD_MEMORY_ALLOC_STATUS;
-
-typedef struct _ST_AUD_MEMORY_ALLOC {
-    u8 *pu8StartAddress;
-    u32 u32TotalLen;
-    u32 u32UsedLen;
-    EN_AUD_MEMORY_ALLOC_STATUS enMEMAllocStatus;
-    u32 u32Counter;
-} ST_AUD_MEMORY_ALLOC, *PST_AUD_MEMORY_ALLOC;
-
-static ST_AUD_MEMORY_ALLOC _astMemAlloc[1];
-static void *_pMemInitAddr;
+/*Heap block used by the counting arena, the payload follows the header*/
+typedef struct _ST_AUD_MEM_COUNT_BLOCK {
+    struct _ST_AUD_MEM_COUNT_BLOCK *pstNext;
+    u32 u32Size;
+} ST_AUD_MEM_COUNT_BLOCK, *PST_AUD_MEM_COUNT_BLOCK;
+
+#define AUD_MEM_COUNT_HDR_SIZE ((sizeof(ST_AUD_MEM_COUNT_BLOCK) + 15) & ~15)
 
 //==========================================================================================
 // memory allocate
 //==========================================================================================
-void *_AUD_Malloc(s32 s32SizeOrg)
+void *AUD_Arena_Malloc(PST_AUD_MEM_ARENA pstArena, s32 s32SizeOrg)
 {
-    PST_AUD_MEMORY_ALLOC pstMemAlloc = &_astMemAlloc[0];
-    u8 *pu8StartAddr                 = pstMemAlloc->pu8StartAddress + pstMemAlloc->u32UsedLen;
-    s32 s32Size;
+    u8 *pu8StartAddr;
+    u32 u32Size;
+
+    if (pstArena == NULL)
+        return malloc(s32SizeOrg);
+
+    if (pstArena->enMode == EN_AUD_MEMORY_ALLOC_MODE_COUNT) {
+        PST_AUD_MEM_COUNT_BLOCK pstBlock = (PST_AUD_MEM_COUNT_BLOCK)calloc(1, AUD_MEM_COUNT_HDR_SIZE + s32SizeOrg);
+        if (pstBlock == NULL)
+            return (NULL);
+        pstBlock->pstNext      = (PST_AUD_MEM_COUNT_BLOCK)pstArena->pBaseAddress;
+        pstBlock->u32Size      = s32SizeOrg;
+        pstArena->pBaseAddress = pstBlock;
+        pstArena->u32UsedLen += AUD_MEM_ALIGN_SIZE((u32)s32SizeOrg);
+        pstArena->u32Counter++;
+        return ((u8 *)pstBlock + AUD_MEM_COUNT_HDR_SIZE);
+    }
 
-    if (pstMemAlloc->enMEMAllocStatus == EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN) {
+    if (pstArena->enMEMAllocStatus == EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN) {
         return (NULL);
     }
 
-    s32Size = (s32SizeOrg + 3) & 0xfffffffc;
-    s32Size += pstMemAlloc->u32UsedLen;
+    pu8StartAddr = pstArena->pu8StartAddress + pstArena->u32UsedLen;
+    u32Size      = AUD_MEM_ALIGN_SIZE((u32)s32SizeOrg);
+    u32Size += pstArena->u32UsedLen;
 
-    if ((u32)s32Size > pstMemAlloc->u32TotalLen) {
-        pstMemAlloc->enMEMAllocStatus = EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN;
+    if (u32Size > pstArena->u32TotalLen) {
+        pstArena->enMEMAllocStatus = EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN;
     }
 
-    if (pstMemAlloc->enMEMAllocStatus == EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN) {
-        printf("\n[AUD] Error !!! (_AUD_Malloc) over max length\n");
+    if (pstArena->enMEMAllocStatus == EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN) {
+        printf("\n[AUD] Error !!! (AUD_Arena_Malloc) over max length\n");
         return (NULL);
     }
 
-    pstMemAlloc->u32UsedLen = s32Size;
-    pstMemAlloc->u32Counter++;
+    pstArena->u32UsedLen = u32Size;
+    pstArena->u32Counter++;
 
-    // printf("[AUD](%d) MemAlloc size: %d, addr: 0x%x, total: %d\n",pstMemAlloc->u32Counter, s32SizeOrg, (intptr_t)pu8StartAddr, s32Size);
+    // printf("[AUD](%d) MemAlloc size: %d, addr: 0x%x, total: %d\n",pstArena->u32Counter, s32SizeOrg, (intptr_t)pu8StartAddr, u32Size);
 
     return (pu8StartAddr);
 }
 
 //-------------------------------------------------------------------------------------
-void *_AUD_Calloc(s32 s32num, s32 s32size)
+void *AUD_Arena_Calloc(PST_AUD_MEM_ARENA pstArena, s32 s32num, s32 s32size)
 {
-    void *pstart = _AUD_Malloc(s32num * s32size);
+    void *pstart;
+
+    if (pstArena == NULL)
+        return calloc(s32num, s32size);
+
+    pstart = AUD_Arena_Malloc(pstArena, s32num * s32size);
     if (pstart != NULL) {
         memset(pstart, 0, s32num * s32size);
     }
@@ -70,49 +76,106 @@ void *_AUD_Calloc(s32 s32num, s32 s32size)
 }
 
 //-------------------------------------------------------------------------------------
-void *_AUD_Realloc(void *ptr, s32 s32Size)
+// Block only needed inside one process call. Taken from the scratch arena when one is
+// attached, its content is then shared with every other instance using that arena.
+//-------------------------------------------------------------------------------------
+void *AUD_Arena_CallocScratch(PST_AUD_MEM_ARENA pstArena, s32 s32num, s32 s32size)
+{
+    if (pstArena != NULL && pstArena->pstScratch != NULL)
+        return AUD_Arena_Calloc(pstArena->pstScratch, s32num, s32size);
+
+    return AUD_Arena_Calloc(pstArena, s32num, s32size);
+}
+
+//-------------------------------------------------------------------------------------
+void *AUD_Arena_Realloc(PST_AUD_MEM_ARENA pstArena, void *ptr, s32 s32Size)
 {
-    void *pviodDes = _AUD_Malloc(s32Size);
+    void *pviodDes;
+
+    if (pstArena == NULL)
+        return realloc(ptr, s32Size);
+
+    pviodDes = AUD_Arena_Malloc(pstArena, s32Size);
     if (ptr != NULL && pviodDes != NULL) {
-        memcpy(pviodDes, ptr, s32Size);
+        u32 u32CopyLen = s32Size;
+        if (pstArena->enMode == EN_AUD_MEMORY_ALLOC_MODE_COUNT) {
+            PST_AUD_MEM_COUNT_BLOCK pstOld = (PST_AUD_MEM_COUNT_BLOCK)((u8 *)ptr - AUD_MEM_COUNT_HDR_SIZE);
+            if (pstOld->u32Size < u32CopyLen)
+                u32CopyLen = pstOld->u32Size;
+        }
+        memcpy(pviodDes, ptr, u32CopyLen);
     }
 
     return (pviodDes);
 }
 
 //-------------------------------------------------------------------------------------
-void _AUD_Free(void *ptr)
+void AUD_Arena_Free(PST_AUD_MEM_ARENA pstArena, void *ptr)
 {
-    return;
+    // Arena memory is released as a whole by the owner of the buffer
+    if (pstArena == NULL)
+        free(ptr);
 }
 //--------------------------------------------------------------------------------------
-void AUD_Malloc_Init(void *ptr, u32 u32TotalLen)
+void AUD_Arena_Init(PST_AUD_MEM_ARENA pstArena, void *ptr, u32 u32TotalLen)
 {
-    PST_AUD_MEMORY_ALLOC pstMemAlloc = &_astMemAlloc[0];
-
-    _pMemInitAddr = ptr;
-
-    pstMemAlloc->pu8StartAddress = (u8 *)ptr;
-
-    pstMemAlloc->u32TotalLen      = u32TotalLen;
-    pstMemAlloc->u32UsedLen       = 0;
-    pstMemAlloc->enMEMAllocStatus = EN_AUD_MEMORY_ALLOC_STATUS_NORMAL;
-    pstMemAlloc->u32Counter       = 0;
-
-    AUD_malloc  = _AUD_Malloc;
-    AUD_realloc = _AUD_Realloc;
-    AUD_calloc  = _AUD_Calloc;
-    AUD_free    = _AUD_Free;
+    u32 u32Pad = (u32)(AUD_MEM_ALIGN_SIZE((uintptr_t)ptr) - (uintptr_t)ptr);
+
+    pstArena->enMode          = EN_AUD_MEMORY_ALLOC_MODE_BUFFER;
+    pstArena->pBaseAddress    = ptr;
+    pstArena->pu8StartAddress = (u8 *)ptr + u32Pad;
+    pstArena->u32TotalLen     = (u32TotalLen > u32Pad) ? (u32TotalLen - u32Pad) : 0;
+
+    pstArena->u32UsedLen       = 0;
+    pstArena->enMEMAllocStatus = EN_AUD_MEMORY_ALLOC_STATUS_NORMAL;
+    pstArena->u32Counter       = 0;
+    pstArena->pstScratch       = NULL;
+    pstArena->u32ShareTables   = 0;
 }
 //--------------------------------------------------------------------------------------
-int AUD_Malloc_Uninit(void)
+int AUD_Arena_Uninit(PST_AUD_MEM_ARENA pstArena)
 {
-    PST_AUD_MEMORY_ALLOC pstMemAlloc = &_astMemAlloc[0];
-    if (pstMemAlloc->pu8StartAddress) {
-        free(pstMemAlloc->pu8StartAddress);
-        pstMemAlloc->pu8StartAddress = NULL;
-        pstMemAlloc->u32TotalLen     = 0;
+    if (pstArena->enMode == EN_AUD_MEMORY_ALLOC_MODE_COUNT) {
+        AUD_Arena_UninitCounter(pstArena);
+        return TRUE;
+    }
+    if (pstArena->pBaseAddress) {
+        free(pstArena->pBaseAddress);
+        pstArena->pBaseAddress    = NULL;
+        pstArena->pu8StartAddress = NULL;
+        pstArena->u32TotalLen     = 0;
         return TRUE;
     }
     return FALSE;
 }
+//--------------------------------------------------------------------------------------
+// Dry run arena: the real init code runs against it and the footprint it would need
+// inside a caller buffer is tallied, including the worst case start alignment.
+//--------------------------------------------------------------------------------------
+void AUD_Arena_InitCounter(PST_AUD_MEM_ARENA pstArena)
+{
+    memset(pstArena, 0, sizeof(ST_AUD_MEM_ARENA));
+    pstArena->enMode           = EN_AUD_MEMORY_ALLOC_MODE_COUNT;
+    pstArena->enMEMAllocStatus = EN_AUD_MEMORY_ALLOC_STATUS_NORMAL;
+}
+//--------------------------------------------------------------------------------------
+u32 AUD_Arena_GetUsedSize(PST_AUD_MEM_ARENA pstArena)
+{
+    return pstArena->u32UsedLen;
+}
+//--------------------------------------------------------------------------------------
+u32 AUD_Arena_UninitCounter(PST_AUD_MEM_ARENA pstArena)
+{
+    PST_AUD_MEM_COUNT_BLOCK pstBlock = (PST_AUD_MEM_COUNT_BLOCK)pstArena->pBaseAddress;
+    u32 u32Need                      = pstArena->u32UsedLen + AUD_MEM_ALIGN - 1;
+
+    while (pstBlock) {
+        PST_AUD_MEM_COUNT_BLOCK pstNext = pstBlock->pstNext;
+        free(pstBlock);
+        pstBlock = pstNext;
+    }
+    pstArena->pBaseAddress = NULL;
+    pstArena->u32UsedLen   = 0;
+
+    return u32Need;
+}
@@ -4,12 +4,46 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-extern void *(*AUD_malloc)(s32 s32size);
-extern void *(*AUD_calloc)(s32 s32num, s32 s32size);
-extern void *(*AUD_realloc)(void *ptr, s32 s32size);
-extern void (*AUD_free)(void *ptr);
+#define AUD_MEM_ALIGN 64  // Cache line, also enough for any SIMD load/store
+#define AUD_MEM_ALIGN_SIZE(x) (((x) + (AUD_MEM_ALIGN - 1)) & ~(AUD_MEM_ALIGN - 1))
 
-void AUD_Malloc_Init(void *ptr, u32 u32TotalLen);
-int AUD_Malloc_Uninit(void);
+typedef enum _EN_AUD_MEMORY_ALLOC_STATUS {
+    EN_AUD_MEMORY_ALLOC_STATUS_NORMAL,
+    EN_AUD_MEMORY_ALLOC_STATUS_OVER_TOTAL_LEN,
+    EN_AUD_MEMORY_ALLOC_STATUS_TOTAL
+} EN_AUD_MEMORY_ALLOC_STATUS;
+
+typedef enum _EN_AUD_MEMORY_ALLOC_MODE {
+    EN_AUD_MEMORY_ALLOC_MODE_BUFFER,  // Carve blocks out of the caller's buffer
+    EN_AUD_MEMORY_ALLOC_MODE_COUNT,   // Dry run, blocks come from the heap and only their arena footprint is tallied
+    EN_AUD_MEMORY_ALLOC_MODE_TOTAL
+} EN_AUD_MEMORY_ALLOC_MODE;
+
+/*Bump allocator over a caller supplied buffer. Every AEC/NS/AGC instance owns one,
+  a NULL arena means the system heap.
+  pstScratch optionally points at a second arena that takes the per-frame scratch
+  blocks, so instances run one after another on the same thread can share it.*/
+typedef struct _ST_AUD_MEM_ARENA {
+    EN_AUD_MEMORY_ALLOC_MODE enMode;
+    void *pBaseAddress;  // Buffer as handed over by the caller, heap block list in count mode
+    u8 *pu8StartAddress; // First AUD_MEM_ALIGN aligned address inside the buffer
+    u32 u32TotalLen;
+    u32 u32UsedLen;
+    EN_AUD_MEMORY_ALLOC_STATUS enMEMAllocStatus;
+    u32 u32Counter;
+    struct _ST_AUD_MEM_ARENA *pstScratch;  // NULL: scratch blocks come from this arena
+    u32 u32ShareTables;                    // Read-only tables come from the process-wide cache of aud_table.c instead of this arena
+} ST_AUD_MEM_ARENA, *PST_AUD_MEM_ARENA;
+
+void AUD_Arena_Init(PST_AUD_MEM_ARENA pstArena, void *ptr, u32 u32TotalLen);
+int AUD_Arena_Uninit(PST_AUD_MEM_ARENA pstArena);
+void AUD_Arena_InitCounter(PST_AUD_MEM_ARENA pstArena);
+u32 AUD_Arena_UninitCounter(PST_AUD_MEM_ARENA pstArena);
+u32 AUD_Arena_GetUsedSize(PST_AUD_MEM_ARENA pstArena);
+void *AUD_Arena_Malloc(PST_AUD_MEM_ARENA pstArena, s32 s32Size);
+void *AUD_Arena_Calloc(PST_AUD_MEM_ARENA pstArena, s32 s32num, s32 s32size);
+void *AUD_Arena_Realloc(PST_AUD_MEM_ARENA pstArena, void *ptr, s32 s32Size);
+void *AUD_Arena_CallocScratch(PST_AUD_MEM_ARENA pstArena, s32 s32num, s32 s32size);
+void AUD_Arena_Free(PST_AUD_MEM_ARENA pstArena, void *ptr);
 
 #endif
@@ -21,8 +21,10 @@
 
 
 EN_AUD_NS_ERR _AUD_NS_Init(void *pInternalBuf, int u32BufSize);
+EN_AUD_NS_ERR _AUD_NS_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize);
 EN_AUD_NS_ERR _AUD_NS_Uninit(void);
 void _AUD_NS_Run(short *ps16InBuf, short *ps16OutBuf);
+void _AUD_NS_RunVad(short *ps16InBuf, int *ps32Vad);
 EN_AUD_NS_ERR _AUD_NS_SetParam(EN_AUD_NS_PARAMS enParamsCMD, void *pParamsValue);
 
 
@@ -44,6 +46,20 @@ int AUD_NS_Init(void *pInternalBuf, int u32BufSize)
         return TRUE;
 }
 
+/*-------------------------------------------------------------------------------
+** Input        : pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
+** Output   : err
+**--------------------------------------------------------------------------------*/
+int AUD_NS_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize)
+{
+    EN_AUD_NS_ERR err;
+    err = _AUD_NS_InitEx(pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize);
+    if(err != EN_AUD_NS_ENOERR)
+        return FALSE;
+    else
+        return TRUE;
+}
+
 /*-------------------------------------------------------------------------------
 ** Input        : ps16InBuf
 ** Output   : ps16OutBuf
@@ -53,6 +69,15 @@ void AUD_NS_Run(short *ps16InBuf, short *ps16OutBuf)
     _AUD_NS_Run(ps16InBuf, ps16OutBuf);
 }
 
+/*-------------------------------------------------------------------------------
+** Input        : ps16InBuf
+** Output   : ps32Vad
+**--------------------------------------------------------------------------------*/
+void AUD_NS_RunVad(short *ps16InBuf, int *ps32Vad)
+{
+    _AUD_NS_RunVad(ps16InBuf, ps32Vad);
+}
+
 /*-------------------------------------------------------------------------------
 ** Input        : enParamsCMD,  pParamsValue
 ** Output   : err
@@ -0,0 +1,133 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "aud_pool_api.h"
+
+/*Workers and the caller pull task indices off one shared counter, so a worker that is done early takes over
+  whatever is left instead of waiting on a fixed share. A job is only a handful of channels, a queue per worker
+  would not buy anything over that.*/
+typedef struct _ST_AUD_POOL_INST {
+    ST_AUD_POOL stPool;  // Must stay first, the handle given out is its address
+    pthread_t *pThreads;
+    int s32NumThreads;
+    pthread_mutex_t stRunLock;  // One job at a time
+    pthread_mutex_t stLock;
+    pthread_cond_t stWake;
+    pthread_cond_t stDone;
+    AUD_POOL_TASK pfTask;
+    void *pArg;
+    int s32Count;
+    int s32Next;     // Next task index to hand out
+    int s32Pending;  // Tasks not finished yet
+    unsigned int u32Job;
+    int s32Quit;
+} ST_AUD_POOL_INST, *PST_AUD_POOL_INST;
+
+/* Runs tasks of the current job until none is left to hand out, called with stLock held */
+static void _AUD_Pool_Drain(PST_AUD_POOL_INST pstInst)
+{
+    while (pstInst->s32Next < pstInst->s32Count) {
+        int s32Index = pstInst->s32Next++;
+        pthread_mutex_unlock(&pstInst->stLock);
+        pstInst->pfTask(pstInst->pArg, s32Index);
+        pthread_mutex_lock(&pstInst->stLock);
+        if (--pstInst->s32Pending == 0)
+            pthread_cond_broadcast(&pstInst->stDone);
+    }
+}
+
+static void *_AUD_Pool_Worker(void *pCtx)
+{
+    PST_AUD_POOL_INST pstInst = (PST_AUD_POOL_INST)pCtx;
+    unsigned int u32Job       = 0;
+
+    pthread_mutex_lock(&pstInst->stLock);
+    for (;;) {
+        while (u32Job == pstInst->u32Job && !pstInst->s32Quit)
+            pthread_cond_wait(&pstInst->stWake, &pstInst->stLock);
+        if (pstInst->s32Quit)
+            break;
+        u32Job = pstInst->u32Job;
+        _AUD_Pool_Drain(pstInst);
+    }
+    pthread_mutex_unlock(&pstInst->stLock);
+    return NULL;
+}
+
+static void _AUD_Pool_Run(void *pCtx, AUD_POOL_TASK pfTask, void *pArg, int s32Count)
+{
+    PST_AUD_POOL_INST pstInst = (PST_AUD_POOL_INST)pCtx;
+
+    if (s32Count <= 0)
+        return;
+    pthread_mutex_lock(&pstInst->stRunLock);
+    pthread_mutex_lock(&pstInst->stLock);
+    pstInst->pfTask     = pfTask;
+    pstInst->pArg       = pArg;
+    pstInst->s32Count   = s32Count;
+    pstInst->s32Next    = 0;
+    pstInst->s32Pending = s32Count;
+    pstInst->u32Job++;
+    if (s32Count > 1)
+        pthread_cond_broadcast(&pstInst->stWake);
+    _AUD_Pool_Drain(pstInst);
+    while (pstInst->s32Pending)
+        pthread_cond_wait(&pstInst->stDone, &pstInst->stLock);
+    pthread_mutex_unlock(&pstInst->stLock);
+    pthread_mutex_unlock(&pstInst->stRunLock);
+}
+
+PST_AUD_POOL AUD_Pool_Create(int s32NumThreads)
+{
+    PST_AUD_POOL_INST pstInst;
+    int i;
+
+    if (s32NumThreads < 0)
+        return NULL;
+    pstInst = (PST_AUD_POOL_INST)calloc(1, sizeof(ST_AUD_POOL_INST));
+    if (pstInst == NULL)
+        return NULL;
+    pstInst->pThreads = (pthread_t *)calloc(s32NumThreads + 1, sizeof(pthread_t));
+    if (pstInst->pThreads == NULL) {
+        free(pstInst);
+        return NULL;
+    }
+    pstInst->stPool.pfRun = _AUD_Pool_Run;
+    pstInst->stPool.pCtx  = pstInst;
+    pthread_mutex_init(&pstInst->stRunLock, NULL);
+    pthread_mutex_init(&pstInst->stLock, NULL);
+    pthread_cond_init(&pstInst->stWake, NULL);
+    pthread_cond_init(&pstInst->stDone, NULL);
+
+    for (i = 0; i < s32NumThreads; i++) {
+        if (pthread_create(&pstInst->pThreads[i], NULL, _AUD_Pool_Worker, pstInst) != 0)
+            break;
+        pstInst->s32NumThreads++;
+    }
+    if (pstInst->s32NumThreads < s32NumThreads) {
+        AUD_Pool_Destroy(&pstInst->stPool);
+        return NULL;
+    }
+    return &pstInst->stPool;
+}
+
+void AUD_Pool_Destroy(PST_AUD_POOL pstPool)
+{
+    PST_AUD_POOL_INST pstInst = (PST_AUD_POOL_INST)pstPool;
+    int i;
+
+    if (pstInst == NULL)
+        return;
+    pthread_mutex_lock(&pstInst->stLock);
+    pstInst->s32Quit = 1;
+    pthread_cond_broadcast(&pstInst->stWake);
+    pthread_mutex_unlock(&pstInst->stLock);
+    for (i = 0; i < pstInst->s32NumThreads; i++)
+        pthread_join(pstInst->pThreads[i], NULL);
+
+    pthread_cond_destroy(&pstInst->stDone);
+    pthread_cond_destroy(&pstInst->stWake);
+    pthread_mutex_destroy(&pstInst->stLock);
+    pthread_mutex_destroy(&pstInst->stRunLock);
+    free(pstInst->pThreads);
+    free(pstInst);
+}
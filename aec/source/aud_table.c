@@ -0,0 +1,88 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aud_table.h"
+
+/*A few dozen entries at most (one per transform size, window and filter bank in use), looked up at init
+  only, so a list under one lock does.*/
+typedef struct _ST_AUD_TABLE_ENTRY {
+    struct _ST_AUD_TABLE_ENTRY *pstNext;
+    AUD_TABLE_NEW pfNew;
+    AUD_TABLE_DELETE pfDelete;
+    s32 s32Key[AUD_TABLE_KEY_MAX];
+    int s32KeyLen;
+    void *pTable;
+    u32 u32Refs;
+} ST_AUD_TABLE_ENTRY, *PST_AUD_TABLE_ENTRY;
+
+static pthread_mutex_t _stTableLock = PTHREAD_MUTEX_INITIALIZER;
+static PST_AUD_TABLE_ENTRY _pstTables;
+
+static int _AUD_Table_Shared(PST_AUD_MEM_ARENA pstArena)
+{
+    return pstArena != NULL && pstArena->u32ShareTables;
+}
+
+void *AUD_Table_Get(PST_AUD_MEM_ARENA pstArena, AUD_TABLE_NEW pfNew, AUD_TABLE_DELETE pfDelete, const s32 *ps32Key, int s32KeyLen, const void *pProto)
+{
+    PST_AUD_TABLE_ENTRY pstEntry;
+    void *pTable = NULL;
+
+    if (!_AUD_Table_Shared(pstArena) || s32KeyLen > AUD_TABLE_KEY_MAX)
+        return pfNew(pstArena, ps32Key, pProto);
+
+    pthread_mutex_lock(&_stTableLock);
+    for (pstEntry = _pstTables; pstEntry; pstEntry = pstEntry->pstNext) {
+        if (pstEntry->pfNew == pfNew && pstEntry->s32KeyLen == s32KeyLen && !memcmp(pstEntry->s32Key, ps32Key, s32KeyLen * sizeof(s32)))
+            break;
+    }
+    if (pstEntry) {
+        pstEntry->u32Refs++;
+        pTable = pstEntry->pTable;
+    } else if ((pstEntry = (PST_AUD_TABLE_ENTRY)calloc(1, sizeof(ST_AUD_TABLE_ENTRY))) != NULL) {
+        // Built under the lock, an instance asking for the same key meanwhile waits for it instead of building its own
+        pTable = pfNew(NULL, ps32Key, pProto);
+        if (pTable) {
+            pstEntry->pfNew    = pfNew;
+            pstEntry->pfDelete = pfDelete;
+            memcpy(pstEntry->s32Key, ps32Key, s32KeyLen * sizeof(s32));
+            pstEntry->s32KeyLen = s32KeyLen;
+            pstEntry->pTable    = pTable;
+            pstEntry->u32Refs   = 1;
+            pstEntry->pstNext   = _pstTables;
+            _pstTables          = pstEntry;
+        } else {
+            free(pstEntry);
+        }
+    }
+    pthread_mutex_unlock(&_stTableLock);
+    return pTable;
+}
+
+void AUD_Table_Put(PST_AUD_MEM_ARENA pstArena, AUD_TABLE_DELETE pfDelete, void *pTable)
+{
+    PST_AUD_TABLE_ENTRY *ppstLink, pstEntry = NULL;
+
+    if (pTable == NULL)
+        return;
+    if (!_AUD_Table_Shared(pstArena)) {
+        pfDelete(pstArena, pTable);
+        return;
+    }
+
+    pthread_mutex_lock(&_stTableLock);
+    for (ppstLink = &_pstTables; *ppstLink; ppstLink = &(*ppstLink)->pstNext) {
+        if ((*ppstLink)->pTable == pTable) {
+            if (--(*ppstLink)->u32Refs == 0) {
+                pstEntry  = *ppstLink;
+                *ppstLink = pstEntry->pstNext;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_stTableLock);
+    if (pstEntry) {
+        pstEntry->pfDelete(NULL, pstEntry->pTable);
+        free(pstEntry);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef AUD_TABLE_H
+#define AUD_TABLE_H
+#include "aud_mem.h"
+
+#define AUD_TABLE_KEY_MAX 4  // Sizes a table may depend on
+
+/*Builds the table of ps32Key in pstArena, copied from pProto (a table of the same key) when it is not NULL*/
+typedef void *(*AUD_TABLE_NEW)(PST_AUD_MEM_ARENA pstArena, const s32 *ps32Key, const void *pProto);
+/*Releases a table built by the matching AUD_TABLE_NEW in pstArena*/
+typedef void (*AUD_TABLE_DELETE)(PST_AUD_MEM_ARENA pstArena, void *pTable);
+
+/*Read-only tables (transform twiddles, windows, filter banks) that only depend on a few sizes.
+  With u32ShareTables set on the arena they come from one process-wide cache: the first instance asking for a
+  key builds the table on the heap, later ones take a reference to it and the last AUD_Table_Put frees it.
+  Without it every instance builds its own table in its arena, as pfNew(pstArena, ...).
+  A table is identified by pfNew and its key and must not be written once returned.*/
+void *AUD_Table_Get(PST_AUD_MEM_ARENA pstArena, AUD_TABLE_NEW pfNew, AUD_TABLE_DELETE pfDelete, const s32 *ps32Key, int s32KeyLen, const void *pProto);
+void AUD_Table_Put(PST_AUD_MEM_ARENA pstArena, AUD_TABLE_DELETE pfDelete, void *pTable);
+
+#endif
@@ -50,8 +50,8 @@ struct SpeexBuffer_ {
 
 EXPORT SpeexBuffer *speex_buffer_init(int size)
 {
-   SpeexBuffer *st = speex_alloc(sizeof(SpeexBuffer));
-   st->data = speex_alloc(size);
+   SpeexBuffer *st = speex_alloc(NULL, sizeof(SpeexBuffer));
+   st->data = speex_alloc(NULL, size);
    st->size = size;
    st->read_ptr = 0;
    st->write_ptr = 0;
@@ -61,8 +61,8 @@ EXPORT SpeexBuffer *speex_buffer_init(int size)
 
 EXPORT void speex_buffer_destroy(SpeexBuffer *st)
 {
-   speex_free(st->data);
-   speex_free(st);
+   speex_free(NULL, st->data);
+   speex_free(NULL, st);
 }
 
 EXPORT int speex_buffer_write(SpeexBuffer *st, void *_data, int len)
@@ -166,11 +166,11 @@ EXPORT int speex_buffer_resize(SpeexBuffer *st, int len)
    int old_len = st->size;
    if (len > old_len)
    {
-      st->data = speex_realloc(st->data, len);
+      st->data = speex_realloc(NULL, st->data, len);
       /* FIXME: move data/pointers properly for growing the buffer */
    } else {
       /* FIXME: move data/pointers properly for shrinking the buffer */
-      st->data = speex_realloc(st->data, len);
+      st->data = speex_realloc(NULL, st->data, len);
    }
    return len;
 }
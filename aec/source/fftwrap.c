@@ -81,18 +81,26 @@ static void renorm_range(spx_word16_t *in, spx_word16_t *out, int shift, int len
 #include "smallft.h"
 #include <math.h>
 
-void *spx_fft_init(int size)
+void *spx_fft_init(int size, PST_AUD_MEM_ARENA arena)
 {
    struct drft_lookup *table;
-   table = speex_alloc(sizeof(struct drft_lookup));
-   spx_drft_init((struct drft_lookup *)table, size);
+   table = speex_alloc(arena, sizeof(struct drft_lookup));
+   spx_drft_init((struct drft_lookup *)table, size, arena);
    return (void*)table;
 }
 
-void spx_fft_destroy(void *table)
+void *spx_fft_clone(const void *proto, PST_AUD_MEM_ARENA arena)
 {
-   spx_drft_clear(table);
-   speex_free(table);
+   struct drft_lookup *table;
+   table = speex_alloc(arena, sizeof(struct drft_lookup));
+   spx_drft_copy(table, (const struct drft_lookup *)proto, arena);
+   return (void*)table;
+}
+
+void spx_fft_destroy(void *table, PST_AUD_MEM_ARENA arena)
+{
+   spx_drft_clear(table, arena);
+   speex_free(arena, table);
 }
 
 void spx_fft(void *table, float *in, float *out)
@@ -134,9 +142,9 @@ struct mkl_config {
   int N;
 };
 
-void *spx_fft_init(int size)
+void *spx_fft_init(int size, PST_AUD_MEM_ARENA arena)
 {
-  struct mkl_config *table = (struct mkl_config *) speex_alloc(sizeof(struct mkl_config));
+  struct mkl_config *table = (struct mkl_config *) speex_alloc(arena, sizeof(struct mkl_config));
   table->N = size;
   DftiCreateDescriptor(&table->desc, DFTI_SINGLE, DFTI_REAL, 1, size);
   DftiSetValue(table->desc, DFTI_PACKED_FORMAT, DFTI_PACK_FORMAT);
@@ -146,11 +154,16 @@ void *spx_fft_init(int size)
   return table;
 }
 
-void spx_fft_destroy(void *table)
+void *spx_fft_clone(const void *proto, PST_AUD_MEM_ARENA arena)
+{
+  return spx_fft_init(((const struct mkl_config *)proto)->N, arena);
+}
+
+void spx_fft_destroy(void *table, PST_AUD_MEM_ARENA arena)
 {
   struct mkl_config *t = (struct mkl_config *) table;
   DftiFreeDescriptor(t->desc);
-  speex_free(table);
+  speex_free(arena, table);
 }
 
 void spx_fft(void *table, spx_word16_t *in, spx_word16_t *out)
@@ -173,15 +186,16 @@ struct ipp_fft_config
 {
   IppsDFTSpec_R_32f *dftSpec;
   Ipp8u *buffer;
+  int N;
 };
 
-void *spx_fft_init(int size)
+void *spx_fft_init(int size, PST_AUD_MEM_ARENA arena)
 {
   int bufferSize = 0;
   int hint;
   struct ipp_fft_config *table;
 
-  table = (struct ipp_fft_config *)speex_alloc(sizeof(struct ipp_fft_config));
+  table = (struct ipp_fft_config *)speex_alloc(arena, sizeof(struct ipp_fft_config));
 
   /* there appears to be no performance difference between ippAlgHintFast and
      ippAlgHintAccurate when using the with the floating point version
@@ -192,16 +206,22 @@ void *spx_fft_init(int size)
 
   ippsDFTGetBufSize_R_32f(table->dftSpec, &bufferSize);
   table->buffer = ippsMalloc_8u(bufferSize);
+  table->N = size;
 
   return table;
 }
 
-void spx_fft_destroy(void *table)
+void *spx_fft_clone(const void *proto, PST_AUD_MEM_ARENA arena)
+{
+  return spx_fft_init(((const struct ipp_fft_config *)proto)->N, arena);
+}
+
+void spx_fft_destroy(void *table, PST_AUD_MEM_ARENA arena)
 {
   struct ipp_fft_config *t = (struct ipp_fft_config *)table;
   ippsFree(t->buffer);
   ippsDFTFree_R_32f(t->dftSpec);
-  speex_free(t);
+  speex_free(arena, t);
 }
 
 void spx_fft(void *table, spx_word16_t *in, spx_word16_t *out)
@@ -228,9 +248,9 @@ struct fftw_config {
   int N;
 };
 
-void *spx_fft_init(int size)
+void *spx_fft_init(int size, PST_AUD_MEM_ARENA arena)
 {
-  struct fftw_config *table = (struct fftw_config *) speex_alloc(sizeof(struct fftw_config));
+  struct fftw_config *table = (struct fftw_config *) speex_alloc(arena, sizeof(struct fftw_config));
   table->in = fftwf_malloc(sizeof(float) * (size+2));
   table->out = fftwf_malloc(sizeof(float) * (size+2));
 
@@ -241,14 +261,19 @@ void *spx_fft_init(int size)
   return table;
 }
 
-void spx_fft_destroy(void *table)
+void *spx_fft_clone(const void *proto, PST_AUD_MEM_ARENA arena)
+{
+  return spx_fft_init(((const struct fftw_config *)proto)->N, arena);
+}
+
+void spx_fft_destroy(void *table, PST_AUD_MEM_ARENA arena)
 {
   struct fftw_config *t = (struct fftw_config *) table;
   fftwf_destroy_plan(t->fft);
   fftwf_destroy_plan(t->ifft);
   fftwf_free(t->in);
   fftwf_free(t->out);
-  speex_free(table);
+  speex_free(arena, table);
 }
 
 
@@ -298,25 +323,60 @@ void spx_ifft(void *table, spx_word16_t *in, spx_word16_t *out)
 struct kiss_config {
    kiss_fftr_cfg forward;
    kiss_fftr_cfg backward;
+   kiss_fftr_cfg forward_twiddles;   /* Read-only, possibly shared with other configs */
+   kiss_fftr_cfg backward_twiddles;
    int N;
 };
 
-void *spx_fft_init(int size)
+/* Twiddles of a real transform, key size and direction. Those of proto are copied instead of worked out. */
+static void *kiss_twiddles_new(PST_AUD_MEM_ARENA arena, const int *key, const void *proto)
+{
+   size_t len = 0;
+   void *mem;
+   kiss_fftr_alloc_twiddles(key[0],key[1],NULL,&len);
+   mem = speex_alloc(arena, len);
+   if (proto)
+      return kiss_fftr_copy((kiss_fftr_cfg)proto,mem,len);
+   return kiss_fftr_alloc_twiddles(key[0],key[1],mem,&len);
+}
+
+static void *kiss_config_new(int size, const struct kiss_config *proto, PST_AUD_MEM_ARENA arena)
 {
    struct kiss_config *table;
-   table = (struct kiss_config*)speex_alloc(sizeof(struct kiss_config));
-   table->forward = kiss_fftr_alloc(size,0,NULL,NULL);
-   table->backward = kiss_fftr_alloc(size,1,NULL,NULL);
+   size_t len = 0;
+   int key[2];
+   table = (struct kiss_config*)speex_alloc(arena, sizeof(struct kiss_config));
+   key[0] = size;
+   key[1] = 0;
+   table->forward_twiddles = speex_table_get(arena, kiss_twiddles_new, speex_free, key, 2, proto ? proto->forward_twiddles : NULL);
+   key[1] = 1;
+   table->backward_twiddles = speex_table_get(arena, kiss_twiddles_new, speex_free, key, 2, proto ? proto->backward_twiddles : NULL);
+   /* Only the work buffers are the config's own */
+   kiss_fftr_share(table->forward_twiddles,NULL,&len);
+   table->forward = kiss_fftr_share(table->forward_twiddles,speex_alloc(arena, len),&len);
+   table->backward = kiss_fftr_share(table->backward_twiddles,speex_alloc(arena, len),&len);
    table->N = size;
    return table;
 }
 
-void spx_fft_destroy(void *table)
+void *spx_fft_init(int size, PST_AUD_MEM_ARENA arena)
+{
+   return kiss_config_new(size, NULL, arena);
+}
+
+void *spx_fft_clone(const void *proto, PST_AUD_MEM_ARENA arena)
+{
+   return kiss_config_new(((const struct kiss_config *)proto)->N, (const struct kiss_config *)proto, arena);
+}
+
+void spx_fft_destroy(void *table, PST_AUD_MEM_ARENA arena)
 {
    struct kiss_config *t = (struct kiss_config *)table;
-   kiss_fftr_free(t->forward);
-   kiss_fftr_free(t->backward);
-   speex_free(table);
+   speex_free(arena, t->forward);
+   speex_free(arena, t->backward);
+   speex_table_put(arena, speex_free, t->forward_twiddles);
+   speex_table_put(arena, speex_free, t->backward_twiddles);
+   speex_free(arena, table);
 }
 
 #ifdef FIXED_POINT
@@ -389,12 +449,12 @@ void spx_fft_float(void *table, float *in, float *out)
    {
       float scale;
       struct drft_lookup t;
-      spx_drft_init(&t, ((struct kiss_config *)table)->N);
+      spx_drft_init(&t, ((struct kiss_config *)table)->N, NULL);
       scale = 1./((struct kiss_config *)table)->N;
       for (i=0;i<((struct kiss_config *)table)->N;i++)
          out[i] = scale*in[i];
       spx_drft_forward(&t, out);
-      spx_drft_clear(&t);
+      spx_drft_clear(&t, NULL);
    }
 #endif
 }
@@ -425,11 +485,11 @@ void spx_ifft_float(void *table, float *in, float *out)
    {
       int i;
       struct drft_lookup t;
-      spx_drft_init(&t, ((struct kiss_config *)table)->N);
+      spx_drft_init(&t, ((struct kiss_config *)table)->N, NULL);
       for (i=0;i<((struct kiss_config *)table)->N;i++)
          out[i] = in[i];
       spx_drft_backward(&t, out);
-      spx_drft_clear(&t);
+      spx_drft_clear(&t, NULL);
    }
 #endif
 }
@@ -36,12 +36,19 @@
 #define FFTWRAP_H
 
 #include "arch.h"
+#include "aud_mem.h"
 
-/** Compute tables for an FFT */
-void *spx_fft_init(int size);
+/** Compute tables for an FFT, carved from arena (NULL for the system heap) */
+void *spx_fft_init(int size, PST_AUD_MEM_ARENA arena);
+
+/** Tables for an FFT of the same size as those of proto, copied instead of computed. The copy has its own work
+    area, so it may run alongside proto.
+    With smallft and kiss the read-only part of the tables is shared through speex_table_get when the arena asks
+    for it, MKL, IPP and FFTW keep their own plans. */
+void *spx_fft_clone(const void *proto, PST_AUD_MEM_ARENA arena);
 
 /** Destroy tables for an FFT */
-void spx_fft_destroy(void *table);
+void spx_fft_destroy(void *table, PST_AUD_MEM_ARENA arena);
 
 /** Forward (real to half-complex) transform */
 void spx_fft(void *table, spx_word16_t *in, spx_word16_t *out);
@@ -51,7 +51,7 @@
 
 #define toMEL(n)    (2595.f*log10(1.f+(n)/700.f))
 
-FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
+FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type, PST_AUD_MEM_ARENA arena)
 {
    FilterBank *bank;
    spx_word32_t df;
@@ -63,17 +63,18 @@ FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
    max_mel = toBARK(EXTRACT16(sampling/2));
    mel_interval = PDIV32(max_mel,banks-1);
 
-   bank = (FilterBank*)speex_alloc(sizeof(FilterBank));
+   bank = (FilterBank*)speex_alloc(arena, sizeof(FilterBank));
    bank->nb_banks = banks;
    bank->len = len;
-   bank->bank_left = (int*)speex_alloc(len*sizeof(int));
-   bank->bank_right = (int*)speex_alloc(len*sizeof(int));
-   bank->filter_left = (spx_word16_t*)speex_alloc(len*sizeof(spx_word16_t));
-   bank->filter_right = (spx_word16_t*)speex_alloc(len*sizeof(spx_word16_t));
+   bank->bank_left = (int*)speex_alloc(arena, len*sizeof(int));
+   bank->bank_right = (int*)speex_alloc(arena, len*sizeof(int));
+   bank->filter_left = (spx_word16_t*)speex_alloc(arena, len*sizeof(spx_word16_t));
+   bank->filter_right = (spx_word16_t*)speex_alloc(arena, len*sizeof(spx_word16_t));
    /* Think I can safely disable normalisation that for fixed-point (and probably float as well) */
 #ifndef FIXED_POINT
-   bank->scaling = (float*)speex_alloc(banks*sizeof(float));
+   bank->scaling = (float*)speex_alloc(arena, banks*sizeof(float));
 #endif
+   bank->band_start = (int*)speex_alloc(arena, banks*sizeof(int));
    for (i=0;i<len;i++)
    {
       spx_word16_t curr_freq;
@@ -101,6 +102,17 @@ FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
       bank->bank_right[i] = id2;
       bank->filter_right[i] = val;
    }
+   /* Bark is monotonic in frequency, so the bins sharing a left band are contiguous */
+   {
+      int b, used = i;
+      for (b=0, i=0;b<banks;b++)
+      {
+         while (i<used && bank->bank_left[i]<b)
+            i++;
+         bank->band_start[b] = i;
+      }
+      bank->band_start[banks-1] = used;
+   }
 
    /* Think I can safely disable normalisation for fixed-point (and probably float as well) */
 #ifndef FIXED_POINT
@@ -119,25 +131,102 @@ FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
    return bank;
 }
 
-void filterbank_destroy(FilterBank *bank)
+FilterBank *filterbank_copy(const FilterBank *proto, PST_AUD_MEM_ARENA arena)
+{
+   FilterBank *bank;
+   int banks = proto->nb_banks, len = proto->len;
+
+   bank = (FilterBank*)speex_alloc(arena, sizeof(FilterBank));
+   bank->nb_banks = banks;
+   bank->len = len;
+   bank->bank_left = (int*)speex_alloc(arena, len*sizeof(int));
+   bank->bank_right = (int*)speex_alloc(arena, len*sizeof(int));
+   bank->filter_left = (spx_word16_t*)speex_alloc(arena, len*sizeof(spx_word16_t));
+   bank->filter_right = (spx_word16_t*)speex_alloc(arena, len*sizeof(spx_word16_t));
+#ifndef FIXED_POINT
+   bank->scaling = (float*)speex_alloc(arena, banks*sizeof(float));
+#endif
+   bank->band_start = (int*)speex_alloc(arena, banks*sizeof(int));
+   SPEEX_COPY(bank->bank_left, proto->bank_left, len);
+   SPEEX_COPY(bank->bank_right, proto->bank_right, len);
+   SPEEX_COPY(bank->filter_left, proto->filter_left, len);
+   SPEEX_COPY(bank->filter_right, proto->filter_right, len);
+#ifndef FIXED_POINT
+   SPEEX_COPY(bank->scaling, proto->scaling, banks);
+#endif
+   SPEEX_COPY(bank->band_start, proto->band_start, banks);
+   return bank;
+}
+
+/* Bank of key banks, sampling, len, type as a speex_table_get table */
+static void *filterbank_table_new(PST_AUD_MEM_ARENA arena, const int *key, const void *proto)
+{
+   if (proto)
+      return filterbank_copy((const FilterBank*)proto, arena);
+   return filterbank_new(key[0], key[1], key[2], key[3], arena);
+}
+
+static void filterbank_table_delete(PST_AUD_MEM_ARENA arena, void *bank)
+{
+   filterbank_destroy((FilterBank*)bank, arena);
+}
+
+FilterBank *filterbank_get(int banks, spx_word32_t sampling, int len, int type, const FilterBank *proto, PST_AUD_MEM_ARENA arena)
+{
+   int key[4];
+   key[0] = banks;
+   key[1] = sampling;
+   key[2] = len;
+   key[3] = type;
+   return (FilterBank*)speex_table_get(arena, filterbank_table_new, filterbank_table_delete, key, 4, proto);
+}
+
+void filterbank_put(FilterBank *bank, PST_AUD_MEM_ARENA arena)
 {
-   speex_free(bank->bank_left);
-   speex_free(bank->bank_right);
-   speex_free(bank->filter_left);
-   speex_free(bank->filter_right);
+   speex_table_put(arena, filterbank_table_delete, bank);
+}
+
+void filterbank_destroy(FilterBank *bank, PST_AUD_MEM_ARENA arena)
+{
+   speex_free(arena, bank->bank_left);
+   speex_free(arena, bank->bank_right);
+   speex_free(arena, bank->filter_left);
+   speex_free(arena, bank->filter_right);
 #ifndef FIXED_POINT
-   speex_free(bank->scaling);
+   speex_free(arena, bank->scaling);
 #endif
-   speex_free(bank);
+   speex_free(arena, bank->band_start);
+   speex_free(arena, bank);
 }
 
-void filterbank_compute_bank32(FilterBank *bank, spx_word32_t *ps, spx_word32_t *mel)
+void filterbank_compute_bank32(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel)
 {
    int i;
+#ifdef _Bark_scale_OPT
+   /* Walk the bins band by band with both sums in registers instead of scattering through bank_left/right.
+      Every band still receives its terms in bin order, so float sums are unchanged. */
+   int b;
+   spx_word32_t carry = 0;
+   for (b=0;b<bank->nb_banks-1;b++)
+   {
+      spx_word32_t left = carry, right = 0;
+      for (i=bank->band_start[b];i<bank->band_start[b+1];i++)
+      {
+         left += MULT16_32_P15(bank->filter_left[i],ps[i]);
+         right += MULT16_32_P15(bank->filter_right[i],ps[i]);
+      }
+      mel[b] = left;
+      carry = right;
+   }
+   mel[b] = carry;
+   i = bank->band_start[bank->nb_banks-1];
+#else
    for (i=0;i<bank->nb_banks;i++)
       mel[i] = 0;
+   i = 0;
+#endif
 
-   for (i=0;i<bank->len;i++)
+   for (;i<bank->len;i++)
    {
       int id;
       id = bank->bank_left[i];
@@ -153,10 +242,27 @@ void filterbank_compute_bank32(FilterBank *bank, spx_word32_t *ps, spx_word32_t
 #endif
 }
 
-void filterbank_compute_psd16(FilterBank *bank, spx_word16_t *mel, spx_word16_t *ps)
+void filterbank_compute_psd16(const FilterBank *bank, const spx_word16_t *mel, spx_word16_t *ps)
 {
    int i;
-   for (i=0;i<bank->len;i++)
+#ifdef _Bark_scale_OPT
+   int b;
+   for (b=0;b<bank->nb_banks-1;b++)
+   {
+      spx_word16_t mel1 = mel[b], mel2 = mel[b+1];
+      for (i=bank->band_start[b];i<bank->band_start[b+1];i++)
+      {
+         spx_word32_t tmp;
+         tmp = MULT16_16(mel1,bank->filter_left[i]);
+         tmp += MULT16_16(mel2,bank->filter_right[i]);
+         ps[i] = EXTRACT16(PSHR32(tmp,15));
+      }
+   }
+   i = bank->band_start[bank->nb_banks-1];
+#else
+   i = 0;
+#endif
+   for (;i<bank->len;i++)
    {
       spx_word32_t tmp;
       int id1, id2;
@@ -35,6 +35,7 @@
 #define FILTERBANK_H
 
 #include "arch.h"
+#include "aud_mem.h"
 
 typedef struct {
    int *bank_left;
@@ -44,18 +45,28 @@ typedef struct {
 #ifndef FIXED_POINT
    float *scaling;
 #endif
+   int *band_start; /* Bins whose left band is b are band_start[b]..band_start[b+1]-1, band_start[nb_banks-1] ends the mapped bins */
    int nb_banks;
    int len;
 } FilterBank;
 
 
-FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type);
+FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type, PST_AUD_MEM_ARENA arena);
 
-void filterbank_destroy(FilterBank *bank);
+/** Same bank as proto, copied instead of worked out from the Bark scale */
+FilterBank *filterbank_copy(const FilterBank *proto, PST_AUD_MEM_ARENA arena);
 
-void filterbank_compute_bank32(FilterBank *bank, spx_word32_t *ps, spx_word32_t *mel);
+void filterbank_destroy(FilterBank *bank, PST_AUD_MEM_ARENA arena);
 
-void filterbank_compute_psd16(FilterBank *bank, spx_word16_t *mel, spx_word16_t *psd);
+/** Bank of filterbank_new (or filterbank_copy of proto when given), shared with every other user of the same
+    parameters when the arena asks for it (see speex_table_get). Read-only, released by filterbank_put. */
+FilterBank *filterbank_get(int banks, spx_word32_t sampling, int len, int type, const FilterBank *proto, PST_AUD_MEM_ARENA arena);
+
+void filterbank_put(FilterBank *bank, PST_AUD_MEM_ARENA arena);
+
+void filterbank_compute_bank32(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel);
+
+void filterbank_compute_psd16(const FilterBank *bank, const spx_word16_t *mel, spx_word16_t *psd);
 
 #ifndef FIXED_POINT
 void filterbank_compute_bank(FilterBank *bank, float *psd, float *mel);
@@ -269,7 +269,7 @@ static spx_int16_t compute_opt_delay(JitterBuffer *jitter)
 /** Initialise jitter buffer */
 EXPORT JitterBuffer *jitter_buffer_init(int step_size)
 {
-   JitterBuffer *jitter = (JitterBuffer*)speex_alloc(sizeof(JitterBuffer));
+   JitterBuffer *jitter = (JitterBuffer*)speex_alloc(NULL, sizeof(JitterBuffer));
    if (jitter)
    {
       int i;
@@ -302,7 +302,7 @@ EXPORT void jitter_buffer_reset(JitterBuffer *jitter)
          if (jitter->destroy)
             jitter->destroy(jitter->packets[i].data);
          else
-            speex_free(jitter->packets[i].data);
+            speex_free(NULL, jitter->packets[i].data);
          jitter->packets[i].data = NULL;
       }
    }
@@ -326,7 +326,7 @@ EXPORT void jitter_buffer_reset(JitterBuffer *jitter)
 EXPORT void jitter_buffer_destroy(JitterBuffer *jitter)
 {
    jitter_buffer_reset(jitter);
-   speex_free(jitter);
+   speex_free(NULL, jitter);
 }
 
 /** Take the following timing into consideration for future calculations */
@@ -381,7 +381,7 @@ EXPORT void jitter_buffer_put(JitterBuffer *jitter, const JitterBufferPacket *pa
             if (jitter->destroy)
                jitter->destroy(jitter->packets[i].data);
             else
-               speex_free(jitter->packets[i].data);
+               speex_free(NULL, jitter->packets[i].data);
             jitter->packets[i].data = NULL;
          }
       }
@@ -431,7 +431,7 @@ EXPORT void jitter_buffer_put(JitterBuffer *jitter, const JitterBufferPacket *pa
          if (jitter->destroy)
             jitter->destroy(jitter->packets[i].data);
          else
-            speex_free(jitter->packets[i].data);
+            speex_free(NULL, jitter->packets[i].data);
          jitter->packets[i].data=NULL;
          /*fprintf (stderr, "Buffer is full, discarding earliest frame %d (currently at %d)\n", timestamp, jitter->pointer_timestamp);*/
       }
@@ -441,7 +441,7 @@ EXPORT void jitter_buffer_put(JitterBuffer *jitter, const JitterBufferPacket *pa
       {
          jitter->packets[i].data = packet->data;
       } else {
-         jitter->packets[i].data=(char*)speex_alloc(packet->len);
+         jitter->packets[i].data=(char*)speex_alloc(NULL, packet->len);
          for (j=0;j<packet->len;j++)
             jitter->packets[i].data[j]=packet->data[j];
       }
@@ -602,7 +602,7 @@ EXPORT int jitter_buffer_get(JitterBuffer *jitter, JitterBufferPacket *packet, s
          for (j=0;j<packet->len;j++)
             packet->data[j] = jitter->packets[i].data[j];
          /* Remove packet */
-         speex_free(jitter->packets[i].data);
+         speex_free(NULL, jitter->packets[i].data);
       }
       jitter->packets[i].data = NULL;
       /* Set timestamp and span (if requested) */
@@ -692,7 +692,7 @@ EXPORT int jitter_buffer_get_another(JitterBuffer *jitter, JitterBufferPacket *p
          for (j=0;j<packet->len;j++)
             packet->data[j] = jitter->packets[i].data[j];
          /* Remove packet */
-         speex_free(jitter->packets[i].data);
+         speex_free(NULL, jitter->packets[i].data);
       }
       jitter->packets[i].data = NULL;
       packet->timestamp = jitter->packets[i].timestamp;
@@ -27,7 +27,7 @@ extern "C" {
 # define kiss_fft_scalar __m128
 #define KISS_FFT_MALLOC(nbytes) memalign(16,nbytes)
 #else
-#define KISS_FFT_MALLOC speex_alloc
+#define KISS_FFT_MALLOC(nbytes) speex_alloc(NULL, nbytes)
 #endif
 
 
@@ -92,7 +92,7 @@ void kiss_fft_stride(kiss_fft_cfg cfg,const kiss_fft_cpx *fin,kiss_fft_cpx *fout
 
 /* If kiss_fft_alloc allocated a buffer, it is one contiguous
    buffer and can be simply free()d when no longer needed*/
-#define kiss_fft_free speex_free
+#define kiss_fft_free(ptr) speex_free(NULL, ptr)
 
 /*
  Cleans up some memory that gets managed internally. Not necessary to call, but it might clean up
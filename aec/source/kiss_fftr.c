@@ -29,7 +29,8 @@ struct kiss_fftr_state{
 #endif
 };
 
-kiss_fftr_cfg kiss_fftr_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem)
+/* Config with its own work buffer when work is set, the twiddles alone otherwise */
+static kiss_fftr_cfg kiss_fftr_build(int nfft,int inverse_fft,int work,void * mem,size_t * lenmem)
 {
     int i;
     kiss_fftr_cfg st = NULL;
@@ -42,7 +43,7 @@ kiss_fftr_cfg kiss_fftr_alloc(int nfft,int inverse_fft,void * mem,size_t * lenme
     nfft >>= 1;
 
     kiss_fft_alloc (nfft, inverse_fft, NULL, &subsize);
-    memneeded = sizeof(struct kiss_fftr_state) + subsize + sizeof(kiss_fft_cpx) * ( nfft * 2);
+    memneeded = sizeof(struct kiss_fftr_state) + subsize + sizeof(kiss_fft_cpx) * (work ? nfft * 2 : nfft);
 
     if (lenmem == NULL) {
         st = (kiss_fftr_cfg) KISS_FFT_MALLOC (memneeded);
@@ -55,8 +56,8 @@ kiss_fftr_cfg kiss_fftr_alloc(int nfft,int inverse_fft,void * mem,size_t * lenme
         return NULL;
 
     st->substate = (kiss_fft_cfg) (st + 1); /*just beyond kiss_fftr_state struct */
-    st->tmpbuf = (kiss_fft_cpx *) (((char *) st->substate) + subsize);
-    st->super_twiddles = st->tmpbuf + nfft;
+    st->tmpbuf = work ? (kiss_fft_cpx *) (((char *) st->substate) + subsize) : NULL;
+    st->super_twiddles = (kiss_fft_cpx *) (((char *) st->substate) + subsize) + (work ? nfft : 0);
     kiss_fft_alloc(nfft, inverse_fft, st->substate, &subsize);
 
 #ifdef FIXED_POINT
@@ -78,6 +79,50 @@ kiss_fftr_cfg kiss_fftr_alloc(int nfft,int inverse_fft,void * mem,size_t * lenme
     return st;
 }
 
+kiss_fftr_cfg kiss_fftr_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem)
+{
+    return kiss_fftr_build(nfft, inverse_fft, 1, mem, lenmem);
+}
+
+kiss_fftr_cfg kiss_fftr_alloc_twiddles(int nfft,int inverse_fft,void * mem,size_t * lenmem)
+{
+    return kiss_fftr_build(nfft, inverse_fft, 0, mem, lenmem);
+}
+
+kiss_fftr_cfg kiss_fftr_copy(kiss_fftr_cfg proto, void * mem, size_t lenmem)
+{
+    kiss_fftr_cfg st = (kiss_fftr_cfg) mem;
+
+    if (!st)
+        return NULL;
+    /* The pointers lead into the config itself */
+    memcpy(st, proto, lenmem);
+    st->substate = (kiss_fft_cfg) (st + 1);
+    st->super_twiddles = (kiss_fft_cpx *) (((char *) st) + (((char *) proto->super_twiddles) - ((char *) proto)));
+    return st;
+}
+
+kiss_fftr_cfg kiss_fftr_share(kiss_fftr_cfg twiddles, void * mem, size_t * lenmem)
+{
+    kiss_fftr_cfg st = NULL;
+    size_t memneeded = sizeof(struct kiss_fftr_state) + sizeof(kiss_fft_cpx) * twiddles->substate->nfft;
+
+    if (lenmem == NULL) {
+        st = (kiss_fftr_cfg) KISS_FFT_MALLOC (memneeded);
+    } else {
+        if (*lenmem >= memneeded)
+            st = (kiss_fftr_cfg) mem;
+        *lenmem = memneeded;
+    }
+    if (!st)
+        return NULL;
+
+    st->substate = twiddles->substate;
+    st->tmpbuf = (kiss_fft_cpx *) (st + 1);
+    st->super_twiddles = twiddles->super_twiddles;
+    return st;
+}
+
 void kiss_fftr(kiss_fftr_cfg st,const kiss_fft_scalar *timedata,kiss_fft_cpx *freqdata)
 {
     /* input buffer timedata is stored row-wise */
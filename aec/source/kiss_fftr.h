@@ -25,6 +25,24 @@ kiss_fftr_cfg kiss_fftr_alloc(int nfft,int inverse_fft,void * mem, size_t * lenm
  If you don't care to allocate space, use mem = lenmem = NULL
 */
 
+kiss_fftr_cfg kiss_fftr_alloc_twiddles(int nfft,int inverse_fft,void * mem, size_t * lenmem);
+/*
+ Same as kiss_fftr_alloc without the work buffer, so the config only holds read-only tables. It can not
+ transform on its own, see kiss_fftr_share.
+*/
+
+kiss_fftr_cfg kiss_fftr_copy(kiss_fftr_cfg proto, void * mem, size_t lenmem);
+/*
+ Same twiddles as proto (from kiss_fftr_alloc_twiddles) without working them out again, in lenmem bytes at mem
+ (what kiss_fftr_alloc_twiddles of proto's size asks for)
+*/
+
+kiss_fftr_cfg kiss_fftr_share(kiss_fftr_cfg twiddles, void * mem, size_t * lenmem);
+/*
+ Config running on the twiddles of a kiss_fftr_alloc_twiddles config with a work buffer of its own, so any
+ number of them may transform at the same time. twiddles must outlive it. mem/lenmem as for kiss_fftr_alloc.
+*/
+
 
 void kiss_fftr(kiss_fftr_cfg cfg,const kiss_fft_scalar *timedata,kiss_fft_cpx *freqdata);
 /*
@@ -43,7 +61,7 @@ void kiss_fftri2(kiss_fftr_cfg st,const kiss_fft_scalar *freqdata, kiss_fft_scal
  output timedata has nfft scalar points
 */
 
-#define kiss_fftr_free speex_free
+#define kiss_fftr_free(ptr) speex_free(NULL, ptr)
 
 #ifdef __cplusplus
 }
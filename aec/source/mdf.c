@@ -74,6 +74,7 @@
 #include "speex_echo.h"
 #include "fftwrap.h"
 #include "pseudofloat.h"
+#include "mdf_kernels.h"
 #include "math_approx.h"
 #include "os_support.h"
 #include "comdef_nvt.h"
@@ -83,11 +84,8 @@
 #endif
 
 #ifdef FIXED_POINT
-#define WEIGHT_SHIFT 11
 #define NORMALIZE_SCALEDOWN 5
 #define NORMALIZE_SCALEUP 3
-#else
-#define WEIGHT_SHIFT 0
 #endif
 
 /* If enabled, the AEC will use a foreground filter and a background filter to be more robust to double-talk
@@ -103,7 +101,6 @@ static const spx_float_t VAR2_SMOOTH   = {23675, -15};
 static const spx_float_t VAR1_UPDATE   = {16384, -15};
 static const spx_float_t VAR2_UPDATE   = {16384, -16};
 static const spx_float_t VAR_BACKTRACK = {16384, -12};
-#define TOP16(x) ((x) >> 16)
 
 #else
 
@@ -115,12 +112,44 @@ static const spx_float_t VAR2_SMOOTH   = .7225f;
 static const spx_float_t VAR1_UPDATE   = .5f;
 static const spx_float_t VAR2_UPDATE   = .25f;
 static const spx_float_t VAR_BACKTRACK = 4.f;
-#define TOP16(x) (x)
 #endif
 
 #define PLAYBACK_DELAY 2
+/* Frames in the playback ring, a power of two so the slots stay in order when the frame counts wrap. The deepest
+   pre-buffer SPEEX_ECHO_SET_PLAYBACK_DELAY takes leaves room for two more frames */
+#define PLAYBACK_SLOTS 16
+#define PLAYBACK_DELAY_MAX (PLAYBACK_SLOTS - 2)
+
+/* The playback ring is shared by a playback and a capture thread without a lock: every field has a single writer,
+   which publishes it with a release store, and the other side reads it with an acquire load */
+#if defined(__GNUC__)
+#define MDF_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MDF_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+/* No ordering without the builtins, playback and capture then have to run on the same thread */
+#define MDF_LOAD(p) (*(p))
+#define MDF_STORE(p, v) (*(p) = (v))
+#endif
+
+/* Pre-emphasis of the far end and the microphone */
+#define PREEMPH QCONST16(.9, 15)
+
+/* Default mean far-end power per sample (after pre-emphasis) below which a frame counts as silent, about -80 dBFS */
+#define FAR_END_SILENCE 10
+
+/* With sparse updates, a partition whose weight energy is below SPARSE_LEVEL times that of the strongest one (-24 dB)
+   only adapts every 2^SPARSE_SHIFT frames, with as many times the step */
+#define SPARSE_LEVEL QCONST16(.004f, 15)
+#define SPARSE_SHIFT 2
+
+#if defined(__GNUC__)
+#define MDF_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define MDF_ALWAYS_INLINE inline
+#endif
 
 void speex_echo_get_residual(SpeexEchoState *st, spx_word32_t *Yout, int len);
+void speex_echo_get_filter_residual(SpeexEchoState *st, int chan, spx_word32_t *residual_echo, int len);
 
 /** Speex echo cancellation state. */
 struct SpeexEchoState_ {
@@ -142,7 +171,8 @@ struct SpeexEchoState_ {
 
     spx_word16_t *e;     /* scratch */
     spx_word16_t *x;     /* Far-end input buffer (2N) */
-    spx_word16_t *X;     /* Far-end buffer (M+1 frames) in frequency domain */
+    spx_word16_t *X;     /* Far-end buffer (M+1 frames) in frequency domain, ring of K*N slots */
+    int X_head;          /* Slot of the newest far-end frame in X */
     spx_word16_t *input; /* scratch */
     spx_word16_t *y;     /* scratch */
     spx_word16_t *last_y;
@@ -179,11 +209,128 @@ struct SpeexEchoState_ {
     spx_mem_t *notch_mem;
 
     /* NOTE: If you only use speex_echo_cancel() and want to save some memory, remove this */
-    spx_int16_t *play_buf;
-    int play_buf_pos;
-    int play_buf_started;
+    struct MdfPlayRing_ *play; /* Far end queued by speex_echo_playback for speex_echo_capture */
+
+    PST_AUD_MEM_ARENA arena;   /* Memory arena the state lives in */
+    const MdfKernels *kernels; /* Spectral kernels picked for this CPU */
+
+    PST_AUD_POOL pool;                /* Runs the per-microphone work when set and C > 1 */
+    void **chan_fft;                  /* FFT table of every microphone, the transforms keep their work area in there */
+    struct MdfChanStats_ *chan_stats; /* scratch, per-microphone sums of a frame */
+    spx_int16_t *last_in;             /* scratch, start of the microphone frame as read, for last_y */
+    spx_word16_t *residual_gain;      /* Per bin, undoes the pre-emphasis of Y and matches the energy of the windowed last_y */
+    int far_end_silence;              /* Mean far-end power per sample below which a frame is silent (SPEEX_ECHO_SET_FAR_END_SILENCE) */
+    int far_end_silent;               /* Silent far-end frames in a row, the filters are bypassed once they cover the tail */
+    int sparse;                       /* Partitions holding little echo adapt at a reduced rate (SPEEX_ECHO_SET_SPARSE_UPDATE) */
+    spx_word32_t *part_energy;        /* Weight energy of every partition, as mdf_adjust_prop sums it */
+    int *part_stale;                  /* Partitions whose weights changed since their part_energy was summed */
+    int *part_update;                 /* Shift of the step of every partition this frame, -1 for no update */
 };
 
+/** Per-microphone contributions to the frame sums, added up in microphone order whichever thread produced them */
+typedef struct MdfChanStats_ {
+    spx_word32_t Sff, Dbf, See;
+    spx_word32_t Sey, Syy, Sdd;
+    int saturated;
+} MdfChanStats;
+
+/** Caller buffers of a frame. Sample i of microphone chan is in[i * in_stride + chan], likewise for the speakers
+    in far_end and the microphones in out, so interleaved channels of a wider stream are read and written in place */
+typedef struct MdfIo_ {
+    const spx_int16_t *in;
+    const spx_int16_t *far_end;
+    spx_int16_t *out;
+    int in_stride;
+    int far_stride;
+    int out_stride;
+} MdfIo;
+
+/** What the per-microphone tasks of a frame need besides the microphone index */
+typedef struct MdfChanTask_ {
+    SpeexEchoState *st;
+    const struct MdfFrame_ *f;
+    const MdfIo *io;
+    int adapt;
+} MdfChanTask;
+
+/** Per-frame values carried from one stage of the canceller to the next */
+typedef struct MdfFrame_ {
+    spx_word16_t *X; /* Newest far-end spectrum */
+    int X_wrap;
+    spx_word32_t Sxx, Sff, See, Dbf;
+} MdfFrame;
+
+/** Far-end frames on their way from speex_echo_playback to speex_echo_capture, which may run on two threads. Each
+    side only writes its own half, kept on its own cache line, so neither ever waits for the other. The ring starts
+    with delay frames of silence; a playback frame is dropped when the ring already holds more than delay frames and
+    queued twice when it holds fewer than delay - 1, which keeps the far end about delay frames ahead of the
+    microphone. */
+typedef struct MdfPlayRing_ {
+    /* Playback side */
+    unsigned int write;    /* Frames queued */
+    unsigned int offered;  /* Frames passed to speex_echo_playback since the first capture */
+    unsigned int overruns; /* Frames dropped, the ring was full */
+    unsigned int refills;  /* Frames queued twice */
+    char pad[AUD_MEM_ALIGN - 4 * sizeof(unsigned int)];
+    /* Capture side */
+    unsigned int read;      /* Frames consumed */
+    unsigned int captured;  /* Captures since the first one */
+    unsigned int underruns; /* Captures that found no frame */
+    int started;            /* Set by the first capture, the frames played before it are dropped */
+    int fill_min;           /* Fill seen by the captures since the statistics were last read */
+    int fill_max;
+    /* Fixed while streaming */
+    spx_int16_t *buf; /* PLAYBACK_SLOTS frames of K interleaved speakers */
+    int delay;
+} MdfPlayRing;
+
+/* Layout check of the snapshots of speex_echo_state_save */
+#define MDF_SNAPSHOT_MAGIC 0x5344464d /* "MFDS" */
+#define MDF_SNAPSHOT_VERSION 2
+
+/** Start of a snapshot, followed by the raw arrays in the order mdf_snapshot_fields walks them. A snapshot only
+    loads into a state of the same build and shape. */
+typedef struct MdfSnapshot_ {
+    spx_uint32_t magic;
+    spx_int32_t version;
+    spx_int32_t size;        /* Bytes of the whole snapshot */
+    spx_int32_t fixed_point; /* The arrays hold fixed-point values */
+    spx_int32_t frame_size;
+    spx_int32_t M;
+    spx_int32_t C;
+    spx_int32_t K;
+} MdfSnapshot;
+
+#ifdef _filter_dc_notch16_OPT
+/* Same recursion with both filter memories kept in registers, they only go back to mem once per frame.
+   The generic version reloads them after every store to out, which may alias mem as far as the compiler knows. */
+static inline void filter_dc_notch16(const spx_int16_t *in, spx_word16_t radius, spx_word16_t *out, int len, spx_mem_t *mem, int stride)
+{
+    int i;
+    spx_word16_t den2;
+    spx_mem_t mem0 = mem[0];
+    spx_mem_t mem1 = mem[1];
+#ifdef FIXED_POINT
+    den2 = MULT16_16_Q15(radius, radius) + MULT16_16_Q15(QCONST16(.7, 15), MULT16_16_Q15(32767 - radius, 32767 - radius));
+#else
+    den2 = radius * radius + .7 * (1 - radius) * (1 - radius);
+#endif
+    for (i = 0; i < len; i++) {
+        spx_word16_t vin  = in[i * stride];
+        spx_word32_t vin15 = SHL32(EXTEND32(vin), 15);
+        spx_word32_t vout = mem0 + vin15;
+#ifdef FIXED_POINT
+        mem0 = mem1 + SHL32(SHL32(-EXTEND32(vin), 15) + MULT16_32_Q15(radius, vout), 1);
+#else
+        mem0 = mem1 + 2 * (-vin + radius * vout);
+#endif
+        mem1   = vin15 - MULT16_32_Q15(den2, vout);
+        out[i] = SATURATE32(PSHR32(MULT16_32_Q15(radius, vout), 15), 32767);
+    }
+    mem[0] = mem0;
+    mem[1] = mem1;
+}
+#else
 static inline void filter_dc_notch16(const spx_int16_t *in, spx_word16_t radius, spx_word16_t *out, int len, spx_mem_t *mem, int stride)
 {
     int i;
@@ -206,144 +353,89 @@ static inline void filter_dc_notch16(const spx_int16_t *in, spx_word16_t radius,
         out[i] = SATURATE32(PSHR32(MULT16_32_Q15(radius, vout), 15), 32767);
     }
 }
+#endif
 
-/* This inner product is slightly different from the codec version because of fixed-point */
-static inline spx_word32_t mdf_inner_prod(const spx_word16_t *x, const spx_word16_t *y, int len)
+/** Far-end spectrum of partition j (0 is the newest frame, M the oldest) inside the X ring */
+static inline spx_word16_t *mdf_far_end_part(SpeexEchoState *st, int j)
 {
-    spx_word32_t sum = 0;
-    len >>= 1;
-    while (len--) {
-        spx_word32_t part = 0;
-        part              = MAC16_16(part, *x++, *y++);
-        part              = MAC16_16(part, *x++, *y++);
-        /* HINT: If you had a 40-bit accumulator, you could shift only at the end */
-        sum = ADD32(sum, SHR32(part, 6));
-    }
-    return sum;
+    int slot = st->X_head + j;
+    if (slot > st->M)
+        slot -= st->M + 1;
+    return st->X + slot * st->window_size * st->K;
 }
 
-/** Compute power spectrum of a half-complex (packed) vector */
-static inline void power_spectrum(const spx_word16_t *X, spx_word32_t *ps, int N)
+/** Number of blocks of size N, starting from the newest partition, stored contiguously before the X ring wraps */
+static inline int mdf_far_end_wrap(SpeexEchoState *st, int M)
 {
-    int i, j;
-    ps[0] = MULT16_16(X[0], X[0]);
-    for (i = 1, j = 1; i < N - 1; i += 2, j++) {
-        ps[j] = MULT16_16(X[i], X[i]) + MULT16_16(X[i + 1], X[i + 1]);
-    }
-    ps[j] = MULT16_16(X[i], X[i]);
+    int parts = st->M + 1 - st->X_head;
+    return (parts < M ? parts : M) * st->K;
 }
 
-/** Compute power spectrum of a half-complex (packed) vector and accumulate */
-static inline void power_spectrum_accum(const spx_word16_t *X, spx_word32_t *ps, int N)
+#ifdef TWO_PATH
+/** Copy background filter to foreground filter */
+static inline void mdf_save_foreground(SpeexEchoState *st)
 {
-    int i, j;
-    ps[0] += MULT16_16(X[0], X[0]);
-    for (i = 1, j = 1; i < N - 1; i += 2, j++) {
-        ps[j] += MULT16_16(X[i], X[i]) + MULT16_16(X[i + 1], X[i + 1]);
-    }
-    ps[j] += MULT16_16(X[i], X[i]);
+    int i, n = st->window_size * st->M * st->C * st->K;
+    for (i = 0; i < n; i++)
+        st->foreground[i] = EXTRACT16(PSHR32(st->W[i], 16));
 }
 
-/** Compute cross-power spectrum of a half-complex (packed) vectors and add to acc */
-#ifdef FIXED_POINT
-static inline void spectral_mul_accum(const spx_word16_t *X, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+/** Copy foreground filter to background filter */
+static inline void mdf_restore_foreground(SpeexEchoState *st)
 {
-    int i, j;
-    spx_word32_t tmp1 = 0, tmp2 = 0;
-    for (j = 0; j < M; j++) {
-        tmp1 = MAC16_16(tmp1, X[j * N], TOP16(Y[j * N]));
-    }
-    acc[0] = PSHR32(tmp1, WEIGHT_SHIFT);
-    for (i = 1; i < N - 1; i += 2) {
-        tmp1 = tmp2 = 0;
-        for (j = 0; j < M; j++) {
-            tmp1 = SUB32(MAC16_16(tmp1, X[j * N + i], TOP16(Y[j * N + i])), MULT16_16(X[j * N + i + 1], TOP16(Y[j * N + i + 1])));
-            tmp2 = MAC16_16(MAC16_16(tmp2, X[j * N + i + 1], TOP16(Y[j * N + i])), X[j * N + i], TOP16(Y[j * N + i + 1]));
-        }
-        acc[i]     = PSHR32(tmp1, WEIGHT_SHIFT);
-        acc[i + 1] = PSHR32(tmp2, WEIGHT_SHIFT);
-    }
-    tmp1 = tmp2 = 0;
-    for (j = 0; j < M; j++) {
-        tmp1 = MAC16_16(tmp1, X[(j + 1) * N - 1], TOP16(Y[(j + 1) * N - 1]));
-    }
-    acc[N - 1] = PSHR32(tmp1, WEIGHT_SHIFT);
-}
-static inline void spectral_mul_accum16(const spx_word16_t *X, const spx_word16_t *Y, spx_word16_t *acc, int N, int M)
-{
-    int i, j;
-    spx_word32_t tmp1 = 0, tmp2 = 0;
-    for (j = 0; j < M; j++) {
-        tmp1 = MAC16_16(tmp1, X[j * N], Y[j * N]);
-    }
-    acc[0] = PSHR32(tmp1, WEIGHT_SHIFT);
-    for (i = 1; i < N - 1; i += 2) {
-        tmp1 = tmp2 = 0;
-        for (j = 0; j < M; j++) {
-            tmp1 = SUB32(MAC16_16(tmp1, X[j * N + i], Y[j * N + i]), MULT16_16(X[j * N + i + 1], Y[j * N + i + 1]));
-            tmp2 = MAC16_16(MAC16_16(tmp2, X[j * N + i + 1], Y[j * N + i]), X[j * N + i], Y[j * N + i + 1]);
-        }
-        acc[i]     = PSHR32(tmp1, WEIGHT_SHIFT);
-        acc[i + 1] = PSHR32(tmp2, WEIGHT_SHIFT);
-    }
-    tmp1 = tmp2 = 0;
-    for (j = 0; j < M; j++) {
-        tmp1 = MAC16_16(tmp1, X[(j + 1) * N - 1], Y[(j + 1) * N - 1]);
-    }
-    acc[N - 1] = PSHR32(tmp1, WEIGHT_SHIFT);
+    int i, n = st->window_size * st->M * st->C * st->K;
+    for (i = 0; i < n; i++)
+        st->W[i] = SHL32(EXTEND32(st->foreground[i]), 16);
+    for (i = 0; i < st->M; i++)
+        st->part_stale[i] = 1;
 }
+#endif
 
-#else
-static inline void spectral_mul_accum(const spx_word16_t *X, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+#ifdef _mdf_adjust_prop_OPT
+/* Adds the energy of one N-word block of weights to sum. Fixed point keeps four independent partial sums
+   so the adds don't serialise on one register (integer, same result). Float has to keep the order, so there this
+   is the reference loop again and the switch only matters to the fixed-point build. */
+static inline spx_word32_t mdf_weight_energy(spx_word32_t sum, const spx_word32_t *W, int N)
 {
-    int i, j;
-    for (i = 0; i < N; i++)
-        acc[i] = 0;
-    for (j = 0; j < M; j++) {
-        acc[0] += X[0] * Y[0];
-        for (i = 1; i < N - 1; i += 2) {
-            acc[i] += (X[i] * Y[i] - X[i + 1] * Y[i + 1]);
-            acc[i + 1] += (X[i + 1] * Y[i] + X[i] * Y[i + 1]);
-        }
-        acc[i] += X[i] * Y[i];
-        X += N;
-        Y += N;
+    int j = 0;
+#ifdef FIXED_POINT
+    spx_word32_t sum1 = 0, sum2 = 0, sum3 = 0;
+    for (; j + 4 <= N; j += 4) {
+        spx_word16_t w0 = EXTRACT16(SHR32(W[j], 18));
+        spx_word16_t w1 = EXTRACT16(SHR32(W[j + 1], 18));
+        spx_word16_t w2 = EXTRACT16(SHR32(W[j + 2], 18));
+        spx_word16_t w3 = EXTRACT16(SHR32(W[j + 3], 18));
+        sum             = MAC16_16(sum, w0, w0);
+        sum1            = MAC16_16(sum1, w1, w1);
+        sum2            = MAC16_16(sum2, w2, w2);
+        sum3            = MAC16_16(sum3, w3, w3);
     }
+    sum = ADD32(ADD32(sum, sum1), ADD32(sum2, sum3));
+#endif
+    for (; j < N; j++) {
+        spx_word16_t w0 = EXTRACT16(SHR32(W[j], 18));
+        sum             = MAC16_16(sum, w0, w0);
+    }
+    return sum;
 }
-#define spectral_mul_accum16 spectral_mul_accum
 #endif
 
-/** Compute weighted cross-power spectrum of a half-complex (packed) vector with conjugate */
-static inline void weighted_spectral_mul_conj(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+/** Step size weight of a partition from its filter energy, before normalisation */
+static inline spx_word16_t mdf_prop_from_energy(spx_word32_t tmp)
 {
-    int i, j;
-    spx_float_t W;
-    W       = FLOAT_AMULT(p, w[0]);
-    prod[0] = FLOAT_MUL32(W, MULT16_16(X[0], Y[0]));
-    for (i = 1, j = 1; i < N - 1; i += 2, j++) {
-        W           = FLOAT_AMULT(p, w[j]);
-        prod[i]     = FLOAT_MUL32(W, MAC16_16(MULT16_16(X[i], Y[i]), X[i + 1], Y[i + 1]));
-        prod[i + 1] = FLOAT_MUL32(W, MAC16_16(MULT16_16(-X[i + 1], Y[i]), X[i], Y[i + 1]));
-    }
-    W       = FLOAT_AMULT(p, w[j]);
-    prod[i] = FLOAT_MUL32(W, MULT16_16(X[i], Y[i]));
+#ifdef FIXED_POINT
+    /* Just a security in case an overflow were to occur */
+    tmp = MIN32(ABS32(tmp), 536870912);
+#endif
+    return spx_sqrt(tmp);
 }
 
-static inline void mdf_adjust_prop(const spx_word32_t *W, int N, int M, int P, spx_word16_t *prop)
+static inline void mdf_normalise_prop(spx_word16_t *prop, int M)
 {
-    int i, j, p;
+    int i;
     spx_word16_t max_sum  = 1;
     spx_word32_t prop_sum = 1;
     for (i = 0; i < M; i++) {
-        spx_word32_t tmp = 1;
-        for (p = 0; p < P; p++)
-            for (j = 0; j < N; j++)
-                tmp += MULT16_16(EXTRACT16(SHR32(W[p * N * M + i * N + j], 18)), EXTRACT16(SHR32(W[p * N * M + i * N + j], 18)));
-#ifdef FIXED_POINT
-        /* Just a security in case an overflow were to occur */
-        tmp = MIN32(ABS32(tmp), 536870912);
-#endif
-        prop[i] = spx_sqrt(tmp);
         if (prop[i] > max_sum)
             max_sum = prop[i];
     }
@@ -358,6 +450,67 @@ static inline void mdf_adjust_prop(const spx_word32_t *W, int N, int M, int P, s
     /*printf ("\n");*/
 }
 
+/** Weight energy of partition i over the P filters */
+static inline spx_word32_t mdf_partition_energy(const spx_word32_t *W, int N, int M, int P, int i)
+{
+    int p;
+    spx_word32_t tmp = 1;
+#ifdef _mdf_adjust_prop_OPT
+    for (p = 0; p < P; p++)
+        tmp = mdf_weight_energy(tmp, W + p * N * M + i * N, N);
+#else
+    int j;
+    for (p = 0; p < P; p++)
+        for (j = 0; j < N; j++)
+            tmp += MULT16_16(EXTRACT16(SHR32(W[p * N * M + i * N + j], 18)), EXTRACT16(SHR32(W[p * N * M + i * N + j], 18)));
+#endif
+    return tmp;
+}
+
+static inline void mdf_adjust_prop(const spx_word32_t *W, int N, int M, int P, spx_word16_t *prop)
+{
+    int i;
+    for (i = 0; i < M; i++)
+        prop[i] = mdf_prop_from_energy(mdf_partition_energy(W, N, M, P, i));
+    mdf_normalise_prop(prop, M);
+}
+
+/** mdf_adjust_prop for sparse updates, which only sums the partitions whose weights changed again. Also picks the
+    partitions the gradient goes into this frame: those with at least SPARSE_LEVEL of the energy of the strongest one,
+    and each of the others once every 2^SPARSE_SHIFT frames, in turn. */
+static inline void mdf_adjust_prop_sparse(SpeexEchoState *st, int N, int M)
+{
+    int i;
+    spx_word32_t level = 0;
+    for (i = 0; i < M; i++) {
+        if (st->part_stale[i]) {
+            st->part_energy[i] = mdf_partition_energy(st->W, N, M, st->C * st->K, i);
+            st->part_stale[i]  = 0;
+        }
+        st->prop[i] = mdf_prop_from_energy(st->part_energy[i]);
+        level       = MAX32(level, st->part_energy[i]);
+    }
+    /* The sums start at 1, which is no small energy in float */
+    level = MULT16_32_Q15(SPARSE_LEVEL, SUB32(level, 1));
+    for (i = 0; i < M; i++) {
+        if (SUB32(st->part_energy[i], 1) >= level)
+            st->part_update[i] = 0;
+        else
+            st->part_update[i] = ((st->cancel_count + i) & ((1 << SPARSE_SHIFT) - 1)) == 0 ? SPARSE_SHIFT : -1;
+    }
+    mdf_normalise_prop(st->prop, M);
+}
+
+/** Every partition adapts and has its energy summed again on the next frame */
+static inline void mdf_sparse_reset(SpeexEchoState *st)
+{
+    int i;
+    for (i = 0; i < st->M; i++) {
+        st->part_stale[i]  = 1;
+        st->part_update[i] = 0;
+    }
+}
+
 #ifdef DUMP_ECHO_CANCEL_DATA
 #include <stdio.h>
 static FILE *rFile = NULL, *pFile = NULL, *oFile = NULL;
@@ -374,15 +527,122 @@ static void dump_audio(const spx_int16_t *rec, const spx_int16_t *play, const sp
 #endif
 
 /** Creates a new echo canceller state */
-EXPORT SpeexEchoState *speex_echo_state_init(int frame_size, int filter_length)
+static SpeexEchoState *mdf_state_init(int frame_size, int filter_length, int nb_mic, int nb_speakers, PST_AUD_MEM_ARENA arena, const SpeexEchoState *proto);
+
+/** Empties the playback ring down to its delay frames of silence, neither side may be running */
+static void mdf_play_reset(SpeexEchoState *st)
+{
+    MdfPlayRing *play = st->play;
+    int i;
+
+    for (i = 0; i < play->delay * st->K * st->frame_size; i++)
+        play->buf[i] = 0;
+    play->write     = play->delay;
+    play->read      = 0;
+    play->offered   = 0;
+    play->captured  = 0;
+    play->overruns  = 0;
+    play->refills   = 0;
+    play->underruns = 0;
+    play->started   = 0;
+    play->fill_min  = play->delay;
+    play->fill_max  = play->delay;
+}
+
+EXPORT SpeexEchoState *speex_echo_state_init(int frame_size, int filter_length, PST_AUD_MEM_ARENA arena)
 {
-    return speex_echo_state_init_mc(frame_size, filter_length, 1, 1);
+    return speex_echo_state_init_mc(frame_size, filter_length, 1, 1, arena);
 }
 
-EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_length, int nb_mic, int nb_speakers)
+EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_length, int nb_mic, int nb_speakers, PST_AUD_MEM_ARENA arena)
+{
+    return mdf_state_init(frame_size, filter_length, nb_mic, nb_speakers, arena, NULL);
+}
+
+EXPORT SpeexEchoState *speex_echo_state_clone(const SpeexEchoState *proto, PST_AUD_MEM_ARENA arena)
+{
+    SpeexEchoState *st;
+
+    st = mdf_state_init(proto->frame_size, proto->M * proto->frame_size, proto->C, proto->K, arena, proto);
+    if (!st)
+        return NULL;
+    /* The settings of proto, as speex_echo_ctl left them */
+    st->sampling_rate   = proto->sampling_rate;
+    st->spec_average    = proto->spec_average;
+    st->beta0           = proto->beta0;
+    st->beta_max        = proto->beta_max;
+    st->notch_radius    = proto->notch_radius;
+    st->far_end_silence = proto->far_end_silence;
+    st->sparse          = proto->sparse;
+    st->play->delay     = proto->play->delay;
+    mdf_play_reset(st);
+    return st;
+}
+
+/** Hanning window of N points, key N */
+static void *mdf_window_new(PST_AUD_MEM_ARENA arena, const int *key, const void *proto)
+{
+    const int N          = key[0];
+    spx_word16_t *window = (spx_word16_t *)speex_alloc(arena, N * sizeof(spx_word16_t));
+    int i;
+
+    if (!window)
+        return NULL;
+    if (proto) {
+        SPEEX_COPY(window, (const spx_word16_t *)proto, N);
+        return window;
+    }
+#ifdef FIXED_POINT
+    for (i = 0; i < N >> 1; i++) {
+        window[i]         = (16383 - SHL16(spx_cos(DIV32_16(MULT16_16(25736, i << 1), N)), 1));
+        window[N - i - 1] = window[i];
+    }
+#else
+    for (i = 0; i < N; i++)
+        window[i] = .5 - .5 * cos(2 * M_PI * i / N);
+#endif
+    return window;
+}
+
+/** Y holds one rectangular frame of the pre-emphasised echo estimate, the residual echo is worked out from two
+    Hanning-windowed frames of the echo as played: 3/4 of the energy times 1/|1 - PREEMPH*exp(-jw)|^2 per bin.
+    Key frame_size. */
+static void *mdf_residual_gain_new(PST_AUD_MEM_ARENA arena, const int *key, const void *proto)
+{
+    const int frame_size        = key[0];
+    const spx_word16_t preemph  = PREEMPH;
+    spx_word16_t *residual_gain = (spx_word16_t *)speex_alloc(arena, (frame_size + 1) * sizeof(spx_word16_t));
+    int i;
+
+    if (!residual_gain)
+        return NULL;
+    if (proto) {
+        SPEEX_COPY(residual_gain, (const spx_word16_t *)proto, frame_size + 1);
+        return residual_gain;
+    }
+    for (i = 0; i <= frame_size; i++) {
+#ifdef FIXED_POINT
+        spx_word32_t den = ADD32(SUB32(QCONST32(1.f, 15), PSHR32(MULT16_16(preemph, spx_cos(DIV32_16(MULT16_16(25736, i), frame_size))), 12)), MULT16_16_Q15(preemph, preemph));
+        residual_gain[i] = EXTRACT16(DIV32(QCONST32(.75f, 23), den)); /* Q8 */
+#else
+        residual_gain[i] = .75f / (1.f + preemph * preemph - 2.f * preemph * cos(M_PI * i / frame_size));
+#endif
+    }
+    return residual_gain;
+}
+
+/** With proto the tables (transforms, window, step size profile, residual gain) are copied from it instead of computed. The
+    window, residual gain and transform twiddles are read-only and shared with other states when the arena asks
+    for it (see speex_table_get). */
+static SpeexEchoState *mdf_state_init(int frame_size, int filter_length, int nb_mic, int nb_speakers, PST_AUD_MEM_ARENA arena, const SpeexEchoState *proto)
 {
     int i, N, M, C, K;
-    SpeexEchoState *st = (SpeexEchoState *)speex_alloc(sizeof(SpeexEchoState));
+    SpeexEchoState *st = (SpeexEchoState *)speex_alloc(arena, sizeof(SpeexEchoState));
+
+    if (!st)
+        return NULL;
+    st->arena   = arena;
+    st->kernels = mdf_kernels_select(MDF_KERNEL_LEVEL_MAX);
 
     st->K = nb_speakers;
     st->C = nb_mic;
@@ -415,41 +675,46 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
 #endif
     st->leak_estimate = 0;
 
-    st->fft_table = spx_fft_init(N);
-
-    st->e      = (spx_word16_t *)speex_alloc(C * N * sizeof(spx_word16_t));
-    st->x      = (spx_word16_t *)speex_alloc(K * N * sizeof(spx_word16_t));
-    st->input  = (spx_word16_t *)speex_alloc(C * st->frame_size * sizeof(spx_word16_t));
-    st->y      = (spx_word16_t *)speex_alloc(C * N * sizeof(spx_word16_t));
-    st->last_y = (spx_word16_t *)speex_alloc(C * N * sizeof(spx_word16_t));
-    st->Yf     = (spx_word32_t *)speex_alloc((st->frame_size + 1) * sizeof(spx_word32_t));
-    st->Rf     = (spx_word32_t *)speex_alloc((st->frame_size + 1) * sizeof(spx_word32_t));
-    st->Xf     = (spx_word32_t *)speex_alloc((st->frame_size + 1) * sizeof(spx_word32_t));
-    st->Yh     = (spx_word32_t *)speex_alloc((st->frame_size + 1) * sizeof(spx_word32_t));
-    st->Eh     = (spx_word32_t *)speex_alloc((st->frame_size + 1) * sizeof(spx_word32_t));
-
-    st->X = (spx_word16_t *)speex_alloc(K * (M + 1) * N * sizeof(spx_word16_t));
-    st->Y = (spx_word16_t *)speex_alloc(C * N * sizeof(spx_word16_t));
-    st->E = (spx_word16_t *)speex_alloc(C * N * sizeof(spx_word16_t));
-    st->W = (spx_word32_t *)speex_alloc(C * K * M * N * sizeof(spx_word32_t));
+    st->fft_table   = proto ? spx_fft_clone(proto->fft_table, st->arena) : spx_fft_init(N, st->arena);
+    st->chan_fft    = (void **)speex_alloc(st->arena, C * sizeof(void *));
+    st->chan_fft[0] = st->fft_table;
+    /* Same size for every microphone, only the work area differs */
+    for (i = 1; i < C; i++)
+        st->chan_fft[i] = spx_fft_clone(st->fft_table, st->arena);
+    st->chan_stats = (MdfChanStats *)speex_alloc_scratch(st->arena, C * sizeof(MdfChanStats));
+    st->last_in    = (spx_int16_t *)speex_alloc_scratch(st->arena, frame_size * sizeof(spx_int16_t));
+
+    st->e      = (spx_word16_t *)speex_alloc_scratch(st->arena, C * N * sizeof(spx_word16_t));
+    st->x      = (spx_word16_t *)speex_alloc(st->arena, K * N * sizeof(spx_word16_t));
+    st->input  = (spx_word16_t *)speex_alloc_scratch(st->arena, C * st->frame_size * sizeof(spx_word16_t));
+    st->y      = (spx_word16_t *)speex_alloc_scratch(st->arena, C * N * sizeof(spx_word16_t));
+    st->last_y = (spx_word16_t *)speex_alloc(st->arena, C * N * sizeof(spx_word16_t));
+    st->Yf     = (spx_word32_t *)speex_alloc_scratch(st->arena, (st->frame_size + 1) * sizeof(spx_word32_t));
+    st->Rf     = (spx_word32_t *)speex_alloc_scratch(st->arena, (st->frame_size + 1) * sizeof(spx_word32_t));
+    st->Xf     = (spx_word32_t *)speex_alloc_scratch(st->arena, (st->frame_size + 1) * sizeof(spx_word32_t));
+    st->Yh     = (spx_word32_t *)speex_alloc(st->arena, (st->frame_size + 1) * sizeof(spx_word32_t));
+    st->Eh     = (spx_word32_t *)speex_alloc(st->arena, (st->frame_size + 1) * sizeof(spx_word32_t));
+
+    st->X = (spx_word16_t *)speex_alloc(st->arena, K * (M + 1) * N * sizeof(spx_word16_t));
+    st->Y = (spx_word16_t *)speex_alloc_scratch(st->arena, C * N * sizeof(spx_word16_t));
+    st->E = (spx_word16_t *)speex_alloc(st->arena, C * N * sizeof(spx_word16_t));
+    st->W = (spx_word32_t *)speex_alloc(st->arena, C * K * M * N * sizeof(spx_word32_t));
 #ifdef TWO_PATH
-    st->foreground = (spx_word16_t *)speex_alloc(M * N * C * K * sizeof(spx_word16_t));
-#endif
-    st->PHI     = (spx_word32_t *)speex_alloc(N * sizeof(spx_word32_t));
-    st->power   = (spx_word32_t *)speex_alloc((frame_size + 1) * sizeof(spx_word32_t));
-    st->power_1 = (spx_float_t *)speex_alloc((frame_size + 1) * sizeof(spx_float_t));
-    st->window  = (spx_word16_t *)speex_alloc(N * sizeof(spx_word16_t));
-    st->prop    = (spx_word16_t *)speex_alloc(M * sizeof(spx_word16_t));
-    st->wtmp    = (spx_word16_t *)speex_alloc(N * sizeof(spx_word16_t));
+    st->foreground = (spx_word16_t *)speex_alloc(st->arena, M * N * C * K * sizeof(spx_word16_t));
+#endif
+#ifndef _weighted_spectral_mul_conj_OPT
+    st->PHI = (spx_word32_t *)speex_alloc_scratch(st->arena, C * N * sizeof(spx_word32_t));
+#endif
+    st->power   = (spx_word32_t *)speex_alloc(st->arena, (frame_size + 1) * sizeof(spx_word32_t));
+    st->power_1 = (spx_float_t *)speex_alloc(st->arena, (frame_size + 1) * sizeof(spx_float_t));
+    st->window  = (spx_word16_t *)speex_table_get(st->arena, mdf_window_new, speex_free, &N, 1, proto ? proto->window : NULL);
+    st->prop    = (spx_word16_t *)speex_alloc(st->arena, M * sizeof(spx_word16_t));
+    st->part_energy = (spx_word32_t *)speex_alloc(st->arena, M * sizeof(spx_word32_t));
+    st->part_stale  = (int *)speex_alloc(st->arena, M * sizeof(int));
+    st->part_update = (int *)speex_alloc(st->arena, M * sizeof(int));
+    st->wtmp    = (spx_word16_t *)speex_alloc_scratch(st->arena, C * N * sizeof(spx_word16_t));
 #ifdef FIXED_POINT
-    st->wtmp2 = (spx_word16_t *)speex_alloc(N * sizeof(spx_word16_t));
-    for (i = 0; i < N >> 1; i++) {
-        st->window[i]         = (16383 - SHL16(spx_cos(DIV32_16(MULT16_16(25736, i << 1), N)), 1));
-        st->window[N - i - 1] = st->window[i];
-    }
-#else
-    for (i = 0; i < N; i++)
-        st->window[i] = .5 - .5 * cos(2 * M_PI * i / N);
+    st->wtmp2 = (spx_word16_t *)speex_alloc_scratch(st->arena, C * N * sizeof(spx_word16_t));
 #endif
     for (i = 0; i <= st->frame_size; i++)
         st->power_1[i] = FLOAT_ONE;
@@ -470,10 +735,11 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
         }
     }
 
-    st->memX    = (spx_word16_t *)speex_alloc(K * sizeof(spx_word16_t));
-    st->memD    = (spx_word16_t *)speex_alloc(C * sizeof(spx_word16_t));
-    st->memE    = (spx_word16_t *)speex_alloc(C * sizeof(spx_word16_t));
-    st->preemph = QCONST16(.9, 15);
+    st->memX    = (spx_word16_t *)speex_alloc(st->arena, K * sizeof(spx_word16_t));
+    st->memD    = (spx_word16_t *)speex_alloc(st->arena, C * sizeof(spx_word16_t));
+    st->memE    = (spx_word16_t *)speex_alloc(st->arena, C * sizeof(spx_word16_t));
+    st->preemph = PREEMPH;
+    st->residual_gain = (spx_word16_t *)speex_table_get(st->arena, mdf_residual_gain_new, speex_free, &frame_size, 1, proto ? proto->residual_gain : NULL);
     if (st->sampling_rate < 12000)
         st->notch_radius = QCONST16(.9, 15);
     else if (st->sampling_rate < 24000)
@@ -481,8 +747,13 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
     else
         st->notch_radius = QCONST16(.992, 15);
 
-    st->notch_mem = (spx_mem_t *)speex_alloc(2 * C * sizeof(spx_mem_t));
+    st->notch_mem = (spx_mem_t *)speex_alloc(st->arena, 2 * C * sizeof(spx_mem_t));
     st->adapted   = 0;
+
+    st->far_end_silence = FAR_END_SILENCE;
+    st->far_end_silent  = 0;
+    st->sparse          = 0;
+    mdf_sparse_reset(st);
     st->Pey = st->Pyy = FLOAT_ONE;
 
 #ifdef TWO_PATH
@@ -490,14 +761,15 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
     st->Dvar1 = st->Dvar2 = FLOAT_ZERO;
 #endif
 
-    st->play_buf         = (spx_int16_t *)speex_alloc(K * (PLAYBACK_DELAY + 1) * st->frame_size * sizeof(spx_int16_t));
-    st->play_buf_pos     = PLAYBACK_DELAY * st->frame_size;
-    st->play_buf_started = 0;
+    st->play        = (MdfPlayRing *)speex_alloc(st->arena, sizeof(MdfPlayRing));
+    st->play->delay = PLAYBACK_DELAY;
+    st->play->buf   = (spx_int16_t *)speex_alloc(st->arena, PLAYBACK_SLOTS * K * frame_size * sizeof(spx_int16_t));
+    mdf_play_reset(st);
     return st;
 }
 
-/** Resets echo canceller state */
-EXPORT void speex_echo_state_reset(SpeexEchoState *st)
+/** Resets everything but the playback ring, which the playback side may be filling meanwhile */
+static void mdf_state_reset(SpeexEchoState *st)
 {
     int i, M, N, C, K;
     st->cancel_count = 0;
@@ -514,6 +786,7 @@ EXPORT void speex_echo_state_reset(SpeexEchoState *st)
 #endif
     for (i = 0; i < N * (M + 1); i++)
         st->X[i] = 0;
+    st->X_head = 0;
     for (i = 0; i <= st->frame_size; i++) {
         st->power[i]   = 0;
         st->power_1[i] = FLOAT_ONE;
@@ -536,59 +809,175 @@ EXPORT void speex_echo_state_reset(SpeexEchoState *st)
     for (i = 0; i < K; i++)
         st->memX[i] = 0;
 
-    st->saturated = 0;
-    st->adapted   = 0;
-    st->sum_adapt = 0;
+    st->saturated      = 0;
+    st->adapted        = 0;
+    st->sum_adapt      = 0;
+    st->far_end_silent = 0;
     st->Pey = st->Pyy = FLOAT_ONE;
 #ifdef TWO_PATH
     st->Davg1 = st->Davg2 = 0;
     st->Dvar1 = st->Dvar2 = FLOAT_ZERO;
 #endif
-    for (i = 0; i < 3 * st->frame_size; i++)
-        st->play_buf[i] = 0;
-    st->play_buf_pos     = PLAYBACK_DELAY * st->frame_size;
-    st->play_buf_started = 0;
+    mdf_sparse_reset(st);
+}
+
+/** Resets echo canceller state */
+EXPORT void speex_echo_state_reset(SpeexEchoState *st)
+{
+    mdf_state_reset(st);
+    mdf_play_reset(st);
+}
+
+/** Moves bytes of field to (dir > 0) or from (dir < 0) offset pos of buf, dir = 0 only counts them */
+static inline int mdf_snapshot_copy(char *buf, int pos, void *field, int bytes, int dir)
+{
+    if (dir > 0)
+        memcpy(buf + pos, field, bytes);
+    else if (dir < 0)
+        memcpy(field, buf + pos, bytes);
+    return pos + bytes;
+}
+
+/** Walks what the echo path taught st: the filters, the far-end power estimates, the step size and leak estimates
+    and the foreground/background decision statistics. The signal memories are left out, they refill in a frame.
+    Returns the offset of the end of the last field. */
+static int mdf_snapshot_fields(SpeexEchoState *st, char *buf, int dir)
+{
+    const int N = st->window_size, M = st->M, C = st->C, K = st->K;
+    int pos = sizeof(MdfSnapshot);
+
+    pos = mdf_snapshot_copy(buf, pos, st->W, C * K * M * N * sizeof(spx_word32_t), dir);
+#ifdef TWO_PATH
+    pos = mdf_snapshot_copy(buf, pos, st->foreground, C * K * M * N * sizeof(spx_word16_t), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->Davg1, sizeof(st->Davg1), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->Davg2, sizeof(st->Davg2), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->Dvar1, sizeof(st->Dvar1), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->Dvar2, sizeof(st->Dvar2), dir);
+#endif
+    pos = mdf_snapshot_copy(buf, pos, st->power, (st->frame_size + 1) * sizeof(spx_word32_t), dir);
+    pos = mdf_snapshot_copy(buf, pos, st->power_1, (st->frame_size + 1) * sizeof(spx_float_t), dir);
+    pos = mdf_snapshot_copy(buf, pos, st->prop, M * sizeof(spx_word16_t), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->leak_estimate, sizeof(st->leak_estimate), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->sum_adapt, sizeof(st->sum_adapt), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->adapted, sizeof(st->adapted), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->Pey, sizeof(st->Pey), dir);
+    pos = mdf_snapshot_copy(buf, pos, &st->Pyy, sizeof(st->Pyy), dir);
+    return pos;
+}
+
+static void mdf_snapshot_header(SpeexEchoState *st, MdfSnapshot *hdr)
+{
+    hdr->magic   = MDF_SNAPSHOT_MAGIC;
+    hdr->version = MDF_SNAPSHOT_VERSION;
+    hdr->size    = mdf_snapshot_fields(st, NULL, 0);
+#ifdef FIXED_POINT
+    hdr->fixed_point = 1;
+#else
+    hdr->fixed_point = 0;
+#endif
+    hdr->frame_size = st->frame_size;
+    hdr->M          = st->M;
+    hdr->C          = st->C;
+    hdr->K          = st->K;
+}
+
+EXPORT int speex_echo_state_snapshot_size(SpeexEchoState *st)
+{
+    return mdf_snapshot_fields(st, NULL, 0);
+}
+
+EXPORT int speex_echo_state_save(SpeexEchoState *st, void *buf, int size)
+{
+    MdfSnapshot hdr;
+
+    mdf_snapshot_header(st, &hdr);
+    if (size < hdr.size)
+        return -1;
+    memcpy(buf, &hdr, sizeof(hdr));
+    mdf_snapshot_fields(st, (char *)buf, 1);
+    return hdr.size;
+}
+
+EXPORT int speex_echo_state_snapshot_check(SpeexEchoState *st, const void *buf, int size)
+{
+    MdfSnapshot hdr, own;
+
+    if (size < (int)sizeof(MdfSnapshot))
+        return -1;
+    memcpy(&hdr, buf, sizeof(hdr));
+    mdf_snapshot_header(st, &own);
+    if (memcmp(&hdr, &own, sizeof(hdr)) != 0 || size < hdr.size) {
+        speex_warning("Echo canceller snapshot does not match the state");
+        return -1;
+    }
+    return hdr.size;
+}
+
+EXPORT int speex_echo_state_load(SpeexEchoState *st, const void *buf, int size)
+{
+    int len = speex_echo_state_snapshot_check(st, buf, size);
+
+    if (len < 0)
+        return -1;
+    /* Signal memories start from silence, as after a reset; the far end refills within the first frame */
+    mdf_state_reset(st);
+    mdf_snapshot_fields(st, (char *)buf, -1);
+    return len;
 }
 
 /** Destroys an echo canceller state */
 EXPORT void speex_echo_state_destroy(SpeexEchoState *st)
 {
-    spx_fft_destroy(st->fft_table);
-
-    speex_free(st->e);
-    speex_free(st->x);
-    speex_free(st->input);
-    speex_free(st->y);
-    speex_free(st->last_y);
-    speex_free(st->Yf);
-    speex_free(st->Rf);
-    speex_free(st->Xf);
-    speex_free(st->Yh);
-    speex_free(st->Eh);
-
-    speex_free(st->X);
-    speex_free(st->Y);
-    speex_free(st->E);
-    speex_free(st->W);
+    int i;
+
+    spx_fft_destroy(st->fft_table, st->arena);
+    for (i = 1; i < st->C; i++)
+        spx_fft_destroy(st->chan_fft[i], st->arena);
+    speex_free(st->arena, st->chan_fft);
+    speex_free_scratch(st->arena, st->chan_stats);
+    speex_free_scratch(st->arena, st->last_in);
+
+    speex_free_scratch(st->arena, st->e);
+    speex_free(st->arena, st->x);
+    speex_free_scratch(st->arena, st->input);
+    speex_free_scratch(st->arena, st->y);
+    speex_free(st->arena, st->last_y);
+    speex_free_scratch(st->arena, st->Yf);
+    speex_free_scratch(st->arena, st->Rf);
+    speex_free_scratch(st->arena, st->Xf);
+    speex_free(st->arena, st->Yh);
+    speex_free(st->arena, st->Eh);
+
+    speex_free(st->arena, st->X);
+    speex_free_scratch(st->arena, st->Y);
+    speex_free(st->arena, st->E);
+    speex_free(st->arena, st->W);
 #ifdef TWO_PATH
-    speex_free(st->foreground);
-#endif
-    speex_free(st->PHI);
-    speex_free(st->power);
-    speex_free(st->power_1);
-    speex_free(st->window);
-    speex_free(st->prop);
-    speex_free(st->wtmp);
+    speex_free(st->arena, st->foreground);
+#endif
+#ifndef _weighted_spectral_mul_conj_OPT
+    speex_free_scratch(st->arena, st->PHI);
+#endif
+    speex_free(st->arena, st->power);
+    speex_free(st->arena, st->power_1);
+    speex_table_put(st->arena, speex_free, st->window);
+    speex_free(st->arena, st->prop);
+    speex_free(st->arena, st->part_energy);
+    speex_free(st->arena, st->part_stale);
+    speex_free(st->arena, st->part_update);
+    speex_free_scratch(st->arena, st->wtmp);
 #ifdef FIXED_POINT
-    speex_free(st->wtmp2);
+    speex_free_scratch(st->arena, st->wtmp2);
 #endif
-    speex_free(st->memX);
-    speex_free(st->memD);
-    speex_free(st->memE);
-    speex_free(st->notch_mem);
+    speex_free(st->arena, st->memX);
+    speex_free(st->arena, st->memD);
+    speex_free(st->arena, st->memE);
+    speex_free(st->arena, st->notch_mem);
+    speex_table_put(st->arena, speex_free, st->residual_gain);
 
-    speex_free(st->play_buf);
-    speex_free(st);
+    speex_free(st->arena, st->play->buf);
+    speex_free(st->arena, st->play);
+    speex_free(st->arena, st);
 
 #ifdef DUMP_ECHO_CANCEL_DATA
     fclose(rFile);
@@ -600,45 +989,64 @@ EXPORT void speex_echo_state_destroy(SpeexEchoState *st)
 
 EXPORT void speex_echo_capture(SpeexEchoState *st, const spx_int16_t *rec, spx_int16_t *out)
 {
-    int i;
-    /*speex_warning_int("capture with fill level ", st->play_buf_pos/st->frame_size);*/
-    st->play_buf_started = 1;
-    if (st->play_buf_pos >= st->frame_size) {
-        speex_echo_cancellation(st, rec, st->play_buf, out);
-        st->play_buf_pos -= st->frame_size;
-        for (i = 0; i < st->play_buf_pos; i++)
-            st->play_buf[i] = st->play_buf[i + st->frame_size];
+    MdfPlayRing *play = st->play;
+    unsigned int read = play->read;
+    int fill          = (int)(MDF_LOAD(&play->write) - read);
+
+    if (!play->started)
+        MDF_STORE(&play->started, 1);
+    else
+        play->captured++;
+    if (fill < play->fill_min)
+        play->fill_min = fill;
+    if (fill > play->fill_max)
+        play->fill_max = fill;
+    if (fill > 0) {
+        const int n = st->K * st->frame_size;
+        speex_echo_cancellation(st, rec, play->buf + (read & (PLAYBACK_SLOTS - 1)) * n, out);
+        /* Only now may the playback side write the slot again */
+        MDF_STORE(&play->read, read + 1);
     } else {
-        speex_warning("No playback frame available (your application is buggy and/or got xruns)");
-        if (st->play_buf_pos != 0) {
-            speex_warning("internal playback buffer corruption?");
-            st->play_buf_pos = 0;
-        }
-        for (i = 0; i < st->frame_size; i++)
+        /* No far end to cancel with (xrun or a playback side that stopped), the microphone goes through */
+        int i;
+        play->underruns++;
+        for (i = 0; i < st->C * st->frame_size; i++)
             out[i] = rec[i];
     }
 }
 
-EXPORT void speex_echo_playback(SpeexEchoState *st, const spx_int16_t *play)
+/** Queues one frame of the far end, at most twice, without waiting for the capture side */
+static void mdf_play_push(SpeexEchoState *st, const spx_int16_t *play_frame, int copies)
 {
-    /*speex_warning_int("playback with fill level ", st->play_buf_pos/st->frame_size);*/
-    if (!st->play_buf_started) {
-        speex_warning("discarded first playback frame");
-        return;
+    MdfPlayRing *play  = st->play;
+    unsigned int write = play->write;
+    const int n        = st->K * st->frame_size;
+
+    while (copies--) {
+        SPEEX_COPY(play->buf + (write & (PLAYBACK_SLOTS - 1)) * n, play_frame, n);
+        write++;
     }
-    if (st->play_buf_pos <= PLAYBACK_DELAY * st->frame_size) {
-        int i;
-        for (i = 0; i < st->frame_size; i++)
-            st->play_buf[st->play_buf_pos + i] = play[i];
-        st->play_buf_pos += st->frame_size;
-        if (st->play_buf_pos <= (PLAYBACK_DELAY - 1) * st->frame_size) {
-            speex_warning("Auto-filling the buffer (your application is buggy and/or got xruns)");
-            for (i = 0; i < st->frame_size; i++)
-                st->play_buf[st->play_buf_pos + i] = play[i];
-            st->play_buf_pos += st->frame_size;
-        }
+    MDF_STORE(&play->write, write);
+}
+
+EXPORT void speex_echo_playback(SpeexEchoState *st, const spx_int16_t *play_frame)
+{
+    MdfPlayRing *play = st->play;
+    int fill;
+
+    /* Frames played before the first capture are dropped so the two sides start together */
+    if (!MDF_LOAD(&play->started))
+        return;
+    MDF_STORE(&play->offered, play->offered + 1);
+    fill = (int)(play->write - MDF_LOAD(&play->read));
+    if (fill > play->delay) {
+        MDF_STORE(&play->overruns, play->overruns + 1);
+    } else if (fill < play->delay - 1) {
+        /* The capture side got ahead, catch up */
+        MDF_STORE(&play->refills, play->refills + 1);
+        mdf_play_push(st, play_frame, 2);
     } else {
-        speex_warning("Had to discard a playback frame (your application is buggy and/or got xruns)");
+        mdf_play_push(st, play_frame, 1);
     }
 }
 
@@ -648,46 +1056,31 @@ EXPORT void speex_echo_cancel(SpeexEchoState *st, const spx_int16_t *in, const s
     speex_echo_cancellation(st, in, far_end, out);
 }
 
-/** Performs echo cancellation on a frame */
-EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, const spx_int16_t *far_end, spx_int16_t *out)
+/** Notch, pre-emphasis and transform of the far end */
+static MDF_ALWAYS_INLINE void mdf_frame_input(SpeexEchoState *st, const MdfIo *io, MdfFrame *f, const int frame_size, const int N, const int M)
 {
     int i, j, chan, speak;
-    int N, M, C, K;
-    spx_word32_t Syy, See, Sxx, Sdd, Sff;
-#ifdef TWO_PATH
-    spx_word32_t Dbf;
-    int update_foreground;
-#endif
-    spx_word32_t Sey;
-    spx_word16_t ss, ss_1;
-    spx_float_t Pey = FLOAT_ONE, Pyy = FLOAT_ONE;
-    spx_float_t alpha, alpha_1;
-    spx_word16_t RER;
-    spx_word32_t tmp32;
-
-    N = st->window_size;
-    M = st->M;
-    C = st->C;
-    K = st->K;
+    const int C = st->C, K = st->K;
+    const spx_int16_t *far_end = io->far_end;
+    const int far_stride       = io->far_stride;
 
     st->cancel_count++;
-#ifdef FIXED_POINT
-    ss   = DIV32_16(11469, M);
-    ss_1 = SUB16(32767, ss);
-#else
-    ss   = .35 / M;
-    ss_1 = 1 - ss;
-#endif
+
+    /* Kept for last_y, the caller may have the output written over the microphones. last_y takes the first
+       frame_size samples of the interleaved frame whatever the channel count (FIXME: MC) */
+    for (i = 0, j = 0; j < frame_size; i++)
+        for (chan = 0; chan < C && j < frame_size; chan++, j++)
+            st->last_in[j] = io->in[i * io->in_stride + chan];
 
     for (chan = 0; chan < C; chan++) {
         /* Apply a notch filter to make sure DC doesn't end up causing problems */
-        filter_dc_notch16(in + chan, st->notch_radius, st->input + chan * st->frame_size, st->frame_size, st->notch_mem + 2 * chan, C);
+        filter_dc_notch16(io->in + chan, st->notch_radius, st->input + chan * frame_size, frame_size, st->notch_mem + 2 * chan, io->in_stride);
         /* Copy input data to buffer and apply pre-emphasis */
         /* Copy input data to buffer */
-        for (i = 0; i < st->frame_size; i++) {
+        for (i = 0; i < frame_size; i++) {
             spx_word32_t tmp32;
             /* FIXME: This core has changed a bit, need to merge properly */
-            tmp32 = SUB32(EXTEND32(st->input[chan * st->frame_size + i]), EXTEND32(MULT16_16_P15(st->preemph, st->memD[chan])));
+            tmp32 = SUB32(EXTEND32(st->input[chan * frame_size + i]), EXTEND32(MULT16_16_P15(st->preemph, st->memD[chan])));
 #ifdef FIXED_POINT
             if (tmp32 > 32767) {
                 tmp32 = 32767;
@@ -700,16 +1093,16 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
                     st->saturated = 1;
             }
 #endif
-            st->memD[chan]                       = st->input[chan * st->frame_size + i];
-            st->input[chan * st->frame_size + i] = EXTRACT16(tmp32);
+            st->memD[chan]                       = st->input[chan * frame_size + i];
+            st->input[chan * frame_size + i] = EXTRACT16(tmp32);
         }
     }
 
     for (speak = 0; speak < K; speak++) {
-        for (i = 0; i < st->frame_size; i++) {
+        for (i = 0; i < frame_size; i++) {
             spx_word32_t tmp32;
-            st->x[speak * N + i] = st->x[speak * N + i + st->frame_size];
-            tmp32                = SUB32(EXTEND32(far_end[i * K + speak]), EXTEND32(MULT16_16_P15(st->preemph, st->memX[speak])));
+            st->x[speak * N + i] = st->x[speak * N + i + frame_size];
+            tmp32                = SUB32(EXTEND32(far_end[i * far_stride + speak]), EXTEND32(MULT16_16_P15(st->preemph, st->memX[speak])));
 #ifdef FIXED_POINT
             /*FIXME: If saturation occurs here, we need to freeze adaptation for M frames (not just one) */
             if (tmp32 > 32767) {
@@ -721,111 +1114,302 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
                 st->saturated = M + 1;
             }
 #endif
-            st->x[speak * N + i + st->frame_size] = EXTRACT16(tmp32);
-            st->memX[speak]                       = far_end[i * K + speak];
+            st->x[speak * N + i + frame_size] = EXTRACT16(tmp32);
+            st->memX[speak]                       = far_end[i * far_stride + speak];
         }
     }
 
+    /* Rotate the ring instead of shifting memory, the oldest partition becomes the newest */
+    st->X_head = (st->X_head == 0) ? M : st->X_head - 1;
+    f->X       = mdf_far_end_part(st, 0);
+    f->X_wrap  = mdf_far_end_wrap(st, M);
     for (speak = 0; speak < K; speak++) {
-        /* Shift memory: this could be optimized eventually*/
-        for (j = M - 1; j >= 0; j--) {
-            for (i = 0; i < N; i++)
-                st->X[(j + 1) * N * K + speak * N + i] = st->X[j * N * K + speak * N + i];
-        }
         /* Convert x (echo input) to frequency domain */
-        spx_fft(st->fft_table, st->x + speak * N, &st->X[speak * N]);
+        spx_fft(st->fft_table, st->x + speak * N, &f->X[speak * N]);
     }
 
-    Sxx = 0;
+    f->Sxx = 0;
     for (speak = 0; speak < K; speak++) {
-        Sxx += mdf_inner_prod(st->x + speak * N + st->frame_size, st->x + speak * N + st->frame_size, st->frame_size);
-        power_spectrum_accum(st->X + speak * N, st->Xf, N);
+        f->Sxx += st->kernels->inner_prod(st->x + speak * N + frame_size, st->x + speak * N + frame_size, frame_size);
+#ifndef _speex_echo_cancellation_OPT
+        /* Cleared again before use below, only the second accumulation counts */
+        st->kernels->power_spectrum_accum(f->X + speak * N, st->Xf, N);
+#endif
     }
+}
 
-    Sff = 0;
-    for (chan = 0; chan < C; chan++) {
 #ifdef TWO_PATH
-        /* Compute foreground filter */
-        spectral_mul_accum16(st->X, st->foreground + chan * N * K * M, st->Y + chan * N, N, M * K);
-        spx_ifft(st->fft_table, st->Y + chan * N, st->e + chan * N);
-        for (i = 0; i < st->frame_size; i++)
-            st->e[chan * N + i] = SUB16(st->input[chan * st->frame_size + i], st->e[chan * N + i + st->frame_size]);
-        Sff += mdf_inner_prod(st->e + chan * N, st->e + chan * N, st->frame_size);
-#endif
+/** Error of the foreground filter on one microphone, whose output spectrum the caller left in Y */
+static MDF_ALWAYS_INLINE void mdf_foreground_chan(SpeexEchoState *st, int chan, const int frame_size, const int N)
+{
+    int i;
+
+    spx_ifft(st->chan_fft[chan], st->Y + chan * N, st->e + chan * N);
+    for (i = 0; i < frame_size; i++)
+        st->e[chan * N + i] = SUB16(st->input[chan * frame_size + i], st->e[chan * N + i + frame_size]);
+    st->chan_stats[chan].Sff = st->kernels->inner_prod(st->e + chan * N, st->e + chan * N, frame_size);
+}
+
+/** Error of the foreground filter, whose output spectra the caller left in Y. fanned: the pool already ran
+    mdf_foreground_chan for every microphone */
+static MDF_ALWAYS_INLINE void mdf_foreground_error(SpeexEchoState *st, MdfFrame *f, const int frame_size, const int N, int fanned)
+{
+    int chan;
+
+    f->Sff = 0;
+    for (chan = 0; chan < st->C; chan++) {
+        if (!fanned)
+            mdf_foreground_chan(st, chan, frame_size, N);
+        f->Sff += st->chan_stats[chan].Sff;
     }
+}
+#endif
 
-    /* Adjust proportional adaption rate */
-    /* FIXME: Adjust that for C, K*/
-    if (st->adapted)
-        mdf_adjust_prop(st->W, N, M, C * K, st->prop);
-    /* Compute weight gradient */
-    if (st->saturated == 0) {
-        for (chan = 0; chan < C; chan++) {
-            for (speak = 0; speak < K; speak++) {
-                for (j = M - 1; j >= 0; j--) {
-                    weighted_spectral_mul_conj(st->power_1, FLOAT_SHL(PSEUDOFLOAT(st->prop[j]), -15), &st->X[(j + 1) * N * K + speak * N], st->E + chan * N, st->PHI, N);
-                    for (i = 0; i < N; i++)
-                        st->W[chan * N * K * M + j * N * K + speak * N + i] += st->PHI[i];
-                }
-            }
-        }
-    } else {
-        st->saturated--;
+/** Removes the circular convolution part of one block of N weights. wtmp2 is only used in fixed point */
+static MDF_ALWAYS_INLINE void mdf_constrain_block(void *fft_table, spx_word32_t *W, spx_word16_t *wtmp, spx_word16_t *wtmp2, const int frame_size, const int N)
+{
+    int i;
+#ifdef FIXED_POINT
+    for (i = 0; i < N; i++)
+        wtmp2[i] = EXTRACT16(PSHR32(W[i], NORMALIZE_SCALEDOWN + 16));
+    spx_ifft(fft_table, wtmp2, wtmp);
+    for (i = 0; i < frame_size; i++) {
+        wtmp[i] = 0;
+    }
+    for (i = frame_size; i < N; i++) {
+        wtmp[i] = SHL16(wtmp[i], NORMALIZE_SCALEUP);
     }
+    spx_fft(fft_table, wtmp, wtmp2);
+    /* The "-1" in the shift is a sort of kludge that trades less efficient update speed for decrease noise */
+    for (i = 0; i < N; i++)
+        W[i] -= SHL32(EXTEND32(wtmp2[i]), 16 + NORMALIZE_SCALEDOWN - NORMALIZE_SCALEUP - 1);
+#else
+    spx_ifft(fft_table, W, wtmp);
+    for (i = frame_size; i < N; i++) {
+        wtmp[i] = 0;
+    }
+    spx_fft(fft_table, wtmp, W);
+#endif
+}
 
-    /* FIXME: MC conversion required */
-    /* Update weight to prevent circular convolution (MDF / AUMDF) */
-    for (chan = 0; chan < C; chan++) {
-        for (speak = 0; speak < K; speak++) {
-            for (j = 0; j < M; j++) {
-                /* This is a variant of the Alternatively Updated MDF (AUMDF) */
-                /* Remove the "if" to make this an MDF filter */
-                if (j == 0 || st->cancel_count % (M - 1) == j - 1) {
+/** Removes the circular convolution part of the blocks of W updated this frame, for one microphone */
+static MDF_ALWAYS_INLINE void mdf_constrain_chan(SpeexEchoState *st, int chan, const int frame_size, const int N, const int M)
+{
+    int j, speak;
+    const int K     = st->K;
+    void *fft_table = st->chan_fft[chan];
+    spx_word16_t *wtmp = st->wtmp + chan * N;
 #ifdef FIXED_POINT
-                    for (i = 0; i < N; i++)
-                        st->wtmp2[i] = EXTRACT16(PSHR32(st->W[chan * N * K * M + j * N * K + speak * N + i], NORMALIZE_SCALEDOWN + 16));
-                    spx_ifft(st->fft_table, st->wtmp2, st->wtmp);
-                    for (i = 0; i < st->frame_size; i++) {
-                        st->wtmp[i] = 0;
-                    }
-                    for (i = st->frame_size; i < N; i++) {
-                        st->wtmp[i] = SHL16(st->wtmp[i], NORMALIZE_SCALEUP);
-                    }
-                    spx_fft(st->fft_table, st->wtmp, st->wtmp2);
-                    /* The "-1" in the shift is a sort of kludge that trades less efficient update speed for decrease noise */
-                    for (i = 0; i < N; i++)
-                        st->W[chan * N * K * M + j * N * K + speak * N + i] -= SHL32(EXTEND32(st->wtmp2[i]), 16 + NORMALIZE_SCALEDOWN - NORMALIZE_SCALEUP - 1);
+    spx_word16_t *wtmp2 = st->wtmp2 + chan * N;
 #else
-                    spx_ifft(st->fft_table, &st->W[chan * N * K * M + j * N * K + speak * N], st->wtmp);
-                    for (i = st->frame_size; i < N; i++) {
-                        st->wtmp[i] = 0;
-                    }
-                    spx_fft(st->fft_table, st->wtmp, &st->W[chan * N * K * M + j * N * K + speak * N]);
+    spx_word16_t *wtmp2 = NULL;
 #endif
-                }
+
+    /* FIXME: MC conversion required */
+    /* Update weight to prevent circular convolution (MDF / AUMDF) */
+    for (speak = 0; speak < K; speak++) {
+        for (j = 0; j < M; j++) {
+            /* This is a variant of the Alternatively Updated MDF (AUMDF) */
+            /* Remove the "if" to make this an MDF filter */
+            if (j == 0 || st->cancel_count % (M - 1) == j - 1) {
+                mdf_constrain_block(fft_table, &st->W[chan * N * K * M + j * N * K + speak * N], wtmp, wtmp2, frame_size, N);
             }
         }
     }
+}
+
+static MDF_ALWAYS_INLINE void mdf_constrain_weights(SpeexEchoState *st, const int frame_size, const int N, const int M)
+{
+    int chan;
+
+    for (chan = 0; chan < st->C; chan++)
+        mdf_constrain_chan(st, chan, frame_size, N, M);
+}
+
+#ifdef TWO_PATH
+/** Error of the background filter on one microphone, whose output spectrum the caller left in Y */
+static MDF_ALWAYS_INLINE void mdf_background_chan(SpeexEchoState *st, int chan, const int frame_size, const int N)
+{
+    MdfChanStats *s = &st->chan_stats[chan];
+    int i;
+
+    /* Difference in response, this is used to estimate the variance of our residual power estimate */
+    spx_ifft(st->chan_fft[chan], st->Y + chan * N, st->y + chan * N);
+    for (i = 0; i < frame_size; i++)
+        st->e[chan * N + i] = SUB16(st->e[chan * N + i + frame_size], st->y[chan * N + i + frame_size]);
+    s->Dbf = 10 + st->kernels->inner_prod(st->e + chan * N, st->e + chan * N, frame_size);
+    for (i = 0; i < frame_size; i++)
+        st->e[chan * N + i] = SUB16(st->input[chan * frame_size + i], st->y[chan * N + i + frame_size]);
+    s->See = st->kernels->inner_prod(st->e + chan * N, st->e + chan * N, frame_size);
+}
+#endif
+
+/** Error of the background filter, whose output spectra the caller left in Y. fanned: the pool already ran
+    mdf_background_chan for every microphone */
+static MDF_ALWAYS_INLINE void mdf_background_error(SpeexEchoState *st, MdfFrame *f, const int frame_size, const int N, int fanned)
+{
+    int i;
 
     /* So we can use power_spectrum_accum */
-    for (i = 0; i <= st->frame_size; i++)
+    for (i = 0; i <= frame_size; i++)
         st->Rf[i] = st->Yf[i] = st->Xf[i] = 0;
 
-    Dbf = 0;
-    See = 0;
+    f->Dbf = 0;
+    f->See = 0;
 #ifdef TWO_PATH
-    /* Difference in response, this is used to estimate the variance of our residual power estimate */
-    for (chan = 0; chan < C; chan++) {
-        spectral_mul_accum(st->X, st->W + chan * N * K * M, st->Y + chan * N, N, M * K);
-        spx_ifft(st->fft_table, st->Y + chan * N, st->y + chan * N);
-        for (i = 0; i < st->frame_size; i++)
-            st->e[chan * N + i] = SUB16(st->e[chan * N + i + st->frame_size], st->y[chan * N + i + st->frame_size]);
-        Dbf += 10 + mdf_inner_prod(st->e + chan * N, st->e + chan * N, st->frame_size);
-        for (i = 0; i < st->frame_size; i++)
-            st->e[chan * N + i] = SUB16(st->input[chan * st->frame_size + i], st->y[chan * N + i + st->frame_size]);
-        See += mdf_inner_prod(st->e + chan * N, st->e + chan * N, st->frame_size);
+    for (i = 0; i < st->C; i++) {
+        if (!fanned)
+            mdf_background_chan(st, i, frame_size, N);
+        f->Dbf += st->chan_stats[i].Dbf;
+        f->See += st->chan_stats[i].See;
     }
 #endif
+}
+
+/** Output of one microphone, its error for the filter update and the correlations of the frame */
+static MDF_ALWAYS_INLINE void mdf_output_chan(SpeexEchoState *st, const MdfIo *io, int chan, const int frame_size, const int N)
+{
+    MdfChanStats *s        = &st->chan_stats[chan];
+    const spx_int16_t *in  = io->in + chan;
+    spx_int16_t *out       = io->out + chan;
+    int i;
+
+    s->saturated = 0;
+    /* Compute error signal (for the output with de-emphasis) */
+    for (i = 0; i < frame_size; i++) {
+        spx_word32_t tmp_out;
+#ifdef TWO_PATH
+        tmp_out = SUB32(EXTEND32(st->input[chan * frame_size + i]), EXTEND32(st->e[chan * N + i + frame_size]));
+#else
+        tmp_out = SUB32(EXTEND32(st->input[chan * frame_size + i]), EXTEND32(st->y[chan * N + i + frame_size]));
+#endif
+        tmp_out = ADD32(tmp_out, EXTEND32(MULT16_16_P15(st->preemph, st->memE[chan])));
+        /* This is an arbitrary test for saturation in the microphone signal */
+        if (in[i * io->in_stride] <= -32000 || in[i * io->in_stride] >= 32000)
+            s->saturated = 1;
+        out[i * io->out_stride] = WORD2INT(tmp_out);
+        st->memE[chan]    = tmp_out;
+    }
+
+#ifdef DUMP_ECHO_CANCEL_DATA
+    dump_audio(io->in, io->far_end, io->out, frame_size);
+#endif
+
+    /* Compute error signal (filter update version) */
+    for (i = 0; i < frame_size; i++) {
+        st->e[chan * N + i + frame_size] = st->e[chan * N + i];
+        st->e[chan * N + i]              = 0;
+    }
+
+    /* Compute a bunch of correlations */
+    /* FIXME: bad merge */
+    s->Sey = st->kernels->inner_prod(st->e + chan * N + frame_size, st->y + chan * N + frame_size, frame_size);
+    s->Syy = st->kernels->inner_prod(st->y + chan * N + frame_size, st->y + chan * N + frame_size, frame_size);
+    s->Sdd = st->kernels->inner_prod(st->input + chan * frame_size, st->input + chan * frame_size, frame_size);
+
+    /* Convert error to frequency domain */
+    spx_fft(st->chan_fft[chan], st->e + chan * N, st->E + chan * N);
+    for (i = 0; i < frame_size; i++)
+        st->y[i + chan * N] = 0;
+    spx_fft(st->chan_fft[chan], st->y + chan * N, st->Y + chan * N);
+}
+
+/** NLMS gradient of the filters of one microphone, added to W */
+static MDF_ALWAYS_INLINE void mdf_gradient_chan(SpeexEchoState *st, int chan, const int N, const int M)
+{
+    int j, speak;
+    const int K = st->K;
+#ifndef _weighted_spectral_mul_conj_OPT
+    spx_word32_t *PHI = st->PHI + chan * N;
+    int i;
+#endif
+
+    for (speak = 0; speak < K; speak++) {
+        for (j = M - 1; j >= 0; j--) {
+            spx_float_t step = FLOAT_SHL(PSEUDOFLOAT(st->prop[j]), -15);
+            if (st->sparse) {
+                if (st->part_update[j] < 0)
+                    continue;
+                step = FLOAT_MULT(step, PSEUDOFLOAT(1 << st->part_update[j]));
+            }
+#ifdef _weighted_spectral_mul_conj_OPT
+            /* The gradient is added straight into the weights instead of going through PHI */
+            st->kernels->weighted_spectral_mul_conj_accum(st->power_1, step, mdf_far_end_part(st, j + 1) + speak * N, st->E + chan * N,
+                                                          &st->W[chan * N * K * M + j * N * K + speak * N], N);
+#else
+            st->kernels->weighted_spectral_mul_conj(st->power_1, step, mdf_far_end_part(st, j + 1) + speak * N, st->E + chan * N, PHI, N);
+            for (i = 0; i < N; i++)
+                st->W[chan * N * K * M + j * N * K + speak * N + i] += PHI[i];
+#endif
+        }
+    }
+}
+
+/* Per-microphone stages of a frame as pool tasks, arg is an MdfChanTask. The pool runs them on any thread and in
+   any order; every microphone only touches its own slices of the state, its own FFT table and its own chan_stats. */
+#ifdef TWO_PATH
+static void mdf_foreground_task(void *arg, int chan)
+{
+    const MdfChanTask *task = (const MdfChanTask *)arg;
+    SpeexEchoState *st      = task->st;
+    const int N = st->window_size, K = st->K, M = st->M;
+
+    st->kernels->spectral_mul_accum16(task->f->X, st->X, task->f->X_wrap, st->foreground + chan * N * K * M, st->Y + chan * N, N, M * K);
+    mdf_foreground_chan(st, chan, st->frame_size, N);
+}
+
+static void mdf_background_task(void *arg, int chan)
+{
+    const MdfChanTask *task = (const MdfChanTask *)arg;
+    SpeexEchoState *st      = task->st;
+    const int N = st->window_size, K = st->K, M = st->M;
+
+    st->kernels->spectral_mul_accum(task->f->X, st->X, task->f->X_wrap, st->W + chan * N * K * M, st->Y + chan * N, N, M * K);
+    mdf_background_chan(st, chan, st->frame_size, N);
+}
+#endif
+
+static void mdf_adapt_task(void *arg, int chan)
+{
+    const MdfChanTask *task = (const MdfChanTask *)arg;
+    SpeexEchoState *st      = task->st;
+
+    if (task->adapt)
+        mdf_gradient_chan(st, chan, st->window_size, st->M);
+    mdf_constrain_chan(st, chan, st->frame_size, st->window_size, st->M);
+}
+
+static void mdf_output_task(void *arg, int chan)
+{
+    const MdfChanTask *task = (const MdfChanTask *)arg;
+
+    mdf_output_chan(task->st, task->io, chan, task->st->frame_size, task->st->window_size);
+}
+
+/** Foreground/background decision, output and the adaptation rate for the next frame */
+static MDF_ALWAYS_INLINE void mdf_frame_output(SpeexEchoState *st, const MdfIo *io, MdfFrame *f, const int frame_size, const int N, const int M, int fanned)
+{
+    int i, j, chan, speak;
+    const int C = st->C, K = st->K;
+    spx_word32_t Syy, Sdd, Sey;
+    spx_word32_t Sxx = f->Sxx, Sff = f->Sff, See = f->See;
+#ifdef TWO_PATH
+    spx_word32_t Dbf = f->Dbf;
+    int update_foreground;
+#endif
+    spx_word16_t ss, ss_1;
+    spx_float_t Pey = FLOAT_ONE, Pyy = FLOAT_ONE;
+    spx_float_t alpha, alpha_1;
+    spx_word16_t RER;
+    spx_word32_t tmp32;
+
+#ifdef FIXED_POINT
+    ss   = DIV32_16(11469, M);
+    ss_1 = SUB16(32767, ss);
+#else
+    ss   = .35 / M;
+    ss_1 = 1 - ss;
+#endif
 
 #ifndef TWO_PATH
     Sff = See;
@@ -862,12 +1446,11 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
         st->Davg1 = st->Davg2 = 0;
         st->Dvar1 = st->Dvar2 = FLOAT_ZERO;
         /* Copy background filter to foreground filter */
-        for (i = 0; i < N * M * C * K; i++)
-            st->foreground[i] = EXTRACT16(PSHR32(st->W[i], 16));
+        mdf_save_foreground(st);
         /* Apply a smooth transition so as to not introduce blocking artifacts */
         for (chan = 0; chan < C; chan++)
-            for (i = 0; i < st->frame_size; i++)
-                st->e[chan * N + i + st->frame_size] = MULT16_16_Q15(st->window[i + st->frame_size], st->e[chan * N + i + st->frame_size]) + MULT16_16_Q15(st->window[i], st->y[chan * N + i + st->frame_size]);
+            for (i = 0; i < frame_size; i++)
+                st->e[chan * N + i + frame_size] = MULT16_16_Q15(st->window[i + frame_size], st->e[chan * N + i + frame_size]) + MULT16_16_Q15(st->window[i], st->y[chan * N + i + frame_size]);
     } else {
         int reset_background = 0;
         /* Otherwise, check if the background filter is significantly worse */
@@ -879,14 +1462,13 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
             reset_background = 1;
         if (reset_background) {
             /* Copy foreground filter to background filter */
-            for (i = 0; i < N * M * C * K; i++)
-                st->W[i] = SHL32(EXTEND32(st->foreground[i]), 16);
+            mdf_restore_foreground(st);
             /* We also need to copy the output so as to get correct adaptation */
             for (chan = 0; chan < C; chan++) {
-                for (i = 0; i < st->frame_size; i++)
-                    st->y[chan * N + i + st->frame_size] = st->e[chan * N + i + st->frame_size];
-                for (i = 0; i < st->frame_size; i++)
-                    st->e[chan * N + i] = SUB16(st->input[chan * st->frame_size + i], st->y[chan * N + i + st->frame_size]);
+                for (i = 0; i < frame_size; i++)
+                    st->y[chan * N + i + frame_size] = st->e[chan * N + i + frame_size];
+                for (i = 0; i < frame_size; i++)
+                    st->e[chan * N + i] = SUB16(st->input[chan * frame_size + i], st->y[chan * N + i + frame_size]);
             }
             See       = Sff;
             st->Davg1 = st->Davg2 = 0;
@@ -895,51 +1477,23 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
     }
 #endif
 
+    if (fanned) {
+        MdfChanTask task = {st, f, io, 0};
+        st->pool->pfRun(st->pool->pCtx, mdf_output_task, &task, C);
+    }
     Sey = Syy = Sdd = 0;
     for (chan = 0; chan < C; chan++) {
-        /* Compute error signal (for the output with de-emphasis) */
-        for (i = 0; i < st->frame_size; i++) {
-            spx_word32_t tmp_out;
-#ifdef TWO_PATH
-            tmp_out = SUB32(EXTEND32(st->input[chan * st->frame_size + i]), EXTEND32(st->e[chan * N + i + st->frame_size]));
-#else
-            tmp_out = SUB32(EXTEND32(st->input[chan * st->frame_size + i]), EXTEND32(st->y[chan * N + i + st->frame_size]));
-#endif
-            tmp_out = ADD32(tmp_out, EXTEND32(MULT16_16_P15(st->preemph, st->memE[chan])));
-            /* This is an arbitrary test for saturation in the microphone signal */
-            if (in[i * C + chan] <= -32000 || in[i * C + chan] >= 32000) {
-                if (st->saturated == 0)
-                    st->saturated = 1;
-            }
-            out[i * C + chan] = WORD2INT(tmp_out);
-            st->memE[chan]    = tmp_out;
-        }
-
-#ifdef DUMP_ECHO_CANCEL_DATA
-        dump_audio(in, far_end, out, st->frame_size);
-#endif
-
-        /* Compute error signal (filter update version) */
-        for (i = 0; i < st->frame_size; i++) {
-            st->e[chan * N + i + st->frame_size] = st->e[chan * N + i];
-            st->e[chan * N + i]                  = 0;
-        }
-
-        /* Compute a bunch of correlations */
-        /* FIXME: bad merge */
-        Sey += mdf_inner_prod(st->e + chan * N + st->frame_size, st->y + chan * N + st->frame_size, st->frame_size);
-        Syy += mdf_inner_prod(st->y + chan * N + st->frame_size, st->y + chan * N + st->frame_size, st->frame_size);
-        Sdd += mdf_inner_prod(st->input + chan * st->frame_size, st->input + chan * st->frame_size, st->frame_size);
-
-        /* Convert error to frequency domain */
-        spx_fft(st->fft_table, st->e + chan * N, st->E + chan * N);
-        for (i = 0; i < st->frame_size; i++)
-            st->y[i + chan * N] = 0;
-        spx_fft(st->fft_table, st->y + chan * N, st->Y + chan * N);
+        if (!fanned)
+            mdf_output_chan(st, io, chan, frame_size, N);
+        if (st->chan_stats[chan].saturated && st->saturated == 0)
+            st->saturated = 1;
+        Sey += st->chan_stats[chan].Sey;
+        Syy += st->chan_stats[chan].Syy;
+        Sdd += st->chan_stats[chan].Sdd;
 
         /* Compute power spectrum of echo (X), error (E) and filter response (Y) */
-        power_spectrum_accum(st->E + chan * N, st->Rf, N);
-        power_spectrum_accum(st->Y + chan * N, st->Yf, N);
+        st->kernels->power_spectrum_accum(st->E + chan * N, st->Rf, N);
+        st->kernels->power_spectrum_accum(st->Y + chan * N, st->Yf, N);
     }
 
     /*printf ("%f %f %f %f\n", Sff, See, Syy, Sdd, st->update_cond);*/
@@ -952,8 +1506,9 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
     ) {
         /* Things have gone really bad */
         st->screwed_up += 50;
-        for (i = 0; i < st->frame_size * C; i++)
-            out[i] = 0;
+        for (i = 0; i < frame_size; i++)
+            for (chan = 0; chan < C; chan++)
+                io->out[i * io->out_stride + chan] = 0;
     } else if (SHR32(Sff, 2) > ADD32(Sdd, SHR32(MULT16_16(N, 10000), 6))) {
         /* AEC seems to add lots of echo instead of removing it, let's see if it will improve */
         st->screwed_up++;
@@ -963,7 +1518,7 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
     }
     if (st->screwed_up >= 50) {
         speex_warning("The echo canceller started acting funny and got slapped (reset). It swears it will behave now.");
-        speex_echo_state_reset(st);
+        mdf_state_reset(st);
         return;
     }
 
@@ -971,16 +1526,23 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
     See = MAX32(See, SHR32(MULT16_16(N, 100), 6));
 
     for (speak = 0; speak < K; speak++) {
-        Sxx += mdf_inner_prod(st->x + speak * N + st->frame_size, st->x + speak * N + st->frame_size, st->frame_size);
-        power_spectrum_accum(st->X + speak * N, st->Xf, N);
+#ifdef _speex_echo_cancellation_OPT
+        /* x has not changed since the energy at the top of the frame, with one speaker that is simply counted twice
+           (several speakers would change the float summation order) */
+        if (K == 1)
+            Sxx = ADD32(Sxx, Sxx);
+        else
+#endif
+            Sxx += st->kernels->inner_prod(st->x + speak * N + frame_size, st->x + speak * N + frame_size, frame_size);
+        st->kernels->power_spectrum_accum(f->X + speak * N, st->Xf, N);
     }
 
     /* Smooth far end energy estimate over time */
-    for (j = 0; j <= st->frame_size; j++)
+    for (j = 0; j <= frame_size; j++)
         st->power[j] = MULT16_32_Q15(ss_1, st->power[j]) + 1 + MULT16_32_Q15(ss, st->Xf[j]);
 
     /* Compute filtered spectra and (cross-)correlations */
-    for (j = st->frame_size; j >= 0; j--) {
+    for (j = frame_size; j >= 0; j--) {
         spx_float_t Eh, Yh;
         Eh  = PSEUDOFLOAT(st->Rf[j] - st->Eh[j]);
         Yh  = PSEUDOFLOAT(st->Yf[j] - st->Yh[j]);
@@ -1055,7 +1617,7 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
 
     if (st->adapted) {
         /* Normal learning rate calculation once we're past the minimal adaptation phase */
-        for (i = 0; i <= st->frame_size; i++) {
+        for (i = 0; i <= frame_size; i++) {
             spx_word32_t r, e;
             /* Compute frequency-domain adaptation mask */
             r = MULT16_32_Q15(st->leak_estimate, SHL32(st->Yf[i], 3));
@@ -1086,7 +1648,7 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
 #endif
             adapt_rate = FLOAT_EXTRACT16(FLOAT_SHL(FLOAT_DIV32(tmp32, See), 15));
         }
-        for (i = 0; i <= st->frame_size; i++)
+        for (i = 0; i <= frame_size; i++)
             st->power_1[i] = FLOAT_SHL(FLOAT_DIV32(EXTEND32(adapt_rate), ADD32(st->power[i], 10)), WEIGHT_SHIFT + 1);
 
         /* How much have we adapted so far? */
@@ -1094,12 +1656,13 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
     }
 
     /* FIXME: MC conversion required */
-    for (i = 0; i < st->frame_size; i++)
-        st->last_y[i] = st->last_y[st->frame_size + i];
+    for (i = 0; i < frame_size; i++)
+        st->last_y[i] = st->last_y[frame_size + i];
     if (st->adapted) {
         /* If the filter is adapted, take the filtered echo */
-        for (i = 0; i < st->frame_size; i++)
-            st->last_y[st->frame_size + i] = in[i] - out[i];
+        for (i = 0, j = 0; j < frame_size; i++)
+            for (chan = 0; chan < C && j < frame_size; chan++, j++)
+                st->last_y[frame_size + j] = st->last_in[j] - io->out[i * io->out_stride + chan];
     } else {
         /* If filter isn't adapted yet, all we can do is take the far end signal directly */
         /* moved earlier: for (i=0;i<N;i++)
@@ -1107,6 +1670,139 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
     }
 }
 
+/** Frame whose far end has been silent for the whole tail: both filters would put out nothing, so the output is
+    the conditioned microphone signal and adaptation is held. Only what the next full frame reads is kept up to date:
+    the far-end history and the notch and emphasis memories (mdf_frame_input), the de-emphasis memory, and last_y,
+    E and Y, which now hold no echo. */
+static MDF_ALWAYS_INLINE void mdf_bypass_frame(SpeexEchoState *st, const MdfIo *io, const int frame_size, const int N)
+{
+    int i, chan;
+    const int C = st->C;
+
+    if (st->saturated)
+        st->saturated--;
+    for (chan = 0; chan < C; chan++) {
+        const spx_int16_t *in = io->in + chan;
+        spx_int16_t *out      = io->out + chan;
+
+        for (i = 0; i < frame_size; i++) {
+            spx_word32_t tmp_out = ADD32(EXTEND32(st->input[chan * frame_size + i]), EXTEND32(MULT16_16_P15(st->preemph, st->memE[chan])));
+            if ((in[i * io->in_stride] <= -32000 || in[i * io->in_stride] >= 32000) && st->saturated == 0)
+                st->saturated = 1;
+            out[i * io->out_stride] = WORD2INT(tmp_out);
+            st->memE[chan]          = tmp_out;
+        }
+        for (i = 0; i < N; i++)
+            st->E[chan * N + i] = st->Y[chan * N + i] = 0;
+    }
+    for (i = 0; i < frame_size; i++) {
+        st->last_y[i]              = st->last_y[frame_size + i];
+        st->last_y[frame_size + i] = 0;
+    }
+}
+
+/** Performs echo cancellation on a frame */
+/** Body of speex_echo_cancellation with the frame geometry passed in, so a caller passing constants gets its own specialised copy */
+static MDF_ALWAYS_INLINE void mdf_echo_cancellation(SpeexEchoState *st, const MdfIo *io, const int frame_size, const int N, const int M)
+{
+    int chan;
+    const int C = st->C, K = st->K;
+    /* Spread the microphones over the pool; the sums and everything shared stay on this thread and in order */
+    const int fanned = st->pool && C > 1;
+    MdfFrame f;
+    MdfChanTask task = {st, &f, io, 0};
+
+    mdf_frame_input(st, io, &f, frame_size, N, M);
+
+    /* Nothing to cancel or learn from once the far end has been silent for as long as the filter is */
+    if (f.Sxx < SHR32(MULT16_16(frame_size, st->far_end_silence), 6)) {
+        if (st->far_end_silent <= M)
+            st->far_end_silent++;
+    } else {
+        st->far_end_silent = 0;
+    }
+    if (st->far_end_silent > M) {
+        mdf_bypass_frame(st, io, frame_size, N);
+        return;
+    }
+
+#ifdef TWO_PATH
+    /* Compute foreground filter */
+    if (fanned) {
+        st->pool->pfRun(st->pool->pCtx, mdf_foreground_task, &task, C);
+    } else {
+        for (chan = 0; chan < C; chan++)
+            st->kernels->spectral_mul_accum16(f.X, st->X, f.X_wrap, st->foreground + chan * N * K * M, st->Y + chan * N, N, M * K);
+    }
+    mdf_foreground_error(st, &f, frame_size, N, fanned);
+#endif
+
+    /* Adjust proportional adaption rate */
+    /* FIXME: Adjust that for C, K*/
+    if (st->adapted) {
+        if (st->sparse)
+            mdf_adjust_prop_sparse(st, N, M);
+        else
+            mdf_adjust_prop(st->W, N, M, C * K, st->prop);
+    }
+    /* Compute weight gradient */
+    task.adapt = st->saturated == 0;
+    if (!task.adapt)
+        st->saturated--;
+    if (fanned) {
+        st->pool->pfRun(st->pool->pCtx, mdf_adapt_task, &task, C);
+    } else {
+        if (task.adapt) {
+            for (chan = 0; chan < C; chan++)
+                mdf_gradient_chan(st, chan, N, M);
+        }
+        mdf_constrain_weights(st, frame_size, N, M);
+    }
+    if (st->sparse) {
+        /* Weights the gradient or the constraint just changed */
+        int j;
+        for (j = 0; j < M; j++)
+            if ((task.adapt && st->part_update[j] >= 0) || j == 0 || st->cancel_count % (M - 1) == j - 1)
+                st->part_stale[j] = 1;
+    }
+
+#ifdef TWO_PATH
+    if (fanned) {
+        st->pool->pfRun(st->pool->pCtx, mdf_background_task, &task, C);
+    } else {
+        for (chan = 0; chan < C; chan++)
+            st->kernels->spectral_mul_accum(f.X, st->X, f.X_wrap, st->W + chan * N * K * M, st->Y + chan * N, N, M * K);
+    }
+#endif
+    mdf_background_error(st, &f, frame_size, N, fanned);
+
+    mdf_frame_output(st, io, &f, frame_size, N, M, fanned);
+}
+
+EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, const spx_int16_t *far_end, spx_int16_t *out)
+{
+    speex_echo_cancellation_strided(st, in, st->C, far_end, st->K, out, st->C);
+}
+
+EXPORT void speex_echo_cancellation_strided(SpeexEchoState *st, const spx_int16_t *in, int in_stride, const spx_int16_t *far_end, int far_stride, spx_int16_t *out,
+                                            int out_stride)
+{
+    MdfIo io = {in, far_end, out, in_stride, far_stride, out_stride};
+
+#ifdef _ONLY_FOR_1024_SAMPLES_
+    /* 1024-sample frames (48 kHz): the per-bin loop bounds are constants, with a tail of one frame (1024 taps) the
+       partition loops collapse to a single pass as well */
+    if (st->frame_size == 1024) {
+        if (st->M == 1)
+            mdf_echo_cancellation(st, &io, 1024, 2048, 1);
+        else
+            mdf_echo_cancellation(st, &io, 1024, 2048, st->M);
+        return;
+    }
+#endif
+    mdf_echo_cancellation(st, &io, st->frame_size, st->window_size, st->M);
+}
+
 /* Compute spectrum of estimated echo for use in an echo post-filter */
 void speex_echo_get_residual(SpeexEchoState *st, spx_word32_t *residual_echo, int len)
 {
@@ -1122,7 +1818,7 @@ void speex_echo_get_residual(SpeexEchoState *st, spx_word32_t *residual_echo, in
 
     /* Compute power spectrum of the echo */
     spx_fft(st->fft_table, st->y, st->Y);
-    power_spectrum(st->Y, residual_echo, N);
+    st->kernels->power_spectrum(st->Y, residual_echo, N);
 
 #ifdef FIXED_POINT
     if (st->leak_estimate > 16383)
@@ -1140,6 +1836,39 @@ void speex_echo_get_residual(SpeexEchoState *st, spx_word32_t *residual_echo, in
         residual_echo[i] = (spx_int32_t)MULT16_32_Q15(leak2, residual_echo[i]);
 }
 
+/* Same as speex_echo_get_residual for microphone chan, from the spectrum of the echo estimate the last frame left in Y
+   instead of windowing last_y and transforming it again. Y is the background filter's echo in the pre-emphasised
+   domain, so the result is close to but not the same as speex_echo_get_residual. */
+void speex_echo_get_filter_residual(SpeexEchoState *st, int chan, spx_word32_t *residual_echo, int len)
+{
+    int i;
+    spx_word16_t leak2;
+
+    if (chan >= st->C)
+        chan = st->C - 1;
+
+    st->kernels->power_spectrum(st->Y + chan * st->window_size, residual_echo, st->window_size);
+
+#ifdef FIXED_POINT
+    if (st->leak_estimate > 16383)
+        leak2 = 32767;
+    else
+        leak2 = SHL16(st->leak_estimate, 1);
+    for (i = 0; i <= st->frame_size; i++) {
+        /* residual_gain is Q8 */
+        spx_word32_t r   = MULT16_32_Q15(st->residual_gain[i], MULT16_32_Q15(leak2, residual_echo[i]));
+        residual_echo[i] = r > (VERY_LARGE32 >> 7) ? VERY_LARGE32 : SHL32(r, 7);
+    }
+#else
+    if (st->leak_estimate > .5)
+        leak2 = 1;
+    else
+        leak2 = 2 * st->leak_estimate;
+    for (i = 0; i <= st->frame_size; i++)
+        residual_echo[i] = leak2 * st->residual_gain[i] * residual_echo[i];
+#endif
+}
+
 EXPORT int speex_echo_ctl(SpeexEchoState *st, int request, void *ptr)
 {
     switch (request) {
@@ -1171,21 +1900,64 @@ EXPORT int speex_echo_ctl(SpeexEchoState *st, int request, void *ptr)
             *((spx_int32_t *)ptr) = st->M * st->frame_size;
             break;
         case SPEEX_ECHO_GET_IMPULSE_RESPONSE: {
-            int M = st->M, N = st->window_size, n = st->frame_size, i, j;
+            int M = st->M, n = st->frame_size, i, j;
             spx_int32_t *filt = (spx_int32_t *)ptr;
             for (j = 0; j < M; j++) {
                 /*FIXME: Implement this for multiple channels */
+                spx_word32_t *W = st->W + j * st->window_size;
 #ifdef FIXED_POINT
-                for (i = 0; i < N; i++)
-                    st->wtmp2[i] = EXTRACT16(PSHR32(st->W[j * N + i], 16 + NORMALIZE_SCALEDOWN));
+                for (i = 0; i < st->window_size; i++)
+                    st->wtmp2[i] = EXTRACT16(PSHR32(W[i], 16 + NORMALIZE_SCALEDOWN));
                 spx_ifft(st->fft_table, st->wtmp2, st->wtmp);
 #else
-                spx_ifft(st->fft_table, &st->W[j * N], st->wtmp);
+                spx_ifft(st->fft_table, W, st->wtmp);
 #endif
                 for (i = 0; i < n; i++)
                     filt[j * n + i] = PSHR32(MULT16_16(32767, st->wtmp[i]), WEIGHT_SHIFT - NORMALIZE_SCALEDOWN);
             }
         } break;
+        case SPEEX_ECHO_SET_THREAD_POOL:
+            st->pool = (PST_AUD_POOL)ptr;
+            break;
+        case SPEEX_ECHO_SET_FAR_END_SILENCE:
+            st->far_end_silence = (*(spx_int32_t *)ptr);
+            break;
+        case SPEEX_ECHO_GET_FAR_END_SILENCE:
+            (*(spx_int32_t *)ptr) = st->far_end_silence;
+            break;
+        case SPEEX_ECHO_SET_SPARSE_UPDATE:
+            st->sparse = (*(spx_int32_t *)ptr) != 0;
+            mdf_sparse_reset(st);
+            break;
+        case SPEEX_ECHO_GET_SPARSE_UPDATE:
+            (*(spx_int32_t *)ptr) = st->sparse;
+            break;
+        case SPEEX_ECHO_SET_PLAYBACK_DELAY:
+            if ((*(spx_int32_t *)ptr) < 0 || (*(spx_int32_t *)ptr) > PLAYBACK_DELAY_MAX)
+                return -1;
+            st->play->delay = (*(spx_int32_t *)ptr);
+            mdf_play_reset(st);
+            break;
+        case SPEEX_ECHO_GET_PLAYBACK_DELAY:
+            (*(spx_int32_t *)ptr) = st->play->delay;
+            break;
+        case SPEEX_ECHO_GET_PLAYBACK_STATS: {
+            MdfPlayRing *play            = st->play;
+            SpeexEchoPlaybackStats *stats = (SpeexEchoPlaybackStats *)ptr;
+            unsigned int captured        = play->captured;
+            /* Frames offered beyond those captured since the first capture; a playback clock running fast makes
+               this grow however the ring itself copes with it */
+            spx_int32_t ahead = (spx_int32_t)(MDF_LOAD(&play->offered) - captured);
+
+            stats->fill      = (spx_int32_t)(MDF_LOAD(&play->write) - play->read);
+            stats->fill_min  = play->fill_min;
+            stats->fill_max  = play->fill_max;
+            stats->underruns = play->underruns;
+            stats->overruns  = MDF_LOAD(&play->overruns);
+            stats->refills   = MDF_LOAD(&play->refills);
+            stats->drift     = captured ? (spx_int32_t)((long long)ahead * 1000000 / captured) : 0;
+            play->fill_min = play->fill_max = stats->fill;
+        } break;
         default:
             speex_warning_int("Unknown speex_echo_ctl request: ", request);
             return -1;
@@ -1195,18 +1967,14 @@ EXPORT int speex_echo_ctl(SpeexEchoState *st, int request, void *ptr)
 
 u32 _Aec_SetEchoParams(void *pstEchoState, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue)
 {
-#if 0
     SpeexEchoState *pstEchoSt = (SpeexEchoState *)pstEchoState;
-    s32 s32value = *((s32 *)pParamsValue);
-    s32 i;
-    s16 s16value = (s16)s32value;
 
     switch (enParamsCMD) {
+        case EN_AUD_AEC_SPARSE_UPDATE:
+            speex_echo_ctl(pstEchoSt, SPEEX_ECHO_SET_SPARSE_UPDATE, pParamsValue);
+            break;
         default:
-            return 1;
+            break;
     }
     return 0;
-#else
-    return 0;
-#endif
 }
@@ -0,0 +1,340 @@
+/*
+   File: mdf_delay.c
+   Far-end delay estimator and alignment in front of the echo canceller
+*/
+
+/*
+   The playback path (driver buffers, network, DAC) delays the echo by far more than the room does. Instead of
+   making the adaptive filter long enough to cover that latency, the far end is delayed by an estimate of it, so
+   the filter only has to model the room.
+
+   Each frame of the far end and of the first microphone is reduced to a binary spectrum: one bit per band, set
+   when the band is above its own long-term mean. The microphone bits are compared with the far-end bits of every
+   candidate delay (a whole number of frames) and a smoothed Hamming distance is kept per candidate; echo makes the
+   microphone follow the far end at its true delay, so that candidate ends up with the lowest distance. A new
+   delay is only applied once it has been the best one for a while and is clearly better than the current one.
+
+   The delay applied is one frame less than the estimate, so the echo never leads the far end it is filtered from.
+   The filter then needs to cover the room response plus up to two frames.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "arch.h"
+#include "speex_echo.h"
+#include "fftwrap.h"
+#include "os_support.h"
+
+/* Number of bands of the binary spectra, one bit each */
+#define DELAY_BANDS 32
+/* The bands cover the speech range */
+#define DELAY_LOW_HZ 300
+#define DELAY_HIGH_HZ 3400
+/* Mean power per sample below which a frame says nothing about the delay */
+#define DELAY_ACTIVE 1000
+/* Distances are kept in Q8 bits and smoothed over 2^DELAY_SMOOTH frames */
+#define DELAY_SMOOTH 5
+/* Frames a candidate must stay the best one before it is applied */
+#define DELAY_STABLE 20
+/* Distance (Q8 bits) by which it must beat the delay in use */
+#define DELAY_MARGIN 512
+
+/* Layout check of the snapshots of speex_echo_delay_save */
+#define DELAY_SNAPSHOT_MAGIC 0x53444c44 /* "DLDS" */
+#define DELAY_SNAPSHOT_VERSION 1
+
+struct SpeexEchoDelay_ {
+    int frame_size;
+    int K;          /* Number of speakers, interleaved in the far end */
+    int nb_delays;  /* Candidate delays, 0 to nb_delays-1 frames */
+    int band_start; /* First FFT bin of the bands */
+    int nb_bins;    /* FFT bins covered by the bands */
+    int nb_bands;
+
+    spx_int16_t *far_hist;  /* Last nb_delays far-end frames, ring of frame slots */
+    int far_pos;            /* Slot the next far-end frame goes into */
+    spx_uint32_t *far_bits; /* Binary spectra of the far end, same slots as far_hist */
+    int *far_active;        /* Whether each far-end frame was loud enough to count */
+    spx_int32_t *dist;      /* Smoothed distance (Q8 bits) of the microphone to the far end of each candidate */
+    spx_word32_t *far_mean; /* Long-term mean of every band */
+    spx_word32_t *near_mean;
+    int best;       /* Candidate with the lowest distance... */
+    int best_count; /* ...and for how many frames in a row */
+    int delay;      /* Candidate in use */
+
+    void *fft_table;
+    spx_word16_t *buf;  /* scratch, frame to transform (frame_size) */
+    spx_word16_t *spec; /* scratch, its spectrum (frame_size) */
+
+    PST_AUD_MEM_ARENA arena;
+};
+
+/** Start of a snapshot, the fields of delay_snapshot_fields follow */
+typedef struct DelaySnapshot_ {
+    spx_uint32_t magic;
+    spx_int32_t version;
+    spx_int32_t size;        /* Bytes of the whole snapshot */
+    spx_int32_t fixed_point; /* The band means hold fixed-point values */
+    spx_int32_t frame_size;
+    spx_int32_t K;
+    spx_int32_t nb_delays;
+    spx_int32_t band_start;
+    spx_int32_t nb_bins;
+} DelaySnapshot;
+
+static inline int delay_popcount(spx_uint32_t v)
+{
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    v = (v + (v >> 4)) & 0x0f0f0f0f;
+    return (int)((v * 0x01010101) >> 24);
+}
+
+/** Estimator over the given candidates and bins, with the transform tables of fft_proto when given */
+static SpeexEchoDelay *delay_new(int frame_size, int nb_speakers, int nb_delays, int band_start, int nb_bins, const void *fft_proto, PST_AUD_MEM_ARENA arena)
+{
+    SpeexEchoDelay *dl = (SpeexEchoDelay *)speex_alloc(arena, sizeof(SpeexEchoDelay));
+    int i;
+
+    if (!dl)
+        return NULL;
+    dl->arena      = arena;
+    dl->frame_size = frame_size;
+    dl->K          = nb_speakers;
+    dl->nb_delays  = nb_delays;
+    dl->band_start = band_start;
+    dl->nb_bins    = nb_bins;
+    dl->nb_bands   = dl->nb_bins < DELAY_BANDS ? dl->nb_bins : DELAY_BANDS;
+
+    dl->far_hist   = (spx_int16_t *)speex_alloc(arena, dl->nb_delays * frame_size * nb_speakers * sizeof(spx_int16_t));
+    dl->far_bits   = (spx_uint32_t *)speex_alloc(arena, dl->nb_delays * sizeof(spx_uint32_t));
+    dl->far_active = (int *)speex_alloc(arena, dl->nb_delays * sizeof(int));
+    dl->dist       = (spx_int32_t *)speex_alloc(arena, dl->nb_delays * sizeof(spx_int32_t));
+    dl->far_mean   = (spx_word32_t *)speex_alloc(arena, DELAY_BANDS * sizeof(spx_word32_t));
+    dl->near_mean  = (spx_word32_t *)speex_alloc(arena, DELAY_BANDS * sizeof(spx_word32_t));
+    dl->fft_table  = fft_proto ? spx_fft_clone(fft_proto, arena) : spx_fft_init(frame_size, arena);
+    dl->buf        = (spx_word16_t *)speex_alloc_scratch(arena, frame_size * sizeof(spx_word16_t));
+    dl->spec       = (spx_word16_t *)speex_alloc_scratch(arena, frame_size * sizeof(spx_word16_t));
+
+    dl->far_pos    = 0;
+    dl->best       = 0;
+    dl->best_count = 0;
+    dl->delay      = 0;
+    for (i = 0; i < dl->nb_delays; i++)
+        dl->dist[i] = (DELAY_BANDS / 2) << 8;
+    return dl;
+}
+
+EXPORT SpeexEchoDelay *speex_echo_delay_init(int frame_size, int sampling_rate, int max_delay, int nb_speakers, PST_AUD_MEM_ARENA arena)
+{
+    int lo, hi;
+
+    lo = (int)((spx_int32_t)DELAY_LOW_HZ * frame_size / sampling_rate);
+    hi = (int)((spx_int32_t)DELAY_HIGH_HZ * frame_size / sampling_rate);
+    if (lo < 1)
+        lo = 1;
+    if (hi > frame_size / 2)
+        hi = frame_size / 2;
+    /* One more than the frames of max_delay, the applied delay is one frame less than the estimate */
+    return delay_new(frame_size, nb_speakers, max_delay / frame_size + 2, lo, hi > lo ? hi - lo : 1, NULL, arena);
+}
+
+EXPORT SpeexEchoDelay *speex_echo_delay_clone(const SpeexEchoDelay *proto, PST_AUD_MEM_ARENA arena)
+{
+    return delay_new(proto->frame_size, proto->K, proto->nb_delays, proto->band_start, proto->nb_bins, proto->fft_table, arena);
+}
+
+EXPORT void speex_echo_delay_destroy(SpeexEchoDelay *dl)
+{
+    PST_AUD_MEM_ARENA arena = dl->arena;
+
+    speex_free(arena, dl->far_hist);
+    speex_free(arena, dl->far_bits);
+    speex_free(arena, dl->far_active);
+    speex_free(arena, dl->dist);
+    speex_free(arena, dl->far_mean);
+    speex_free(arena, dl->near_mean);
+    spx_fft_destroy(dl->fft_table, arena);
+    speex_free_scratch(arena, dl->buf);
+    speex_free_scratch(arena, dl->spec);
+    speex_free(arena, dl);
+}
+
+/** Binary spectrum of one channel of a frame (x[i * stride]) against the band means, which it updates.
+    Sets *active when the frame is loud enough to tell anything. */
+static spx_uint32_t delay_binary_spectrum(SpeexEchoDelay *dl, const spx_int16_t *x, int stride, spx_word32_t *mean, int *active)
+{
+    const int frame_size = dl->frame_size;
+    long long energy     = 0;
+    spx_uint32_t bits    = 0;
+    int i, b;
+
+    for (i = 0; i < frame_size; i++) {
+        dl->buf[i] = x[i * stride];
+        energy += (spx_int32_t)x[i * stride] * x[i * stride];
+    }
+    /* 64-bit: a full-scale 1024-sample frame is 2^40 */
+    *active = energy > (long long)DELAY_ACTIVE * frame_size;
+    spx_fft(dl->fft_table, dl->buf, dl->spec);
+
+    for (b = 0; b < dl->nb_bands; b++) {
+        int first       = dl->band_start + b * dl->nb_bins / dl->nb_bands;
+        int last        = dl->band_start + (b + 1) * dl->nb_bins / dl->nb_bands;
+        spx_word32_t ps = 0;
+        for (i = first; i < last; i++)
+            ps = ADD32(ps, ADD32(SHR32(MULT16_16(dl->spec[2 * i - 1], dl->spec[2 * i - 1]), 4), SHR32(MULT16_16(dl->spec[2 * i], dl->spec[2 * i]), 4)));
+        if (ps > mean[b])
+            bits |= (spx_uint32_t)1 << b;
+        if (*active)
+            mean[b] = ADD32(mean[b], MULT16_32_Q15(QCONST16(.015625f, 15), SUB32(ps, mean[b])));
+    }
+    return bits;
+}
+
+EXPORT const spx_int16_t *speex_echo_delay_align(SpeexEchoDelay *dl, const spx_int16_t *rec, int rec_stride, const spx_int16_t *play)
+{
+    const int frame_size = dl->frame_size, K = dl->K, nb_delays = dl->nb_delays;
+    spx_uint32_t near_bits;
+    int near_active, slot, k;
+
+    /* Keep the new far-end frame and its spectrum */
+    slot = dl->far_pos;
+    SPEEX_COPY(dl->far_hist + slot * frame_size * K, play, frame_size * K);
+    dl->far_bits[slot] = delay_binary_spectrum(dl, play, K, dl->far_mean, &dl->far_active[slot]);
+    dl->far_pos        = (slot + 1 == nb_delays) ? 0 : slot + 1;
+
+    /* Compare the microphone with the far end of every candidate delay */
+    near_bits = delay_binary_spectrum(dl, rec, rec_stride, dl->near_mean, &near_active);
+    if (near_active) {
+        int best = 0;
+        for (k = 0; k < nb_delays; k++) {
+            int s = slot - k < 0 ? slot - k + nb_delays : slot - k;
+            if (dl->far_active[s]) {
+                spx_int32_t d = delay_popcount(near_bits ^ dl->far_bits[s]) << 8;
+                dl->dist[k] += (d - dl->dist[k]) >> DELAY_SMOOTH;
+            }
+            if (dl->dist[k] < dl->dist[best])
+                best = k;
+        }
+        if (best == dl->best) {
+            dl->best_count++;
+        } else {
+            dl->best       = best;
+            dl->best_count = 1;
+        }
+        if (best != dl->delay && dl->best_count >= DELAY_STABLE && dl->dist[best] + DELAY_MARGIN < dl->dist[dl->delay])
+            dl->delay = best;
+    }
+
+    /* Far end delayed by one frame less than the estimate */
+    k = dl->delay > 0 ? dl->delay - 1 : 0;
+    slot -= k;
+    if (slot < 0)
+        slot += nb_delays;
+    return dl->far_hist + slot * frame_size * K;
+}
+
+static inline int delay_snapshot_copy(char *buf, int pos, void *field, int bytes, int dir)
+{
+    if (dir > 0)
+        memcpy(buf + pos, field, bytes);
+    else if (dir < 0)
+        memcpy(field, buf + pos, bytes);
+    return pos + bytes;
+}
+
+/** Walks the estimate and what it is built on: to buf for dir > 0, from it for dir < 0, only counted for dir = 0.
+    The far-end history is a signal memory and left out. Returns the offset of the end of the last field. */
+static int delay_snapshot_fields(SpeexEchoDelay *dl, char *buf, int dir)
+{
+    int pos = sizeof(DelaySnapshot);
+
+    pos = delay_snapshot_copy(buf, pos, &dl->delay, sizeof(dl->delay), dir);
+    pos = delay_snapshot_copy(buf, pos, &dl->best, sizeof(dl->best), dir);
+    pos = delay_snapshot_copy(buf, pos, &dl->best_count, sizeof(dl->best_count), dir);
+    pos = delay_snapshot_copy(buf, pos, dl->dist, dl->nb_delays * sizeof(spx_int32_t), dir);
+    pos = delay_snapshot_copy(buf, pos, dl->far_mean, DELAY_BANDS * sizeof(spx_word32_t), dir);
+    pos = delay_snapshot_copy(buf, pos, dl->near_mean, DELAY_BANDS * sizeof(spx_word32_t), dir);
+    return pos;
+}
+
+static void delay_snapshot_header(SpeexEchoDelay *dl, DelaySnapshot *hdr)
+{
+    hdr->magic   = DELAY_SNAPSHOT_MAGIC;
+    hdr->version = DELAY_SNAPSHOT_VERSION;
+    hdr->size    = delay_snapshot_fields(dl, NULL, 0);
+#ifdef FIXED_POINT
+    hdr->fixed_point = 1;
+#else
+    hdr->fixed_point = 0;
+#endif
+    hdr->frame_size = dl->frame_size;
+    hdr->K          = dl->K;
+    hdr->nb_delays  = dl->nb_delays;
+    hdr->band_start = dl->band_start;
+    hdr->nb_bins    = dl->nb_bins;
+}
+
+EXPORT int speex_echo_delay_snapshot_size(SpeexEchoDelay *dl)
+{
+    return delay_snapshot_fields(dl, NULL, 0);
+}
+
+EXPORT int speex_echo_delay_save(SpeexEchoDelay *dl, void *buf, int size)
+{
+    DelaySnapshot hdr;
+
+    delay_snapshot_header(dl, &hdr);
+    if (size < hdr.size)
+        return -1;
+    memcpy(buf, &hdr, sizeof(hdr));
+    delay_snapshot_fields(dl, (char *)buf, 1);
+    return hdr.size;
+}
+
+EXPORT int speex_echo_delay_snapshot_check(SpeexEchoDelay *dl, const void *buf, int size)
+{
+    DelaySnapshot hdr, own;
+
+    if (size < (int)sizeof(DelaySnapshot))
+        return -1;
+    memcpy(&hdr, buf, sizeof(hdr));
+    delay_snapshot_header(dl, &own);
+    if (memcmp(&hdr, &own, sizeof(hdr)) != 0 || size < hdr.size) {
+        speex_warning("Delay estimator snapshot does not match the estimator");
+        return -1;
+    }
+    return hdr.size;
+}
+
+EXPORT int speex_echo_delay_load(SpeexEchoDelay *dl, const void *buf, int size)
+{
+    int len = speex_echo_delay_snapshot_check(dl, buf, size);
+
+    if (len < 0)
+        return -1;
+    /* Far-end frames from before the snapshot are not there, none of them counts */
+    SPEEX_MEMSET(dl->far_hist, 0, dl->nb_delays * dl->frame_size * dl->K);
+    SPEEX_MEMSET(dl->far_bits, 0, dl->nb_delays);
+    SPEEX_MEMSET(dl->far_active, 0, dl->nb_delays);
+    delay_snapshot_fields(dl, (char *)buf, -1);
+    return len;
+}
+
+EXPORT int speex_echo_delay_ctl(SpeexEchoDelay *dl, int request, void *ptr)
+{
+    switch (request) {
+        case SPEEX_ECHO_DELAY_GET_DELAY:
+            (*(spx_int32_t *)ptr) = (dl->delay > 0 ? dl->delay - 1 : 0) * dl->frame_size;
+            break;
+        case SPEEX_ECHO_DELAY_GET_ESTIMATE:
+            (*(spx_int32_t *)ptr) = dl->best * dl->frame_size;
+            break;
+        default:
+            speex_warning_int("Unknown speex_echo_delay_ctl request: ", request);
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+   File: mdf_kernels.c
+   Scalar reference of the MDF kernels and the runtime dispatcher
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mdf_kernels.h"
+
+/* This inner product is slightly different from the codec version because of fixed-point */
+static spx_word32_t mdf_inner_prod_c(const spx_word16_t *x, const spx_word16_t *y, int len)
+{
+    return mdf_inner_prod_tail(x, y, 0, len);
+}
+
+/** Compute power spectrum of a half-complex (packed) vector */
+static void power_spectrum_c(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    ps[0] = MULT16_16(X[0], X[0]);
+    power_spectrum_tail(X, ps, N, 1);
+}
+
+/** Compute power spectrum of a half-complex (packed) vector and accumulate */
+static void power_spectrum_accum_c(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    ps[0] += MULT16_16(X[0], X[0]);
+    power_spectrum_accum_tail(X, ps, N, 1);
+}
+
+/** Compute cross-power spectrum of a half-complex (packed) vectors and add to acc.
+    X is walked as a ring: blocks from wrap onwards are read from Xw */
+#ifdef FIXED_POINT
+static void spectral_mul_accum_c(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    acc[0] = spectral_mul_accum_dc(X, Xw, wrap, Y, N, M);
+    spectral_mul_accum_tail(X, Xw, wrap, Y, acc, N, M, 1);
+}
+
+static void spectral_mul_accum16_c(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word16_t *Y, spx_word16_t *acc, int N, int M)
+{
+    acc[0] = spectral_mul_accum16_dc(X, Xw, wrap, Y, N, M);
+    spectral_mul_accum16_tail(X, Xw, wrap, Y, acc, N, M, 1);
+}
+
+#else
+static void spectral_mul_accum_c(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    for (i = 0; i < N; i++)
+        acc[i] = 0;
+    for (j = 0; j < M; j++) {
+        if (j == wrap)
+            X = Xw;
+        acc[0] += X[0] * Y[0];
+        spectral_mul_accum_part_tail(X, Y, acc, N, 1);
+        X += N;
+        Y += N;
+    }
+}
+#define spectral_mul_accum16_c spectral_mul_accum_c
+#endif
+
+/** Compute weighted cross-power spectrum of a half-complex (packed) vector with conjugate */
+static void weighted_spectral_mul_conj_c(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, 0);
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, 1, 0);
+}
+
+static void weighted_spectral_mul_conj_accum_c(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, 1);
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, 1, 1);
+}
+
+const MdfKernels mdf_kernels_c = {
+    "scalar",
+    MDF_KERNEL_SCALAR,
+    mdf_inner_prod_c,
+    power_spectrum_c,
+    power_spectrum_accum_c,
+    spectral_mul_accum_c,
+    spectral_mul_accum16_c,
+    weighted_spectral_mul_conj_c,
+    weighted_spectral_mul_conj_accum_c,
+};
+
+int mdf_kernels_level(int max_level)
+{
+#if defined(MDF_KERNELS_X86)
+    __builtin_cpu_init();
+    if (max_level >= MDF_KERNEL_AVX512 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return MDF_KERNEL_AVX512;
+    if (max_level >= MDF_KERNEL_AVX2 && __builtin_cpu_supports("avx2"))
+        return MDF_KERNEL_AVX2;
+    if (max_level >= MDF_KERNEL_SSE41 && __builtin_cpu_supports("sse4.1"))
+        return MDF_KERNEL_SSE41;
+#endif
+    return MDF_KERNEL_SCALAR;
+}
+
+const MdfKernels *mdf_kernels_select(int max_level)
+{
+    if (max_level > MDF_KERNEL_LEVEL_MAX)
+        max_level = MDF_KERNEL_LEVEL_MAX;
+    switch (mdf_kernels_level(max_level)) {
+#if defined(MDF_KERNELS_X86)
+        case MDF_KERNEL_AVX512:
+            return &mdf_kernels_avx512;
+        case MDF_KERNEL_AVX2:
+            return &mdf_kernels_avx2;
+        case MDF_KERNEL_SSE41:
+            return &mdf_kernels_sse41;
+#endif
+        default:
+            return &mdf_kernels_c;
+    }
+}
@@ -0,0 +1,222 @@
+/*
+   File: mdf_kernels.h
+   Spectral inner loops of the MDF echo canceller with per-ISA variants
+   (SSE4.1/AVX2/AVX-512 on x86) picked once at init time. Other targets,
+   ARM included, run the scalar versions.
+
+   The scalar versions below are the reference. Fixed-point variants are
+   bit-exact with them, float variants perform the same per-bin operations
+   in the same order except mdf_inner_prod, which sums in a different order
+   (off by at most ~1e-7 of the sum of |x*y|).
+*/
+
+#ifndef MDF_KERNELS_H
+#define MDF_KERNELS_H
+
+#include "arch.h"
+#include "pseudofloat.h"
+
+#ifdef FIXED_POINT
+#define WEIGHT_SHIFT 11
+#define TOP16(x) ((x) >> 16)
+#else
+#define WEIGHT_SHIFT 0
+#define TOP16(x) (x)
+#endif
+
+/* Kernel levels */
+#define MDF_KERNEL_SCALAR 0
+#define MDF_KERNEL_SSE41  1
+#define MDF_KERNEL_AVX2   2
+#define MDF_KERNEL_AVX512 3
+
+/* Highest level the dispatcher may pick, build with -DMDF_KERNEL_LEVEL_MAX=0 for the scalar reference only */
+#ifndef MDF_KERNEL_LEVEL_MAX
+#define MDF_KERNEL_LEVEL_MAX MDF_KERNEL_AVX512
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MDF_KERNELS_X86
+#endif
+
+/** One implementation of every vectorised MDF kernel */
+typedef struct MdfKernels_ {
+    const char *name;
+    int level;
+    spx_word32_t (*inner_prod)(const spx_word16_t *x, const spx_word16_t *y, int len);
+    void (*power_spectrum)(const spx_word16_t *X, spx_word32_t *ps, int N);
+    void (*power_spectrum_accum)(const spx_word16_t *X, spx_word32_t *ps, int N);
+    void (*spectral_mul_accum)(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M);
+    void (*spectral_mul_accum16)(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word16_t *Y, spx_word16_t *acc, int N, int M);
+    void (*weighted_spectral_mul_conj)(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N);
+    /* Same product added into prod, lets the gradient go straight into the filter weights */
+    void (*weighted_spectral_mul_conj_accum)(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N);
+} MdfKernels;
+
+/** Highest kernel level the running CPU supports, capped at max_level */
+int mdf_kernels_level(int max_level);
+
+/** Best kernel set the running CPU supports, capped at max_level */
+const MdfKernels *mdf_kernels_select(int max_level);
+
+extern const MdfKernels mdf_kernels_c;
+#ifdef MDF_KERNELS_X86
+extern const MdfKernels mdf_kernels_sse41;
+extern const MdfKernels mdf_kernels_avx2;
+extern const MdfKernels mdf_kernels_avx512;
+#endif
+
+/* The helpers below finish whatever a SIMD loop left over, starting at element/bin i.
+   Half-complex layout: X[0] is DC, (X[i], X[i+1]) for odd i are complex bins, X[N-1] is Nyquist. */
+
+/* Inner product of x[k..len-1], k even */
+static inline spx_word32_t mdf_inner_prod_tail(const spx_word16_t *x, const spx_word16_t *y, int k, int len)
+{
+    spx_word32_t sum = 0;
+    for (; k < len; k += 2) {
+        spx_word32_t part = 0;
+        part              = MAC16_16(part, x[k], y[k]);
+        part              = MAC16_16(part, x[k + 1], y[k + 1]);
+        /* HINT: If you had a 40-bit accumulator, you could shift only at the end */
+        sum = ADD32(sum, SHR32(part, 6));
+    }
+    return sum;
+}
+
+/* Power of the complex bins from odd index i on and of the Nyquist bin */
+static inline void power_spectrum_tail(const spx_word16_t *X, spx_word32_t *ps, int N, int i)
+{
+    int j = (i + 1) >> 1;
+    for (; i < N - 1; i += 2, j++) {
+        ps[j] = MULT16_16(X[i], X[i]) + MULT16_16(X[i + 1], X[i + 1]);
+    }
+    ps[j] = MULT16_16(X[i], X[i]);
+}
+
+static inline void power_spectrum_accum_tail(const spx_word16_t *X, spx_word32_t *ps, int N, int i)
+{
+    int j = (i + 1) >> 1;
+    for (; i < N - 1; i += 2, j++) {
+        ps[j] += MULT16_16(X[i], X[i]) + MULT16_16(X[i + 1], X[i + 1]);
+    }
+    ps[j] += MULT16_16(X[i], X[i]);
+}
+
+/* Stores v into prod[i], or adds it there for the accumulating variants */
+static inline void mdf_store_prod(spx_word32_t *prod, int i, spx_word32_t v, int accum)
+{
+    if (accum)
+        prod[i] += v;
+    else
+        prod[i] = v;
+}
+
+static inline void weighted_spectral_mul_conj_tail(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N, int i, int accum)
+{
+    int j = (i + 1) >> 1;
+    spx_float_t W;
+    for (; i < N - 1; i += 2, j++) {
+        W = FLOAT_AMULT(p, w[j]);
+        mdf_store_prod(prod, i, FLOAT_MUL32(W, MAC16_16(MULT16_16(X[i], Y[i]), X[i + 1], Y[i + 1])), accum);
+        mdf_store_prod(prod, i + 1, FLOAT_MUL32(W, MAC16_16(MULT16_16(-X[i + 1], Y[i]), X[i], Y[i + 1])), accum);
+    }
+    W = FLOAT_AMULT(p, w[j]);
+    mdf_store_prod(prod, i, FLOAT_MUL32(W, MULT16_16(X[i], Y[i])), accum);
+}
+
+/* DC bin of the weighted product, the SIMD loops start at bin 1 */
+static inline void weighted_spectral_mul_conj_dc(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int accum)
+{
+    spx_float_t W = FLOAT_AMULT(p, w[0]);
+    mdf_store_prod(prod, 0, FLOAT_MUL32(W, MULT16_16(X[0], Y[0])), accum);
+}
+
+#ifdef FIXED_POINT
+/* Fixed point walks bins in the outer loop (one 32-bit accumulator per bin) and the M partitions
+   in the inner one, X is read as a ring: partitions from wrap onwards come from Xw */
+static inline void spectral_mul_accum_tail(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M, int i)
+{
+    int j;
+    spx_word32_t tmp1, tmp2;
+    for (; i < N - 1; i += 2) {
+        tmp1 = tmp2 = 0;
+        for (j = 0; j < wrap; j++) {
+            tmp1 = SUB32(MAC16_16(tmp1, X[j * N + i], TOP16(Y[j * N + i])), MULT16_16(X[j * N + i + 1], TOP16(Y[j * N + i + 1])));
+            tmp2 = MAC16_16(MAC16_16(tmp2, X[j * N + i + 1], TOP16(Y[j * N + i])), X[j * N + i], TOP16(Y[j * N + i + 1]));
+        }
+        for (; j < M; j++) {
+            tmp1 = SUB32(MAC16_16(tmp1, Xw[(j - wrap) * N + i], TOP16(Y[j * N + i])), MULT16_16(Xw[(j - wrap) * N + i + 1], TOP16(Y[j * N + i + 1])));
+            tmp2 = MAC16_16(MAC16_16(tmp2, Xw[(j - wrap) * N + i + 1], TOP16(Y[j * N + i])), Xw[(j - wrap) * N + i], TOP16(Y[j * N + i + 1]));
+        }
+        acc[i]     = PSHR32(tmp1, WEIGHT_SHIFT);
+        acc[i + 1] = PSHR32(tmp2, WEIGHT_SHIFT);
+    }
+    tmp1 = 0;
+    for (j = 0; j < wrap; j++)
+        tmp1 = MAC16_16(tmp1, X[(j + 1) * N - 1], TOP16(Y[(j + 1) * N - 1]));
+    for (; j < M; j++)
+        tmp1 = MAC16_16(tmp1, Xw[(j - wrap + 1) * N - 1], TOP16(Y[(j + 1) * N - 1]));
+    acc[N - 1] = PSHR32(tmp1, WEIGHT_SHIFT);
+}
+
+static inline void spectral_mul_accum16_tail(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word16_t *Y, spx_word16_t *acc, int N, int M, int i)
+{
+    int j;
+    spx_word32_t tmp1, tmp2;
+    for (; i < N - 1; i += 2) {
+        tmp1 = tmp2 = 0;
+        for (j = 0; j < wrap; j++) {
+            tmp1 = SUB32(MAC16_16(tmp1, X[j * N + i], Y[j * N + i]), MULT16_16(X[j * N + i + 1], Y[j * N + i + 1]));
+            tmp2 = MAC16_16(MAC16_16(tmp2, X[j * N + i + 1], Y[j * N + i]), X[j * N + i], Y[j * N + i + 1]);
+        }
+        for (; j < M; j++) {
+            tmp1 = SUB32(MAC16_16(tmp1, Xw[(j - wrap) * N + i], Y[j * N + i]), MULT16_16(Xw[(j - wrap) * N + i + 1], Y[j * N + i + 1]));
+            tmp2 = MAC16_16(MAC16_16(tmp2, Xw[(j - wrap) * N + i + 1], Y[j * N + i]), Xw[(j - wrap) * N + i], Y[j * N + i + 1]);
+        }
+        acc[i]     = PSHR32(tmp1, WEIGHT_SHIFT);
+        acc[i + 1] = PSHR32(tmp2, WEIGHT_SHIFT);
+    }
+    tmp1 = 0;
+    for (j = 0; j < wrap; j++)
+        tmp1 = MAC16_16(tmp1, X[(j + 1) * N - 1], Y[(j + 1) * N - 1]);
+    for (; j < M; j++)
+        tmp1 = MAC16_16(tmp1, Xw[(j - wrap + 1) * N - 1], Y[(j + 1) * N - 1]);
+    acc[N - 1] = PSHR32(tmp1, WEIGHT_SHIFT);
+}
+
+/* DC bin of both fixed-point spectral products */
+static inline spx_word16_t spectral_mul_accum_dc(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, int N, int M)
+{
+    int j;
+    spx_word32_t tmp1 = 0;
+    for (j = 0; j < wrap; j++)
+        tmp1 = MAC16_16(tmp1, X[j * N], TOP16(Y[j * N]));
+    for (; j < M; j++)
+        tmp1 = MAC16_16(tmp1, Xw[(j - wrap) * N], TOP16(Y[j * N]));
+    return PSHR32(tmp1, WEIGHT_SHIFT);
+}
+
+static inline spx_word16_t spectral_mul_accum16_dc(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word16_t *Y, int N, int M)
+{
+    int j;
+    spx_word32_t tmp1 = 0;
+    for (j = 0; j < wrap; j++)
+        tmp1 = MAC16_16(tmp1, X[j * N], Y[j * N]);
+    for (; j < M; j++)
+        tmp1 = MAC16_16(tmp1, Xw[(j - wrap) * N], Y[j * N]);
+    return PSHR32(tmp1, WEIGHT_SHIFT);
+}
+
+#else
+/* Float walks the M partitions in the outer loop, this adds partition X*Y from bin i on into acc */
+static inline void spectral_mul_accum_part_tail(const spx_word16_t *X, const spx_word32_t *Y, spx_word16_t *acc, int N, int i)
+{
+    for (; i < N - 1; i += 2) {
+        acc[i] += (X[i] * Y[i] - X[i + 1] * Y[i + 1]);
+        acc[i + 1] += (X[i + 1] * Y[i] + X[i] * Y[i + 1]);
+    }
+    acc[i] += X[i] * Y[i];
+}
+#endif
+
+#endif
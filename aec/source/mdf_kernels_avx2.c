@@ -0,0 +1,268 @@
+/*
+   File: mdf_kernels_avx2.c
+   AVX2 MDF kernels, 256-bit: 4 complex bins per float vector, 8 per fixed-point one.
+   FMA is deliberately not enabled so the float products round like the scalar code.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mdf_kernels.h"
+
+#ifdef MDF_KERNELS_X86
+#include <immintrin.h>
+
+#define MDF_TARGET __attribute__((target("avx2")))
+
+#ifdef FIXED_POINT
+static MDF_TARGET spx_word32_t mdf_inner_prod_avx2(const spx_word16_t *x, const spx_word16_t *y, int len)
+{
+    __m256i sum = _mm256_setzero_si256();
+    __m128i s;
+    int k;
+    for (k = 0; k + 16 <= len; k += 16) {
+        __m256i part = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(x + k)), _mm256_loadu_si256((const __m256i *)(y + k)));
+        sum          = _mm256_add_epi32(sum, _mm256_srai_epi32(part, 6));
+    }
+    s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s) + mdf_inner_prod_tail(x, y, k, len);
+}
+
+static MDF_TARGET void power_spectrum_avx2(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] = MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 16 <= N - 1; i += 16, j += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(X + i));
+        _mm256_storeu_si256((__m256i *)(ps + j), _mm256_madd_epi16(x, x));
+    }
+    power_spectrum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void power_spectrum_accum_avx2(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] += MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 16 <= N - 1; i += 16, j += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(X + i));
+        _mm256_storeu_si256((__m256i *)(ps + j), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(ps + j)), _mm256_madd_epi16(x, x)));
+    }
+    power_spectrum_accum_tail(X, ps, N, i);
+}
+
+/* TOP16 of 16 filter weights, packed like the 16-bit spectra (packs works per 128-bit lane) */
+static inline MDF_TARGET __m256i mdf_top16_avx2(const spx_word32_t *Y)
+{
+    __m256i y = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)Y), 16), _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(Y + 8)), 16));
+    return _mm256_permute4x64_epi64(y, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+/* re += Xr*Yr - Xi*Yi and im += Xi*Yr + Xr*Yi over 8 bins */
+static inline MDF_TARGET void mdf_cmac_avx2(__m256i x, __m256i y, __m256i *re, __m256i *im)
+{
+    const __m256i lo = _mm256_set1_epi32(0x0000ffff);
+    __m256i xs       = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+    *re              = _mm256_add_epi32(*re, _mm256_sub_epi32(_mm256_madd_epi16(x, _mm256_and_si256(y, lo)), _mm256_madd_epi16(x, _mm256_andnot_si256(lo, y))));
+    *im              = _mm256_add_epi32(*im, _mm256_madd_epi16(xs, y));
+}
+
+/* PSHR32 by WEIGHT_SHIFT and the truncating narrowing to spx_word16_t of 8 bins */
+static inline MDF_TARGET void mdf_store_bins_avx2(spx_word16_t *acc, __m256i re, __m256i im)
+{
+    const __m256i rnd = _mm256_set1_epi32(1 << (WEIGHT_SHIFT - 1));
+    __m256i a, b;
+    re = _mm256_srai_epi32(_mm256_add_epi32(re, rnd), WEIGHT_SHIFT);
+    im = _mm256_srai_epi32(_mm256_add_epi32(im, rnd), WEIGHT_SHIFT);
+    a  = _mm256_unpacklo_epi32(re, im);
+    b  = _mm256_unpackhi_epi32(re, im);
+    a  = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+    b  = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+    /* Both unpack and packs work per lane, so the two shuffles cancel out */
+    _mm256_storeu_si256((__m256i *)acc, _mm256_packs_epi32(a, b));
+}
+
+static MDF_TARGET void spectral_mul_accum_avx2(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    acc[0] = spectral_mul_accum_dc(X, Xw, wrap, Y, N, M);
+    for (i = 1; i + 16 <= N - 1; i += 16) {
+        __m256i re = _mm256_setzero_si256(), im = _mm256_setzero_si256();
+        for (j = 0; j < wrap; j++)
+            mdf_cmac_avx2(_mm256_loadu_si256((const __m256i *)(X + j * N + i)), mdf_top16_avx2(Y + j * N + i), &re, &im);
+        for (; j < M; j++)
+            mdf_cmac_avx2(_mm256_loadu_si256((const __m256i *)(Xw + (j - wrap) * N + i)), mdf_top16_avx2(Y + j * N + i), &re, &im);
+        mdf_store_bins_avx2(acc + i, re, im);
+    }
+    spectral_mul_accum_tail(X, Xw, wrap, Y, acc, N, M, i);
+}
+
+static MDF_TARGET void spectral_mul_accum16_avx2(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word16_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    acc[0] = spectral_mul_accum16_dc(X, Xw, wrap, Y, N, M);
+    for (i = 1; i + 16 <= N - 1; i += 16) {
+        __m256i re = _mm256_setzero_si256(), im = _mm256_setzero_si256();
+        for (j = 0; j < wrap; j++)
+            mdf_cmac_avx2(_mm256_loadu_si256((const __m256i *)(X + j * N + i)), _mm256_loadu_si256((const __m256i *)(Y + j * N + i)), &re, &im);
+        for (; j < M; j++)
+            mdf_cmac_avx2(_mm256_loadu_si256((const __m256i *)(Xw + (j - wrap) * N + i)), _mm256_loadu_si256((const __m256i *)(Y + j * N + i)), &re, &im);
+        mdf_store_bins_avx2(acc + i, re, im);
+    }
+    spectral_mul_accum16_tail(X, Xw, wrap, Y, acc, N, M, i);
+}
+
+/* FLOAT_MUL32(FLOAT_AMULT(p, w), v) for 8 bins, w holds the 8 pseudo-floats as {m, e} pairs */
+static inline MDF_TARGET __m256i mdf_float_mul32_avx2(__m256i pm, __m256i pe, __m256i w, __m256i v)
+{
+    __m256i m     = _mm256_srai_epi32(_mm256_slli_epi32(w, 16), 16);
+    __m256i shift = _mm256_sub_epi32(_mm256_set1_epi32(-30), _mm256_add_epi32(pe, _mm256_srai_epi32(w, 16)));
+    __m256i r;
+    m = _mm256_srai_epi32(_mm256_mullo_epi32(pm, m), 15);
+    m = _mm256_srai_epi32(_mm256_slli_epi32(m, 16), 16);
+    /* MULT16_32_Q15 */
+    r = _mm256_add_epi32(_mm256_mullo_epi32(m, _mm256_srai_epi32(v, 15)), _mm256_srai_epi32(_mm256_mullo_epi32(m, _mm256_and_si256(v, _mm256_set1_epi32(0x7fff))), 15));
+    /* VSHR32 */
+    return _mm256_blendv_epi8(_mm256_sllv_epi32(r, _mm256_sub_epi32(_mm256_setzero_si256(), shift)), _mm256_srav_epi32(r, shift), _mm256_cmpgt_epi32(shift, _mm256_setzero_si256()));
+}
+
+static inline MDF_TARGET void mdf_store_prod_avx2(spx_word32_t *prod, __m256i v, int accum)
+{
+    if (accum)
+        v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)prod), v);
+    _mm256_storeu_si256((__m256i *)prod, v);
+}
+
+static inline MDF_TARGET void mdf_weighted_conj_avx2(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N, int accum)
+{
+    const __m256i pm  = _mm256_set1_epi32(p.m);
+    const __m256i pe  = _mm256_set1_epi32(p.e);
+    const __m256i neg = _mm256_set1_epi32(0x0001ffff); /* -1 on the real halves for sign_epi16 */
+    int i, j;
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, accum);
+    for (i = 1, j = 1; i + 16 <= N - 1; i += 16, j += 8) {
+        __m256i x  = _mm256_loadu_si256((const __m256i *)(X + i));
+        __m256i y  = _mm256_loadu_si256((const __m256i *)(Y + i));
+        __m256i wj = _mm256_loadu_si256((const __m256i *)(w + j));
+        /* (-Xi, Xr), the 16-bit negation wraps like the scalar MULT16_16 cast */
+        __m256i xs = _mm256_sign_epi16(_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1)), neg);
+        __m256i re = mdf_float_mul32_avx2(pm, pe, wj, _mm256_madd_epi16(x, y));
+        __m256i im = mdf_float_mul32_avx2(pm, pe, wj, _mm256_madd_epi16(xs, y));
+        __m256i a  = _mm256_unpacklo_epi32(re, im);
+        __m256i b  = _mm256_unpackhi_epi32(re, im);
+        mdf_store_prod_avx2(prod + i, _mm256_permute2x128_si256(a, b, 0x20), accum);
+        mdf_store_prod_avx2(prod + i + 8, _mm256_permute2x128_si256(a, b, 0x31), accum);
+    }
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, i, accum);
+}
+
+#else
+static MDF_TARGET spx_word32_t mdf_inner_prod_avx2(const spx_word16_t *x, const spx_word16_t *y, int len)
+{
+    __m256 sum = _mm256_setzero_ps();
+    __m128 s;
+    int k;
+    for (k = 0; k + 8 <= len; k += 8)
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k)));
+    s = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    s = _mm_hadd_ps(s, s);
+    s = _mm_hadd_ps(s, s);
+    return _mm_cvtss_f32(s) + mdf_inner_prod_tail(x, y, k, len);
+}
+
+/* |X|^2 of 8 bins, hadd works per 128-bit lane so the halves are put back in order */
+static inline MDF_TARGET __m256 mdf_power8_avx2(const spx_word16_t *X)
+{
+    __m256 a = _mm256_loadu_ps(X), b = _mm256_loadu_ps(X + 8);
+    __m256 s = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(s), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+static MDF_TARGET void power_spectrum_avx2(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] = MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 16 <= N - 1; i += 16, j += 8)
+        _mm256_storeu_ps(ps + j, mdf_power8_avx2(X + i));
+    power_spectrum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void power_spectrum_accum_avx2(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] += MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 16 <= N - 1; i += 16, j += 8)
+        _mm256_storeu_ps(ps + j, _mm256_add_ps(_mm256_loadu_ps(ps + j), mdf_power8_avx2(X + i)));
+    power_spectrum_accum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void spectral_mul_accum_avx2(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    for (i = 0; i < N; i++)
+        acc[i] = 0;
+    for (j = 0; j < M; j++) {
+        if (j == wrap)
+            X = Xw;
+        acc[0] += X[0] * Y[0];
+        for (i = 1; i + 8 <= N - 1; i += 8) {
+            __m256 x  = _mm256_loadu_ps(X + i);
+            __m256 y  = _mm256_loadu_ps(Y + i);
+            __m256 xs = _mm256_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+            __m256 t  = _mm256_addsub_ps(_mm256_mul_ps(_mm256_moveldup_ps(y), x), _mm256_mul_ps(_mm256_movehdup_ps(y), xs));
+            _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), t));
+        }
+        spectral_mul_accum_part_tail(X, Y, acc, N, i);
+        X += N;
+        Y += N;
+    }
+}
+#define spectral_mul_accum16_avx2 spectral_mul_accum_avx2
+
+static inline MDF_TARGET void mdf_weighted_conj_avx2(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N, int accum)
+{
+    const __m256 neg_im = _mm256_castsi256_ps(_mm256_set1_epi64x((long long)0x8000000000000000ULL));
+    const __m256 vp     = _mm256_set1_ps(p);
+    const __m256i dup   = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+    int i, j;
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, accum);
+    for (i = 1, j = 1; i + 8 <= N - 1; i += 8, j += 4) {
+        __m256 x  = _mm256_loadu_ps(X + i);
+        __m256 y  = _mm256_loadu_ps(Y + i);
+        __m256 xs = _mm256_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+        __m256 wj = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(w + j)), dup);
+        __m256 t  = _mm256_add_ps(_mm256_xor_ps(_mm256_mul_ps(_mm256_moveldup_ps(y), x), neg_im), _mm256_mul_ps(_mm256_movehdup_ps(y), xs));
+        t = _mm256_mul_ps(_mm256_mul_ps(vp, wj), t);
+        if (accum)
+            t = _mm256_add_ps(_mm256_loadu_ps(prod + i), t);
+        _mm256_storeu_ps(prod + i, t);
+    }
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, i, accum);
+}
+#endif
+
+static MDF_TARGET void weighted_spectral_mul_conj_avx2(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    mdf_weighted_conj_avx2(w, p, X, Y, prod, N, 0);
+}
+
+static MDF_TARGET void weighted_spectral_mul_conj_accum_avx2(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    mdf_weighted_conj_avx2(w, p, X, Y, prod, N, 1);
+}
+
+const MdfKernels mdf_kernels_avx2 = {
+    "avx2",
+    MDF_KERNEL_AVX2,
+    mdf_inner_prod_avx2,
+    power_spectrum_avx2,
+    power_spectrum_accum_avx2,
+    spectral_mul_accum_avx2,
+    spectral_mul_accum16_avx2,
+    weighted_spectral_mul_conj_avx2,
+    weighted_spectral_mul_conj_accum_avx2,
+};
+
+#endif
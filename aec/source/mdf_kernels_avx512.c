@@ -0,0 +1,282 @@
+/*
+   File: mdf_kernels_avx512.c
+   AVX-512 (F+BW) MDF kernels, 512-bit: 8 complex bins per float vector, 16 per fixed-point one.
+   No fused multiply-add, so the float products round like the scalar code.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mdf_kernels.h"
+
+#ifdef MDF_KERNELS_X86
+#include <immintrin.h>
+
+#define MDF_TARGET __attribute__((target("avx512f,avx512bw")))
+
+/* AVX-512F brings its own FMA encodings, keep GCC from fusing the float multiply-adds */
+#if !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#ifdef FIXED_POINT
+static MDF_TARGET spx_word32_t mdf_inner_prod_avx512(const spx_word16_t *x, const spx_word16_t *y, int len)
+{
+    __m512i sum = _mm512_setzero_si512();
+    int k;
+    for (k = 0; k + 32 <= len; k += 32) {
+        __m512i part = _mm512_madd_epi16(_mm512_loadu_si512((const void *)(x + k)), _mm512_loadu_si512((const void *)(y + k)));
+        sum          = _mm512_add_epi32(sum, _mm512_srai_epi32(part, 6));
+    }
+    return _mm512_reduce_add_epi32(sum) + mdf_inner_prod_tail(x, y, k, len);
+}
+
+static MDF_TARGET void power_spectrum_avx512(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] = MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 32 <= N - 1; i += 32, j += 16) {
+        __m512i x = _mm512_loadu_si512((const void *)(X + i));
+        _mm512_storeu_si512((void *)(ps + j), _mm512_madd_epi16(x, x));
+    }
+    power_spectrum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void power_spectrum_accum_avx512(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] += MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 32 <= N - 1; i += 32, j += 16) {
+        __m512i x = _mm512_loadu_si512((const void *)(X + i));
+        _mm512_storeu_si512((void *)(ps + j), _mm512_add_epi32(_mm512_loadu_si512((const void *)(ps + j)), _mm512_madd_epi16(x, x)));
+    }
+    power_spectrum_accum_tail(X, ps, N, i);
+}
+
+/* TOP16 of 32 filter weights, packed like the 16-bit spectra (packs works per 128-bit lane) */
+static inline MDF_TARGET __m512i mdf_top16_avx512(const spx_word32_t *Y)
+{
+    __m512i y = _mm512_packs_epi32(_mm512_srai_epi32(_mm512_loadu_si512((const void *)Y), 16), _mm512_srai_epi32(_mm512_loadu_si512((const void *)(Y + 16)), 16));
+    return _mm512_permutexvar_epi64(_mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0), y);
+}
+
+/* (Xi, Xr) from (Xr, Xi) */
+static inline MDF_TARGET __m512i mdf_swap16_avx512(__m512i x)
+{
+    return _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+/* re += Xr*Yr - Xi*Yi and im += Xi*Yr + Xr*Yi over 16 bins */
+static inline MDF_TARGET void mdf_cmac_avx512(__m512i x, __m512i y, __m512i *re, __m512i *im)
+{
+    const __m512i lo = _mm512_set1_epi32(0x0000ffff);
+    *re              = _mm512_add_epi32(*re, _mm512_sub_epi32(_mm512_madd_epi16(x, _mm512_and_si512(y, lo)), _mm512_madd_epi16(x, _mm512_andnot_si512(lo, y))));
+    *im              = _mm512_add_epi32(*im, _mm512_madd_epi16(mdf_swap16_avx512(x), y));
+}
+
+/* PSHR32 by WEIGHT_SHIFT and the truncating narrowing to spx_word16_t of 16 bins */
+static inline MDF_TARGET void mdf_store_bins_avx512(spx_word16_t *acc, __m512i re, __m512i im)
+{
+    const __m512i rnd = _mm512_set1_epi32(1 << (WEIGHT_SHIFT - 1));
+    __m512i a, b;
+    re = _mm512_srai_epi32(_mm512_add_epi32(re, rnd), WEIGHT_SHIFT);
+    im = _mm512_srai_epi32(_mm512_add_epi32(im, rnd), WEIGHT_SHIFT);
+    a  = _mm512_unpacklo_epi32(re, im);
+    b  = _mm512_unpackhi_epi32(re, im);
+    a  = _mm512_srai_epi32(_mm512_slli_epi32(a, 16), 16);
+    b  = _mm512_srai_epi32(_mm512_slli_epi32(b, 16), 16);
+    /* Both unpack and packs work per lane, so the two shuffles cancel out */
+    _mm512_storeu_si512((void *)acc, _mm512_packs_epi32(a, b));
+}
+
+static MDF_TARGET void spectral_mul_accum_avx512(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    acc[0] = spectral_mul_accum_dc(X, Xw, wrap, Y, N, M);
+    for (i = 1; i + 32 <= N - 1; i += 32) {
+        __m512i re = _mm512_setzero_si512(), im = _mm512_setzero_si512();
+        for (j = 0; j < wrap; j++)
+            mdf_cmac_avx512(_mm512_loadu_si512((const void *)(X + j * N + i)), mdf_top16_avx512(Y + j * N + i), &re, &im);
+        for (; j < M; j++)
+            mdf_cmac_avx512(_mm512_loadu_si512((const void *)(Xw + (j - wrap) * N + i)), mdf_top16_avx512(Y + j * N + i), &re, &im);
+        mdf_store_bins_avx512(acc + i, re, im);
+    }
+    spectral_mul_accum_tail(X, Xw, wrap, Y, acc, N, M, i);
+}
+
+static MDF_TARGET void spectral_mul_accum16_avx512(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word16_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    acc[0] = spectral_mul_accum16_dc(X, Xw, wrap, Y, N, M);
+    for (i = 1; i + 32 <= N - 1; i += 32) {
+        __m512i re = _mm512_setzero_si512(), im = _mm512_setzero_si512();
+        for (j = 0; j < wrap; j++)
+            mdf_cmac_avx512(_mm512_loadu_si512((const void *)(X + j * N + i)), _mm512_loadu_si512((const void *)(Y + j * N + i)), &re, &im);
+        for (; j < M; j++)
+            mdf_cmac_avx512(_mm512_loadu_si512((const void *)(Xw + (j - wrap) * N + i)), _mm512_loadu_si512((const void *)(Y + j * N + i)), &re, &im);
+        mdf_store_bins_avx512(acc + i, re, im);
+    }
+    spectral_mul_accum16_tail(X, Xw, wrap, Y, acc, N, M, i);
+}
+
+/* FLOAT_MUL32(FLOAT_AMULT(p, w), v) for 16 bins, w holds the 16 pseudo-floats as {m, e} pairs */
+static inline MDF_TARGET __m512i mdf_float_mul32_avx512(__m512i pm, __m512i pe, __m512i w, __m512i v)
+{
+    __m512i m     = _mm512_srai_epi32(_mm512_slli_epi32(w, 16), 16);
+    __m512i shift = _mm512_sub_epi32(_mm512_set1_epi32(-30), _mm512_add_epi32(pe, _mm512_srai_epi32(w, 16)));
+    __m512i r;
+    m = _mm512_srai_epi32(_mm512_mullo_epi32(pm, m), 15);
+    m = _mm512_srai_epi32(_mm512_slli_epi32(m, 16), 16);
+    /* MULT16_32_Q15 */
+    r = _mm512_add_epi32(_mm512_mullo_epi32(m, _mm512_srai_epi32(v, 15)), _mm512_srai_epi32(_mm512_mullo_epi32(m, _mm512_and_si512(v, _mm512_set1_epi32(0x7fff))), 15));
+    /* VSHR32 */
+    return _mm512_mask_blend_epi32(_mm512_cmpgt_epi32_mask(shift, _mm512_setzero_si512()), _mm512_sllv_epi32(r, _mm512_sub_epi32(_mm512_setzero_si512(), shift)), _mm512_srav_epi32(r, shift));
+}
+
+static inline MDF_TARGET void mdf_store_prod_avx512(spx_word32_t *prod, __m512i v, int accum)
+{
+    if (accum)
+        v = _mm512_add_epi32(_mm512_loadu_si512((const void *)prod), v);
+    _mm512_storeu_si512((void *)prod, v);
+}
+
+static inline MDF_TARGET void mdf_weighted_conj_avx512(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N, int accum)
+{
+    const __m512i pm = _mm512_set1_epi32(p.m);
+    const __m512i pe = _mm512_set1_epi32(p.e);
+    const __m512i lo = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    const __m512i hi = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+    int i, j;
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, accum);
+    for (i = 1, j = 1; i + 32 <= N - 1; i += 32, j += 16) {
+        __m512i x  = _mm512_loadu_si512((const void *)(X + i));
+        __m512i y  = _mm512_loadu_si512((const void *)(Y + i));
+        __m512i wj = _mm512_loadu_si512((const void *)(w + j));
+        /* (-Xi, Xr), the 16-bit negation wraps like the scalar MULT16_16 cast */
+        __m512i xs = mdf_swap16_avx512(x);
+        __m512i re, im, a, b;
+        xs = _mm512_mask_sub_epi16(xs, 0x55555555, _mm512_setzero_si512(), xs);
+        re = mdf_float_mul32_avx512(pm, pe, wj, _mm512_madd_epi16(x, y));
+        im = mdf_float_mul32_avx512(pm, pe, wj, _mm512_madd_epi16(xs, y));
+        a  = _mm512_unpacklo_epi32(re, im);
+        b  = _mm512_unpackhi_epi32(re, im);
+        mdf_store_prod_avx512(prod + i, _mm512_permutex2var_epi64(a, lo, b), accum);
+        mdf_store_prod_avx512(prod + i + 16, _mm512_permutex2var_epi64(a, hi, b), accum);
+    }
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, i, accum);
+}
+
+#else
+static MDF_TARGET spx_word32_t mdf_inner_prod_avx512(const spx_word16_t *x, const spx_word16_t *y, int len)
+{
+    __m512 sum = _mm512_setzero_ps();
+    int k;
+    for (k = 0; k + 16 <= len; k += 16)
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(x + k), _mm512_loadu_ps(y + k)));
+    return _mm512_reduce_add_ps(sum) + mdf_inner_prod_tail(x, y, k, len);
+}
+
+/* |X|^2 of 16 bins, Xr^2 + Xi^2 like the scalar code */
+static inline MDF_TARGET __m512 mdf_power16_avx512(const spx_word16_t *X)
+{
+    const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd  = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+    __m512 a           = _mm512_loadu_ps(X), b = _mm512_loadu_ps(X + 16);
+    a                  = _mm512_mul_ps(a, a);
+    b                  = _mm512_mul_ps(b, b);
+    return _mm512_add_ps(_mm512_permutex2var_ps(a, even, b), _mm512_permutex2var_ps(a, odd, b));
+}
+
+static MDF_TARGET void power_spectrum_avx512(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] = MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 32 <= N - 1; i += 32, j += 16)
+        _mm512_storeu_ps(ps + j, mdf_power16_avx512(X + i));
+    power_spectrum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void power_spectrum_accum_avx512(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] += MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 32 <= N - 1; i += 32, j += 16)
+        _mm512_storeu_ps(ps + j, _mm512_add_ps(_mm512_loadu_ps(ps + j), mdf_power16_avx512(X + i)));
+    power_spectrum_accum_tail(X, ps, N, i);
+}
+
+/* Flip the sign of the even (real) or odd (imaginary) lanes */
+static inline MDF_TARGET __m512 mdf_negate_avx512(__m512 a, long long mask)
+{
+    return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi64(mask)));
+}
+
+static MDF_TARGET void spectral_mul_accum_avx512(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    for (i = 0; i < N; i++)
+        acc[i] = 0;
+    for (j = 0; j < M; j++) {
+        if (j == wrap)
+            X = Xw;
+        acc[0] += X[0] * Y[0];
+        for (i = 1; i + 16 <= N - 1; i += 16) {
+            __m512 x  = _mm512_loadu_ps(X + i);
+            __m512 y  = _mm512_loadu_ps(Y + i);
+            __m512 xs = _mm512_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+            /* No addsub on AVX-512, a + (-b) rounds exactly like a - b */
+            __m512 t = _mm512_add_ps(_mm512_mul_ps(_mm512_moveldup_ps(y), x), mdf_negate_avx512(_mm512_mul_ps(_mm512_movehdup_ps(y), xs), 0x80000000LL));
+            _mm512_storeu_ps(acc + i, _mm512_add_ps(_mm512_loadu_ps(acc + i), t));
+        }
+        spectral_mul_accum_part_tail(X, Y, acc, N, i);
+        X += N;
+        Y += N;
+    }
+}
+#define spectral_mul_accum16_avx512 spectral_mul_accum_avx512
+
+static inline MDF_TARGET void mdf_weighted_conj_avx512(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N, int accum)
+{
+    const __m512 vp   = _mm512_set1_ps(p);
+    const __m512i dup = _mm512_set_epi32(7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0);
+    int i, j;
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, accum);
+    for (i = 1, j = 1; i + 16 <= N - 1; i += 16, j += 8) {
+        __m512 x  = _mm512_loadu_ps(X + i);
+        __m512 y  = _mm512_loadu_ps(Y + i);
+        __m512 xs = _mm512_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+        __m512 wj = _mm512_permutexvar_ps(dup, _mm512_castps256_ps512(_mm256_loadu_ps(w + j)));
+        __m512 t  = _mm512_add_ps(mdf_negate_avx512(_mm512_mul_ps(_mm512_moveldup_ps(y), x), (long long)0x8000000000000000ULL), _mm512_mul_ps(_mm512_movehdup_ps(y), xs));
+        t = _mm512_mul_ps(_mm512_mul_ps(vp, wj), t);
+        if (accum)
+            t = _mm512_add_ps(_mm512_loadu_ps(prod + i), t);
+        _mm512_storeu_ps(prod + i, t);
+    }
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, i, accum);
+}
+#endif
+
+static MDF_TARGET void weighted_spectral_mul_conj_avx512(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    mdf_weighted_conj_avx512(w, p, X, Y, prod, N, 0);
+}
+
+static MDF_TARGET void weighted_spectral_mul_conj_accum_avx512(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    mdf_weighted_conj_avx512(w, p, X, Y, prod, N, 1);
+}
+
+const MdfKernels mdf_kernels_avx512 = {
+    "avx512",
+    MDF_KERNEL_AVX512,
+    mdf_inner_prod_avx512,
+    power_spectrum_avx512,
+    power_spectrum_accum_avx512,
+    spectral_mul_accum_avx512,
+    spectral_mul_accum16_avx512,
+    weighted_spectral_mul_conj_avx512,
+    weighted_spectral_mul_conj_accum_avx512,
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+   File: mdf_kernels_sse41.c
+   SSE4.1 MDF kernels, 128-bit: 2 complex bins per float vector, 4 per fixed-point one
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mdf_kernels.h"
+
+#ifdef MDF_KERNELS_X86
+#include <immintrin.h>
+
+#define MDF_TARGET __attribute__((target("sse4.1")))
+
+#ifdef FIXED_POINT
+static MDF_TARGET spx_word32_t mdf_inner_prod_sse41(const spx_word16_t *x, const spx_word16_t *y, int len)
+{
+    __m128i sum = _mm_setzero_si128();
+    int k;
+    /* madd_epi16 yields exactly the scalar pair sums, which are shifted before accumulation */
+    for (k = 0; k + 8 <= len; k += 8) {
+        __m128i part = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(x + k)), _mm_loadu_si128((const __m128i *)(y + k)));
+        sum          = _mm_add_epi32(sum, _mm_srai_epi32(part, 6));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum) + mdf_inner_prod_tail(x, y, k, len);
+}
+
+static MDF_TARGET void power_spectrum_sse41(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] = MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 8 <= N - 1; i += 8, j += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(X + i));
+        _mm_storeu_si128((__m128i *)(ps + j), _mm_madd_epi16(x, x));
+    }
+    power_spectrum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void power_spectrum_accum_sse41(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] += MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 8 <= N - 1; i += 8, j += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(X + i));
+        _mm_storeu_si128((__m128i *)(ps + j), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(ps + j)), _mm_madd_epi16(x, x)));
+    }
+    power_spectrum_accum_tail(X, ps, N, i);
+}
+
+/* TOP16 of 8 filter weights, packed like the 16-bit spectra */
+static inline MDF_TARGET __m128i mdf_top16_sse41(const spx_word32_t *Y)
+{
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i *)Y), 16), _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(Y + 4)), 16));
+}
+
+/* re += Xr*Yr - Xi*Yi and im += Xi*Yr + Xr*Yi over 4 bins, the 32-bit wrap-around matches the scalar MACs */
+static inline MDF_TARGET void mdf_cmac_sse41(__m128i x, __m128i y, __m128i *re, __m128i *im)
+{
+    const __m128i lo = _mm_set1_epi32(0x0000ffff);
+    __m128i xs       = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+    *re              = _mm_add_epi32(*re, _mm_sub_epi32(_mm_madd_epi16(x, _mm_and_si128(y, lo)), _mm_madd_epi16(x, _mm_andnot_si128(lo, y))));
+    *im              = _mm_add_epi32(*im, _mm_madd_epi16(xs, y));
+}
+
+/* PSHR32 by WEIGHT_SHIFT and the truncating narrowing to spx_word16_t of 4 bins */
+static inline MDF_TARGET void mdf_store_bins_sse41(spx_word16_t *acc, __m128i re, __m128i im)
+{
+    const __m128i rnd = _mm_set1_epi32(1 << (WEIGHT_SHIFT - 1));
+    __m128i a, b;
+    re = _mm_srai_epi32(_mm_add_epi32(re, rnd), WEIGHT_SHIFT);
+    im = _mm_srai_epi32(_mm_add_epi32(im, rnd), WEIGHT_SHIFT);
+    a  = _mm_unpacklo_epi32(re, im);
+    b  = _mm_unpackhi_epi32(re, im);
+    /* Sign-extend the low halves first so packs does not saturate */
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    _mm_storeu_si128((__m128i *)acc, _mm_packs_epi32(a, b));
+}
+
+static MDF_TARGET void spectral_mul_accum_sse41(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    acc[0] = spectral_mul_accum_dc(X, Xw, wrap, Y, N, M);
+    for (i = 1; i + 8 <= N - 1; i += 8) {
+        __m128i re = _mm_setzero_si128(), im = _mm_setzero_si128();
+        for (j = 0; j < wrap; j++)
+            mdf_cmac_sse41(_mm_loadu_si128((const __m128i *)(X + j * N + i)), mdf_top16_sse41(Y + j * N + i), &re, &im);
+        for (; j < M; j++)
+            mdf_cmac_sse41(_mm_loadu_si128((const __m128i *)(Xw + (j - wrap) * N + i)), mdf_top16_sse41(Y + j * N + i), &re, &im);
+        mdf_store_bins_sse41(acc + i, re, im);
+    }
+    spectral_mul_accum_tail(X, Xw, wrap, Y, acc, N, M, i);
+}
+
+static MDF_TARGET void spectral_mul_accum16_sse41(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word16_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    acc[0] = spectral_mul_accum16_dc(X, Xw, wrap, Y, N, M);
+    for (i = 1; i + 8 <= N - 1; i += 8) {
+        __m128i re = _mm_setzero_si128(), im = _mm_setzero_si128();
+        for (j = 0; j < wrap; j++)
+            mdf_cmac_sse41(_mm_loadu_si128((const __m128i *)(X + j * N + i)), _mm_loadu_si128((const __m128i *)(Y + j * N + i)), &re, &im);
+        for (; j < M; j++)
+            mdf_cmac_sse41(_mm_loadu_si128((const __m128i *)(Xw + (j - wrap) * N + i)), _mm_loadu_si128((const __m128i *)(Y + j * N + i)), &re, &im);
+        mdf_store_bins_sse41(acc + i, re, im);
+    }
+    spectral_mul_accum16_tail(X, Xw, wrap, Y, acc, N, M, i);
+}
+
+/* The pseudo-float scaling needs per-lane variable shifts, which SSE does not have */
+static void weighted_spectral_mul_conj_sse41(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, 0);
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, 1, 0);
+}
+
+static void weighted_spectral_mul_conj_accum_sse41(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, 1);
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, 1, 1);
+}
+
+#else
+static MDF_TARGET spx_word32_t mdf_inner_prod_sse41(const spx_word16_t *x, const spx_word16_t *y, int len)
+{
+    __m128 sum = _mm_setzero_ps();
+    int k;
+    for (k = 0; k + 4 <= len; k += 4)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_loadu_ps(y + k)));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum) + mdf_inner_prod_tail(x, y, k, len);
+}
+
+static MDF_TARGET void power_spectrum_sse41(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] = MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 8 <= N - 1; i += 8, j += 4) {
+        __m128 a = _mm_loadu_ps(X + i), b = _mm_loadu_ps(X + i + 4);
+        _mm_storeu_ps(ps + j, _mm_hadd_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)));
+    }
+    power_spectrum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void power_spectrum_accum_sse41(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+    int i, j;
+    ps[0] += MULT16_16(X[0], X[0]);
+    for (i = 1, j = 1; i + 8 <= N - 1; i += 8, j += 4) {
+        __m128 a = _mm_loadu_ps(X + i), b = _mm_loadu_ps(X + i + 4);
+        _mm_storeu_ps(ps + j, _mm_add_ps(_mm_loadu_ps(ps + j), _mm_hadd_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b))));
+    }
+    power_spectrum_accum_tail(X, ps, N, i);
+}
+
+static MDF_TARGET void spectral_mul_accum_sse41(const spx_word16_t *X, const spx_word16_t *Xw, int wrap, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
+{
+    int i, j;
+    for (i = 0; i < N; i++)
+        acc[i] = 0;
+    for (j = 0; j < M; j++) {
+        if (j == wrap)
+            X = Xw;
+        acc[0] += X[0] * Y[0];
+        for (i = 1; i + 4 <= N - 1; i += 4) {
+            __m128 x  = _mm_loadu_ps(X + i);
+            __m128 y  = _mm_loadu_ps(Y + i);
+            __m128 xs = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+            /* (Yr*Xr - Yi*Xi, Yr*Xi + Yi*Xr) */
+            __m128 t = _mm_addsub_ps(_mm_mul_ps(_mm_moveldup_ps(y), x), _mm_mul_ps(_mm_movehdup_ps(y), xs));
+            _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), t));
+        }
+        spectral_mul_accum_part_tail(X, Y, acc, N, i);
+        X += N;
+        Y += N;
+    }
+}
+#define spectral_mul_accum16_sse41 spectral_mul_accum_sse41
+
+static inline MDF_TARGET void mdf_weighted_conj_sse41(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N, int accum)
+{
+    const __m128 neg_im = _mm_castsi128_ps(_mm_set_epi32((int)0x80000000, 0, (int)0x80000000, 0));
+    const __m128 vp     = _mm_set1_ps(p);
+    int i, j;
+    weighted_spectral_mul_conj_dc(w, p, X, Y, prod, accum);
+    for (i = 1, j = 1; i + 4 <= N - 1; i += 4, j += 2) {
+        __m128 x  = _mm_loadu_ps(X + i);
+        __m128 y  = _mm_loadu_ps(Y + i);
+        __m128 xs = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 wj = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)(w + j)));
+        /* (Xr*Yr + Xi*Yi, -Xi*Yr + Xr*Yi) */
+        __m128 t = _mm_add_ps(_mm_xor_ps(_mm_mul_ps(_mm_moveldup_ps(y), x), neg_im), _mm_mul_ps(_mm_movehdup_ps(y), xs));
+        t = _mm_mul_ps(_mm_mul_ps(vp, _mm_unpacklo_ps(wj, wj)), t);
+        if (accum)
+            t = _mm_add_ps(_mm_loadu_ps(prod + i), t);
+        _mm_storeu_ps(prod + i, t);
+    }
+    weighted_spectral_mul_conj_tail(w, p, X, Y, prod, N, i, accum);
+}
+
+static MDF_TARGET void weighted_spectral_mul_conj_sse41(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    mdf_weighted_conj_sse41(w, p, X, Y, prod, N, 0);
+}
+
+static MDF_TARGET void weighted_spectral_mul_conj_accum_sse41(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+    mdf_weighted_conj_sse41(w, p, X, Y, prod, N, 1);
+}
+#endif
+
+const MdfKernels mdf_kernels_sse41 = {
+    "sse4.1",
+    MDF_KERNEL_SSE41,
+    mdf_inner_prod_sse41,
+    power_spectrum_sse41,
+    power_spectrum_accum_sse41,
+    spectral_mul_accum_sse41,
+    spectral_mul_accum16_sse41,
+    weighted_spectral_mul_conj_sse41,
+    weighted_spectral_mul_conj_accum_sse41,
+};
+
+#endif
@@ -15,6 +15,7 @@
 #endif
 
 #include "ns.h"
+#include "aud_mem.h"
 #include "speex_preprocess.h"
 //#include "perf.h"
 
@@ -26,18 +27,60 @@
 /*-----------------------------------------------------------------------------*/
 /* Extern Global Variables                                                     */
 /*-----------------------------------------------------------------------------*/
-extern u32 _Ns_GetInternalBufSize(PST_AUD_NS_INFO pstNsInfo, u32 u32NumPreProc);
 extern u32 _Ns_SetPreProcParams(void **ppstPreProcState, EN_AUD_NS_PARAMS enParamsCMD, void *pParamsValue, s32 s32ChannelNum);
 
-extern void AUD_Malloc_Init(void *ptr, u32 u32TotalLen);
-extern int AUD_Malloc_Uninit(void);
-extern void *(*AUD_calloc)(s32 s32num, s32 s32size);
 
 /*-----------------------------------------------------------------------------*/
 /* Local Global Variables                                                      */
 /*-----------------------------------------------------------------------------*/
 static void **_ppstPreProcState;
+static ST_AUD_MEM_ARENA _stNsArena;
 static ST_AUD_NS_INFO _stNsInfo;
+static PST_AUD_POOL _pstNsPool;  // EN_AUD_NS_THREAD_POOL
+static s32 _s32NsInterleaved;  // EN_AUD_NS_INTERLEAVED
+
+/*-------------------------------------------------------------------------------
+** Input        : pstArena, pstNsInfo
+** Output   : preprocess state array carved from pstArena, NULL if fail
+**--------------------------------------------------------------------------------*/
+static void **_AUD_NS_Build(PST_AUD_MEM_ARENA pstArena, PST_AUD_NS_INFO pstNsInfo, u32 *pu32StateSize)
+{
+    u32 u32FrameSize    = (u32)pstNsInfo->s32FrameSize;
+    u32 u32ChannelNum   = (u32)pstNsInfo->s32ChannelNum;
+    u32 u32SamplingRate = (u32)pstNsInfo->s32SamplingRate;
+    u32 u32Mark;
+    void **ppstPreProcState;
+    u32 i;
+
+    ppstPreProcState = (void **)AUD_Arena_Calloc(pstArena, u32ChannelNum, sizeof(void *));
+    if (!ppstPreProcState)
+        return NULL;
+
+    for (i = 0; i < u32ChannelNum; i++) {
+        u32Mark             = AUD_Arena_GetUsedSize(pstArena);
+        ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate, pstArena);
+        if (!ppstPreProcState[i])
+            return NULL;
+        if (pu32StateSize)
+            *pu32StateSize = AUD_Arena_GetUsedSize(pstArena) - u32Mark;
+    }
+
+    return ppstPreProcState;
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : ppstPreProcState of _AUD_NS_Build, s32ChannelNum
+** Note     : the memory stays with the arena, this only drops the references to the shared tables
+**--------------------------------------------------------------------------------*/
+static void _AUD_NS_Release(void **ppstPreProcState, s32 s32ChannelNum)
+{
+    s32 i;
+
+    for (i = 0; i < s32ChannelNum; i++) {
+        if (ppstPreProcState[i])
+            speex_preprocess_state_destroy((SpeexPreprocessState *)ppstPreProcState[i]);
+    }
+}
 
 /*-------------------------------------------------------------------------------
 ** Input        : pstNsInfo
@@ -46,29 +89,37 @@ static ST_AUD_NS_INFO _stNsInfo;
 void AUD_NS_PreInit(PST_AUD_NS_INFO pstNsInfo, PST_AUD_NS_RTN pstNsRtn)
 {
     PST_AUD_NS_INFO pstNsInfoSave = &_stNsInfo;
-    u32 u32BytePerSample          = 2;
+    ST_AUD_MEM_ARENA stArena, stScratch;
+    void **ppstPreProcState;
+    u32 u32StateSize     = 0;
+    u32 u32BytePerSample = 2;
 
     memcpy(pstNsInfoSave, pstNsInfo, sizeof(ST_AUD_NS_INFO));
 
-    pstNsRtn->u32InBufSize       = pstNsInfoSave->s32ChannelNum * pstNsInfoSave->s32FrameSize * u32BytePerSample;
-    pstNsRtn->u32OutBufSize      = pstNsRtn->u32InBufSize;
-    pstNsRtn->u32InternalBufSize = _Ns_GetInternalBufSize(pstNsInfoSave, pstNsInfoSave->s32ChannelNum);
-#ifndef FIXED_POINT
-    pstNsRtn->u32InternalBufSize *= 2;
-#endif
+    pstNsRtn->u32InBufSize  = pstNsInfoSave->s32ChannelNum * pstNsInfoSave->s32FrameSize * u32BytePerSample;
+    pstNsRtn->u32OutBufSize = pstNsRtn->u32InBufSize;
+
+    // Dry run of the real init code, the arenas tally what the state and scratch buffers must hold
+    AUD_Arena_InitCounter(&stArena);
+    AUD_Arena_InitCounter(&stScratch);
+    stArena.pstScratch     = &stScratch;
+    stArena.u32ShareTables = pstNsInfoSave->s32ShareTables != 0;
+    ppstPreProcState       = _AUD_NS_Build(&stArena, pstNsInfoSave, &u32StateSize);
+    if (ppstPreProcState)
+        _AUD_NS_Release(ppstPreProcState, pstNsInfoSave->s32ChannelNum);
+    pstNsRtn->u32StateBufSize        = AUD_Arena_UninitCounter(&stArena);
+    pstNsRtn->u32ScratchBufSize      = AUD_Arena_UninitCounter(&stScratch);
+    pstNsRtn->u32InternalBufSize     = pstNsRtn->u32StateBufSize + pstNsRtn->u32ScratchBufSize - (AUD_MEM_ALIGN - 1);
+    pstNsRtn->u32PreProcStateBufSize = u32StateSize;
 }
 
 /*-------------------------------------------------------------------------------
-** Input        : pInternalBuf, u32BufSize
+** Input        : pInternalBuf, u32BufSize, pScratchBuf, u32ScratchBufSize
 ** Output   : EN_AUD_NS_ERR
 **--------------------------------------------------------------------------------*/
-EN_AUD_NS_ERR _AUD_NS_Init(void *pInternalBuf, int u32BufSize)
+EN_AUD_NS_ERR _AUD_NS_InitEx(void *pInternalBuf, int u32BufSize, void *pScratchBuf, int u32ScratchBufSize)
 {
-    PST_AUD_NS_INFO pstNsInfo = &_stNsInfo;
-    u32 u32FrameSize          = (u32)pstNsInfo->s32FrameSize;
-    u32 u32ChannelNum         = (u32)pstNsInfo->s32ChannelNum;
-    u32 u32SamplingRate       = (u32)pstNsInfo->s32SamplingRate;
-    u32 i;
+    ST_AUD_MEM_ARENA stScratch;
 
 #ifdef _MIPS_
     {
@@ -85,32 +136,63 @@ EN_AUD_NS_ERR _AUD_NS_Init(void *pInternalBuf, int u32BufSize)
     if (pInternalBuf == 0)
         return EN_AUD_NS_EINITFAIL;
 
-    AUD_Malloc_Init(pInternalBuf, u32BufSize * 2);
-    _ppstPreProcState = (void **)AUD_calloc(u32ChannelNum, sizeof(void *));
-
-    for (i = 0; i < u32ChannelNum; i++) {
-        _ppstPreProcState[i] = speex_preprocess_state_init(u32FrameSize, u32SamplingRate);
-        if (!_ppstPreProcState[i])
-            return EN_AUD_NS_EINITFAIL;
+    AUD_Arena_Init(&_stNsArena, pInternalBuf, u32BufSize);
+    _stNsArena.u32ShareTables = _stNsInfo.s32ShareTables != 0;
+    if (pScratchBuf) {
+        AUD_Arena_Init(&stScratch, pScratchBuf, u32ScratchBufSize);
+        _stNsArena.pstScratch = &stScratch;
     }
+    _ppstPreProcState     = _AUD_NS_Build(&_stNsArena, &_stNsInfo, NULL);
+    _stNsArena.pstScratch = NULL;
+    _pstNsPool            = NULL;
+    _s32NsInterleaved     = 0;
+    if (!_ppstPreProcState)
+        return EN_AUD_NS_EINITFAIL;
 
     return EN_AUD_NS_ENOERR;
 }
 
+/*-------------------------------------------------------------------------------
+**     Input        : pInternalBuf, u32BufSize
+** Output   : EN_AUD_NS_ERR
+**--------------------------------------------------------------------------------*/
+EN_AUD_NS_ERR _AUD_NS_Init(void *pInternalBuf, int u32BufSize)
+{
+    return _AUD_NS_InitEx(pInternalBuf, u32BufSize, NULL, 0);
+}
+
 /*-------------------------------------------------------------------------------
 ** Input        : ps16InBuf
 ** Output   : pu16OutBuf
 **--------------------------------------------------------------------------------*/
 void _AUD_NS_Run(short *ps16InBuf, short *ps16OutBuf)
 {
-    s32 s32NumCH = _stNsInfo.s32ChannelNum;
-    s32 i;
-
-    for (i = 0; i < s32NumCH; i++)
-        speex_preprocess_run(_ppstPreProcState[i], ps16InBuf);
+    s32 s32NumCH     = _stNsInfo.s32ChannelNum;
+    s32 s32FrameSize = _stNsInfo.s32FrameSize;
 
+    // Processed in place in the output, the input is left as it was
     if (((uintptr_t)ps16InBuf) != ((uintptr_t)ps16OutBuf))
-        memcpy(ps16OutBuf, ps16InBuf, s32NumCH * _stNsInfo.s32FrameSize * sizeof(short));
+        memcpy(ps16OutBuf, ps16InBuf, s32NumCH * s32FrameSize * sizeof(short));
+
+    if (_s32NsInterleaved)
+        speex_preprocess_run_mc((SpeexPreprocessState **)_ppstPreProcState, s32NumCH, ps16OutBuf, 1, s32NumCH, _pstNsPool);
+    else
+        speex_preprocess_run_mc((SpeexPreprocessState **)_ppstPreProcState, s32NumCH, ps16OutBuf, s32FrameSize, 1, _pstNsPool);
+}
+
+/*-------------------------------------------------------------------------------
+** Input        : ps16InBuf
+** Output   : ps32Vad
+**--------------------------------------------------------------------------------*/
+void _AUD_NS_RunVad(short *ps16InBuf, int *ps32Vad)
+{
+    s32 s32NumCH     = _stNsInfo.s32ChannelNum;
+    s32 s32FrameSize = _stNsInfo.s32FrameSize;
+
+    if (_s32NsInterleaved)
+        speex_preprocess_vad_mc((SpeexPreprocessState **)_ppstPreProcState, s32NumCH, ps16InBuf, 1, s32NumCH, ps32Vad, _pstNsPool);
+    else
+        speex_preprocess_vad_mc((SpeexPreprocessState **)_ppstPreProcState, s32NumCH, ps16InBuf, s32FrameSize, 1, ps32Vad, _pstNsPool);
 }
 
 /*-------------------------------------------------------------------------------
@@ -122,6 +204,14 @@ EN_AUD_NS_ERR _AUD_NS_SetParam(EN_AUD_NS_PARAMS enParamsCMD, void *pParamsValue)
     s32 s32NumCH = _stNsInfo.s32ChannelNum;
     u32 ret;
 
+    if (enParamsCMD == EN_AUD_NS_THREAD_POOL) {
+        _pstNsPool = (PST_AUD_POOL)pParamsValue;
+        return EN_AUD_NS_ENOERR;
+    }
+    if (enParamsCMD == EN_AUD_NS_INTERLEAVED) {
+        _s32NsInterleaved = *((s32 *)pParamsValue);
+        return EN_AUD_NS_ENOERR;
+    }
     ret = _Ns_SetPreProcParams(_ppstPreProcState, enParamsCMD, pParamsValue, s32NumCH);
 
     if (ret != 0)
@@ -131,7 +221,11 @@ EN_AUD_NS_ERR _AUD_NS_SetParam(EN_AUD_NS_PARAMS enParamsCMD, void *pParamsValue)
 
 EN_AUD_NS_ERR _AUD_NS_Uninit(void)
 {
-    return AUD_Malloc_Uninit();
+    if (_ppstPreProcState) {
+        _AUD_NS_Release(_ppstPreProcState, _stNsInfo.s32ChannelNum);
+        _ppstPreProcState = NULL;
+    }
+    return AUD_Arena_Uninit(&_stNsArena);
 }
 
 /*-------------------------------------------------------------------------------
@@ -38,6 +38,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "aud_mem.h"
+#include "aud_table.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -47,47 +48,63 @@
 #endif
 
 /** Speex wrapper for calloc. To do your own dynamic allocation, all you need to do is replace this function, speex_realloc and speex_free
-    NOTE:  needs to CLEAR THE MEMORY */
+    NOTE:  needs to CLEAR THE MEMORY. A NULL arena allocates from the system heap */
 #ifndef OVERRIDE_SPEEX_ALLOC
-static inline void *speex_alloc(int size)
+static inline void *speex_alloc(PST_AUD_MEM_ARENA arena, int size)
 {
     /* WARNING: this is not equivalent to malloc(). If you want to use malloc()
        or your own allocator, YOU NEED TO CLEAR THE MEMORY ALLOCATED. Otherwise
        you will experience strange bugs */
-    return AUD_calloc(1, size);
+    return AUD_Arena_Calloc(arena, 1, size);
 }
 #endif
 
 /** Same as speex_alloc, except that the area is only needed inside a Speex call (might cause problem with wideband though) */
 #ifndef OVERRIDE_SPEEX_ALLOC_SCRATCH
-static inline void *speex_alloc_scratch(int size)
+static inline void *speex_alloc_scratch(PST_AUD_MEM_ARENA arena, int size)
 {
-    /* Scratch space doesn't need to be cleared */
-    return AUD_calloc(1, size);
+    /* Scratch space doesn't need to be cleared. It goes to the arena's scratch
+       arena when one is attached and may then be shared between states */
+    return AUD_Arena_CallocScratch(arena, 1, size);
 }
 #endif
 
 /** Speex wrapper for realloc. To do your own dynamic allocation, all you need to do is replace this function, speex_alloc and speex_free */
 #ifndef OVERRIDE_SPEEX_REALLOC
-static inline void *speex_realloc(void *ptr, int size)
+static inline void *speex_realloc(PST_AUD_MEM_ARENA arena, void *ptr, int size)
 {
-    return AUD_realloc(ptr, size);
+    return AUD_Arena_Realloc(arena, ptr, size);
 }
 #endif
 
 /** Speex wrapper for calloc. To do your own dynamic allocation, all you need to do is replace this function, speex_realloc and speex_alloc */
 #ifndef OVERRIDE_SPEEX_FREE
-static inline void speex_free(void *ptr)
+static inline void speex_free(PST_AUD_MEM_ARENA arena, void *ptr)
 {
-    AUD_free(ptr);
+    AUD_Arena_Free(arena, ptr);
 }
 #endif
 
 /** Same as speex_free, except that the area is only needed inside a Speex call (might cause problem with wideband though) */
 #ifndef OVERRIDE_SPEEX_FREE_SCRATCH
-static inline void speex_free_scratch(void *ptr)
+static inline void speex_free_scratch(PST_AUD_MEM_ARENA arena, void *ptr)
 {
-    AUD_free(ptr);
+    AUD_Arena_Free(arena, ptr);
+}
+#endif
+
+/** Read-only table (twiddles, window, filter bank) built by build for key, copied from proto when given. It is
+    shared with every other state of the process when the arena asks for it, see AUD_Table_Get */
+#ifndef OVERRIDE_SPEEX_TABLE
+static inline void *speex_table_get(PST_AUD_MEM_ARENA arena, AUD_TABLE_NEW build, AUD_TABLE_DELETE release, const int *key, int key_len, const void *proto)
+{
+    return AUD_Table_Get(arena, build, release, key, key_len, proto);
+}
+
+/** Drops a table of speex_table_get */
+static inline void speex_table_put(PST_AUD_MEM_ARENA arena, AUD_TABLE_DELETE release, void *table)
+{
+    AUD_Table_Put(arena, release, table);
 }
 #endif
 
@@ -65,6 +65,8 @@
 #include "fftwrap.h"
 #include "filterbank.h"
 #include "math_approx.h"
+#include "pseudofloat.h"
+#include "preprocess_kernels.h"
 #include "os_support.h"
 #include "aud_aec_api.h"
 #include "aud_ns_api.h"
@@ -87,86 +89,6 @@
 #define NULL 0
 #endif
 
-#define SQR(x) ((x) * (x))
-#define SQR16(x) (MULT16_16((x), (x)))
-#define SQR16_Q15(x) (MULT16_16_Q15((x), (x)))
-
-#ifdef FIXED_POINT
-static inline spx_word16_t DIV32_16_Q8(spx_word32_t a, spx_word32_t b)
-{
-    if (SHR32(a, 7) >= b) {
-        return 32767;
-    } else {
-        if (b >= QCONST32(1, 23)) {
-            a = SHR32(a, 8);
-            b = SHR32(b, 8);
-        }
-        if (b >= QCONST32(1, 19)) {
-            a = SHR32(a, 4);
-            b = SHR32(b, 4);
-        }
-        if (b >= QCONST32(1, 15)) {
-            a = SHR32(a, 4);
-            b = SHR32(b, 4);
-        }
-        a = SHL32(a, 8);
-        return PDIV32_16(a, b);
-    }
-}
-static inline spx_word16_t DIV32_16_Q15(spx_word32_t a, spx_word32_t b)
-{
-    if (SHR32(a, 15) >= b) {
-        return 32767;
-    } else {
-        if (b >= QCONST32(1, 23)) {
-            a = SHR32(a, 8);
-            b = SHR32(b, 8);
-        }
-        if (b >= QCONST32(1, 19)) {
-            a = SHR32(a, 4);
-            b = SHR32(b, 4);
-        }
-        if (b >= QCONST32(1, 15)) {
-            a = SHR32(a, 4);
-            b = SHR32(b, 4);
-        }
-        a = SHL32(a, 15) - a;
-        return DIV32_16(a, b);
-    }
-}
-#define SNR_SCALING 256.f
-#define SNR_SCALING_1 0.0039062f
-#define SNR_SHIFT 8
-
-#define FRAC_SCALING 32767.f
-#define FRAC_SCALING_1 3.0518e-05
-#define FRAC_SHIFT 1
-
-#define EXPIN_SCALING 2048.f
-#define EXPIN_SCALING_1 0.00048828f
-#define EXPIN_SHIFT 11
-#define EXPOUT_SCALING_1 1.5259e-05
-
-#define NOISE_SHIFT 7
-
-#else
-
-#define DIV32_16_Q8(a, b) ((a) / (b))
-#define DIV32_16_Q15(a, b) ((a) / (b))
-#define SNR_SCALING 1.f
-#define SNR_SCALING_1 1.f
-#define SNR_SHIFT 0
-#define FRAC_SCALING 1.f
-#define FRAC_SCALING_1 1.f
-#define FRAC_SHIFT 0
-#define NOISE_SHIFT 0
-
-#define EXPIN_SCALING 1.f
-#define EXPIN_SCALING_1 1.f
-#define EXPOUT_SCALING_1 1.f
-
-#endif
-
 /** Speex echo cancellation state. */
 struct SpeexEchoState_ {
     int frame_size; /**< Number of samples processed each time */
@@ -187,7 +109,8 @@ struct SpeexEchoState_ {
 
     spx_word16_t *e;     /* scratch */
     spx_word16_t *x;     /* Far-end input buffer (2N) */
-    spx_word16_t *X;     /* Far-end buffer (M+1 frames) in frequency domain */
+    spx_word16_t *X;     /* Far-end buffer (M+1 frames) in frequency domain, ring of K*N slots */
+    int X_head;          /* Slot of the newest far-end frame in X */
     spx_word16_t *input; /* scratch */
     spx_word16_t *y;     /* scratch */
     spx_word16_t *last_y;
@@ -224,9 +147,22 @@ struct SpeexEchoState_ {
     spx_mem_t *notch_mem;
 
     /* NOTE: If you only use speex_echo_cancel() and want to save some memory, remove this */
-    spx_int16_t *play_buf;
-    int play_buf_pos;
-    int play_buf_started;
+    struct MdfPlayRing_ *play; /* Far end queued by speex_echo_playback for speex_echo_capture */
+
+    PST_AUD_MEM_ARENA arena;           /* Memory arena the state lives in */
+    const struct MdfKernels_ *kernels; /* Spectral kernels picked for this CPU */
+
+    struct _ST_AUD_POOL *pool;        /* Runs the per-microphone work when set and C > 1 */
+    void **chan_fft;                  /* FFT table of every microphone, the transforms keep their work area in there */
+    struct MdfChanStats_ *chan_stats; /* scratch, per-microphone sums of a frame */
+    spx_int16_t *last_in;             /* scratch, start of the microphone frame as read, for last_y */
+    spx_word16_t *residual_gain;      /* Per bin, undoes the pre-emphasis of Y and matches the energy of the windowed last_y */
+    int far_end_silence;              /* Mean far-end power per sample below which a frame is silent (SPEEX_ECHO_SET_FAR_END_SILENCE) */
+    int far_end_silent;               /* Silent far-end frames in a row, the filters are bypassed once they cover the tail */
+    int sparse;                       /* Partitions holding little echo adapt at a reduced rate (SPEEX_ECHO_SET_SPARSE_UPDATE) */
+    spx_word32_t *part_energy;        /* Weight energy of every partition, as mdf_adjust_prop sums it */
+    int *part_stale;                  /* Partitions whose weights changed since their part_energy was summed */
+    int *part_update;                 /* Partitions the gradient goes into this frame */
 };
 
 /** Speex pre-processor state. */
@@ -254,33 +190,35 @@ struct SpeexPreprocessState_ {
     spx_word16_t speech_prob; /**< Probability last frame was speech */
 
     /* DSP-related arrays */
-    spx_word16_t *frame;           /**< Processing frame (2*ps_size) */
-    spx_word16_t *ft;              /**< Processing frame in freq domain (2*ps_size) */
+    spx_word16_t *frame;           /**< Processing frame (2*ps_size), scratch */
+    spx_word16_t *ft;              /**< Processing frame in freq domain (2*ps_size), scratch */
     spx_word32_t *ps;              /**< Current power spectrum */
-    spx_word16_t *gain2;           /**< Adjusted gains */
-    spx_word16_t *gain_floor;      /**< Minimum gain allowed */
+    spx_word16_t *gain2;           /**< Adjusted gains, scratch */
+    spx_word16_t *gain_floor;      /**< Minimum gain allowed, scratch */
     spx_word16_t *window;          /**< Analysis/Synthesis window */
     spx_word32_t *noise;           /**< Noise estimate */
     spx_word32_t *reverb_estimate; /**< Estimate of reverb energy */
     spx_word32_t *old_ps;          /**< Power spectrum for last frame */
-    spx_word16_t *gain;            /**< Ephraim Malah gain */
-    spx_word16_t *prior;           /**< A-priori SNR */
-    spx_word16_t *post;            /**< A-posteriori SNR */
+    spx_word16_t *gain;            /**< Ephraim Malah gain, scratch */
+    spx_word16_t *prior;           /**< A-priori SNR, scratch */
+    spx_word16_t *post;            /**< A-posteriori SNR, scratch */
 
     spx_word32_t *S;    /**< Smoothed power spectrum */
     spx_word32_t *Smin; /**< See Cohen paper */
     spx_word32_t *Stmp; /**< See Cohen paper */
-    int *update_prob;   /**< Probability of speech presence for noise update */
+    int *update_prob;   /**< Probability of speech presence for noise update, scratch */
 
     spx_word16_t *zeta; /**< Smoothed a priori SNR */
     spx_word32_t *echo_noise;
-    spx_word32_t *residual_echo;
+    spx_word32_t *residual_echo; /* scratch */
 
     /* Misc */
     spx_word16_t *inbuf;  /**< Input buffer (overlapped analysis) */
     spx_word16_t *outbuf; /**< Output buffer (for overlap and add) */
 
-    /* AGC stuff, only for floating point for now */
+    PST_AUD_MEM_ARENA arena; /**< Memory arena the state lives in */
+
+    /* AGC stuff, the fixed-point version keeps the gains and levels as log2 (Q11) */
 #ifndef FIXED_POINT
     int agc_enabled;
     float agc_level;
@@ -293,14 +231,30 @@ struct SpeexPreprocessState_ {
     float max_decrease_step; /**< Maximum decrease in gain from one frame to another */
     float prev_loudness;     /**< Loudness of previous frame */
     float init_max;          /**< Current gain limit during initialisation */
+#else
+    int agc_enabled;
+    spx_int32_t agc_level;
+    spx_word16_t loudness_accum;      /**< Q15 */
+    spx_word16_t *loudness_weight;    /**< Perceptual loudness curve, Q14 */
+    spx_float_t loudness;             /**< Loudness estimate */
+    spx_word32_t agc_gain;            /**< Current AGC gain (log2, Q11) */
+    spx_word32_t max_gain;            /**< Maximum gain allowed (log2, Q11) */
+    spx_word32_t max_increase_step;   /**< Maximum increase in gain from one frame to another (log2, Q11) */
+    spx_word32_t max_decrease_step;   /**< Maximum decrease in gain from one frame to another (log2, Q11) */
+    spx_word32_t prev_loudness;       /**< Loudness of previous frame (log2, Q11) */
+    spx_word32_t init_max;            /**< Current gain limit during initialisation (log2, Q11) */
 #endif
     int nb_adapt; /**< Number of frames used for adaptation so far */
     int was_speech;
     int min_count;    /**< Number of frames processed so far */
     void *fft_lookup; /**< Lookup table for the FFT */
+    const PreprocessKernels *kernels; /**< Per-bin loops picked for this CPU */
 #ifdef FIXED_POINT
     int frame_shift;
+    int agc_shift; /**< Whole octaves of the AGC gain, applied by the synthesis instead of in ft */
 #endif
+    int echo_fused;  /**< Residual echo taken from the echo canceller's own echo spectrum (SPEEX_PREPROCESS_SET_ECHO_FUSED) */
+    int linear_gain; /**< Gains at linear frequency resolution, Bark band resolution only when 0 (SPEEX_PREPROCESS_SET_LINEAR_GAIN) */
 };
 
 static void conj_window(spx_word16_t *w, int len)
@@ -333,36 +287,6 @@ static void conj_window(spx_word16_t *w, int len)
 }
 
 #ifdef FIXED_POINT
-/* This function approximates the gain function
-   y = gamma(1.25)^2 * M(-.25;1;-x) / sqrt(x)
-   which multiplied by xi/(1+xi) is the optimal gain
-   in the loudness domain ( sqrt[amplitude] )
-   Input in Q11 format, output in Q15
-*/
-static inline spx_word32_t hypergeom_gain(spx_word32_t xx)
-{
-    int ind;
-    spx_word16_t frac;
-    /* Q13 table */
-    static const spx_word16_t table[21] = {
-        6730, 8357, 9868, 11267, 12563, 13770, 14898,
-        15959, 16961, 17911, 18816, 19682, 20512, 21311,
-        22082, 22827, 23549, 24250, 24931, 25594, 26241};
-    ind = SHR32(xx, 10);
-    if (ind < 0)
-        return Q15_ONE;
-    if (ind > 19)
-        return ADD32(EXTEND32(Q15_ONE), EXTEND32(DIV32_16(QCONST32(.1296, 23), SHR32(xx, EXPIN_SHIFT - SNR_SHIFT))));
-    frac = SHL32(xx - SHL32(ind, 10), 5);
-    return SHL32(DIV32_16(PSHR32(MULT16_16(Q15_ONE - frac, table[ind]) + MULT16_16(frac, table[ind + 1]), 7), (spx_sqrt(SHL32(xx, 15) + 6711))), 7);
-}
-
-static inline spx_word16_t qcurve(spx_word16_t x)
-{
-    x = MAX16(x, 1);
-    return DIV32_16(SHL32(EXTEND32(32767), 9), ADD16(512, MULT16_16_Q15(QCONST16(.60f, 15), DIV32_16(32767, x))));
-}
-
 /* Compute the gain floor based on different floors for the background noise and residual echo */
 static void compute_gain_floor(int noise_suppress, int effective_echo_suppress, spx_word32_t *noise, spx_word32_t *echo, spx_word16_t *gain_floor, int len)
 {
@@ -393,37 +317,29 @@ static void compute_gain_floor(int noise_suppress, int effective_echo_suppress,
     }
 }
 
-#else
-/* This function approximates the gain function
-   y = gamma(1.25)^2 * M(-.25;1;-x) / sqrt(x)
-   which multiplied by xi/(1+xi) is the optimal gain
-   in the loudness domain ( sqrt[amplitude] )
-*/
-static inline spx_word32_t hypergeom_gain(spx_word32_t xx)
+#ifdef _compute_gain_floor_NS_OPT
+/* compute_gain_floor() without a residual echo estimate (echo[] all zero), the echo terms and,
+   when noise dominates, the second exponential drop out */
+static void compute_gain_floor_ns(int noise_suppress, int effective_echo_suppress, spx_word32_t *noise, spx_word16_t *gain_floor, int len)
 {
-    int ind;
-    float integer, frac;
-    float x;
-    static const float table[21] = {
-        0.82157f, 1.02017f, 1.20461f, 1.37534f, 1.53363f, 1.68092f, 1.81865f,
-        1.94811f, 2.07038f, 2.18638f, 2.29688f, 2.40255f, 2.50391f, 2.60144f,
-        2.69551f, 2.78647f, 2.87458f, 2.96015f, 3.04333f, 3.12431f, 3.20326f};
-    x = EXPIN_SCALING_1 * xx;
-    integer = floor(2 * x);
-    ind = (int)integer;
-    if (ind < 0)
-        return FRAC_SCALING;
-    if (ind > 19)
-        return FRAC_SCALING * (1 + .1296 / x);
-    frac = 2 * x - integer;
-    return FRAC_SCALING * ((1 - frac) * table[ind] + frac * table[ind + 1]) / sqrt(x + .0001f);
-}
+    int i;
+    spx_word16_t gain;
 
-static inline spx_word16_t qcurve(spx_word16_t x)
-{
-    return 1.f / (1.f + .15f / (SNR_SCALING_1 * x));
+    if (noise_suppress > effective_echo_suppress) {
+        gain = EXTRACT16(MIN32(Q15_ONE, SHR32(spx_exp(MULT16_16(QCONST16(0.11513, 11), noise_suppress)), 1)));
+        for (i = 0; i < len; i++)
+            gain_floor[i] = MULT16_16_Q15(gain, spx_sqrt(SHL32(EXTEND32(DIV32_16_Q15(PSHR32(noise[i], NOISE_SHIFT), (1 + PSHR32(noise[i], NOISE_SHIFT)))), 15)));
+    } else {
+        spx_word16_t gain_ratio;
+        gain       = EXTRACT16(MIN32(Q15_ONE, SHR32(spx_exp(MULT16_16(QCONST16(0.11513, 11), effective_echo_suppress)), 1)));
+        gain_ratio = EXTRACT16(MIN32(Q15_ONE, SHR32(spx_exp(MULT16_16(QCONST16(.2302585f, 11), noise_suppress - effective_echo_suppress)), 1)));
+        for (i = 0; i < len; i++)
+            gain_floor[i] = MULT16_16_Q15(gain, spx_sqrt(SHL32(EXTEND32(DIV32_16_Q15(MULT16_32_Q15(gain_ratio, PSHR32(noise[i], NOISE_SHIFT)), (1 + PSHR32(noise[i], NOISE_SHIFT)))), 15)));
+    }
 }
+#endif
 
+#else
 static void compute_gain_floor(int noise_suppress, int effective_echo_suppress, spx_word32_t *noise, spx_word32_t *echo, spx_word16_t *gain_floor, int len)
 {
     int i;
@@ -438,13 +354,161 @@ static void compute_gain_floor(int noise_suppress, int effective_echo_suppress,
         gain_floor[i] = FRAC_SCALING * sqrt(noise_floor * PSHR32(noise[i], NOISE_SHIFT) + echo_floor * echo[i]) / sqrt(1 + PSHR32(noise[i], NOISE_SHIFT) + echo[i]);
 }
 
+#ifdef _compute_gain_floor_NS_OPT
+/* compute_gain_floor() without a residual echo estimate (echo[] all zero): the echo terms add exact zeros, so
+   dropping them and the echo floor's exp() changes nothing. The two square roots have to stay, the root of the
+   quotient rounds differently. */
+static void compute_gain_floor_ns(int noise_suppress, int effective_echo_suppress, spx_word32_t *noise, spx_word16_t *gain_floor, int len)
+{
+    int i;
+    float noise_floor;
+
+    (void)effective_echo_suppress;
+    noise_floor = exp(.2302585f * noise_suppress);
+    for (i = 0; i < len; i++)
+        gain_floor[i] = FRAC_SCALING * sqrt(noise_floor * PSHR32(noise[i], NOISE_SHIFT)) / sqrt(1 + PSHR32(noise[i], NOISE_SHIFT));
+}
+#endif
+
 #endif
-EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sampling_rate)
+/** Analysis/synthesis window of 2*ps_size points, key frame_size and ps_size */
+static void *preprocess_window_new(PST_AUD_MEM_ARENA arena, const int *key, const void *proto)
+{
+    const int frame_size = key[0], N = key[1], N3 = 2 * N - frame_size, N4 = frame_size - N3;
+    spx_word16_t *window = (spx_word16_t *)speex_alloc(arena, 2 * N * sizeof(spx_word16_t));
+    int i;
+
+    if (!window)
+        return NULL;
+    if (proto) {
+        SPEEX_COPY(window, (const spx_word16_t *)proto, 2 * N);
+        return window;
+    }
+    conj_window(window, 2 * N3);
+    for (i = 2 * N3; i < 2 * N; i++)
+        window[i] = Q15_ONE;
+
+    if (N4 > 0) {
+        for (i = N3 - 1; i >= 0; i--) {
+            window[i + N3 + N4] = window[i + N3];
+            window[i + N3]      = 1;
+        }
+    }
+    return window;
+}
+
+#ifdef FIXED_POINT
+/** Perceptual loudness curve of the AGC over ps_size bins (Q14), key ps_size and sampling rate. Integer only, so the
+    AGC gives the same output on every platform. */
+static void *preprocess_loudness_new(PST_AUD_MEM_ARENA arena, const int *key, const void *proto)
 {
+    const int N = key[0], sampling_rate = key[1];
+    spx_word16_t *loudness_weight = (spx_word16_t *)speex_alloc(arena, N * sizeof(spx_word16_t));
     int i;
-    int N, N3, N4, M;
 
-    SpeexPreprocessState *st = (SpeexPreprocessState *)speex_alloc(sizeof(SpeexPreprocessState));
+    if (!loudness_weight)
+        return NULL;
+    if (proto) {
+        SPEEX_COPY(loudness_weight, (const spx_word16_t *)proto, N);
+        return loudness_weight;
+    }
+    for (i = 0; i < N; i++) {
+        spx_int32_t ff = i * sampling_rate / (2 * N);
+        /* -.5*(ff-3800)^2/9e5 in Q11, spx_exp is 0 below -21290 */
+        spx_word32_t arg = MAX32(-21291, -(ff - 3800) * (ff - 3800) / 879);
+        spx_word32_t w   = QCONST16(.35f, 14) - ff * QCONST16(.35f, 14) / 16000 + SHR32(MULT16_32_Q15(QCONST16(.73f, 15), spx_exp(arg)), 2);
+        w                  = MAX32(w, QCONST16(.01f, 14));
+        loudness_weight[i] = EXTRACT16(SHR32(MULT16_16(w, w), 14));
+    }
+    return loudness_weight;
+}
+
+/** log2 of x > 0, Q11 */
+static inline spx_word32_t agc_log2(spx_word32_t x)
+{
+    int e          = spx_ilog2(x);
+    spx_word16_t f = EXTRACT16(SUB32(VSHR32(x, e - 14), 16384)); /* Mantissa minus one, Q14 */
+    spx_word16_t r;
+
+    /* log2(1 + f) to 1.5e-4, least squares with r(1) = 1 */
+    r = MULT16_16_Q14(f, ADD16(23561, MULT16_16_Q14(f, ADD16(-11055, MULT16_16_Q14(f, ADD16(5194, MULT16_16_Q14(f, -1316)))))));
+    return ADD32(SHL32(EXTEND32(e), 11), PSHR32(EXTEND32(r), 3));
+}
+
+/** log2 of a positive pseudo-float, Q11 */
+static inline spx_word32_t agc_log2_float(spx_float_t x)
+{
+    return ADD32(agc_log2(x.m), SHL32(EXTEND32(x.e), 11));
+}
+
+/** 2^x for x in Q11, as a pseudo-float (same polynomial as spx_exp2) */
+static inline spx_float_t agc_exp2(spx_word32_t x)
+{
+    spx_float_t r;
+    spx_word32_t integer = SHR32(x, 11);
+    spx_word16_t frac    = SHL16(EXTRACT16(SUB32(x, SHL32(integer, 11))), 3);
+
+    r.m = ADD16(D0, MULT16_16_Q14(frac, ADD16(D1, MULT16_16_Q14(frac, ADD16(D2, MULT16_16_Q14(D3, frac))))));
+    r.e = integer - 14;
+    return r;
+}
+
+/** Gain in dB to log2, Q11 */
+static spx_word32_t agc_db_to_log2(spx_int32_t db)
+{
+    db = MIN32(1000, MAX32(-1000, db));
+    return PSHR32(MULT16_16(db, 21771), 6); /* 2048 * log2(10) / 20 in Q6 */
+}
+
+/** Gain in log2, Q11, to dB */
+static spx_int32_t agc_log2_to_db(spx_word32_t x)
+{
+    return PSHR32(MULT16_32_Q15(QCONST16(.7525749f, 15), x), 8);
+}
+
+/** Slew rate in dB per second to the log2 (Q11) step of one frame */
+static spx_word32_t agc_db_to_step(SpeexPreprocessState *st, spx_int32_t db)
+{
+    return agc_db_to_log2(db) * st->frame_size / st->sampling_rate;
+}
+#else
+/** Perceptual loudness curve of the AGC over ps_size bins, key ps_size and sampling rate */
+static void *preprocess_loudness_new(PST_AUD_MEM_ARENA arena, const int *key, const void *proto)
+{
+    const int N = key[0], sampling_rate = key[1];
+    float *loudness_weight = (float *)speex_alloc(arena, N * sizeof(float));
+    int i;
+
+    if (!loudness_weight)
+        return NULL;
+    if (proto) {
+        SPEEX_COPY(loudness_weight, (const float *)proto, N);
+        return loudness_weight;
+    }
+    for (i = 0; i < N; i++) {
+        float ff = ((float)i) * .5 * sampling_rate / ((float)N);
+        /*loudness_weight[i] = .5f*(1.f/(1.f+ff/8000.f))+1.f*exp(-.5f*(ff-3800.f)*(ff-3800.f)/9e5f);*/
+        loudness_weight[i] = .35f - .35f * ff / 16000.f + .73f * exp(-.5f * (ff - 3800) * (ff - 3800) / 9e5f);
+        if (loudness_weight[i] < .01f)
+            loudness_weight[i] = .01f;
+        loudness_weight[i] *= loudness_weight[i];
+    }
+    return loudness_weight;
+}
+#endif
+
+/** With proto the filter bank, window, loudness curve and transform tables are copied from it instead of computed.
+    Those tables are read-only and shared with other states when the arena asks for it (see speex_table_get). */
+static SpeexPreprocessState *preprocess_state_new(int frame_size, int sampling_rate, PST_AUD_MEM_ARENA arena, const SpeexPreprocessState *proto)
+{
+    int i;
+    int N, N3, M;
+    int key[2];
+
+    SpeexPreprocessState *st = (SpeexPreprocessState *)speex_alloc(arena, sizeof(SpeexPreprocessState));
+    if (!st)
+        return NULL;
+    st->arena = arena;
     st->frame_size           = frame_size;
 
     /* Round ps_size down to the nearest power of two */
@@ -471,7 +535,6 @@ EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sam
 
     N  = st->ps_size;
     N3 = 2 * N - st->frame_size;
-    N4 = st->frame_size - N3;
 
     st->sampling_rate        = sampling_rate;
     st->denoise_enabled      = 1;
@@ -486,47 +549,41 @@ EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sam
     st->speech_prob_start    = SPEECH_PROB_START_DEFAULT;
     st->speech_prob_continue = SPEECH_PROB_CONTINUE_DEFAULT;
 
-    st->echo_state = NULL;
+    st->echo_state  = NULL;
+    st->echo_fused  = 0;
+    st->linear_gain = 1;
 
     st->nbands = NB_BANDS;
     M          = st->nbands;
-    st->bank   = filterbank_new(M, sampling_rate, N, 1);
-
-    st->frame  = (spx_word16_t *)speex_alloc(2 * N * sizeof(spx_word16_t));
-    st->window = (spx_word16_t *)speex_alloc(2 * N * sizeof(spx_word16_t));
-    st->ft     = (spx_word16_t *)speex_alloc(2 * N * sizeof(spx_word16_t));
-
-    st->ps              = (spx_word32_t *)speex_alloc((N + M) * sizeof(spx_word32_t));
-    st->noise           = (spx_word32_t *)speex_alloc((N + M) * sizeof(spx_word32_t));
-    st->echo_noise      = (spx_word32_t *)speex_alloc((N + M) * sizeof(spx_word32_t));
-    st->residual_echo   = (spx_word32_t *)speex_alloc((N + M) * sizeof(spx_word32_t));
-    st->reverb_estimate = (spx_word32_t *)speex_alloc((N + M) * sizeof(spx_word32_t));
-    st->old_ps          = (spx_word32_t *)speex_alloc((N + M) * sizeof(spx_word32_t));
-    st->prior           = (spx_word16_t *)speex_alloc((N + M) * sizeof(spx_word16_t));
-    st->post            = (spx_word16_t *)speex_alloc((N + M) * sizeof(spx_word16_t));
-    st->gain            = (spx_word16_t *)speex_alloc((N + M) * sizeof(spx_word16_t));
-    st->gain2           = (spx_word16_t *)speex_alloc((N + M) * sizeof(spx_word16_t));
-    st->gain_floor      = (spx_word16_t *)speex_alloc((N + M) * sizeof(spx_word16_t));
-    st->zeta            = (spx_word16_t *)speex_alloc((N + M) * sizeof(spx_word16_t));
-
-    st->S           = (spx_word32_t *)speex_alloc(N * sizeof(spx_word32_t));
-    st->Smin        = (spx_word32_t *)speex_alloc(N * sizeof(spx_word32_t));
-    st->Stmp        = (spx_word32_t *)speex_alloc(N * sizeof(spx_word32_t));
-    st->update_prob = (int *)speex_alloc(N * sizeof(int));
-
-    st->inbuf  = (spx_word16_t *)speex_alloc(N3 * sizeof(spx_word16_t));
-    st->outbuf = (spx_word16_t *)speex_alloc(N3 * sizeof(spx_word16_t));
-
-    conj_window(st->window, 2 * N3);
-    for (i = 2 * N3; i < 2 * st->ps_size; i++)
-        st->window[i] = Q15_ONE;
+    st->bank   = filterbank_get(M, sampling_rate, N, 1, proto ? proto->bank : NULL, st->arena);
+
+    key[0]     = st->frame_size;
+    key[1]     = N;
+    st->frame  = (spx_word16_t *)speex_alloc_scratch(st->arena, 2 * N * sizeof(spx_word16_t));
+    st->window = (spx_word16_t *)speex_table_get(st->arena, preprocess_window_new, speex_free, key, 2, proto ? proto->window : NULL);
+    st->ft     = (spx_word16_t *)speex_alloc_scratch(st->arena, 2 * N * sizeof(spx_word16_t));
+
+    st->ps              = (spx_word32_t *)speex_alloc(st->arena, (N + M) * sizeof(spx_word32_t));
+    st->noise           = (spx_word32_t *)speex_alloc(st->arena, (N + M) * sizeof(spx_word32_t));
+    st->echo_noise      = (spx_word32_t *)speex_alloc(st->arena, (N + M) * sizeof(spx_word32_t));
+    st->residual_echo   = (spx_word32_t *)speex_alloc_scratch(st->arena, (N + M) * sizeof(spx_word32_t));
+    st->reverb_estimate = (spx_word32_t *)speex_alloc(st->arena, (N + M) * sizeof(spx_word32_t));
+    st->old_ps          = (spx_word32_t *)speex_alloc(st->arena, (N + M) * sizeof(spx_word32_t));
+    st->prior           = (spx_word16_t *)speex_alloc_scratch(st->arena, (N + M) * sizeof(spx_word16_t));
+    st->post            = (spx_word16_t *)speex_alloc_scratch(st->arena, (N + M) * sizeof(spx_word16_t));
+    st->gain            = (spx_word16_t *)speex_alloc_scratch(st->arena, (N + M) * sizeof(spx_word16_t));
+    st->gain2           = (spx_word16_t *)speex_alloc_scratch(st->arena, (N + M) * sizeof(spx_word16_t));
+    st->gain_floor      = (spx_word16_t *)speex_alloc_scratch(st->arena, (N + M) * sizeof(spx_word16_t));
+    st->zeta            = (spx_word16_t *)speex_alloc(st->arena, (N + M) * sizeof(spx_word16_t));
+
+    st->S           = (spx_word32_t *)speex_alloc(st->arena, N * sizeof(spx_word32_t));
+    st->Smin        = (spx_word32_t *)speex_alloc(st->arena, N * sizeof(spx_word32_t));
+    st->Stmp        = (spx_word32_t *)speex_alloc(st->arena, N * sizeof(spx_word32_t));
+    st->update_prob = (int *)speex_alloc_scratch(st->arena, N * sizeof(int));
+
+    st->inbuf  = (spx_word16_t *)speex_alloc(st->arena, N3 * sizeof(spx_word16_t));
+    st->outbuf = (spx_word16_t *)speex_alloc(st->arena, N3 * sizeof(spx_word16_t));
 
-    if (N4 > 0) {
-        for (i = N3 - 1; i >= 0; i--) {
-            st->window[i + N3 + N4] = st->window[i + N3];
-            st->window[i + N3]      = 1;
-        }
-    }
     for (i = 0; i < N + M; i++) {
         st->noise[i]           = QCONST32(1.f, NOISE_SHIFT);
         st->reverb_estimate[i] = 0;
@@ -545,15 +602,9 @@ EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sam
 #ifndef FIXED_POINT
     st->agc_enabled     = 0;
     st->agc_level       = 8000;
-    st->loudness_weight = (float *)speex_alloc(N * sizeof(float));
-    for (i = 0; i < N; i++) {
-        float ff = ((float)i) * .5 * sampling_rate / ((float)N);
-        /*st->loudness_weight[i] = .5f*(1.f/(1.f+ff/8000.f))+1.f*exp(-.5f*(ff-3800.f)*(ff-3800.f)/9e5f);*/
-        st->loudness_weight[i] = .35f - .35f * ff / 16000.f + .73f * exp(-.5f * (ff - 3800) * (ff - 3800) / 9e5f);
-        if (st->loudness_weight[i] < .01f)
-            st->loudness_weight[i] = .01f;
-        st->loudness_weight[i] *= st->loudness_weight[i];
-    }
+    key[0]              = N;
+    key[1]              = sampling_rate;
+    st->loudness_weight = (float *)speex_table_get(st->arena, preprocess_loudness_new, speex_free, key, 2, proto ? proto->loudness_weight : NULL);
     /*st->loudness = pow(AMP_SCALE*st->agc_level,LOUDNESS_EXP);*/
     st->loudness          = 1e-15;
     st->agc_gain          = 1;
@@ -562,52 +613,283 @@ EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sam
     st->max_decrease_step = exp(-0.11513f * 40. * st->frame_size / st->sampling_rate);
     st->prev_loudness     = 1;
     st->init_max          = 1;
+#else
+    st->agc_enabled       = 0;
+    st->agc_level         = 8000;
+    key[0]                = N;
+    key[1]                = sampling_rate;
+    st->loudness_weight   = (spx_word16_t *)speex_table_get(st->arena, preprocess_loudness_new, speex_free, key, 2, proto ? proto->loudness_weight : NULL);
+    st->loudness          = agc_exp2(QCONST32(-49.82892f, 11)); /* 1e-15 */
+    st->loudness_accum    = 0;
+    st->agc_gain          = 0;
+    st->max_gain          = QCONST32(4.906891f, 11); /* 30 */
+    st->max_increase_step = agc_db_to_step(st, 12);
+    st->max_decrease_step = agc_db_to_step(st, -40);
+    st->prev_loudness     = 0;
+    st->init_max          = 0;
+    st->agc_shift         = 0;
 #endif
     st->was_speech = 0;
 
-    st->fft_lookup = spx_fft_init(2 * N);
+    st->fft_lookup = proto ? spx_fft_clone(proto->fft_lookup, st->arena) : spx_fft_init(2 * N, st->arena);
+    st->kernels    = proto ? proto->kernels : preprocess_kernels_select(PREPROCESS_KERNEL_LEVEL_MAX);
 
     st->nb_adapt  = 0;
     st->min_count = 0;
     return st;
 }
 
+EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sampling_rate, PST_AUD_MEM_ARENA arena)
+{
+    return preprocess_state_new(frame_size, sampling_rate, arena, NULL);
+}
+
+EXPORT SpeexPreprocessState *speex_preprocess_state_clone(const SpeexPreprocessState *proto, PST_AUD_MEM_ARENA arena)
+{
+    SpeexPreprocessState *st = preprocess_state_new(proto->frame_size, proto->sampling_rate, arena, proto);
+
+    if (!st)
+        return NULL;
+    /* The settings of proto, as speex_preprocess_ctl left them */
+    st->denoise_enabled      = proto->denoise_enabled;
+    st->vad_enabled          = proto->vad_enabled;
+    st->dereverb_enabled     = proto->dereverb_enabled;
+    st->reverb_decay         = proto->reverb_decay;
+    st->reverb_level         = proto->reverb_level;
+    st->noise_suppress       = proto->noise_suppress;
+    st->echo_suppress        = proto->echo_suppress;
+    st->echo_suppress_active = proto->echo_suppress_active;
+    st->speech_prob_start    = proto->speech_prob_start;
+    st->speech_prob_continue = proto->speech_prob_continue;
+    st->echo_fused           = proto->echo_fused;
+    st->linear_gain          = proto->linear_gain;
+    st->agc_enabled          = proto->agc_enabled;
+    st->agc_level            = proto->agc_level;
+    st->max_gain             = proto->max_gain;
+    st->max_increase_step    = proto->max_increase_step;
+    st->max_decrease_step    = proto->max_decrease_step;
+    return st;
+}
+
 EXPORT void speex_preprocess_state_destroy(SpeexPreprocessState *st)
 {
-    speex_free(st->frame);
-    speex_free(st->ft);
-    speex_free(st->ps);
-    speex_free(st->gain2);
-    speex_free(st->gain_floor);
-    speex_free(st->window);
-    speex_free(st->noise);
-    speex_free(st->reverb_estimate);
-    speex_free(st->old_ps);
-    speex_free(st->gain);
-    speex_free(st->prior);
-    speex_free(st->post);
-#ifndef FIXED_POINT
-    speex_free(st->loudness_weight);
+    speex_free_scratch(st->arena, st->frame);
+    speex_free_scratch(st->arena, st->ft);
+    speex_free(st->arena, st->ps);
+    speex_free_scratch(st->arena, st->gain2);
+    speex_free_scratch(st->arena, st->gain_floor);
+    speex_table_put(st->arena, speex_free, st->window);
+    speex_free(st->arena, st->noise);
+    speex_free(st->arena, st->reverb_estimate);
+    speex_free(st->arena, st->old_ps);
+    speex_free_scratch(st->arena, st->gain);
+    speex_free_scratch(st->arena, st->prior);
+    speex_free_scratch(st->arena, st->post);
+    speex_table_put(st->arena, speex_free, st->loudness_weight);
+    speex_free(st->arena, st->echo_noise);
+    speex_free_scratch(st->arena, st->residual_echo);
+
+    speex_free(st->arena, st->S);
+    speex_free(st->arena, st->Smin);
+    speex_free(st->arena, st->Stmp);
+    speex_free_scratch(st->arena, st->update_prob);
+    speex_free(st->arena, st->zeta);
+
+    speex_free(st->arena, st->inbuf);
+    speex_free(st->arena, st->outbuf);
+
+    spx_fft_destroy(st->fft_lookup, st->arena);
+    filterbank_put(st->bank, st->arena);
+    speex_free(st->arena, st);
+}
+
+/* Layout check of the snapshots of speex_preprocess_state_save */
+#define PREPROCESS_SNAPSHOT_MAGIC 0x53535050 /* "PPSS" */
+#define PREPROCESS_SNAPSHOT_VERSION 2
+
+/** Start of a snapshot, the raw arrays of preprocess_snapshot_fields follow */
+typedef struct PreprocessSnapshot_ {
+    spx_uint32_t magic;
+    spx_int32_t version;
+    spx_int32_t size; /* Bytes of the whole snapshot */
+    spx_int32_t fixed_point;
+    spx_int32_t ps_size;
+    spx_int32_t sampling_rate;
+    spx_int32_t nbands;
+} PreprocessSnapshot;
+
+static inline int preprocess_snapshot_copy(char *buf, int pos, void *field, int bytes, int dir)
+{
+    if (dir > 0)
+        memcpy(buf + pos, field, bytes);
+    else if (dir < 0)
+        memcpy(field, buf + pos, bytes);
+    return pos + bytes;
+}
+
+/** Walks the noise, residual echo and reverberation estimates, the minimum tracking of the noise update, the
+    speech state and the AGC loudness and gain: to buf for dir > 0, from it for dir < 0, only
+    counted for dir = 0. Returns the offset of the end of the last field. */
+static int preprocess_snapshot_fields(SpeexPreprocessState *st, char *buf, int dir)
+{
+    const int N = st->ps_size, M = st->nbands;
+    int pos = sizeof(PreprocessSnapshot);
+
+    pos = preprocess_snapshot_copy(buf, pos, st->noise, (N + M) * sizeof(spx_word32_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, st->echo_noise, (N + M) * sizeof(spx_word32_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, st->reverb_estimate, (N + M) * sizeof(spx_word32_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, st->old_ps, (N + M) * sizeof(spx_word32_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, st->zeta, (N + M) * sizeof(spx_word16_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, st->S, N * sizeof(spx_word32_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, st->Smin, N * sizeof(spx_word32_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, st->Stmp, N * sizeof(spx_word32_t), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->speech_prob, sizeof(st->speech_prob), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->nb_adapt, sizeof(st->nb_adapt), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->min_count, sizeof(st->min_count), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->was_speech, sizeof(st->was_speech), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->loudness, sizeof(st->loudness), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->loudness_accum, sizeof(st->loudness_accum), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->agc_gain, sizeof(st->agc_gain), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->prev_loudness, sizeof(st->prev_loudness), dir);
+    pos = preprocess_snapshot_copy(buf, pos, &st->init_max, sizeof(st->init_max), dir);
+    return pos;
+}
+
+static void preprocess_snapshot_header(SpeexPreprocessState *st, PreprocessSnapshot *hdr)
+{
+    hdr->magic   = PREPROCESS_SNAPSHOT_MAGIC;
+    hdr->version = PREPROCESS_SNAPSHOT_VERSION;
+    hdr->size    = preprocess_snapshot_fields(st, NULL, 0);
+#ifdef FIXED_POINT
+    hdr->fixed_point = 1;
+#else
+    hdr->fixed_point = 0;
 #endif
-    speex_free(st->echo_noise);
-    speex_free(st->residual_echo);
+    hdr->ps_size       = st->ps_size;
+    hdr->sampling_rate = st->sampling_rate;
+    hdr->nbands        = st->nbands;
+}
+
+EXPORT int speex_preprocess_state_snapshot_size(SpeexPreprocessState *st)
+{
+    return preprocess_snapshot_fields(st, NULL, 0);
+}
+
+EXPORT int speex_preprocess_state_save(SpeexPreprocessState *st, void *buf, int size)
+{
+    PreprocessSnapshot hdr;
+
+    preprocess_snapshot_header(st, &hdr);
+    if (size < hdr.size)
+        return -1;
+    memcpy(buf, &hdr, sizeof(hdr));
+    preprocess_snapshot_fields(st, (char *)buf, 1);
+    return hdr.size;
+}
 
-    speex_free(st->S);
-    speex_free(st->Smin);
-    speex_free(st->Stmp);
-    speex_free(st->update_prob);
-    speex_free(st->zeta);
+EXPORT int speex_preprocess_state_snapshot_check(SpeexPreprocessState *st, const void *buf, int size)
+{
+    PreprocessSnapshot hdr, own;
+
+    if (size < (int)sizeof(PreprocessSnapshot))
+        return -1;
+    memcpy(&hdr, buf, sizeof(hdr));
+    preprocess_snapshot_header(st, &own);
+    if (memcmp(&hdr, &own, sizeof(hdr)) != 0 || size < hdr.size) {
+        speex_warning("Preprocessor snapshot does not match the state");
+        return -1;
+    }
+    return hdr.size;
+}
 
-    speex_free(st->inbuf);
-    speex_free(st->outbuf);
+EXPORT int speex_preprocess_state_load(SpeexPreprocessState *st, const void *buf, int size)
+{
+    int len = speex_preprocess_state_snapshot_check(st, buf, size);
 
-    spx_fft_destroy(st->fft_lookup);
-    filterbank_destroy(st->bank);
-    speex_free(st);
+    if (len < 0)
+        return -1;
+    preprocess_snapshot_fields(st, (char *)buf, -1);
+    return len;
 }
 
-/* FIXME: The AGC doesn't work yet with fixed-point*/
-#ifndef FIXED_POINT
+#ifdef FIXED_POINT
+#define AGC_LOG2_AMP_SCALE QCONST32(-9.965784f, 11)
+#define AGC_LOG2_10 QCONST32(3.321928f, 11)
+
+/** Fixed-point version of the AGC below: the same loudness tracking and gain limits, with the levels and gains as
+    log2 and the loudness estimate as a pseudo-float. The whole octaves of the gain are left to the synthesis. */
+static void speex_compute_agc(SpeexPreprocessState *st, spx_word16_t Pframe, spx_word16_t *ft)
+{
+    int i;
+    int N            = st->ps_size;
+    int sh           = MAX16(0, spx_ilog2(N) + 1 - 2 * st->frame_shift);
+    spx_word32_t sum = 0;
+    spx_word32_t loudness, target_gain;
+    spx_word16_t rate, frac;
+
+    /* Sum of w*ps/2^(sh+1): ps is below 2^(31-2*frame_shift), so this only drops bits for loud frames */
+    for (i = 2; i < N; i++)
+        sum = ADD32(sum, SHR32(MULT16_32_Q15(st->loudness_weight[i], st->ps[i]), sh));
+    /* log2(sqrt(1 + 2N sum w*ps)) */
+    loudness = SHR32(agc_log2_float(FLOAT_ADD(FLOAT_ONE, FLOAT_SHL(FLOAT_MUL32U(sum, N), sh + 2))), 1);
+    if (Pframe > QCONST16(.3f, 15)) {
+        spx_float_t frame_loudness = agc_exp2(SHL32(MULT16_32_Q15(QCONST16(LOUDNESS_EXP / 8, 15), ADD32(loudness, AGC_LOG2_AMP_SCALE)), 3));
+
+        rate               = MULT16_16_Q15(QCONST16(.03f, 15), MULT16_16_Q15(Pframe, Pframe));
+        st->loudness       = FLOAT_ADD(FLOAT_MULT(st->loudness, FLOAT_SHL(PSEUDOFLOAT(SUB16(Q15_ONE, rate)), -15)), FLOAT_MULT(frame_loudness, FLOAT_SHL(PSEUDOFLOAT(rate), -15)));
+        st->loudness_accum = ADD16(MULT16_16_Q15(SUB16(Q15_ONE, rate), st->loudness_accum), rate);
+        if (st->init_max < st->max_gain && st->nb_adapt > 20)
+            st->init_max = ADD32(st->init_max, SUB32(agc_log2(ADD32(QCONST32(1.f, 14), MULT16_16_Q15(QCONST16(.1f, 14), MULT16_16_Q15(Pframe, Pframe)))), QCONST32(14.f, 11)));
+    }
+
+    /* log2 of AMP_SCALE*agc_level*(loudness/(1e-4+loudness_accum))^(-1/LOUDNESS_EXP) */
+    target_gain = SUB32(agc_log2_float(st->loudness), SUB32(agc_log2(ADD32(QCONST32(1e-4f, 15), st->loudness_accum)), QCONST32(15.f, 11)));
+    target_gain = SUB32(ADD32(agc_log2(st->agc_level), AGC_LOG2_AMP_SCALE), MULT16_32_Q15(QCONST16(1.f / LOUDNESS_EXP, 15), target_gain));
+
+    if ((Pframe > QCONST16(.5f, 15) && st->nb_adapt > 20) || target_gain < st->agc_gain) {
+        if (target_gain > ADD32(st->agc_gain, st->max_increase_step))
+            target_gain = ADD32(st->agc_gain, st->max_increase_step);
+        if (target_gain < ADD32(st->agc_gain, st->max_decrease_step) && loudness < ADD32(st->prev_loudness, AGC_LOG2_10))
+            target_gain = ADD32(st->agc_gain, st->max_decrease_step);
+        if (target_gain > st->max_gain)
+            target_gain = st->max_gain;
+        if (target_gain > st->init_max)
+            target_gain = st->init_max;
+
+        /* As far as the synthesis shift goes */
+        st->agc_gain = MIN32(QCONST32(14.f, 11), MAX32(-QCONST32(15.f, 11), target_gain));
+    }
+
+    /* ft takes the gain over its whole octaves, in [.5, 1) */
+    st->agc_shift = SHR32(st->agc_gain, 11) + 1;
+    frac          = EXTRACT16(SHR32(spx_exp2(EXTRACT16(SUB32(st->agc_gain, SHL32(st->agc_shift, 11)))), 1));
+    for (i = 0; i < 2 * N; i++)
+        ft[i] = MULT16_16_P15(frac, ft[i]);
+    st->prev_loudness = loudness;
+}
+
+/** Scales the frame back by frame_shift less the octaves of the AGC gain, with the floating-point limiter at 28000 */
+static void speex_agc_scale(SpeexPreprocessState *st)
+{
+    int i;
+    int N                   = st->ps_size;
+    int shift               = st->frame_shift - st->agc_shift + 15;
+    spx_word16_t max_sample = 0;
+    spx_word32_t peak;
+
+    for (i = 0; i < 2 * N; i++)
+        max_sample = MAX16(max_sample, ABS16(st->frame[i]));
+    peak = VSHR32(EXTEND32(max_sample), shift - 15);
+    if (peak > 28000) {
+        spx_word16_t damp = EXTRACT16(DIV32(QCONST32(28000.f, 15), peak));
+        for (i = 0; i < 2 * N; i++)
+            st->frame[i] = EXTRACT16(PSHR32(MULT16_16(st->frame[i], damp), shift));
+    } else {
+        for (i = 0; i < 2 * N; i++)
+            st->frame[i] = EXTRACT16(PSHR32(SHL32(EXTEND32(st->frame[i]), 15), shift));
+    }
+}
+#else
 static void speex_compute_agc(SpeexPreprocessState *st, spx_word16_t Pframe, spx_word16_t *ft)
 {
     int i;
@@ -654,7 +936,7 @@ static void speex_compute_agc(SpeexPreprocessState *st, spx_word16_t Pframe, spx
 }
 #endif
 
-static void preprocess_analysis(SpeexPreprocessState *st, spx_int16_t *x)
+static void preprocess_analysis(SpeexPreprocessState *st, const spx_int16_t *x, int stride)
 {
     int i;
     int N            = st->ps_size;
@@ -666,11 +948,11 @@ static void preprocess_analysis(SpeexPreprocessState *st, spx_int16_t *x)
     for (i = 0; i < N3; i++)
         st->frame[i] = st->inbuf[i];
     for (i = 0; i < st->frame_size; i++)
-        st->frame[N3 + i] = x[i];
+        st->frame[N3 + i] = x[i * stride];
 
     /* Update inbuf */
     for (i = 0; i < N3; i++)
-        st->inbuf[i] = x[N4 + i];
+        st->inbuf[i] = x[(N4 + i) * stride];
 
     /* Windowing */
     for (i = 0; i < 2 * N; i++)
@@ -697,7 +979,7 @@ static void preprocess_analysis(SpeexPreprocessState *st, spx_int16_t *x)
     for (i = 0; i < N; i++)
         st->ps[i] = PSHR32(st->ps[i], 2 * st->frame_shift);
 
-    filterbank_compute_bank32(st->bank, ps, ps + N);
+    st->kernels->bank32(st->bank, ps, ps + N);
 }
 
 static void update_noise_prob(SpeexPreprocessState *st)
@@ -749,24 +1031,24 @@ static void update_noise_prob(SpeexPreprocessState *st)
 #define NOISE_OVERCOMPENS 1.
 
 void speex_echo_get_residual(SpeexEchoState *st, spx_word32_t *Yout, int len);
+void speex_echo_get_filter_residual(SpeexEchoState *st, int chan, spx_word32_t *residual_echo, int len);
 
 EXPORT int speex_preprocess(SpeexPreprocessState *st, spx_int16_t *x, spx_int32_t *echo)
 {
     return speex_preprocess_run(st, x);
 }
 
-EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
+/** Analysis half of preprocess_run: noise and echo estimates, SNRs, the speech probability of the frame (returned)
+    and the Bark band gains. The bins get their SNR only when linear is set, for the linear frequency gains. */
+static spx_word16_t preprocess_estimate(SpeexPreprocessState *st, const spx_int16_t *x, int stride, int have_residual, int linear)
 {
     int i;
     int M;
     int N            = st->ps_size;
-    int N3           = 2 * N - st->frame_size;
-    int N4           = st->frame_size - N3;
     spx_word32_t *ps = st->ps;
     spx_word32_t Zframe;
     spx_word16_t Pframe;
     spx_word16_t beta, beta_1;
-    spx_word16_t effective_echo_suppress;
 
     st->nb_adapt++;
     if (st->nb_adapt > 20000)
@@ -778,7 +1060,12 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
     M      = st->nbands;
     /* Deal with residual echo if provided */
     if (st->echo_state) {
-        speex_echo_get_residual(st->echo_state, st->residual_echo, N);
+        if (have_residual) {
+        } else if (st->echo_fused) {
+            speex_echo_get_filter_residual(st->echo_state, 0, st->residual_echo, N);
+        } else {
+            speex_echo_get_residual(st->echo_state, st->residual_echo, N);
+        }
 #ifndef FIXED_POINT
         /* If there are NaNs or ridiculous values, it'll show up in the DC and we just reset everything to zero */
         if (!(st->residual_echo[0] >= 0 && st->residual_echo[0] < N * 1e9f)) {
@@ -788,12 +1075,12 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
 #endif
         for (i = 0; i < N; i++)
             st->echo_noise[i] = MAX32(MULT16_32_Q15(QCONST16(.6f, 15), st->echo_noise[i]), st->residual_echo[i]);
-        filterbank_compute_bank32(st->bank, st->echo_noise, st->echo_noise + N);
+        st->kernels->bank32(st->bank, st->echo_noise, st->echo_noise + N);
     } else {
         for (i = 0; i < N + M; i++)
             st->echo_noise[i] = 0;
     }
-    preprocess_analysis(st, x);
+    preprocess_analysis(st, x, stride);
 
     update_noise_prob(st);
 
@@ -810,43 +1097,26 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
         if (!st->update_prob[i] || st->ps[i] < PSHR32(st->noise[i], NOISE_SHIFT))
             st->noise[i] = MAX32(EXTEND32(0), MULT16_32_Q15(beta_1, st->noise[i]) + MULT16_32_Q15(beta, SHL32(st->ps[i], NOISE_SHIFT)));
     }
-    filterbank_compute_bank32(st->bank, st->noise, st->noise + N);
+    st->kernels->bank32(st->bank, st->noise, st->noise + N);
 
     /* Special case for first frame */
     if (st->nb_adapt == 1)
         for (i = 0; i < N + M; i++)
             st->old_ps[i] = ps[i];
 
-    /* Compute a posteriori SNR */
-    for (i = 0; i < N + M; i++) {
-        spx_word16_t gamma;
-
-        /* Total noise estimate including residual echo and reverberation */
-        spx_word32_t tot_noise = ADD32(ADD32(ADD32(EXTEND32(1), PSHR32(st->noise[i], NOISE_SHIFT)), st->echo_noise[i]), st->reverb_estimate[i]);
-
-        /* A posteriori SNR = ps/noise - 1*/
-        st->post[i] = SUB16(DIV32_16_Q8(ps[i], tot_noise), QCONST16(1.f, SNR_SHIFT));
-        st->post[i] = MIN16(st->post[i], QCONST16(100.f, SNR_SHIFT));
-
-        /* Computing update gamma = .1 + .9*(old/(old+noise))^2 */
-        gamma = QCONST16(.1f, 15) + MULT16_16_Q15(QCONST16(.89f, 15), SQR16_Q15(DIV32_16_Q15(st->old_ps[i], ADD32(st->old_ps[i], tot_noise))));
-
-        /* A priori SNR update = gamma*max(0,post) + (1-gamma)*old/noise */
-        st->prior[i] = EXTRACT16(PSHR32(ADD32(MULT16_16(gamma, MAX16(0, st->post[i])), MULT16_16(Q15_ONE - gamma, DIV32_16_Q8(st->old_ps[i], tot_noise))), 15));
-        st->prior[i] = MIN16(st->prior[i], QCONST16(100.f, SNR_SHIFT));
-    }
+    /* Compute a posteriori SNR, the bins only need it for the linear frequency gains */
+    if (linear)
+        st->kernels->snr(ps, st->old_ps, st->noise, st->echo_noise, st->reverb_estimate, st->post, st->prior, N + M);
+    else
+        st->kernels->snr(ps + N, st->old_ps + N, st->noise + N, st->echo_noise + N, st->reverb_estimate + N, st->post + N, st->prior + N, M);
 
     /*print_vec(st->post, N+M, "");*/
 
     /* Recursive average of the a priori SNR. A bit smoothed for the psd components */
-    st->zeta[0] = PSHR32(ADD32(MULT16_16(QCONST16(.7f, 15), st->zeta[0]), MULT16_16(QCONST16(.3f, 15), st->prior[0])), 15);
-    for (i = 1; i < N - 1; i++)
-        st->zeta[i] = PSHR32(ADD32(ADD32(ADD32(MULT16_16(QCONST16(.7f, 15), st->zeta[i]), MULT16_16(QCONST16(.15f, 15), st->prior[i])),
-                                         MULT16_16(QCONST16(.075f, 15), st->prior[i - 1])),
-                                   MULT16_16(QCONST16(.075f, 15), st->prior[i + 1])),
-                             15);
-    for (i = N - 1; i < N + M; i++)
-        st->zeta[i] = PSHR32(ADD32(MULT16_16(QCONST16(.7f, 15), st->zeta[i]), MULT16_16(QCONST16(.3f, 15), st->prior[i])), 15);
+    if (linear)
+        st->kernels->zeta(st->prior, st->zeta, N, M);
+    else
+        preprocess_zeta_tail(st->prior, st->zeta, N, N + M);
 
     /* Speech probability of presence for the entire frame is based on the average filterbank a priori SNR */
     Zframe = 0;
@@ -854,100 +1124,70 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
         Zframe = ADD32(Zframe, EXTEND32(st->zeta[i]));
     Pframe = QCONST16(.1f, 15) + MULT16_16_Q15(QCONST16(.899f, 15), qcurve(DIV32_16(Zframe, st->nbands)));
 
-    effective_echo_suppress = EXTRACT16(PSHR32(ADD32(MULT16_16(SUB16(Q15_ONE, Pframe), st->echo_suppress), MULT16_16(Pframe, st->echo_suppress_active)), 15));
-
-    compute_gain_floor(st->noise_suppress, effective_echo_suppress, st->noise + N, st->echo_noise + N, st->gain_floor + N, M);
-
-    /* Compute Ephraim & Malah gain speech probability of presence for each critical band (Bark scale)
-       Technically this is actually wrong because the EM gaim assumes a slightly different probability
-       distribution */
-    for (i = N; i < N + M; i++) {
-        /* See EM and Cohen papers*/
-        spx_word32_t theta;
-        /* Gain from hypergeometric function */
-        spx_word32_t MM;
-        /* Weiner filter gain */
-        spx_word16_t prior_ratio;
-        /* a priority probability of speech presence based on Bark sub-band alone */
-        spx_word16_t P1;
-        /* Speech absence a priori probability (considering sub-band and frame) */
-        spx_word16_t q;
-#ifdef FIXED_POINT
-        spx_word16_t tmp;
-#endif
+    /* Compute Ephraim & Malah gain speech probability of presence for each critical band (Bark scale) */
+    st->kernels->bark_gain(st->prior + N, st->post + N, st->zeta + N, Pframe, ps + N, st->old_ps + N, st->gain + N, st->gain2 + N, M);
 
-        prior_ratio = PDIV32_16(SHL32(EXTEND32(st->prior[i]), 15), ADD16(st->prior[i], SHL32(1, SNR_SHIFT)));
-        theta       = MULT16_32_P15(prior_ratio, QCONST32(1.f, EXPIN_SHIFT) + SHL32(EXTEND32(st->post[i]), EXPIN_SHIFT - SNR_SHIFT));
+    /* The bins skipped their SNR, start them from this frame when the linear gains come back */
+    if (!linear)
+        for (i = 0; i < N; i++)
+            st->old_ps[i] = ps[i];
 
-        MM = hypergeom_gain(theta);
-        /* Gain with bound */
-        st->gain[i] = EXTRACT16(MIN32(Q15_ONE, MULT16_32_Q15(prior_ratio, MM)));
-        /* Save old Bark power spectrum */
-        st->old_ps[i] = MULT16_32_P15(QCONST16(.2f, 15), st->old_ps[i]) + MULT16_32_P15(MULT16_16_P15(QCONST16(.8f, 15), SQR16_Q15(st->gain[i])), ps[i]);
+    return Pframe;
+}
 
-        P1 = QCONST16(.199f, 15) + MULT16_16_Q15(QCONST16(.8f, 15), qcurve(st->zeta[i]));
-        q  = Q15_ONE - MULT16_16_Q15(Pframe, P1);
-#ifdef FIXED_POINT
-        theta        = MIN32(theta, EXTEND32(32767));
-        /*Q8*/ tmp   = MULT16_16_Q15((SHL32(1, SNR_SHIFT) + st->prior[i]), EXTRACT16(MIN32(Q15ONE, SHR32(spx_exp(-EXTRACT16(theta)), 1))));
-        tmp          = MIN16(QCONST16(3., SNR_SHIFT), tmp); /* Prevent overflows in the next line*/
-        /*Q8*/ tmp   = EXTRACT16(PSHR32(MULT16_16(PDIV32_16(SHL32(EXTEND32(q), 8), (Q15_ONE - q)), tmp), 8));
-        st->gain2[i] = DIV32_16(SHL32(EXTEND32(32767), SNR_SHIFT), ADD16(256, tmp));
-#else
-        st->gain2[i] = 1 / (1.f + (q / (1.f - q)) * (1 + st->prior[i]) * exp(-theta));
-#endif
+/** Speech decision of the frame with the start/continue hysteresis */
+static int preprocess_vad_decision(SpeexPreprocessState *st, spx_word16_t Pframe)
+{
+    /* FIXME: This VAD is a kludge */
+    st->speech_prob = Pframe;
+    if (st->speech_prob > st->speech_prob_start || (st->was_speech && st->speech_prob > st->speech_prob_continue)) {
+        st->was_speech = 1;
+        return 1;
+    } else {
+        st->was_speech = 0;
+        return 0;
     }
-    /* Convert the EM gains and speech prob to linear frequency */
-    filterbank_compute_psd16(st->bank, st->gain2 + N, st->gain2);
-    filterbank_compute_psd16(st->bank, st->gain + N, st->gain);
+}
 
-    /* Use 1 for linear gain resolution (best) or 0 for Bark gain resolution (faster) */
-    if (1) {
-        filterbank_compute_psd16(st->bank, st->gain_floor + N, st->gain_floor);
+/** Body of speex_preprocess_run on a channel picked out of an interleaved frame (x[i * stride]).
+    have_residual says the caller already put the residual echo of the echo state into residual_echo. */
+static int preprocess_run(SpeexPreprocessState *st, spx_int16_t *x, int stride, int have_residual)
+{
+    int i;
+    int M            = st->nbands;
+    int N            = st->ps_size;
+    int N3           = 2 * N - st->frame_size;
+    int N4           = st->frame_size - N3;
+    spx_word32_t *ps = st->ps;
+    spx_word16_t Pframe;
+    spx_word16_t effective_echo_suppress;
+    const spx_word16_t *bands[3];
+    spx_word16_t *bins[3];
+
+    Pframe = preprocess_estimate(st, x, stride, have_residual, st->linear_gain);
+
+    effective_echo_suppress = EXTRACT16(PSHR32(ADD32(MULT16_16(SUB16(Q15_ONE, Pframe), st->echo_suppress), MULT16_16(Pframe, st->echo_suppress_active)), 15));
+
+#ifdef _compute_gain_floor_NS_OPT
+    if (!st->echo_state)
+        compute_gain_floor_ns(st->noise_suppress, effective_echo_suppress, st->noise + N, st->gain_floor + N, M);
+    else
+#endif
+        compute_gain_floor(st->noise_suppress, effective_echo_suppress, st->noise + N, st->echo_noise + N, st->gain_floor + N, M);
+
+    /* Linear gain resolution (best) or Bark gain resolution (faster), see SPEEX_PREPROCESS_SET_LINEAR_GAIN */
+    if (st->linear_gain) {
+        /* Convert the EM gains and speech prob to linear frequency, in one pass over the filter bank */
+        bands[0] = st->gain2 + N;
+        bands[1] = st->gain + N;
+        bands[2] = st->gain_floor + N;
+        bins[0]  = st->gain2;
+        bins[1]  = st->gain;
+        bins[2]  = st->gain_floor;
+        st->kernels->psd16(st->bank, bands, bins, 3);
 
         /* Compute gain according to the Ephraim-Malah algorithm -- linear frequency */
-        for (i = 0; i < N; i++) {
-            spx_word32_t MM;
-            spx_word32_t theta;
-            spx_word16_t prior_ratio;
-            spx_word16_t tmp;
-            spx_word16_t p;
-            spx_word16_t g;
-
-            /* Wiener filter gain */
-            prior_ratio = PDIV32_16(SHL32(EXTEND32(st->prior[i]), 15), ADD16(st->prior[i], SHL32(1, SNR_SHIFT)));
-            theta       = MULT16_32_P15(prior_ratio, QCONST32(1.f, EXPIN_SHIFT) + SHL32(EXTEND32(st->post[i]), EXPIN_SHIFT - SNR_SHIFT));
-
-            /* Optimal estimator for loudness domain */
-            MM = hypergeom_gain(theta);
-            /* EM gain with bound */
-            g = EXTRACT16(MIN32(Q15_ONE, MULT16_32_Q15(prior_ratio, MM)));
-            /* Interpolated speech probability of presence */
-            p = st->gain2[i];
-
-            /* Constrain the gain to be close to the Bark scale gain */
-            if (MULT16_16_Q15(QCONST16(.333f, 15), g) > st->gain[i])
-                g = MULT16_16(3, st->gain[i]);
-            st->gain[i] = g;
-
-            /* Save old power spectrum */
-            st->old_ps[i] = MULT16_32_P15(QCONST16(.2f, 15), st->old_ps[i]) + MULT16_32_P15(MULT16_16_P15(QCONST16(.8f, 15), SQR16_Q15(st->gain[i])), ps[i]);
-
-            /* Apply gain floor */
-            if (st->gain[i] < st->gain_floor[i])
-                st->gain[i] = st->gain_floor[i];
-
-            /* Exponential decay model for reverberation (unused) */
-            /*st->reverb_estimate[i] = st->reverb_decay*st->reverb_estimate[i] + st->reverb_decay*st->reverb_level*st->gain[i]*st->gain[i]*st->ps[i];*/
-
-            /* Take into account speech probability of presence (loudness domain MMSE estimator) */
-            /* gain2 = [p*sqrt(gain)+(1-p)*sqrt(gain _floor) ]^2 */
-            tmp          = MULT16_16_P15(p, spx_sqrt(SHL32(EXTEND32(st->gain[i]), 15))) + MULT16_16_P15(SUB16(Q15_ONE, p), spx_sqrt(SHL32(EXTEND32(st->gain_floor[i]), 15)));
-            st->gain2[i] = SQR16_Q15(tmp);
-
-            /* Use this if you want a log-domain MMSE estimator instead */
-            /*st->gain2[i] = pow(st->gain[i], p) * pow(st->gain_floor[i],1.f-p);*/
-        }
+        st->kernels->linear_gain(st->prior, st->post, st->gain_floor, ps, st->old_ps, st->gain, st->gain2, N);
     } else {
         for (i = N; i < N + M; i++) {
             spx_word16_t tmp;
@@ -956,7 +1196,9 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
             tmp            = MULT16_16_P15(p, spx_sqrt(SHL32(EXTEND32(st->gain[i]), 15))) + MULT16_16_P15(SUB16(Q15_ONE, p), spx_sqrt(SHL32(EXTEND32(st->gain_floor[i]), 15)));
             st->gain2[i]   = SQR16_Q15(tmp);
         }
-        filterbank_compute_psd16(st->bank, st->gain2 + N, st->gain2);
+        bands[0] = st->gain2 + N;
+        bins[0]  = st->gain2;
+        st->kernels->psd16(st->bank, bands, bins, 1);
     }
 
     /* If noise suppression is off, don't apply the gain (but then why call this in the first place!) */
@@ -973,19 +1215,20 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
     st->ft[0]         = MULT16_16_P15(st->gain2[0], st->ft[0]);
     st->ft[2 * N - 1] = MULT16_16_P15(st->gain2[N - 1], st->ft[2 * N - 1]);
 
-    /*FIXME: This *will* not work for fixed-point */
-#ifndef FIXED_POINT
     if (st->agc_enabled)
         speex_compute_agc(st, Pframe, st->ft);
-#endif
 
     /* Inverse FFT with 1/N scaling */
     spx_ifft(st->fft_lookup, st->ft, st->frame);
     /* Scale back to original (lower) amplitude */
-    for (i = 0; i < 2 * N; i++)
-        st->frame[i] = PSHR16(st->frame[i], st->frame_shift);
+#ifdef FIXED_POINT
+    if (st->agc_enabled)
+        speex_agc_scale(st);
+    else
+#endif
+        for (i = 0; i < 2 * N; i++)
+            st->frame[i] = PSHR16(st->frame[i], st->frame_shift);
 
-        /*FIXME: This *will* not work for fixed-point */
 #ifndef FIXED_POINT
     if (st->agc_enabled) {
         float max_sample = 0;
@@ -1006,29 +1249,108 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
 
     /* Perform overlap and add */
     for (i = 0; i < N3; i++)
-        x[i] = WORD2INT(ADD32(EXTEND32(st->outbuf[i]), EXTEND32(st->frame[i])));
+        x[i * stride] = WORD2INT(ADD32(EXTEND32(st->outbuf[i]), EXTEND32(st->frame[i])));
     for (i = 0; i < N4; i++)
-        x[N3 + i] = st->frame[N3 + i];
+        x[(N3 + i) * stride] = st->frame[N3 + i];
 
     /* Update outbuf */
     for (i = 0; i < N3; i++)
         st->outbuf[i] = st->frame[st->frame_size + i];
 
-    /* FIXME: This VAD is a kludge */
+    if (st->vad_enabled)
+        return preprocess_vad_decision(st, Pframe);
     st->speech_prob = Pframe;
-    if (st->vad_enabled) {
-        if (st->speech_prob > st->speech_prob_start || (st->was_speech && st->speech_prob > st->speech_prob_continue)) {
-            st->was_speech = 1;
-            return 1;
-        } else {
-            st->was_speech = 0;
-            return 0;
-        }
+    return 1;
+}
+
+EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
+{
+    return preprocess_run(st, x, 1, 0);
+}
+
+/** Body of speex_preprocess_vad, x picked out of an interleaved frame as in preprocess_run */
+static int preprocess_vad(SpeexPreprocessState *st, const spx_int16_t *x, int stride, int have_residual)
+{
+    int i;
+    int N3 = 2 * st->ps_size - st->frame_size;
+    spx_word16_t Pframe;
+
+    Pframe = preprocess_estimate(st, x, stride, have_residual, 0);
+
+    /* Keep an overlap for the next speex_preprocess_run, as speex_preprocess_estimate_update does */
+    for (i = 0; i < N3; i++)
+        st->outbuf[i] = MULT16_16_Q15(x[(st->frame_size - N3 + i) * stride], st->window[st->frame_size + i]);
+
+    return preprocess_vad_decision(st, Pframe);
+}
+
+EXPORT int speex_preprocess_vad(SpeexPreprocessState *st, const spx_int16_t *x)
+{
+    return preprocess_vad(st, x, 1, 0);
+}
+
+/** What the per-channel tasks of speex_preprocess_run_mc need besides the channel index */
+typedef struct PreprocessChanTask_ {
+    SpeexPreprocessState **st;
+    spx_int16_t *x;
+    int chan_step;
+    int stride;
+    int *vad; /**< Decisions of speex_preprocess_vad_mc, NULL for speex_preprocess_run_mc */
+} PreprocessChanTask;
+
+static void preprocess_chan_task(void *arg, int chan)
+{
+    const PreprocessChanTask *task = (const PreprocessChanTask *)arg;
+
+    if (task->vad)
+        task->vad[chan] = preprocess_vad(task->st[chan], task->x + chan * task->chan_step, task->stride, 1);
+    else
+        preprocess_run(task->st[chan], task->x + chan * task->chan_step, task->stride, 1);
+}
+
+/** Runs the tasks of speex_preprocess_run_mc (vad NULL) or speex_preprocess_vad_mc */
+static void preprocess_mc(SpeexPreprocessState **st, int nb_chan, spx_int16_t *x, int chan_step, int stride, int *vad, PST_AUD_POOL pool)
+{
+    PreprocessChanTask task = {st, x, chan_step, stride, vad};
+    int chan, echo_chan = 0;
+
+    /* The residual echo only depends on the echo state, and computing it uses the echo state's work area: work it
+       out here once per echo state so the channels neither repeat it nor share that area. Fused states take the
+       echo spectrum of their own microphone instead, the n-th state of a run sharing an echo state that of mic n. */
+    for (chan = 0; chan < nb_chan; chan++) {
+        if (!st[chan]->echo_state)
+            continue;
+        if (chan > 0 && st[chan]->echo_state == st[chan - 1]->echo_state)
+            echo_chan++;
+        else
+            echo_chan = 0;
+        if (st[chan]->echo_fused)
+            speex_echo_get_filter_residual(st[chan]->echo_state, echo_chan, st[chan]->residual_echo, st[chan]->ps_size);
+        else if (echo_chan > 0 && !st[chan - 1]->echo_fused)
+            SPEEX_COPY(st[chan]->residual_echo, st[chan - 1]->residual_echo, st[chan]->ps_size);
+        else
+            speex_echo_get_residual(st[chan]->echo_state, st[chan]->residual_echo, st[chan]->ps_size);
+    }
+
+    if (pool && nb_chan > 1) {
+        pool->pfRun(pool->pCtx, preprocess_chan_task, &task, nb_chan);
     } else {
-        return 1;
+        for (chan = 0; chan < nb_chan; chan++)
+            preprocess_chan_task(&task, chan);
     }
 }
 
+EXPORT void speex_preprocess_run_mc(SpeexPreprocessState **st, int nb_chan, spx_int16_t *x, int chan_step, int stride, PST_AUD_POOL pool)
+{
+    preprocess_mc(st, nb_chan, x, chan_step, stride, NULL, pool);
+}
+
+EXPORT void speex_preprocess_vad_mc(SpeexPreprocessState **st, int nb_chan, const spx_int16_t *x, int chan_step, int stride, int *vad, PST_AUD_POOL pool)
+{
+    /* The samples are only read on this path */
+    preprocess_mc(st, nb_chan, (spx_int16_t *)x, chan_step, stride, vad, pool);
+}
+
 EXPORT void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16_t *x)
 {
     int i;
@@ -1040,7 +1362,7 @@ EXPORT void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16
     M = st->nbands;
     st->min_count++;
 
-    preprocess_analysis(st, x);
+    preprocess_analysis(st, x, 1);
 
     update_noise_prob(st);
 
@@ -1073,13 +1395,13 @@ EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *
         case SPEEX_PREPROCESS_GET_DENOISE:
             (*(spx_int32_t *)ptr) = st->denoise_enabled;
             break;
-#ifndef FIXED_POINT
         case SPEEX_PREPROCESS_SET_AGC:
             st->agc_enabled = (*(spx_int32_t *)ptr);
             break;
         case SPEEX_PREPROCESS_GET_AGC:
             (*(spx_int32_t *)ptr) = st->agc_enabled;
             break;
+#ifndef FIXED_POINT
 #ifndef DISABLE_FLOAT_API
         case SPEEX_PREPROCESS_SET_AGC_LEVEL:
             st->agc_level = (*(float *)ptr);
@@ -1110,6 +1432,33 @@ EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *
         case SPEEX_PREPROCESS_GET_AGC_MAX_GAIN:
             (*(spx_int32_t *)ptr) = floor(.5 + 8.6858 * log(st->max_gain));
             break;
+#else
+#ifndef DISABLE_FLOAT_API
+        case SPEEX_PREPROCESS_SET_AGC_LEVEL:
+            st->agc_level = (spx_int32_t)MIN32(32768.f, MAX32(1.f, *(float *)ptr));
+            break;
+        case SPEEX_PREPROCESS_GET_AGC_LEVEL:
+            (*(float *)ptr) = st->agc_level;
+            break;
+#endif /* #ifndef DISABLE_FLOAT_API */
+        case SPEEX_PREPROCESS_SET_AGC_INCREMENT:
+            st->max_increase_step = agc_db_to_step(st, *(spx_int32_t *)ptr);
+            break;
+        case SPEEX_PREPROCESS_GET_AGC_INCREMENT:
+            (*(spx_int32_t *)ptr) = agc_log2_to_db(st->max_increase_step * st->sampling_rate / st->frame_size);
+            break;
+        case SPEEX_PREPROCESS_SET_AGC_DECREMENT:
+            st->max_decrease_step = agc_db_to_step(st, *(spx_int32_t *)ptr);
+            break;
+        case SPEEX_PREPROCESS_GET_AGC_DECREMENT:
+            (*(spx_int32_t *)ptr) = agc_log2_to_db(st->max_decrease_step * st->sampling_rate / st->frame_size);
+            break;
+        case SPEEX_PREPROCESS_SET_AGC_MAX_GAIN:
+            st->max_gain = agc_db_to_log2(*(spx_int32_t *)ptr);
+            break;
+        case SPEEX_PREPROCESS_GET_AGC_MAX_GAIN:
+            (*(spx_int32_t *)ptr) = agc_log2_to_db(st->max_gain);
+            break;
 #endif
         case SPEEX_PREPROCESS_SET_VAD:
             speex_warning("The VAD has been replaced by a hack pending a complete rewrite");
@@ -1186,6 +1535,18 @@ EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *
         case SPEEX_PREPROCESS_GET_ECHO_STATE:
             (*(SpeexEchoState **)ptr) = (SpeexEchoState *)st->echo_state;
             break;
+        case SPEEX_PREPROCESS_SET_ECHO_FUSED:
+            st->echo_fused = (*(spx_int32_t *)ptr);
+            break;
+        case SPEEX_PREPROCESS_GET_ECHO_FUSED:
+            (*(spx_int32_t *)ptr) = st->echo_fused;
+            break;
+        case SPEEX_PREPROCESS_SET_LINEAR_GAIN:
+            st->linear_gain = (*(spx_int32_t *)ptr) != 0;
+            break;
+        case SPEEX_PREPROCESS_GET_LINEAR_GAIN:
+            (*(spx_int32_t *)ptr) = st->linear_gain;
+            break;
 #ifndef FIXED_POINT
         case SPEEX_PREPROCESS_GET_AGC_LOUDNESS:
             (*(spx_int32_t *)ptr) = pow(st->loudness, 1.0 / LOUDNESS_EXP);
@@ -1193,6 +1554,13 @@ EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *
         case SPEEX_PREPROCESS_GET_AGC_GAIN:
             (*(spx_int32_t *)ptr) = floor(.5 + 8.6858 * log(st->agc_gain));
             break;
+#else
+        case SPEEX_PREPROCESS_GET_AGC_LOUDNESS:
+            (*(spx_int32_t *)ptr) = FLOAT_EXTRACT32(agc_exp2(MULT16_32_Q15(QCONST16(1.f / LOUDNESS_EXP, 15), agc_log2_float(st->loudness))));
+            break;
+        case SPEEX_PREPROCESS_GET_AGC_GAIN:
+            (*(spx_int32_t *)ptr) = agc_log2_to_db(st->agc_gain);
+            break;
 #endif
         case SPEEX_PREPROCESS_GET_PSD_SIZE:
         case SPEEX_PREPROCESS_GET_NOISE_PSD_SIZE:
@@ -1209,7 +1577,6 @@ EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *
         case SPEEX_PREPROCESS_GET_PROB:
             (*(spx_int32_t *)ptr) = MULT16_16_Q15(st->speech_prob, 100);
             break;
-#ifndef FIXED_POINT
         case SPEEX_PREPROCESS_SET_AGC_TARGET:
             st->agc_level = (*(spx_int32_t *)ptr);
             if (st->agc_level < 1)
@@ -1220,7 +1587,6 @@ EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *
         case SPEEX_PREPROCESS_GET_AGC_TARGET:
             (*(spx_int32_t *)ptr) = st->agc_level;
             break;
-#endif
         default:
             speex_warning_int("Unknown speex_preprocess_ctl request: ", request);
             return -1;
@@ -1233,11 +1599,7 @@ long long spx_mips = 0;
 #endif
 
 // Noah@20220113
-#define ALLIGN_4BYTE(x) (((x) + 3) & 0xfffffffc)
-#define SIZE_OF_KISS_CONFIG 24
-#define MIST_NUMBER 70 + 16
-
-u32 _Aec_SetPreProcParams(void **ppstPreProcState, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue)
+u32 _Aec_SetPreProcParams(void **ppstPreProcState, EN_AUD_AEC_PARAMS enParamsCMD, void *pParamsValue, s32 s32ChannelNum)
 {
     SpeexPreprocessState **ppstPreProcSt = (SpeexPreprocessState **)ppstPreProcState;
     SpeexEchoState *pstEchoSt            = NULL;
@@ -1252,155 +1614,41 @@ u32 _Aec_SetPreProcParams(void **ppstPreProcState, EN_AUD_AEC_PARAMS enParamsCMD
 
     switch (enParamsCMD) {
         case EN_AUD_AEC_NOISE_SUPPRESS: {
-            for (i = 0; i < pstEchoSt->C; i++)
+            for (i = 0; i < s32ChannelNum; i++)
                 speex_preprocess_ctl(ppstPreProcSt[i], SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &s32value);
             break;
         }
         case EN_AUD_AEC_ECHO_SUPPRESS: {
-            for (i = 0; i < pstEchoSt->C; i++)
+            for (i = 0; i < s32ChannelNum; i++)
                 speex_preprocess_ctl(ppstPreProcSt[i], SPEEX_PREPROCESS_SET_ECHO_SUPPRESS, &s32value);
             break;
         }
         case EN_AUD_AEC_ECHO_SUPPRESS_ACTIVE: {
-            for (i = 0; i < pstEchoSt->C; i++)
+            for (i = 0; i < s32ChannelNum; i++)
                 speex_preprocess_ctl(ppstPreProcSt[i], SPEEX_PREPROCESS_SET_ECHO_SUPPRESS_ACTIVE, &s32value);
             break;
         }
         case EN_AUD_AEC_DENOISE: {
-            for (i = 0; i < pstEchoSt->C; i++)
+            for (i = 0; i < s32ChannelNum; i++)
                 ppstPreProcSt[i]->denoise_enabled = s32value;
             break;
         }
+        case EN_AUD_AEC_FUSED_RESIDUAL: {
+            for (i = 0; i < s32ChannelNum; i++)
+                speex_preprocess_ctl(ppstPreProcSt[i], SPEEX_PREPROCESS_SET_ECHO_FUSED, &s32value);
+            break;
+        }
+        case EN_AUD_AEC_BANK_SCALE: {
+            for (i = 0; i < s32ChannelNum; i++)
+                speex_preprocess_ctl(ppstPreProcSt[i], SPEEX_PREPROCESS_SET_LINEAR_GAIN, &s32value);
+            break;
+        }
         default:
             return 1;
     }
     return 0;
 }
 
-#include "kiss_fftr.h"
-struct kiss_fftr_state {
-    kiss_fft_cfg substate;
-    kiss_fft_cpx *tmpbuf;
-    kiss_fft_cpx *super_twiddles;
-#ifdef USE_SIMD
-    long pad;
-#endif
-};
-
-u32 _Aec_GetInternalBufSize(PST_AUD_AEC_INFO pstAecInfo, u32 u32NumPreProc)
-{
-    u32 u32InitSize            = 0;
-    u32 u32AECInternalSize     = 0;
-    u32 u32PreProcInternalSize = 0;
-    u32 u32NLPInternalSize     = 0;
-    u32 u32TotalInternalSize   = 0;
-    u32 C                      = pstAecInfo->u32NumMic;
-    u32 K                      = pstAecInfo->u32NumSpeaker;
-    u32 N                      = pstAecInfo->u32FrameSize << 1;
-    u32 frame_size             = pstAecInfo->u32FrameSize;
-    u32 M                      = (pstAecInfo->u32FilterLen + frame_size - 1) / frame_size;
-    u32 KN, tmp;
-    KN  = (K * N) << 1;
-    tmp = (frame_size + 1) << 2;
-
-    u32InitSize += ALLIGN_4BYTE(C * sizeof(void *));
-    u32InitSize += ALLIGN_4BYTE((C * frame_size) << 1);
-
-    //===AEC===
-    u32AECInternalSize += ALLIGN_4BYTE(sizeof(SpeexEchoState));
-    u32AECInternalSize += ALLIGN_4BYTE(SIZE_OF_KISS_CONFIG);                      //(sizeof(struct kiss_config));
-    u32AECInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-    u32AECInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-
-    if (pstAecInfo->u32SpkrDualMono) {
-        KN = (N) << 1;
-        u32AECInternalSize += ALLIGN_4BYTE((N) << 1) * 5;               // e y Y E last_y
-        u32AECInternalSize += ALLIGN_4BYTE(tmp) * 5;                    // Yf Rf Xf Yh Wh
-        u32AECInternalSize += ALLIGN_4BYTE((frame_size) << 1);          // input
-        u32AECInternalSize += ALLIGN_4BYTE(KN);                         // x
-        u32AECInternalSize += ALLIGN_4BYTE(KN * (M + 1));               // X
-        u32AECInternalSize += ALLIGN_4BYTE(KN * M);                     // foreground
-        u32AECInternalSize += ALLIGN_4BYTE(KN * M * 2);                 // W
-        u32AECInternalSize += ALLIGN_4BYTE(N << 2);                     // PHI
-        u32AECInternalSize += ALLIGN_4BYTE((frame_size + 1) << 2) * 2;  // power power1
-        u32AECInternalSize += ALLIGN_4BYTE(N << 1) * 3;                 // window wtmp wtmp2
-        u32AECInternalSize += ALLIGN_4BYTE(M << 1);                     // prop
-        u32AECInternalSize += ALLIGN_4BYTE(1 << 1);                     // memX
-        u32AECInternalSize += ALLIGN_4BYTE(1 << 1) * 2;                 // memD memE
-        u32AECInternalSize += ALLIGN_4BYTE(1 << 3);                     // notch_mem
-#ifdef USE_THOSE_PARAMS
-        u32AECInternalSize += ALLIGN_4BYTE((1 * (PLAYBACK_DELAY + 1) * frame_size) << 1);  // play_buf
-#endif
-        u32AECInternalSize += ALLIGN_4BYTE(1 << 1);     // ps16AmpRate
-        u32AECInternalSize += ALLIGN_4BYTE(1 << 2);     //_ppstPreProcState
-        u32AECInternalSize = u32AECInternalSize * (C);  // mono process
-    } else {
-        u32AECInternalSize += ALLIGN_4BYTE((C * N) << 1) * 5;           // e y Y E last_y
-        u32AECInternalSize += ALLIGN_4BYTE(tmp) * 5;                    // Yf Rf Xf Yh Wh
-        u32AECInternalSize += ALLIGN_4BYTE((C * frame_size) << 1);      // input
-        u32AECInternalSize += ALLIGN_4BYTE(KN);                         // x
-        u32AECInternalSize += ALLIGN_4BYTE(KN * (M + 1));               // X
-        u32AECInternalSize += ALLIGN_4BYTE(KN * C * M);                 // foreground
-        u32AECInternalSize += ALLIGN_4BYTE(KN * C * M * 2);             // W
-        u32AECInternalSize += ALLIGN_4BYTE(N << 2);                     // PHI
-        u32AECInternalSize += ALLIGN_4BYTE((frame_size + 1) << 2) * 2;  // power power1
-        u32AECInternalSize += ALLIGN_4BYTE(N << 1) * 3;                 // window wtmp wtmp2
-        u32AECInternalSize += ALLIGN_4BYTE(M << 1);                     // prop
-        u32AECInternalSize += ALLIGN_4BYTE(K << 1);                     // memX
-        u32AECInternalSize += ALLIGN_4BYTE(C << 1) * 2;                 // memD memE
-        u32AECInternalSize += ALLIGN_4BYTE(C << 3);                     // notch_mem
-#ifdef USE_THOSE_PARAMS
-        u32AECInternalSize += ALLIGN_4BYTE((K * (PLAYBACK_DELAY + 1) * frame_size) << 1);  // play_buf
-#endif
-        u32AECInternalSize += ALLIGN_4BYTE(C << 1);  // ps16AmpRate
-
-        u32AECInternalSize += ALLIGN_4BYTE(C << 2);  //_ppstPreProcState
-    }
-    // printf("[PreInit]AECInternalSize = %d\n",u32AECInternalSize);
-
-    //===NS===
-    M = NB_BANDS;
-    u32PreProcInternalSize += ALLIGN_4BYTE(sizeof(SpeexPreprocessState));
-    u32PreProcInternalSize += ALLIGN_4BYTE(sizeof(FilterBank));
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 2) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 1) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(N << 1) * 3;
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 2) * 5;
-#ifdef USE_THOSE_PARAMS
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 2);
-#endif
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 1) * 6;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 2) * 4;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 1) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(SIZE_OF_KISS_CONFIG);                      //(sizeof(struct kiss_config));
-    u32PreProcInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-    u32PreProcInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-                                                                                      // printf("[PreInit]PreProcInternalSize = %d\n",u32PreProcInternalSize);
-
-#ifdef ADD_NLP
-    //===NLP===
-    if ((((C == 1) && (K == 1)) || (pstAecInfo->u32SpkrDualMono)) && (pstAecInfo->u32SamplingRate == 8000)) {
-        u32NLPInternalSize += ALLIGN_4BYTE(frame_size << 2) * 3;
-        u32NLPInternalSize += ALLIGN_4BYTE(SIZE_OF_KISS_CONFIG);                      //(sizeof(struct kiss_config));
-        u32NLPInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-        u32NLPInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-        u32NLPInternalSize += ALLIGN_4BYTE(((frame_size << 1) + 2) << 1);
-        u32NLPInternalSize += ALLIGN_4BYTE(frame_size << 2);
-        u32NLPInternalSize += ALLIGN_4BYTE((frame_size + 1) << 2) * 3;
-        u32NLPInternalSize += ALLIGN_4BYTE((frame_size + 1) << 2) * 3;
-        u32NLPInternalSize += ALLIGN_4BYTE((frame_size + 1) << 3) * 2;
-        u32NLPInternalSize += ALLIGN_4BYTE((frame_size + 1) << 1) * 2;
-        u32NLPInternalSize += ALLIGN_4BYTE((frame_size + 1) << 1);
-    }
-    // printf("[PreInit]NLPInternalSize = %d\n",u32NLPInternalSize);
-#endif
-
-    u32TotalInternalSize = u32InitSize + u32AECInternalSize + u32NumPreProc * u32PreProcInternalSize + u32NLPInternalSize;
-    //printf("[PreInit]InternalSize = %d\n", u32TotalInternalSize);
-
-    return u32TotalInternalSize;
-}
-
 u32 _Ns_SetPreProcParams(void **ppstPreProcState, EN_AUD_NS_PARAMS enParamsCMD, void *pParamsValue, s32 s32ChannelNum)
 {
     SpeexPreprocessState **ppstPreProcSt = (SpeexPreprocessState **)ppstPreProcState;
@@ -1419,86 +1667,17 @@ u32 _Ns_SetPreProcParams(void **ppstPreProcState, EN_AUD_NS_PARAMS enParamsCMD,
             speex_preprocess_ctl(ppstPreProcSt[i], SPEEX_PREPROCESS_SET_DENOISE, &s32value);
             break;
         }
+        case EN_AUD_NS_BANK_SCALE: {
+            for (i = 0; i < s32ChannelNum; i++)
+                speex_preprocess_ctl(ppstPreProcSt[i], SPEEX_PREPROCESS_SET_LINEAR_GAIN, &s32value);
+            break;
+        }
         default:
             return 1;
     }
     return 0;
 }
 
-u32 _Ns_GetInternalBufSize(PST_AUD_NS_INFO pstNsInfo, u32 u32NumPreProc)
-{
-    u32 u32InitSize            = 0;
-    u32 u32PreProcInternalSize = 0;
-    u32 u32TotalInternalSize   = 0;
-    u32 frame_size             = (u32)pstNsInfo->s32FrameSize;
-    u32 N                      = frame_size << 1;
-    u32 M;
-
-    u32InitSize += ALLIGN_4BYTE(pstNsInfo->s32ChannelNum * sizeof(void *));
-    // printf("[PreInit]u32InitSize = %d\n",u32InitSize);
-
-    //===NS===
-    M = NB_BANDS;
-    u32PreProcInternalSize += ALLIGN_4BYTE(sizeof(SpeexPreprocessState));
-    u32PreProcInternalSize += ALLIGN_4BYTE(sizeof(FilterBank));
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 2) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 1) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(N << 1) * 3;
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 2) * 5;
-#ifdef USE_THOSE_PARAMS
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 2);
-#endif
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 1) * 6;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 2) * 4;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 1) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(SIZE_OF_KISS_CONFIG);                      //(sizeof(struct kiss_config));
-    u32PreProcInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-    u32PreProcInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-    // printf("[PreInit]PreProcInternalSize = %d\n",u32PreProcInternalSize);
-
-    u32TotalInternalSize = u32InitSize + u32NumPreProc * u32PreProcInternalSize;
-    // printf("[PreInit]InternalSize = %d\n",u32TotalInternalSize);
-
-    return u32TotalInternalSize;
-}
-
-u32 _Agc_GetInternalBufSize(PST_AUD_AGC_INFO pstAgcInfo, u32 u32NumPreProc)
-{
-    u32 u32InitSize            = 0;
-    u32 u32PreProcInternalSize = 0;
-    u32 u32TotalInternalSize   = 0;
-    u32 frame_size             = (u32)pstAgcInfo->s32FrameSize;
-    u32 N                      = frame_size << 1;
-    u32 M;
-
-    u32InitSize += ALLIGN_4BYTE(pstAgcInfo->s32ChannelNum * sizeof(void *));
-    // printf("[PreInit]u32InitSize = %d\n",u32InitSize);
-
-    //===NS===
-    M = NB_BANDS;
-    u32PreProcInternalSize += ALLIGN_4BYTE(sizeof(SpeexPreprocessState));
-    u32PreProcInternalSize += ALLIGN_4BYTE(sizeof(FilterBank));
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 2) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 1) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(N << 1) * 3;
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 2) * 5;
-#ifdef USE_THOSE_PARAMS
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 2);
-#endif
-    u32PreProcInternalSize += ALLIGN_4BYTE((frame_size + M) << 1) * 6;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 2) * 4;
-    u32PreProcInternalSize += ALLIGN_4BYTE(frame_size << 1) * 2;
-    u32PreProcInternalSize += ALLIGN_4BYTE(SIZE_OF_KISS_CONFIG);                      //(sizeof(struct kiss_config));
-    u32PreProcInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-    u32PreProcInternalSize += ALLIGN_4BYTE((MIST_NUMBER + 3 * frame_size - 1) << 2);  // kiss_fftr_alloc(size,0,NULL,NULL);
-    // printf("[PreInit]PreProcInternalSize = %d\n",u32PreProcInternalSize);
-
-    u32TotalInternalSize = u32InitSize + u32NumPreProc * u32PreProcInternalSize;
-    // printf("[PreInit]InternalSize = %d\n",u32TotalInternalSize);
-
-    return u32TotalInternalSize;
-}
-
 u32 _Agc_SetPreProcParams(void **ppstPreProcState, EN_AUD_AGC_PARAMS enParamsCMD, void *pParamsValue, s32 s32ChannelNum)
 {
     SpeexPreprocessState **ppstPreProcSt = (SpeexPreprocessState **)ppstPreProcState;
@@ -0,0 +1,73 @@
+/*
+   File: preprocess_kernels.c
+   Scalar reference of the preprocessor kernels and their dispatcher
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "preprocess_kernels.h"
+
+static void preprocess_snr_c(const spx_word32_t *ps, const spx_word32_t *old_ps, const spx_word32_t *noise, const spx_word32_t *echo, const spx_word32_t *reverb, spx_word16_t *post, spx_word16_t *prior, int len)
+{
+    preprocess_snr_tail(ps, old_ps, noise, echo, reverb, post, prior, 0, len);
+}
+
+/** Recursive average of the a priori SNR. A bit smoothed for the psd components */
+static void preprocess_zeta_c(const spx_word16_t *prior, spx_word16_t *zeta, int N, int M)
+{
+    zeta[0] = PSHR32(ADD32(MULT16_16(QCONST16(.7f, 15), zeta[0]), MULT16_16(QCONST16(.3f, 15), prior[0])), 15);
+    preprocess_zeta_smooth_tail(prior, zeta, 1, N - 1);
+    preprocess_zeta_tail(prior, zeta, N - 1, N + M);
+}
+
+static void preprocess_bark_gain_c(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *zeta, spx_word16_t Pframe, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    preprocess_bark_gain_tail(prior, post, zeta, Pframe, ps, old_ps, gain, gain2, 0, len);
+}
+
+static void preprocess_linear_gain_c(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *gain_floor, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    preprocess_linear_gain_tail(prior, post, gain_floor, ps, old_ps, gain, gain2, 0, len);
+}
+
+static void preprocess_bank32_c(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel)
+{
+    filterbank_compute_bank32(bank, ps, mel);
+}
+
+/** Each band vector in turn, the weights are as cheap to reload as to keep here */
+static void preprocess_psd16_c(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count)
+{
+    int k;
+    for (k = 0; k < count; k++)
+        filterbank_compute_psd16(bank, mel[k], psd[k]);
+}
+
+const PreprocessKernels preprocess_kernels_c = {
+    "scalar",
+    MDF_KERNEL_SCALAR,
+    preprocess_snr_c,
+    preprocess_zeta_c,
+    preprocess_bark_gain_c,
+    preprocess_linear_gain_c,
+    preprocess_bank32_c,
+    preprocess_psd16_c,
+};
+
+const PreprocessKernels *preprocess_kernels_select(int max_level)
+{
+    if (max_level > PREPROCESS_KERNEL_LEVEL_MAX)
+        max_level = PREPROCESS_KERNEL_LEVEL_MAX;
+    switch (mdf_kernels_level(max_level)) {
+#if defined(MDF_KERNELS_X86)
+        case MDF_KERNEL_AVX2:
+            return &preprocess_kernels_avx2;
+        case MDF_KERNEL_SSE41:
+            return &preprocess_kernels_sse41;
+#endif
+        default:
+            return &preprocess_kernels_c;
+    }
+}
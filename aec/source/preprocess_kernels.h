@@ -0,0 +1,375 @@
+/*
+   File: preprocess_kernels.h
+   Per-bin inner loops of the preprocessor (SNR estimation, Ephraim-Malah gain and the Bark filter bank) with
+   per-ISA variants (SSE4.1/AVX2 on x86) picked once at init time, like the MDF kernels.
+
+   The scalar versions below are the reference. Fixed-point variants are bit-exact with them: the divisions
+   go through a float estimate corrected to the exact integer quotient, spx_sqrt and spx_exp are evaluated
+   lane by lane with the same integer polynomials. SSE4.1 has no per-lane shifts, so its fixed-point gain
+   kernels are the scalar ones.
+
+   Float variants compute the SNRs and the smoothing bit-exactly too. The gains replace the double-precision
+   libm calls of the reference with single-precision ones (hardware square root, polynomial exp on 2^n):
+   against the reference the gain and gain2 of a bin differ by at most 3e-7, and the output stays within
+   1 LSB of it.
+
+   The filter bank kernels walk FilterBank.band_start. Interpolating bands to bins is exact in both builds.
+   Only fixed point sums the bins of a band in vectors, floats keep the bin order of filterbank_compute_bank32.
+*/
+
+#ifndef PREPROCESS_KERNELS_H
+#define PREPROCESS_KERNELS_H
+
+#include <math.h>
+#include "arch.h"
+#include "math_approx.h"
+#include "mdf_kernels.h"
+#include "filterbank.h"
+
+#define SQR(x) ((x) * (x))
+#define SQR16(x) (MULT16_16((x), (x)))
+#define SQR16_Q15(x) (MULT16_16_Q15((x), (x)))
+
+/* Highest level the dispatcher may pick, build with -DPREPROCESS_KERNEL_LEVEL_MAX=0 for the scalar reference only.
+   Nothing here gains from 512-bit vectors, AVX-512 machines run the AVX2 kernels */
+#ifndef PREPROCESS_KERNEL_LEVEL_MAX
+#define PREPROCESS_KERNEL_LEVEL_MAX MDF_KERNEL_AVX2
+#endif
+
+#ifdef FIXED_POINT
+static inline spx_word16_t DIV32_16_Q8(spx_word32_t a, spx_word32_t b)
+{
+    if (SHR32(a, 7) >= b) {
+        return 32767;
+    } else {
+        if (b >= QCONST32(1, 23)) {
+            a = SHR32(a, 8);
+            b = SHR32(b, 8);
+        }
+        if (b >= QCONST32(1, 19)) {
+            a = SHR32(a, 4);
+            b = SHR32(b, 4);
+        }
+        if (b >= QCONST32(1, 15)) {
+            a = SHR32(a, 4);
+            b = SHR32(b, 4);
+        }
+        a = SHL32(a, 8);
+        return PDIV32_16(a, b);
+    }
+}
+static inline spx_word16_t DIV32_16_Q15(spx_word32_t a, spx_word32_t b)
+{
+    if (SHR32(a, 15) >= b) {
+        return 32767;
+    } else {
+        if (b >= QCONST32(1, 23)) {
+            a = SHR32(a, 8);
+            b = SHR32(b, 8);
+        }
+        if (b >= QCONST32(1, 19)) {
+            a = SHR32(a, 4);
+            b = SHR32(b, 4);
+        }
+        if (b >= QCONST32(1, 15)) {
+            a = SHR32(a, 4);
+            b = SHR32(b, 4);
+        }
+        a = SHL32(a, 15) - a;
+        return DIV32_16(a, b);
+    }
+}
+#define SNR_SCALING 256.f
+#define SNR_SCALING_1 0.0039062f
+#define SNR_SHIFT 8
+
+#define FRAC_SCALING 32767.f
+#define FRAC_SCALING_1 3.0518e-05
+#define FRAC_SHIFT 1
+
+#define EXPIN_SCALING 2048.f
+#define EXPIN_SCALING_1 0.00048828f
+#define EXPIN_SHIFT 11
+#define EXPOUT_SCALING_1 1.5259e-05
+
+#define NOISE_SHIFT 7
+
+/* Q13 table of hypergeom_gain, points every .5 of its input */
+static const spx_word16_t hypergeom_table[21] = {
+    6730, 8357, 9868, 11267, 12563, 13770, 14898,
+    15959, 16961, 17911, 18816, 19682, 20512, 21311,
+    22082, 22827, 23549, 24250, 24931, 25594, 26241};
+
+/* This function approximates the gain function
+   y = gamma(1.25)^2 * M(-.25;1;-x) / sqrt(x)
+   which multiplied by xi/(1+xi) is the optimal gain
+   in the loudness domain ( sqrt[amplitude] )
+   Input in Q11 format, output in Q15
+*/
+static inline spx_word32_t hypergeom_gain(spx_word32_t xx)
+{
+    int ind;
+    spx_word16_t frac;
+    ind = SHR32(xx, 10);
+    if (ind < 0)
+        return Q15_ONE;
+    if (ind > 19)
+        return ADD32(EXTEND32(Q15_ONE), EXTEND32(DIV32_16(QCONST32(.1296, 23), SHR32(xx, EXPIN_SHIFT - SNR_SHIFT))));
+    frac = SHL32(xx - SHL32(ind, 10), 5);
+    return SHL32(DIV32_16(PSHR32(MULT16_16(Q15_ONE - frac, hypergeom_table[ind]) + MULT16_16(frac, hypergeom_table[ind + 1]), 7), (spx_sqrt(SHL32(xx, 15) + 6711))), 7);
+}
+
+static inline spx_word16_t qcurve(spx_word16_t x)
+{
+    x = MAX16(x, 1);
+    return DIV32_16(SHL32(EXTEND32(32767), 9), ADD16(512, MULT16_16_Q15(QCONST16(.60f, 15), DIV32_16(32767, x))));
+}
+
+#else
+
+#define DIV32_16_Q8(a, b) ((a) / (b))
+#define DIV32_16_Q15(a, b) ((a) / (b))
+#define SNR_SCALING 1.f
+#define SNR_SCALING_1 1.f
+#define SNR_SHIFT 0
+#define FRAC_SCALING 1.f
+#define FRAC_SCALING_1 1.f
+#define FRAC_SHIFT 0
+#define NOISE_SHIFT 0
+
+#define EXPIN_SCALING 1.f
+#define EXPIN_SCALING_1 1.f
+#define EXPOUT_SCALING_1 1.f
+
+static const float hypergeom_table[21] = {
+    0.82157f, 1.02017f, 1.20461f, 1.37534f, 1.53363f, 1.68092f, 1.81865f,
+    1.94811f, 2.07038f, 2.18638f, 2.29688f, 2.40255f, 2.50391f, 2.60144f,
+    2.69551f, 2.78647f, 2.87458f, 2.96015f, 3.04333f, 3.12431f, 3.20326f};
+
+/* This function approximates the gain function
+   y = gamma(1.25)^2 * M(-.25;1;-x) / sqrt(x)
+   which multiplied by xi/(1+xi) is the optimal gain
+   in the loudness domain ( sqrt[amplitude] )
+*/
+static inline spx_word32_t hypergeom_gain(spx_word32_t xx)
+{
+    int ind;
+    float integer, frac;
+    float x;
+    x       = EXPIN_SCALING_1 * xx;
+    integer = floor(2 * x);
+    ind     = (int)integer;
+    if (ind < 0)
+        return FRAC_SCALING;
+    if (ind > 19)
+        return FRAC_SCALING * (1 + .1296 / x);
+    frac = 2 * x - integer;
+    return FRAC_SCALING * ((1 - frac) * hypergeom_table[ind] + frac * hypergeom_table[ind + 1]) / sqrt(x + .0001f);
+}
+
+static inline spx_word16_t qcurve(spx_word16_t x)
+{
+    return 1.f / (1.f + .15f / (SNR_SCALING_1 * x));
+}
+#endif
+
+/** One implementation of every vectorised preprocessor kernel */
+typedef struct PreprocessKernels_ {
+    const char *name;
+    int level;
+    /* A posteriori SNR post and a priori SNR prior of bins/bands 0..len-1 from their power ps, the speech power
+       old_ps of the previous frame and the noise, residual echo and reverberation estimates */
+    void (*snr)(const spx_word32_t *ps, const spx_word32_t *old_ps, const spx_word32_t *noise, const spx_word32_t *echo, const spx_word32_t *reverb, spx_word16_t *post, spx_word16_t *prior, int len);
+    /* Recursive average zeta of the a priori SNR, the N linear bins smoothed across neighbours, the M bands after them not */
+    void (*zeta)(const spx_word16_t *prior, spx_word16_t *zeta, int N, int M);
+    /* Ephraim-Malah gain and speech presence probability gain2 of len Bark bands, updates old_ps */
+    void (*bark_gain)(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *zeta, spx_word16_t Pframe, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len);
+    /* Ephraim-Malah gain of len linear bins, updates old_ps. gain and gain2 come in as the Bark gain and speech
+       presence probability interpolated to the bins; gain leaves floored, gain2 as the gain to apply */
+    void (*linear_gain)(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *gain_floor, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len);
+    /* Bands mel of the bins ps, as filterbank_compute_bank32 */
+    void (*bank32)(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel);
+    /* Bins psd[k] of the bands mel[k] for k < count, as filterbank_compute_psd16 on each but in a single pass
+       over the bank */
+    void (*psd16)(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count);
+} PreprocessKernels;
+
+/** Best kernel set the running CPU supports, capped at max_level */
+const PreprocessKernels *preprocess_kernels_select(int max_level);
+
+extern const PreprocessKernels preprocess_kernels_c;
+#ifdef MDF_KERNELS_X86
+extern const PreprocessKernels preprocess_kernels_sse41;
+extern const PreprocessKernels preprocess_kernels_avx2;
+#endif
+
+/* The helpers below finish whatever a SIMD loop left over, starting at bin i */
+
+static inline void preprocess_snr_tail(const spx_word32_t *ps, const spx_word32_t *old_ps, const spx_word32_t *noise, const spx_word32_t *echo, const spx_word32_t *reverb, spx_word16_t *post, spx_word16_t *prior, int i, int len)
+{
+    for (; i < len; i++) {
+        spx_word16_t gamma;
+
+        /* Total noise estimate including residual echo and reverberation */
+        spx_word32_t tot_noise = ADD32(ADD32(ADD32(EXTEND32(1), PSHR32(noise[i], NOISE_SHIFT)), echo[i]), reverb[i]);
+
+        /* A posteriori SNR = ps/noise - 1*/
+        post[i] = SUB16(DIV32_16_Q8(ps[i], tot_noise), QCONST16(1.f, SNR_SHIFT));
+        post[i] = MIN16(post[i], QCONST16(100.f, SNR_SHIFT));
+
+        /* Computing update gamma = .1 + .9*(old/(old+noise))^2 */
+        gamma = QCONST16(.1f, 15) + MULT16_16_Q15(QCONST16(.89f, 15), SQR16_Q15(DIV32_16_Q15(old_ps[i], ADD32(old_ps[i], tot_noise))));
+
+        /* A priori SNR update = gamma*max(0,post) + (1-gamma)*old/noise */
+        prior[i] = EXTRACT16(PSHR32(ADD32(MULT16_16(gamma, MAX16(0, post[i])), MULT16_16(Q15_ONE - gamma, DIV32_16_Q8(old_ps[i], tot_noise))), 15));
+        prior[i] = MIN16(prior[i], QCONST16(100.f, SNR_SHIFT));
+    }
+}
+
+/* Bins i..last-1 of the linear part (0 < i, last <= N-1), a bit smoothed across neighbours */
+static inline void preprocess_zeta_smooth_tail(const spx_word16_t *prior, spx_word16_t *zeta, int i, int last)
+{
+    for (; i < last; i++)
+        zeta[i] = PSHR32(ADD32(ADD32(ADD32(MULT16_16(QCONST16(.7f, 15), zeta[i]), MULT16_16(QCONST16(.15f, 15), prior[i])),
+                                     MULT16_16(QCONST16(.075f, 15), prior[i - 1])),
+                               MULT16_16(QCONST16(.075f, 15), prior[i + 1])),
+                         15);
+}
+
+static inline void preprocess_zeta_tail(const spx_word16_t *prior, spx_word16_t *zeta, int i, int last)
+{
+    for (; i < last; i++)
+        zeta[i] = PSHR32(ADD32(MULT16_16(QCONST16(.7f, 15), zeta[i]), MULT16_16(QCONST16(.3f, 15), prior[i])), 15);
+}
+
+/* Compute Ephraim & Malah gain speech probability of presence for each critical band (Bark scale)
+   Technically this is actually wrong because the EM gaim assumes a slightly different probability
+   distribution */
+static inline void preprocess_bark_gain_tail(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *zeta, spx_word16_t Pframe, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int i, int len)
+{
+    for (; i < len; i++) {
+        /* See EM and Cohen papers*/
+        spx_word32_t theta;
+        /* Gain from hypergeometric function */
+        spx_word32_t MM;
+        /* Weiner filter gain */
+        spx_word16_t prior_ratio;
+        /* a priority probability of speech presence based on Bark sub-band alone */
+        spx_word16_t P1;
+        /* Speech absence a priori probability (considering sub-band and frame) */
+        spx_word16_t q;
+#ifdef FIXED_POINT
+        spx_word16_t tmp;
+#endif
+
+        prior_ratio = PDIV32_16(SHL32(EXTEND32(prior[i]), 15), ADD16(prior[i], SHL32(1, SNR_SHIFT)));
+        theta       = MULT16_32_P15(prior_ratio, QCONST32(1.f, EXPIN_SHIFT) + SHL32(EXTEND32(post[i]), EXPIN_SHIFT - SNR_SHIFT));
+
+        MM = hypergeom_gain(theta);
+        /* Gain with bound */
+        gain[i] = EXTRACT16(MIN32(Q15_ONE, MULT16_32_Q15(prior_ratio, MM)));
+        /* Save old Bark power spectrum */
+        old_ps[i] = MULT16_32_P15(QCONST16(.2f, 15), old_ps[i]) + MULT16_32_P15(MULT16_16_P15(QCONST16(.8f, 15), SQR16_Q15(gain[i])), ps[i]);
+
+        P1 = QCONST16(.199f, 15) + MULT16_16_Q15(QCONST16(.8f, 15), qcurve(zeta[i]));
+        q  = Q15_ONE - MULT16_16_Q15(Pframe, P1);
+#ifdef FIXED_POINT
+        theta      = MIN32(theta, EXTEND32(32767));
+        /*Q8*/ tmp = MULT16_16_Q15((SHL32(1, SNR_SHIFT) + prior[i]), EXTRACT16(MIN32(Q15ONE, SHR32(spx_exp(-EXTRACT16(theta)), 1))));
+        tmp        = MIN16(QCONST16(3., SNR_SHIFT), tmp); /* Prevent overflows in the next line*/
+        /*Q8*/ tmp = EXTRACT16(PSHR32(MULT16_16(PDIV32_16(SHL32(EXTEND32(q), 8), (Q15_ONE - q)), tmp), 8));
+        gain2[i]   = DIV32_16(SHL32(EXTEND32(32767), SNR_SHIFT), ADD16(256, tmp));
+#else
+        gain2[i] = 1 / (1.f + (q / (1.f - q)) * (1 + prior[i]) * exp(-theta));
+#endif
+    }
+}
+
+/* Compute gain according to the Ephraim-Malah algorithm -- linear frequency */
+static inline void preprocess_linear_gain_tail(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *gain_floor, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int i, int len)
+{
+    for (; i < len; i++) {
+        spx_word32_t MM;
+        spx_word32_t theta;
+        spx_word16_t prior_ratio;
+        spx_word16_t tmp;
+        spx_word16_t p;
+        spx_word16_t g;
+
+        /* Wiener filter gain */
+        prior_ratio = PDIV32_16(SHL32(EXTEND32(prior[i]), 15), ADD16(prior[i], SHL32(1, SNR_SHIFT)));
+        theta       = MULT16_32_P15(prior_ratio, QCONST32(1.f, EXPIN_SHIFT) + SHL32(EXTEND32(post[i]), EXPIN_SHIFT - SNR_SHIFT));
+
+        /* Optimal estimator for loudness domain */
+        MM = hypergeom_gain(theta);
+        /* EM gain with bound */
+        g = EXTRACT16(MIN32(Q15_ONE, MULT16_32_Q15(prior_ratio, MM)));
+        /* Interpolated speech probability of presence */
+        p = gain2[i];
+
+        /* Constrain the gain to be close to the Bark scale gain */
+        if (MULT16_16_Q15(QCONST16(.333f, 15), g) > gain[i])
+            g = MULT16_16(3, gain[i]);
+        gain[i] = g;
+
+        /* Save old power spectrum */
+        old_ps[i] = MULT16_32_P15(QCONST16(.2f, 15), old_ps[i]) + MULT16_32_P15(MULT16_16_P15(QCONST16(.8f, 15), SQR16_Q15(gain[i])), ps[i]);
+
+        /* Apply gain floor */
+        if (gain[i] < gain_floor[i])
+            gain[i] = gain_floor[i];
+
+        /* Exponential decay model for reverberation (unused) */
+        /*st->reverb_estimate[i] = st->reverb_decay*st->reverb_estimate[i] + st->reverb_decay*st->reverb_level*st->gain[i]*st->gain[i]*st->ps[i];*/
+
+        /* Take into account speech probability of presence (loudness domain MMSE estimator) */
+        /* gain2 = [p*sqrt(gain)+(1-p)*sqrt(gain _floor) ]^2 */
+        tmp      = MULT16_16_P15(p, spx_sqrt(SHL32(EXTEND32(gain[i]), 15))) + MULT16_16_P15(SUB16(Q15_ONE, p), spx_sqrt(SHL32(EXTEND32(gain_floor[i]), 15)));
+        gain2[i] = SQR16_Q15(tmp);
+
+        /* Use this if you want a log-domain MMSE estimator instead */
+        /*st->gain2[i] = pow(st->gain[i], p) * pow(st->gain_floor[i],1.f-p);*/
+    }
+}
+
+/* Bins i..end-1 of band b into the sums of b and b+1 */
+static inline void preprocess_bank32_band_tail(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *left, spx_word32_t *right, int i, int end)
+{
+    for (; i < end; i++) {
+        *left += MULT16_32_P15(bank->filter_left[i], ps[i]);
+        *right += MULT16_32_P15(bank->filter_right[i], ps[i]);
+    }
+}
+
+/* Bins past the last band, if the Bark scale ran out before len (see filterbank_new) */
+static inline void preprocess_bank32_tail(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel)
+{
+    int i;
+    for (i = bank->band_start[bank->nb_banks - 1]; i < bank->len; i++) {
+        mel[bank->bank_left[i]] += MULT16_32_P15(bank->filter_left[i], ps[i]);
+        mel[bank->bank_right[i]] += MULT16_32_P15(bank->filter_right[i], ps[i]);
+    }
+}
+
+/* Bins i..end-1 of band b, from the bands b and b+1 of every mel[k] */
+static inline void preprocess_psd16_band_tail(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count, int b, int i, int end)
+{
+    int j, k;
+    for (k = 0; k < count; k++) {
+        spx_word16_t mel1 = mel[k][b], mel2 = mel[k][b + 1];
+        spx_word16_t *out = psd[k];
+        for (j = i; j < end; j++)
+            out[j] = EXTRACT16(PSHR32(ADD32(MULT16_16(mel1, bank->filter_left[j]), MULT16_16(mel2, bank->filter_right[j])), 15));
+    }
+}
+
+static inline void preprocess_psd16_tail(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count)
+{
+    int i, k;
+    for (i = bank->band_start[bank->nb_banks - 1]; i < bank->len; i++) {
+        for (k = 0; k < count; k++)
+            psd[k][i] = EXTRACT16(PSHR32(ADD32(MULT16_16(mel[k][bank->bank_left[i]], bank->filter_left[i]), MULT16_16(mel[k][bank->bank_right[i]], bank->filter_right[i])), 15));
+    }
+}
+
+#endif
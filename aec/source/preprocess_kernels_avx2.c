@@ -0,0 +1,540 @@
+/*
+   File: preprocess_kernels_avx2.c
+   AVX2 preprocessor kernels, 8 bins per vector. Fixed point keeps every bin in a 32-bit lane, except for the
+   16 bins per vector interpolating the filter bank.
+   FMA is deliberately not enabled so the float products round like the scalar code.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "preprocess_kernels.h"
+
+#ifdef MDF_KERNELS_X86
+#include <immintrin.h>
+
+#define PRE_TARGET __attribute__((target("avx2")))
+
+#ifdef FIXED_POINT
+static inline PRE_TARGET __m256i load16_avx2(const spx_word16_t *x)
+{
+    return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)x));
+}
+
+/* Lanes must already hold 16-bit values */
+static inline PRE_TARGET void store16_avx2(spx_word16_t *x, __m256i v)
+{
+    _mm_storeu_si128((__m128i *)x, _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+/* (spx_word16_t) cast of every lane */
+static inline PRE_TARGET __m256i ext16_avx2(__m256i x)
+{
+    return _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16);
+}
+
+static inline PRE_TARGET __m256i mult16_32_q15_avx2(__m256i a, __m256i b)
+{
+    return _mm256_add_epi32(_mm256_mullo_epi32(a, _mm256_srai_epi32(b, 15)), _mm256_srai_epi32(_mm256_mullo_epi32(a, _mm256_and_si256(b, _mm256_set1_epi32(0x7fff))), 15));
+}
+
+static inline PRE_TARGET __m256i mult16_32_p15_avx2(__m256i a, __m256i b)
+{
+    __m256i lo = _mm256_add_epi32(_mm256_mullo_epi32(a, _mm256_and_si256(b, _mm256_set1_epi32(0x7fff))), _mm256_set1_epi32(16384));
+    return _mm256_add_epi32(_mm256_mullo_epi32(a, _mm256_srai_epi32(b, 15)), _mm256_srai_epi32(lo, 15));
+}
+
+/* a / b truncated like C, exact while |a / b| < 2^23 and b != 0: the float quotient is then off by at most
+   one and the remainder tells which way */
+static inline PRE_TARGET __m256i div_avx2(__m256i a, __m256i b)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i ua        = _mm256_abs_epi32(a);
+    __m256i ub        = _mm256_abs_epi32(b);
+    __m256i q         = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(ua), _mm256_cvtepi32_ps(ub)));
+    __m256i r         = _mm256_sub_epi32(ua, _mm256_mullo_epi32(q, ub));
+    q                 = _mm256_add_epi32(q, _mm256_cmpgt_epi32(_mm256_setzero_si256(), r));
+    q                 = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(r, _mm256_sub_epi32(ub, one)));
+    return _mm256_sign_epi32(q, _mm256_or_si256(_mm256_xor_si256(a, b), one));
+}
+
+/* DIV32_16 and PDIV32_16 */
+static inline PRE_TARGET __m256i div32_16_avx2(__m256i a, __m256i b)
+{
+    return ext16_avx2(div_avx2(a, ext16_avx2(b)));
+}
+
+static inline PRE_TARGET __m256i pdiv32_16_avx2(__m256i a, __m256i b)
+{
+    b = ext16_avx2(b);
+    return ext16_avx2(div_avx2(_mm256_add_epi32(a, _mm256_srai_epi32(b, 1)), b));
+}
+
+/* Brings b below 2^15 like DIV32_16_Q8/DIV32_16_Q15, shifting a along */
+static inline PRE_TARGET void div_normalize_avx2(__m256i *a, __m256i *b)
+{
+    __m256i m = _mm256_cmpgt_epi32(*b, _mm256_set1_epi32(QCONST32(1, 23) - 1));
+    *a        = _mm256_blendv_epi8(*a, _mm256_srai_epi32(*a, 8), m);
+    *b        = _mm256_blendv_epi8(*b, _mm256_srai_epi32(*b, 8), m);
+    m         = _mm256_cmpgt_epi32(*b, _mm256_set1_epi32(QCONST32(1, 19) - 1));
+    *a        = _mm256_blendv_epi8(*a, _mm256_srai_epi32(*a, 4), m);
+    *b        = _mm256_blendv_epi8(*b, _mm256_srai_epi32(*b, 4), m);
+    m         = _mm256_cmpgt_epi32(*b, _mm256_set1_epi32(QCONST32(1, 15) - 1));
+    *a        = _mm256_blendv_epi8(*a, _mm256_srai_epi32(*a, 4), m);
+    *b        = _mm256_blendv_epi8(*b, _mm256_srai_epi32(*b, 4), m);
+}
+
+static inline PRE_TARGET __m256i div32_16_q8_avx2(__m256i a, __m256i b)
+{
+    __m256i sat = _mm256_cmpgt_epi32(_mm256_srai_epi32(a, 7), _mm256_sub_epi32(b, _mm256_set1_epi32(1)));
+    div_normalize_avx2(&a, &b);
+    return _mm256_blendv_epi8(pdiv32_16_avx2(_mm256_slli_epi32(a, 8), b), _mm256_set1_epi32(32767), sat);
+}
+
+static inline PRE_TARGET __m256i div32_16_q15_avx2(__m256i a, __m256i b)
+{
+    __m256i sat = _mm256_cmpgt_epi32(_mm256_srai_epi32(a, 15), _mm256_sub_epi32(b, _mm256_set1_epi32(1)));
+    div_normalize_avx2(&a, &b);
+    return _mm256_blendv_epi8(div32_16_avx2(_mm256_sub_epi32(_mm256_slli_epi32(a, 15), a), b), _mm256_set1_epi32(32767), sat);
+}
+
+/* VSHR32 by a shift per lane */
+static inline PRE_TARGET __m256i vshr32_avx2(__m256i x, __m256i s)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    return _mm256_sllv_epi32(_mm256_srav_epi32(x, _mm256_max_epi32(s, zero)), _mm256_max_epi32(_mm256_sub_epi32(zero, s), zero));
+}
+
+/* spx_ilog2 of lanes below 2^31, the conversion to float may round up to the next power of two */
+static inline PRE_TARGET __m256i ilog2_avx2(__m256i x)
+{
+    __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(x)), 23), _mm256_set1_epi32(127));
+    e         = _mm256_add_epi32(e, _mm256_cmpeq_epi32(_mm256_srlv_epi32(x, e), _mm256_setzero_si256()));
+    return _mm256_max_epi32(e, _mm256_setzero_si256());
+}
+
+/* ADD16(a, MULT16_16_Q14(x, b)) */
+static inline PRE_TARGET __m256i mac16_q14_avx2(int a, __m256i x, __m256i b)
+{
+    return ext16_avx2(_mm256_add_epi32(_mm256_set1_epi32(a), _mm256_srai_epi32(_mm256_mullo_epi32(x, b), 14)));
+}
+
+static inline PRE_TARGET __m256i sqrt_avx2(__m256i x)
+{
+    __m256i k = _mm256_sub_epi32(_mm256_srai_epi32(ilog2_avx2(x), 1), _mm256_set1_epi32(6));
+    __m256i rt;
+    x  = vshr32_avx2(x, _mm256_slli_epi32(k, 1));
+    rt = mac16_q14_avx2(C2, x, _mm256_set1_epi32(C3));
+    rt = mac16_q14_avx2(C1, x, rt);
+    rt = mac16_q14_avx2(C0, x, rt);
+    return ext16_avx2(vshr32_avx2(rt, _mm256_sub_epi32(_mm256_set1_epi32(7), k)));
+}
+
+static inline PRE_TARGET __m256i exp_avx2(__m256i x)
+{
+    __m256i y       = ext16_avx2(_mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(23637), x), _mm256_set1_epi32(8192)), 14));
+    __m256i integer = _mm256_srai_epi32(y, 11);
+    __m256i frac    = ext16_avx2(_mm256_slli_epi32(_mm256_sub_epi32(y, _mm256_slli_epi32(integer, 11)), 3));
+    __m256i r;
+    r = mac16_q14_avx2(D2, frac, _mm256_set1_epi32(D3));
+    r = mac16_q14_avx2(D1, frac, r);
+    r = mac16_q14_avx2(D0, frac, r);
+    r = vshr32_avx2(r, _mm256_sub_epi32(_mm256_set1_epi32(-2), integer));
+    /* Out of range inputs wrap y, so their clamps go last */
+    r = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(-15), integer), r);
+    r = _mm256_blendv_epi8(r, _mm256_set1_epi32(0x7fffffff), _mm256_or_si256(_mm256_cmpgt_epi32(integer, _mm256_set1_epi32(14)), _mm256_cmpgt_epi32(x, _mm256_set1_epi32(21290))));
+    return _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(-21290), x), r);
+}
+
+static inline PRE_TARGET __m256i hypergeom_gain_avx2(__m256i xx)
+{
+    __m256i ind  = _mm256_srai_epi32(xx, 10);
+    __m256i idx  = _mm256_min_epi32(_mm256_max_epi32(ind, _mm256_setzero_si256()), _mm256_set1_epi32(19));
+    __m256i frac = ext16_avx2(_mm256_slli_epi32(_mm256_sub_epi32(xx, _mm256_slli_epi32(ind, 10)), 5));
+    /* 32 bits at entry idx are the two table points around xx */
+    __m256i t   = _mm256_i32gather_epi32((const int *)hypergeom_table, idx, 2);
+    __m256i num = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_set1_epi32(Q15_ONE), frac), ext16_avx2(t)), _mm256_mullo_epi32(frac, _mm256_srai_epi32(t, 16)));
+    __m256i g;
+    num = _mm256_srai_epi32(_mm256_add_epi32(num, _mm256_set1_epi32(64)), 7);
+    g   = _mm256_slli_epi32(div32_16_avx2(num, sqrt_avx2(_mm256_add_epi32(_mm256_slli_epi32(xx, 15), _mm256_set1_epi32(6711)))), 7);
+    g   = _mm256_blendv_epi8(g, _mm256_add_epi32(_mm256_set1_epi32(Q15_ONE), div32_16_avx2(_mm256_set1_epi32(QCONST32(.1296, 23)), _mm256_srai_epi32(xx, EXPIN_SHIFT - SNR_SHIFT))), _mm256_cmpgt_epi32(ind, _mm256_set1_epi32(19)));
+    return _mm256_blendv_epi8(g, _mm256_set1_epi32(Q15_ONE), _mm256_cmpgt_epi32(_mm256_setzero_si256(), ind));
+}
+
+static inline PRE_TARGET __m256i qcurve_avx2(__m256i x)
+{
+    x = _mm256_max_epi32(x, _mm256_set1_epi32(1));
+    x = ext16_avx2(_mm256_add_epi32(_mm256_set1_epi32(512), _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(QCONST16(.60f, 15)), div32_16_avx2(_mm256_set1_epi32(32767), x)), 15)));
+    return div32_16_avx2(_mm256_set1_epi32(32767 << 9), x);
+}
+
+/* Wiener gain prior/(1+prior) and theta of the hypergeometric gain */
+static inline PRE_TARGET __m256i prior_ratio_avx2(__m256i prior, __m256i post, __m256i *theta)
+{
+    __m256i prior_ratio = pdiv32_16_avx2(_mm256_slli_epi32(prior, 15), _mm256_add_epi32(prior, _mm256_set1_epi32(1 << SNR_SHIFT)));
+    *theta              = mult16_32_p15_avx2(prior_ratio, _mm256_add_epi32(_mm256_set1_epi32(QCONST32(1.f, EXPIN_SHIFT)), _mm256_slli_epi32(post, EXPIN_SHIFT - SNR_SHIFT)));
+    return prior_ratio;
+}
+
+/* old_ps of a bin or band from its gain */
+static inline PRE_TARGET __m256i old_ps_avx2(__m256i old_ps, __m256i gain, __m256i ps)
+{
+    __m256i g2 = _mm256_srai_epi32(_mm256_mullo_epi32(gain, gain), 15);
+    g2         = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(QCONST16(.8f, 15)), g2), _mm256_set1_epi32(16384)), 15);
+    return _mm256_add_epi32(mult16_32_p15_avx2(_mm256_set1_epi32(QCONST16(.2f, 15)), old_ps), mult16_32_p15_avx2(g2, ps));
+}
+
+static PRE_TARGET void preprocess_snr_avx2(const spx_word32_t *ps, const spx_word32_t *old_ps, const spx_word32_t *noise, const spx_word32_t *echo, const spx_word32_t *reverb, spx_word16_t *post, spx_word16_t *prior, int len)
+{
+    const __m256i max_snr = _mm256_set1_epi32(QCONST16(100.f, SNR_SHIFT));
+    int i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i old = _mm256_loadu_si256((const __m256i *)(old_ps + i));
+        __m256i tot = _mm256_srai_epi32(_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(noise + i)), _mm256_set1_epi32(1 << (NOISE_SHIFT - 1))), NOISE_SHIFT);
+        __m256i p, gamma, d;
+        tot   = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(tot, _mm256_set1_epi32(1)), _mm256_loadu_si256((const __m256i *)(echo + i))), _mm256_loadu_si256((const __m256i *)(reverb + i)));
+        p     = ext16_avx2(_mm256_sub_epi32(div32_16_q8_avx2(_mm256_loadu_si256((const __m256i *)(ps + i)), tot), _mm256_set1_epi32(QCONST16(1.f, SNR_SHIFT))));
+        p     = _mm256_min_epi32(p, max_snr);
+        d     = div32_16_q15_avx2(old, _mm256_add_epi32(old, tot));
+        gamma = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(QCONST16(.89f, 15)), _mm256_srai_epi32(_mm256_mullo_epi32(d, d), 15)), 15);
+        gamma = ext16_avx2(_mm256_add_epi32(gamma, _mm256_set1_epi32(QCONST16(.1f, 15))));
+        d     = _mm256_add_epi32(_mm256_mullo_epi32(gamma, _mm256_max_epi32(p, _mm256_setzero_si256())),
+                                 _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_set1_epi32(Q15_ONE), gamma), div32_16_q8_avx2(old, tot)));
+        d     = ext16_avx2(_mm256_srai_epi32(_mm256_add_epi32(d, _mm256_set1_epi32(16384)), 15));
+        store16_avx2(post + i, p);
+        store16_avx2(prior + i, _mm256_min_epi32(d, max_snr));
+    }
+    preprocess_snr_tail(ps, old_ps, noise, echo, reverb, post, prior, i, len);
+}
+
+static PRE_TARGET void preprocess_zeta_avx2(const spx_word16_t *prior, spx_word16_t *zeta, int N, int M)
+{
+    const __m256i c7 = _mm256_set1_epi32(QCONST16(.7f, 15)), c3 = _mm256_set1_epi32(QCONST16(.3f, 15));
+    const __m256i c15 = _mm256_set1_epi32(QCONST16(.15f, 15)), c075 = _mm256_set1_epi32(QCONST16(.075f, 15));
+    const __m256i round = _mm256_set1_epi32(16384);
+    int i;
+    zeta[0] = PSHR32(ADD32(MULT16_16(QCONST16(.7f, 15), zeta[0]), MULT16_16(QCONST16(.3f, 15), prior[0])), 15);
+    for (i = 1; i + 8 <= N - 1; i += 8) {
+        __m256i z = _mm256_mullo_epi32(c7, load16_avx2(zeta + i));
+        z         = _mm256_add_epi32(z, _mm256_mullo_epi32(c15, load16_avx2(prior + i)));
+        z         = _mm256_add_epi32(z, _mm256_mullo_epi32(c075, _mm256_add_epi32(load16_avx2(prior + i - 1), load16_avx2(prior + i + 1))));
+        store16_avx2(zeta + i, ext16_avx2(_mm256_srai_epi32(_mm256_add_epi32(z, round), 15)));
+    }
+    preprocess_zeta_smooth_tail(prior, zeta, i, N - 1);
+    for (i = N - 1; i + 8 <= N + M; i += 8) {
+        __m256i z = _mm256_add_epi32(_mm256_mullo_epi32(c7, load16_avx2(zeta + i)), _mm256_mullo_epi32(c3, load16_avx2(prior + i)));
+        store16_avx2(zeta + i, ext16_avx2(_mm256_srai_epi32(_mm256_add_epi32(z, round), 15)));
+    }
+    preprocess_zeta_tail(prior, zeta, i, N + M);
+}
+
+static PRE_TARGET void preprocess_bark_gain_avx2(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *zeta, spx_word16_t Pframe, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    const __m256i one = _mm256_set1_epi32(Q15_ONE);
+    int i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i pr = load16_avx2(prior + i);
+        __m256i theta, prior_ratio, g, P1, q, tmp;
+        prior_ratio = prior_ratio_avx2(pr, load16_avx2(post + i), &theta);
+        g           = ext16_avx2(_mm256_min_epi32(one, mult16_32_q15_avx2(prior_ratio, hypergeom_gain_avx2(theta))));
+        store16_avx2(gain + i, g);
+        _mm256_storeu_si256((__m256i *)(old_ps + i), old_ps_avx2(_mm256_loadu_si256((const __m256i *)(old_ps + i)), g, _mm256_loadu_si256((const __m256i *)(ps + i))));
+
+        P1    = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(QCONST16(.8f, 15)), qcurve_avx2(load16_avx2(zeta + i))), 15);
+        P1    = ext16_avx2(_mm256_add_epi32(_mm256_set1_epi32(QCONST16(.199f, 15)), P1));
+        q     = ext16_avx2(_mm256_sub_epi32(one, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(Pframe), P1), 15)));
+        theta = ext16_avx2(_mm256_min_epi32(theta, one));
+        tmp   = ext16_avx2(_mm256_min_epi32(one, _mm256_srai_epi32(exp_avx2(ext16_avx2(_mm256_sub_epi32(_mm256_setzero_si256(), theta))), 1)));
+        tmp   = ext16_avx2(_mm256_srai_epi32(_mm256_mullo_epi32(ext16_avx2(_mm256_add_epi32(pr, _mm256_set1_epi32(1 << SNR_SHIFT))), tmp), 15));
+        tmp   = _mm256_min_epi32(tmp, _mm256_set1_epi32(QCONST16(3., SNR_SHIFT)));
+        tmp   = _mm256_mullo_epi32(pdiv32_16_avx2(_mm256_slli_epi32(q, 8), _mm256_sub_epi32(one, q)), tmp);
+        tmp   = ext16_avx2(_mm256_srai_epi32(_mm256_add_epi32(tmp, _mm256_set1_epi32(128)), 8));
+        store16_avx2(gain2 + i, div32_16_avx2(_mm256_set1_epi32(32767 << SNR_SHIFT), _mm256_add_epi32(_mm256_set1_epi32(256), tmp)));
+    }
+    preprocess_bark_gain_tail(prior, post, zeta, Pframe, ps, old_ps, gain, gain2, i, len);
+}
+
+static PRE_TARGET void preprocess_linear_gain_avx2(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *gain_floor, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    const __m256i one   = _mm256_set1_epi32(Q15_ONE);
+    const __m256i round = _mm256_set1_epi32(16384);
+    int i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i theta, prior_ratio, g, gb, p, fl, tmp;
+        prior_ratio = prior_ratio_avx2(load16_avx2(prior + i), load16_avx2(post + i), &theta);
+        g           = ext16_avx2(_mm256_min_epi32(one, mult16_32_q15_avx2(prior_ratio, hypergeom_gain_avx2(theta))));
+
+        /* Constrain the gain to be close to the Bark scale gain */
+        gb = load16_avx2(gain + i);
+        g  = _mm256_blendv_epi8(g, ext16_avx2(_mm256_mullo_epi32(_mm256_set1_epi32(3), gb)),
+                                _mm256_cmpgt_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(QCONST16(.333f, 15)), g), 15), gb));
+        _mm256_storeu_si256((__m256i *)(old_ps + i), old_ps_avx2(_mm256_loadu_si256((const __m256i *)(old_ps + i)), g, _mm256_loadu_si256((const __m256i *)(ps + i))));
+
+        fl = load16_avx2(gain_floor + i);
+        g  = _mm256_max_epi32(g, fl);
+        store16_avx2(gain + i, g);
+
+        p   = load16_avx2(gain2 + i);
+        tmp = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(p, sqrt_avx2(_mm256_slli_epi32(g, 15))), round), 15);
+        tmp = _mm256_add_epi32(tmp, _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(one, p), sqrt_avx2(_mm256_slli_epi32(fl, 15))), round), 15));
+        tmp = ext16_avx2(tmp);
+        store16_avx2(gain2 + i, _mm256_srai_epi32(_mm256_mullo_epi32(tmp, tmp), 15));
+    }
+    preprocess_linear_gain_tail(prior, post, gain_floor, ps, old_ps, gain, gain2, i, len);
+}
+
+static inline PRE_TARGET spx_word32_t hsum_avx2(__m256i x)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    s         = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s         = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+static PRE_TARGET void preprocess_bank32_avx2(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel)
+{
+    const int *start   = bank->band_start;
+    spx_word32_t carry = 0;
+    int b, i;
+    for (b = 0; b < bank->nb_banks - 1; b++) {
+        spx_word32_t left = carry, right = 0;
+        i = start[b];
+        if (i + 8 <= start[b + 1]) {
+            __m256i l = _mm256_setzero_si256(), r = _mm256_setzero_si256();
+            for (; i + 8 <= start[b + 1]; i += 8) {
+                __m256i p = _mm256_loadu_si256((const __m256i *)(ps + i));
+                l         = _mm256_add_epi32(l, mult16_32_p15_avx2(load16_avx2(bank->filter_left + i), p));
+                r         = _mm256_add_epi32(r, mult16_32_p15_avx2(load16_avx2(bank->filter_right + i), p));
+            }
+            left += hsum_avx2(l);
+            right += hsum_avx2(r);
+        }
+        preprocess_bank32_band_tail(bank, ps, &left, &right, i, start[b + 1]);
+        mel[b] = left;
+        carry  = right;
+    }
+    mel[b] = carry;
+    preprocess_bank32_tail(bank, ps, mel);
+}
+
+/* Both bands of a bin in one 32-bit lane, for madd against its interleaved weights */
+static inline int band_pair_avx2(const spx_word16_t *mel, int b)
+{
+    return (int)(((unsigned)(unsigned short)mel[b + 1] << 16) | (unsigned short)mel[b]);
+}
+
+static inline PRE_TARGET __m128i psd16_pair128_avx2(__m128i w, __m128i m)
+{
+    return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(w, m), _mm_set1_epi32(16384)), 15);
+}
+
+static inline PRE_TARGET __m256i psd16_pair_avx2(__m256i w, __m256i m)
+{
+    return _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(w, m), _mm256_set1_epi32(16384)), 15);
+}
+
+/* 16 bins per vector, then 8 and 4 at the end of a band when they fit. The packs keep the bin order as
+   unpack and pack both work within 128-bit halves. */
+static PRE_TARGET void preprocess_psd16_avx2(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count)
+{
+    const int *start = bank->band_start;
+    int b, i, k;
+    for (b = 0; b < bank->nb_banks - 1; b++) {
+        for (i = start[b]; i + 16 <= start[b + 1]; i += 16) {
+            __m256i fl = _mm256_loadu_si256((const __m256i *)(bank->filter_left + i));
+            __m256i fr = _mm256_loadu_si256((const __m256i *)(bank->filter_right + i));
+            __m256i lo = _mm256_unpacklo_epi16(fl, fr), hi = _mm256_unpackhi_epi16(fl, fr);
+            for (k = 0; k < count; k++) {
+                __m256i m = _mm256_set1_epi32(band_pair_avx2(mel[k], b));
+                _mm256_storeu_si256((__m256i *)(psd[k] + i), _mm256_packs_epi32(psd16_pair_avx2(lo, m), psd16_pair_avx2(hi, m)));
+            }
+        }
+        if (i + 8 <= start[b + 1]) {
+            __m128i fl = _mm_loadu_si128((const __m128i *)(bank->filter_left + i));
+            __m128i fr = _mm_loadu_si128((const __m128i *)(bank->filter_right + i));
+            __m128i lo = _mm_unpacklo_epi16(fl, fr), hi = _mm_unpackhi_epi16(fl, fr);
+            for (k = 0; k < count; k++) {
+                __m128i m = _mm_set1_epi32(band_pair_avx2(mel[k], b));
+                _mm_storeu_si128((__m128i *)(psd[k] + i), _mm_packs_epi32(psd16_pair128_avx2(lo, m), psd16_pair128_avx2(hi, m)));
+            }
+            i += 8;
+        }
+        if (i + 4 <= start[b + 1]) {
+            __m128i w = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(bank->filter_left + i)), _mm_loadl_epi64((const __m128i *)(bank->filter_right + i)));
+            for (k = 0; k < count; k++) {
+                __m128i v = psd16_pair128_avx2(w, _mm_set1_epi32(band_pair_avx2(mel[k], b)));
+                _mm_storel_epi64((__m128i *)(psd[k] + i), _mm_packs_epi32(v, v));
+            }
+            i += 4;
+        }
+        preprocess_psd16_band_tail(bank, mel, psd, count, b, i, start[b + 1]);
+    }
+    preprocess_psd16_tail(bank, mel, psd, count);
+}
+
+#else
+/* exp(x) as 2^n * e^r with |r| <= ln(2)/2, relative error below 2e-7 down to the smallest normal float */
+static inline PRE_TARGET __m256 exp_avx2(__m256 x)
+{
+    __m256 n, r, y;
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+    n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(0.693359375f))), _mm256_mul_ps(n, _mm256_set1_ps(-2.12194440e-4f)));
+    y = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(1.9875691500e-4f), r), _mm256_set1_ps(1.3981999507e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(8.3334519073e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(4.1665795894e-2f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(1.6666665459e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(5.0000001201e-1f));
+    y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(y, r), r), r), _mm256_set1_ps(1.f));
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)));
+}
+
+static inline PRE_TARGET __m256 hypergeom_gain_avx2(__m256 x)
+{
+    __m256 integer = _mm256_floor_ps(_mm256_mul_ps(_mm256_set1_ps(2.f), x));
+    __m256i ind    = _mm256_cvttps_epi32(integer);
+    __m256i idx    = _mm256_min_epi32(_mm256_max_epi32(ind, _mm256_setzero_si256()), _mm256_set1_epi32(19));
+    __m256 frac    = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(2.f), x), integer);
+    __m256 t0      = _mm256_i32gather_ps(hypergeom_table, idx, 4);
+    __m256 t1      = _mm256_i32gather_ps(hypergeom_table + 1, idx, 4);
+    __m256 g       = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), frac), t0), _mm256_mul_ps(frac, t1));
+    g              = _mm256_div_ps(g, _mm256_sqrt_ps(_mm256_add_ps(x, _mm256_set1_ps(.0001f))));
+    g              = _mm256_blendv_ps(g, _mm256_add_ps(_mm256_set1_ps(1.f), _mm256_div_ps(_mm256_set1_ps(.1296f), x)), _mm256_castsi256_ps(_mm256_cmpgt_epi32(ind, _mm256_set1_epi32(19))));
+    return _mm256_blendv_ps(g, _mm256_set1_ps(1.f), _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_setzero_si256(), ind)));
+}
+
+/* Wiener gain prior/(1+prior) and theta of the hypergeometric gain */
+static inline PRE_TARGET __m256 prior_ratio_avx2(__m256 prior, __m256 post, __m256 *theta)
+{
+    __m256 prior_ratio = _mm256_div_ps(prior, _mm256_add_ps(prior, _mm256_set1_ps(1.f)));
+    *theta             = _mm256_mul_ps(prior_ratio, _mm256_add_ps(_mm256_set1_ps(1.f), post));
+    return prior_ratio;
+}
+
+static inline PRE_TARGET __m256 old_ps_avx2(__m256 old_ps, __m256 gain, __m256 ps)
+{
+    return _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(.2f), old_ps), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(.8f), _mm256_mul_ps(gain, gain)), ps));
+}
+
+static PRE_TARGET void preprocess_snr_avx2(const spx_word32_t *ps, const spx_word32_t *old_ps, const spx_word32_t *noise, const spx_word32_t *echo, const spx_word32_t *reverb, spx_word16_t *post, spx_word16_t *prior, int len)
+{
+    const __m256 one = _mm256_set1_ps(1.f), max_snr = _mm256_set1_ps(100.f);
+    int i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256 old = _mm256_loadu_ps(old_ps + i);
+        __m256 tot = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(one, _mm256_loadu_ps(noise + i)), _mm256_loadu_ps(echo + i)), _mm256_loadu_ps(reverb + i));
+        __m256 p   = _mm256_min_ps(_mm256_sub_ps(_mm256_div_ps(_mm256_loadu_ps(ps + i), tot), one), max_snr);
+        __m256 d   = _mm256_div_ps(old, _mm256_add_ps(old, tot));
+        __m256 gamma;
+        gamma = _mm256_add_ps(_mm256_set1_ps(.1f), _mm256_mul_ps(_mm256_set1_ps(.89f), _mm256_mul_ps(d, d)));
+        d     = _mm256_add_ps(_mm256_mul_ps(gamma, _mm256_max_ps(_mm256_setzero_ps(), p)), _mm256_mul_ps(_mm256_sub_ps(one, gamma), _mm256_div_ps(old, tot)));
+        _mm256_storeu_ps(post + i, p);
+        _mm256_storeu_ps(prior + i, _mm256_min_ps(d, max_snr));
+    }
+    preprocess_snr_tail(ps, old_ps, noise, echo, reverb, post, prior, i, len);
+}
+
+static PRE_TARGET void preprocess_zeta_avx2(const spx_word16_t *prior, spx_word16_t *zeta, int N, int M)
+{
+    const __m256 c7 = _mm256_set1_ps(.7f), c3 = _mm256_set1_ps(.3f), c15 = _mm256_set1_ps(.15f), c075 = _mm256_set1_ps(.075f);
+    int i;
+    zeta[0] = .7f * zeta[0] + .3f * prior[0];
+    for (i = 1; i + 8 <= N - 1; i += 8) {
+        __m256 z = _mm256_add_ps(_mm256_mul_ps(c7, _mm256_loadu_ps(zeta + i)), _mm256_mul_ps(c15, _mm256_loadu_ps(prior + i)));
+        z        = _mm256_add_ps(z, _mm256_mul_ps(c075, _mm256_loadu_ps(prior + i - 1)));
+        _mm256_storeu_ps(zeta + i, _mm256_add_ps(z, _mm256_mul_ps(c075, _mm256_loadu_ps(prior + i + 1))));
+    }
+    preprocess_zeta_smooth_tail(prior, zeta, i, N - 1);
+    for (i = N - 1; i + 8 <= N + M; i += 8)
+        _mm256_storeu_ps(zeta + i, _mm256_add_ps(_mm256_mul_ps(c7, _mm256_loadu_ps(zeta + i)), _mm256_mul_ps(c3, _mm256_loadu_ps(prior + i))));
+    preprocess_zeta_tail(prior, zeta, i, N + M);
+}
+
+static PRE_TARGET void preprocess_bark_gain_avx2(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *zeta, spx_word16_t Pframe, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    int i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256 pr = _mm256_loadu_ps(prior + i);
+        __m256 theta, prior_ratio, g, P1, q;
+        prior_ratio = prior_ratio_avx2(pr, _mm256_loadu_ps(post + i), &theta);
+        g           = _mm256_min_ps(one, _mm256_mul_ps(prior_ratio, hypergeom_gain_avx2(theta)));
+        _mm256_storeu_ps(gain + i, g);
+        _mm256_storeu_ps(old_ps + i, old_ps_avx2(_mm256_loadu_ps(old_ps + i), g, _mm256_loadu_ps(ps + i)));
+
+        /* P1 = .199 + .8*qcurve(zeta) */
+        P1 = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_div_ps(_mm256_set1_ps(.15f), _mm256_loadu_ps(zeta + i))));
+        P1 = _mm256_add_ps(_mm256_set1_ps(.199f), _mm256_mul_ps(_mm256_set1_ps(.8f), P1));
+        q  = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_set1_ps(Pframe), P1));
+        q  = _mm256_mul_ps(_mm256_mul_ps(_mm256_div_ps(q, _mm256_sub_ps(one, q)), _mm256_add_ps(one, pr)), exp_avx2(_mm256_sub_ps(_mm256_setzero_ps(), theta)));
+        _mm256_storeu_ps(gain2 + i, _mm256_div_ps(one, _mm256_add_ps(one, q)));
+    }
+    preprocess_bark_gain_tail(prior, post, zeta, Pframe, ps, old_ps, gain, gain2, i, len);
+}
+
+static PRE_TARGET void preprocess_linear_gain_avx2(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *gain_floor, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    int i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256 theta, prior_ratio, g, gb, p, fl, tmp;
+        prior_ratio = prior_ratio_avx2(_mm256_loadu_ps(prior + i), _mm256_loadu_ps(post + i), &theta);
+        g           = _mm256_min_ps(one, _mm256_mul_ps(prior_ratio, hypergeom_gain_avx2(theta)));
+
+        /* Constrain the gain to be close to the Bark scale gain */
+        gb = _mm256_loadu_ps(gain + i);
+        g  = _mm256_blendv_ps(g, _mm256_mul_ps(_mm256_set1_ps(3.f), gb), _mm256_cmp_ps(_mm256_mul_ps(_mm256_set1_ps(.333f), g), gb, _CMP_GT_OQ));
+        _mm256_storeu_ps(old_ps + i, old_ps_avx2(_mm256_loadu_ps(old_ps + i), g, _mm256_loadu_ps(ps + i)));
+
+        fl = _mm256_loadu_ps(gain_floor + i);
+        g  = _mm256_max_ps(fl, g);
+        _mm256_storeu_ps(gain + i, g);
+
+        p   = _mm256_loadu_ps(gain2 + i);
+        tmp = _mm256_add_ps(_mm256_mul_ps(p, _mm256_sqrt_ps(g)), _mm256_mul_ps(_mm256_sub_ps(one, p), _mm256_sqrt_ps(fl)));
+        _mm256_storeu_ps(gain2 + i, _mm256_mul_ps(tmp, tmp));
+    }
+    preprocess_linear_gain_tail(prior, post, gain_floor, ps, old_ps, gain, gain2, i, len);
+}
+
+static void preprocess_bank32_avx2(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel)
+{
+    filterbank_compute_bank32(bank, ps, mel);
+}
+
+/* 8 bins per vector, 4 in the last one of a band when they fit */
+static PRE_TARGET void preprocess_psd16_avx2(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count)
+{
+    const int *start = bank->band_start;
+    int b, i, k;
+    for (b = 0; b < bank->nb_banks - 1; b++) {
+        for (i = start[b]; i + 8 <= start[b + 1]; i += 8) {
+            __m256 fl = _mm256_loadu_ps(bank->filter_left + i), fr = _mm256_loadu_ps(bank->filter_right + i);
+            for (k = 0; k < count; k++)
+                _mm256_storeu_ps(psd[k] + i, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(mel[k][b]), fl), _mm256_mul_ps(_mm256_set1_ps(mel[k][b + 1]), fr)));
+        }
+        if (i + 4 <= start[b + 1]) {
+            __m128 fl = _mm_loadu_ps(bank->filter_left + i), fr = _mm_loadu_ps(bank->filter_right + i);
+            for (k = 0; k < count; k++)
+                _mm_storeu_ps(psd[k] + i, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mel[k][b]), fl), _mm_mul_ps(_mm_set1_ps(mel[k][b + 1]), fr)));
+            i += 4;
+        }
+        preprocess_psd16_band_tail(bank, mel, psd, count, b, i, start[b + 1]);
+    }
+    preprocess_psd16_tail(bank, mel, psd, count);
+}
+#endif
+
+const PreprocessKernels preprocess_kernels_avx2 = {
+    "avx2",
+    MDF_KERNEL_AVX2,
+    preprocess_snr_avx2,
+    preprocess_zeta_avx2,
+    preprocess_bark_gain_avx2,
+    preprocess_linear_gain_avx2,
+    preprocess_bank32_avx2,
+    preprocess_psd16_avx2,
+};
+
+#endif
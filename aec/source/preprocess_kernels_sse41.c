@@ -0,0 +1,379 @@
+/*
+   File: preprocess_kernels_sse41.c
+   SSE4.1 preprocessor kernels, 4 bins per vector. SSE4.1 has neither per-lane shifts nor gathers, which the
+   fixed-point spx_sqrt, spx_exp and hypergeometric table need, so the fixed-point gains stay scalar here.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "preprocess_kernels.h"
+
+#ifdef MDF_KERNELS_X86
+#include <immintrin.h>
+
+#define PRE_TARGET __attribute__((target("sse4.1")))
+
+#ifdef FIXED_POINT
+static inline PRE_TARGET __m128i load16_sse41(const spx_word16_t *x)
+{
+    return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)x));
+}
+
+/* Lanes must already hold 16-bit values */
+static inline PRE_TARGET void store16_sse41(spx_word16_t *x, __m128i v)
+{
+    _mm_storel_epi64((__m128i *)x, _mm_packs_epi32(v, v));
+}
+
+static inline PRE_TARGET __m128i ext16_sse41(__m128i x)
+{
+    return _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+}
+
+/* a / b truncated like C, exact while |a / b| < 2^23 and b != 0 */
+static inline PRE_TARGET __m128i div_sse41(__m128i a, __m128i b)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i ua        = _mm_abs_epi32(a);
+    __m128i ub        = _mm_abs_epi32(b);
+    __m128i q         = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(ua), _mm_cvtepi32_ps(ub)));
+    __m128i r         = _mm_sub_epi32(ua, _mm_mullo_epi32(q, ub));
+    q                 = _mm_add_epi32(q, _mm_cmplt_epi32(r, _mm_setzero_si128()));
+    q                 = _mm_sub_epi32(q, _mm_cmpgt_epi32(r, _mm_sub_epi32(ub, one)));
+    return _mm_sign_epi32(q, _mm_or_si128(_mm_xor_si128(a, b), one));
+}
+
+static inline PRE_TARGET __m128i div32_16_sse41(__m128i a, __m128i b)
+{
+    return ext16_sse41(div_sse41(a, ext16_sse41(b)));
+}
+
+static inline PRE_TARGET __m128i pdiv32_16_sse41(__m128i a, __m128i b)
+{
+    b = ext16_sse41(b);
+    return ext16_sse41(div_sse41(_mm_add_epi32(a, _mm_srai_epi32(b, 1)), b));
+}
+
+/* Brings b below 2^15 like DIV32_16_Q8/DIV32_16_Q15, shifting a along */
+static inline PRE_TARGET void div_normalize_sse41(__m128i *a, __m128i *b)
+{
+    __m128i m = _mm_cmpgt_epi32(*b, _mm_set1_epi32(QCONST32(1, 23) - 1));
+    *a        = _mm_blendv_epi8(*a, _mm_srai_epi32(*a, 8), m);
+    *b        = _mm_blendv_epi8(*b, _mm_srai_epi32(*b, 8), m);
+    m         = _mm_cmpgt_epi32(*b, _mm_set1_epi32(QCONST32(1, 19) - 1));
+    *a        = _mm_blendv_epi8(*a, _mm_srai_epi32(*a, 4), m);
+    *b        = _mm_blendv_epi8(*b, _mm_srai_epi32(*b, 4), m);
+    m         = _mm_cmpgt_epi32(*b, _mm_set1_epi32(QCONST32(1, 15) - 1));
+    *a        = _mm_blendv_epi8(*a, _mm_srai_epi32(*a, 4), m);
+    *b        = _mm_blendv_epi8(*b, _mm_srai_epi32(*b, 4), m);
+}
+
+static inline PRE_TARGET __m128i div32_16_q8_sse41(__m128i a, __m128i b)
+{
+    __m128i sat = _mm_cmpgt_epi32(_mm_srai_epi32(a, 7), _mm_sub_epi32(b, _mm_set1_epi32(1)));
+    div_normalize_sse41(&a, &b);
+    return _mm_blendv_epi8(pdiv32_16_sse41(_mm_slli_epi32(a, 8), b), _mm_set1_epi32(32767), sat);
+}
+
+static inline PRE_TARGET __m128i div32_16_q15_sse41(__m128i a, __m128i b)
+{
+    __m128i sat = _mm_cmpgt_epi32(_mm_srai_epi32(a, 15), _mm_sub_epi32(b, _mm_set1_epi32(1)));
+    div_normalize_sse41(&a, &b);
+    return _mm_blendv_epi8(div32_16_sse41(_mm_sub_epi32(_mm_slli_epi32(a, 15), a), b), _mm_set1_epi32(32767), sat);
+}
+
+static PRE_TARGET void preprocess_snr_sse41(const spx_word32_t *ps, const spx_word32_t *old_ps, const spx_word32_t *noise, const spx_word32_t *echo, const spx_word32_t *reverb, spx_word16_t *post, spx_word16_t *prior, int len)
+{
+    const __m128i max_snr = _mm_set1_epi32(QCONST16(100.f, SNR_SHIFT));
+    int i;
+    for (i = 0; i + 4 <= len; i += 4) {
+        __m128i old = _mm_loadu_si128((const __m128i *)(old_ps + i));
+        __m128i tot = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)(noise + i)), _mm_set1_epi32(1 << (NOISE_SHIFT - 1))), NOISE_SHIFT);
+        __m128i p, gamma, d;
+        tot   = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(tot, _mm_set1_epi32(1)), _mm_loadu_si128((const __m128i *)(echo + i))), _mm_loadu_si128((const __m128i *)(reverb + i)));
+        p     = ext16_sse41(_mm_sub_epi32(div32_16_q8_sse41(_mm_loadu_si128((const __m128i *)(ps + i)), tot), _mm_set1_epi32(QCONST16(1.f, SNR_SHIFT))));
+        p     = _mm_min_epi32(p, max_snr);
+        d     = div32_16_q15_sse41(old, _mm_add_epi32(old, tot));
+        gamma = _mm_srai_epi32(_mm_mullo_epi32(_mm_set1_epi32(QCONST16(.89f, 15)), _mm_srai_epi32(_mm_mullo_epi32(d, d), 15)), 15);
+        gamma = ext16_sse41(_mm_add_epi32(gamma, _mm_set1_epi32(QCONST16(.1f, 15))));
+        d     = _mm_add_epi32(_mm_mullo_epi32(gamma, _mm_max_epi32(p, _mm_setzero_si128())),
+                              _mm_mullo_epi32(_mm_sub_epi32(_mm_set1_epi32(Q15_ONE), gamma), div32_16_q8_sse41(old, tot)));
+        d     = ext16_sse41(_mm_srai_epi32(_mm_add_epi32(d, _mm_set1_epi32(16384)), 15));
+        store16_sse41(post + i, p);
+        store16_sse41(prior + i, _mm_min_epi32(d, max_snr));
+    }
+    preprocess_snr_tail(ps, old_ps, noise, echo, reverb, post, prior, i, len);
+}
+
+static PRE_TARGET void preprocess_zeta_sse41(const spx_word16_t *prior, spx_word16_t *zeta, int N, int M)
+{
+    const __m128i c7 = _mm_set1_epi32(QCONST16(.7f, 15)), c3 = _mm_set1_epi32(QCONST16(.3f, 15));
+    const __m128i c15 = _mm_set1_epi32(QCONST16(.15f, 15)), c075 = _mm_set1_epi32(QCONST16(.075f, 15));
+    const __m128i round = _mm_set1_epi32(16384);
+    int i;
+    zeta[0] = PSHR32(ADD32(MULT16_16(QCONST16(.7f, 15), zeta[0]), MULT16_16(QCONST16(.3f, 15), prior[0])), 15);
+    for (i = 1; i + 4 <= N - 1; i += 4) {
+        __m128i z = _mm_mullo_epi32(c7, load16_sse41(zeta + i));
+        z         = _mm_add_epi32(z, _mm_mullo_epi32(c15, load16_sse41(prior + i)));
+        z         = _mm_add_epi32(z, _mm_mullo_epi32(c075, _mm_add_epi32(load16_sse41(prior + i - 1), load16_sse41(prior + i + 1))));
+        store16_sse41(zeta + i, ext16_sse41(_mm_srai_epi32(_mm_add_epi32(z, round), 15)));
+    }
+    preprocess_zeta_smooth_tail(prior, zeta, i, N - 1);
+    for (i = N - 1; i + 4 <= N + M; i += 4) {
+        __m128i z = _mm_add_epi32(_mm_mullo_epi32(c7, load16_sse41(zeta + i)), _mm_mullo_epi32(c3, load16_sse41(prior + i)));
+        store16_sse41(zeta + i, ext16_sse41(_mm_srai_epi32(_mm_add_epi32(z, round), 15)));
+    }
+    preprocess_zeta_tail(prior, zeta, i, N + M);
+}
+
+static void preprocess_bark_gain_sse41(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *zeta, spx_word16_t Pframe, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    preprocess_bark_gain_tail(prior, post, zeta, Pframe, ps, old_ps, gain, gain2, 0, len);
+}
+
+static void preprocess_linear_gain_sse41(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *gain_floor, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    preprocess_linear_gain_tail(prior, post, gain_floor, ps, old_ps, gain, gain2, 0, len);
+}
+
+static inline PRE_TARGET __m128i mult16_32_p15_sse41(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_add_epi32(_mm_mullo_epi32(a, _mm_and_si128(b, _mm_set1_epi32(0x7fff))), _mm_set1_epi32(16384));
+    return _mm_add_epi32(_mm_mullo_epi32(a, _mm_srai_epi32(b, 15)), _mm_srai_epi32(lo, 15));
+}
+
+static inline PRE_TARGET spx_word32_t hsum_sse41(__m128i x)
+{
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(x);
+}
+
+static PRE_TARGET void preprocess_bank32_sse41(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel)
+{
+    const int *start   = bank->band_start;
+    spx_word32_t carry = 0;
+    int b, i;
+    for (b = 0; b < bank->nb_banks - 1; b++) {
+        spx_word32_t left = carry, right = 0;
+        i = start[b];
+        if (i + 4 <= start[b + 1]) {
+            __m128i l = _mm_setzero_si128(), r = _mm_setzero_si128();
+            for (; i + 4 <= start[b + 1]; i += 4) {
+                __m128i p = _mm_loadu_si128((const __m128i *)(ps + i));
+                l         = _mm_add_epi32(l, mult16_32_p15_sse41(load16_sse41(bank->filter_left + i), p));
+                r         = _mm_add_epi32(r, mult16_32_p15_sse41(load16_sse41(bank->filter_right + i), p));
+            }
+            left += hsum_sse41(l);
+            right += hsum_sse41(r);
+        }
+        preprocess_bank32_band_tail(bank, ps, &left, &right, i, start[b + 1]);
+        mel[b] = left;
+        carry  = right;
+    }
+    mel[b] = carry;
+    preprocess_bank32_tail(bank, ps, mel);
+}
+
+/* Both bands of a bin in one 32-bit lane */
+static inline int band_pair_sse41(const spx_word16_t *mel, int b)
+{
+    return (int)(((unsigned)(unsigned short)mel[b + 1] << 16) | (unsigned short)mel[b]);
+}
+
+/* madd of the interleaved weights of a bin against both its bands, rounded to Q0 */
+static inline PRE_TARGET __m128i psd16_pair_sse41(__m128i w, __m128i m)
+{
+    return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(w, m), _mm_set1_epi32(16384)), 15);
+}
+
+/* 8 bins per vector, 4 in the last one of a band when they fit */
+static PRE_TARGET void preprocess_psd16_sse41(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count)
+{
+    const int *start = bank->band_start;
+    int b, i, k;
+    for (b = 0; b < bank->nb_banks - 1; b++) {
+        for (i = start[b]; i + 8 <= start[b + 1]; i += 8) {
+            __m128i fl = _mm_loadu_si128((const __m128i *)(bank->filter_left + i));
+            __m128i fr = _mm_loadu_si128((const __m128i *)(bank->filter_right + i));
+            __m128i lo = _mm_unpacklo_epi16(fl, fr), hi = _mm_unpackhi_epi16(fl, fr);
+            for (k = 0; k < count; k++) {
+                __m128i m = _mm_set1_epi32(band_pair_sse41(mel[k], b));
+                _mm_storeu_si128((__m128i *)(psd[k] + i), _mm_packs_epi32(psd16_pair_sse41(lo, m), psd16_pair_sse41(hi, m)));
+            }
+        }
+        if (i + 4 <= start[b + 1]) {
+            __m128i w = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(bank->filter_left + i)), _mm_loadl_epi64((const __m128i *)(bank->filter_right + i)));
+            for (k = 0; k < count; k++) {
+                __m128i v = psd16_pair_sse41(w, _mm_set1_epi32(band_pair_sse41(mel[k], b)));
+                _mm_storel_epi64((__m128i *)(psd[k] + i), _mm_packs_epi32(v, v));
+            }
+            i += 4;
+        }
+        preprocess_psd16_band_tail(bank, mel, psd, count, b, i, start[b + 1]);
+    }
+    preprocess_psd16_tail(bank, mel, psd, count);
+}
+
+#else
+/* exp(x) as 2^n * e^r with |r| <= ln(2)/2, relative error below 2e-7 down to the smallest normal float */
+static inline PRE_TARGET __m128 exp_sse41(__m128 x)
+{
+    __m128 n, r, y;
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.3f)), _mm_set1_ps(88.3f));
+    n = _mm_round_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f))), _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+    y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.9875691500e-4f), r), _mm_set1_ps(1.3981999507e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(8.3334519073e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(4.1665795894e-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(1.6666665459e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(5.0000001201e-1f));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, r), r), r), _mm_set1_ps(1.f));
+    return _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)));
+}
+
+static inline PRE_TARGET __m128 hypergeom_gain_sse41(__m128 x)
+{
+    __m128 integer = _mm_floor_ps(_mm_mul_ps(_mm_set1_ps(2.f), x));
+    __m128i ind    = _mm_cvttps_epi32(integer);
+    __m128 frac    = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.f), x), integer);
+    int idx[4];
+    __m128 t0, t1, g;
+    _mm_storeu_si128((__m128i *)idx, _mm_min_epi32(_mm_max_epi32(ind, _mm_setzero_si128()), _mm_set1_epi32(19)));
+    t0 = _mm_setr_ps(hypergeom_table[idx[0]], hypergeom_table[idx[1]], hypergeom_table[idx[2]], hypergeom_table[idx[3]]);
+    t1 = _mm_setr_ps(hypergeom_table[idx[0] + 1], hypergeom_table[idx[1] + 1], hypergeom_table[idx[2] + 1], hypergeom_table[idx[3] + 1]);
+    g  = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.f), frac), t0), _mm_mul_ps(frac, t1));
+    g  = _mm_div_ps(g, _mm_sqrt_ps(_mm_add_ps(x, _mm_set1_ps(.0001f))));
+    g  = _mm_blendv_ps(g, _mm_add_ps(_mm_set1_ps(1.f), _mm_div_ps(_mm_set1_ps(.1296f), x)), _mm_castsi128_ps(_mm_cmpgt_epi32(ind, _mm_set1_epi32(19))));
+    return _mm_blendv_ps(g, _mm_set1_ps(1.f), _mm_castsi128_ps(_mm_cmplt_epi32(ind, _mm_setzero_si128())));
+}
+
+/* Wiener gain prior/(1+prior) and theta of the hypergeometric gain */
+static inline PRE_TARGET __m128 prior_ratio_sse41(__m128 prior, __m128 post, __m128 *theta)
+{
+    __m128 prior_ratio = _mm_div_ps(prior, _mm_add_ps(prior, _mm_set1_ps(1.f)));
+    *theta             = _mm_mul_ps(prior_ratio, _mm_add_ps(_mm_set1_ps(1.f), post));
+    return prior_ratio;
+}
+
+static inline PRE_TARGET __m128 old_ps_sse41(__m128 old_ps, __m128 gain, __m128 ps)
+{
+    return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(.2f), old_ps), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(.8f), _mm_mul_ps(gain, gain)), ps));
+}
+
+static PRE_TARGET void preprocess_snr_sse41(const spx_word32_t *ps, const spx_word32_t *old_ps, const spx_word32_t *noise, const spx_word32_t *echo, const spx_word32_t *reverb, spx_word16_t *post, spx_word16_t *prior, int len)
+{
+    const __m128 one = _mm_set1_ps(1.f), max_snr = _mm_set1_ps(100.f);
+    int i;
+    for (i = 0; i + 4 <= len; i += 4) {
+        __m128 old = _mm_loadu_ps(old_ps + i);
+        __m128 tot = _mm_add_ps(_mm_add_ps(_mm_add_ps(one, _mm_loadu_ps(noise + i)), _mm_loadu_ps(echo + i)), _mm_loadu_ps(reverb + i));
+        __m128 p   = _mm_min_ps(_mm_sub_ps(_mm_div_ps(_mm_loadu_ps(ps + i), tot), one), max_snr);
+        __m128 d   = _mm_div_ps(old, _mm_add_ps(old, tot));
+        __m128 gamma;
+        gamma = _mm_add_ps(_mm_set1_ps(.1f), _mm_mul_ps(_mm_set1_ps(.89f), _mm_mul_ps(d, d)));
+        d     = _mm_add_ps(_mm_mul_ps(gamma, _mm_max_ps(_mm_setzero_ps(), p)), _mm_mul_ps(_mm_sub_ps(one, gamma), _mm_div_ps(old, tot)));
+        _mm_storeu_ps(post + i, p);
+        _mm_storeu_ps(prior + i, _mm_min_ps(d, max_snr));
+    }
+    preprocess_snr_tail(ps, old_ps, noise, echo, reverb, post, prior, i, len);
+}
+
+static PRE_TARGET void preprocess_zeta_sse41(const spx_word16_t *prior, spx_word16_t *zeta, int N, int M)
+{
+    const __m128 c7 = _mm_set1_ps(.7f), c3 = _mm_set1_ps(.3f), c15 = _mm_set1_ps(.15f), c075 = _mm_set1_ps(.075f);
+    int i;
+    zeta[0] = .7f * zeta[0] + .3f * prior[0];
+    for (i = 1; i + 4 <= N - 1; i += 4) {
+        __m128 z = _mm_add_ps(_mm_mul_ps(c7, _mm_loadu_ps(zeta + i)), _mm_mul_ps(c15, _mm_loadu_ps(prior + i)));
+        z        = _mm_add_ps(z, _mm_mul_ps(c075, _mm_loadu_ps(prior + i - 1)));
+        _mm_storeu_ps(zeta + i, _mm_add_ps(z, _mm_mul_ps(c075, _mm_loadu_ps(prior + i + 1))));
+    }
+    preprocess_zeta_smooth_tail(prior, zeta, i, N - 1);
+    for (i = N - 1; i + 4 <= N + M; i += 4)
+        _mm_storeu_ps(zeta + i, _mm_add_ps(_mm_mul_ps(c7, _mm_loadu_ps(zeta + i)), _mm_mul_ps(c3, _mm_loadu_ps(prior + i))));
+    preprocess_zeta_tail(prior, zeta, i, N + M);
+}
+
+static PRE_TARGET void preprocess_bark_gain_sse41(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *zeta, spx_word16_t Pframe, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    const __m128 one = _mm_set1_ps(1.f);
+    int i;
+    for (i = 0; i + 4 <= len; i += 4) {
+        __m128 pr = _mm_loadu_ps(prior + i);
+        __m128 theta, prior_ratio, g, P1, q;
+        prior_ratio = prior_ratio_sse41(pr, _mm_loadu_ps(post + i), &theta);
+        g           = _mm_min_ps(one, _mm_mul_ps(prior_ratio, hypergeom_gain_sse41(theta)));
+        _mm_storeu_ps(gain + i, g);
+        _mm_storeu_ps(old_ps + i, old_ps_sse41(_mm_loadu_ps(old_ps + i), g, _mm_loadu_ps(ps + i)));
+
+        /* P1 = .199 + .8*qcurve(zeta) */
+        P1 = _mm_div_ps(one, _mm_add_ps(one, _mm_div_ps(_mm_set1_ps(.15f), _mm_loadu_ps(zeta + i))));
+        P1 = _mm_add_ps(_mm_set1_ps(.199f), _mm_mul_ps(_mm_set1_ps(.8f), P1));
+        q  = _mm_sub_ps(one, _mm_mul_ps(_mm_set1_ps(Pframe), P1));
+        q  = _mm_mul_ps(_mm_mul_ps(_mm_div_ps(q, _mm_sub_ps(one, q)), _mm_add_ps(one, pr)), exp_sse41(_mm_sub_ps(_mm_setzero_ps(), theta)));
+        _mm_storeu_ps(gain2 + i, _mm_div_ps(one, _mm_add_ps(one, q)));
+    }
+    preprocess_bark_gain_tail(prior, post, zeta, Pframe, ps, old_ps, gain, gain2, i, len);
+}
+
+static PRE_TARGET void preprocess_linear_gain_sse41(const spx_word16_t *prior, const spx_word16_t *post, const spx_word16_t *gain_floor, const spx_word32_t *ps, spx_word32_t *old_ps, spx_word16_t *gain, spx_word16_t *gain2, int len)
+{
+    const __m128 one = _mm_set1_ps(1.f);
+    int i;
+    for (i = 0; i + 4 <= len; i += 4) {
+        __m128 theta, prior_ratio, g, gb, p, fl, tmp;
+        prior_ratio = prior_ratio_sse41(_mm_loadu_ps(prior + i), _mm_loadu_ps(post + i), &theta);
+        g           = _mm_min_ps(one, _mm_mul_ps(prior_ratio, hypergeom_gain_sse41(theta)));
+
+        /* Constrain the gain to be close to the Bark scale gain */
+        gb = _mm_loadu_ps(gain + i);
+        g  = _mm_blendv_ps(g, _mm_mul_ps(_mm_set1_ps(3.f), gb), _mm_cmpgt_ps(_mm_mul_ps(_mm_set1_ps(.333f), g), gb));
+        _mm_storeu_ps(old_ps + i, old_ps_sse41(_mm_loadu_ps(old_ps + i), g, _mm_loadu_ps(ps + i)));
+
+        fl = _mm_loadu_ps(gain_floor + i);
+        g  = _mm_max_ps(fl, g);
+        _mm_storeu_ps(gain + i, g);
+
+        p   = _mm_loadu_ps(gain2 + i);
+        tmp = _mm_add_ps(_mm_mul_ps(p, _mm_sqrt_ps(g)), _mm_mul_ps(_mm_sub_ps(one, p), _mm_sqrt_ps(fl)));
+        _mm_storeu_ps(gain2 + i, _mm_mul_ps(tmp, tmp));
+    }
+    preprocess_linear_gain_tail(prior, post, gain_floor, ps, old_ps, gain, gain2, i, len);
+}
+
+static void preprocess_bank32_sse41(const FilterBank *bank, const spx_word32_t *ps, spx_word32_t *mel)
+{
+    filterbank_compute_bank32(bank, ps, mel);
+}
+
+static PRE_TARGET void preprocess_psd16_sse41(const FilterBank *bank, const spx_word16_t *const *mel, spx_word16_t *const *psd, int count)
+{
+    const int *start = bank->band_start;
+    int b, i, k;
+    for (b = 0; b < bank->nb_banks - 1; b++) {
+        for (i = start[b]; i + 4 <= start[b + 1]; i += 4) {
+            __m128 fl = _mm_loadu_ps(bank->filter_left + i), fr = _mm_loadu_ps(bank->filter_right + i);
+            for (k = 0; k < count; k++)
+                _mm_storeu_ps(psd[k] + i, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mel[k][b]), fl), _mm_mul_ps(_mm_set1_ps(mel[k][b + 1]), fr)));
+        }
+        preprocess_psd16_band_tail(bank, mel, psd, count, b, i, start[b + 1]);
+    }
+    preprocess_psd16_tail(bank, mel, psd, count);
+}
+#endif
+
+const PreprocessKernels preprocess_kernels_sse41 = {
+    "sse4.1",
+    MDF_KERNEL_SSE41,
+    preprocess_snr_sse41,
+    preprocess_zeta_sse41,
+    preprocess_bark_gain_sse41,
+    preprocess_linear_gain_sse41,
+    preprocess_bank32_sse41,
+    preprocess_psd16_sse41,
+};
+
+#endif
@@ -107,10 +107,10 @@ static void drfti1(int n, float *wa, int *ifac){
   }
 }
 
-static void fdrffti(int n, float *wsave, int *ifac){
+static void fdrffti(int n, float *wa, int *ifac){
 
   if (n == 1) return;
-  drfti1(n, wsave+n, ifac);
+  drfti1(n, wa, ifac);
 }
 
 static void dradf2(int ido,int l1,float *cc,float *ch,float *wa1){
@@ -1233,29 +1233,55 @@ static void drftb1(int n, float *c, float *ch, float *wa, int *ifac){
 
 void spx_drft_forward(struct drft_lookup *l,float *data){
   if(l->n==1)return;
-  drftf1(l->n,data,l->trigcache,l->trigcache+l->n,l->splitcache);
+  drftf1(l->n,data,l->work,l->trigcache,l->splitcache);
 }
 
 void spx_drft_backward(struct drft_lookup *l,float *data){
   if (l->n==1)return;
-  drftb1(l->n,data,l->trigcache,l->trigcache+l->n,l->splitcache);
+  drftb1(l->n,data,l->work,l->trigcache,l->splitcache);
 }
 
-void spx_drft_init(struct drft_lookup *l,int n)
+/* Twiddles (2n floats) followed by the factors (32 ints) of an n-point transform, key n. A table of the
+   same n in proto is copied instead of worked out again. */
+static void *drft_tables_new(PST_AUD_MEM_ARENA arena,const int *key,const void *proto)
+{
+  int n=key[0];
+  float *wa=(float*)speex_alloc(arena,2*n*sizeof(float)+32*sizeof(int));
+  if(!wa)
+    return NULL;
+  if(proto)
+    memcpy(wa,proto,2*n*sizeof(float)+32*sizeof(int));
+  else
+    fdrffti(n,wa,(int*)(wa+2*n));
+  return wa;
+}
+
+static void drft_lookup_new(struct drft_lookup *l,int n,const struct drft_lookup *proto,PST_AUD_MEM_ARENA arena)
 {
   l->n=n;
-  l->trigcache=(float*)speex_alloc(3*n*sizeof(*l->trigcache));
-  l->splitcache=(int*)speex_alloc(32*sizeof(*l->splitcache));
-  fdrffti(n, l->trigcache, l->splitcache);
+  l->work=(float*)speex_alloc(arena,n*sizeof(*l->work));
+  l->trigcache=(float*)speex_table_get(arena,drft_tables_new,speex_free,&n,1,proto?proto->trigcache:NULL);
+  l->splitcache=l->trigcache?(int*)(l->trigcache+2*n):NULL;
+}
+
+void spx_drft_init(struct drft_lookup *l,int n,PST_AUD_MEM_ARENA arena)
+{
+  drft_lookup_new(l,n,NULL,arena);
+}
+
+/* Same tables as proto, copied instead of worked out again (or shared with it, see speex_table_get). The
+   work area is not copied, proto may be running meanwhile. */
+void spx_drft_copy(struct drft_lookup *l,const struct drft_lookup *proto,PST_AUD_MEM_ARENA arena)
+{
+  drft_lookup_new(l,proto->n,proto,arena);
 }
 
-void spx_drft_clear(struct drft_lookup *l)
+void spx_drft_clear(struct drft_lookup *l,PST_AUD_MEM_ARENA arena)
 {
   if(l)
   {
-    if(l->trigcache)
-      speex_free(l->trigcache);
-    if(l->splitcache)
-      speex_free(l->splitcache);
+    if(l->work)
+      speex_free(arena,l->work);
+    speex_table_put(arena,speex_free,l->trigcache);
   }
 }
@@ -22,6 +22,7 @@
 #ifndef _V_SMFT_H_
 #define _V_SMFT_H_
 
+#include "aud_mem.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,14 +31,16 @@ extern "C" {
 /** Discrete Rotational Fourier Transform lookup */
 struct drft_lookup{
   int n;
-  float *trigcache;
+  float *work;       /* n, work area of the transforms */
+  float *trigcache;  /* 2n twiddles then splitcache, read-only and possibly shared with other lookups */
   int *splitcache;
 };
 
 extern void spx_drft_forward(struct drft_lookup *l,float *data);
 extern void spx_drft_backward(struct drft_lookup *l,float *data);
-extern void spx_drft_init(struct drft_lookup *l,int n);
-extern void spx_drft_clear(struct drft_lookup *l);
+extern void spx_drft_init(struct drft_lookup *l,int n,PST_AUD_MEM_ARENA arena);
+extern void spx_drft_copy(struct drft_lookup *l,const struct drft_lookup *proto,PST_AUD_MEM_ARENA arena);
+extern void spx_drft_clear(struct drft_lookup *l,PST_AUD_MEM_ARENA arena);
 
 #ifdef __cplusplus
 }